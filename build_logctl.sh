@@ -0,0 +1,5 @@
+#!/bin/sh
+
+mkdir -p build
+
+gcc ./samples/logctl/logctl.c -o ./build/logctl
@@ -0,0 +1,5 @@
+#!/bin/sh
+
+mkdir -p build
+
+g++ ./samples/logdecode/logdecode.cpp -o ./build/logdecode
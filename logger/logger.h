@@ -27,6 +27,14 @@
 // $(srcfile) - source file
 // $(PID) - process ID
 // $(TID) - thread ID
+// $(ctx) - context of thread added by LOG_CONTEXT: key=value key=value
+// $(seq) - sequence number of record, common for all threads: restores order of records written by LOG_PRIORITY_QUEUE
+
+// OUTPUT FORMATS (OutputFormat):
+// text - header by HeaderFormat and message
+// json - JSON object per line; header macros above become members level, time, seq, pid, tid, module, function, file,
+//        line, $(ctx) becomes own member for each key
+// logfmt - key=value pairs per line with the same keys, values are quoted only when needed
 
 
 // CONFIG PATH & NAMES MACROSES:
@@ -40,6 +48,7 @@
 // $(EXEDIR) - path to process EXE
 // $(EXEFILENAME) - process EXE file name without extension
 // $(EXEFULLFILENAME) - process EXE file name with extension
+// $(PID) - process ID
 
 // only if LOG_USE_MODULEDEFINITION
 // $(MODULEDIR) - module directory
@@ -53,11 +62,13 @@
 // LogPath=$(USERAPPDATA)\$(EXEFILENAME)\Log
 // Verbose=255
 // HeaderFormat=$(V)|$(dd).$(MM).$(yyyy)|$(hh):$(mm):$(ss).$(ttt) ($(module)!$(function))  
+// OutputFormat=text
 // LogFileName=$(EXEFILENAME).log
 // LogSysInfo=1
 // ScrollFileCount=70
 // ScrollFileSize=1638400
 // ScrollFileEveryRun=1
+// ForkLogFileName=$(EXEFILENAME).$(PID).log
 // RegistryConfigPath=HKCU\Software\$(EXEFILENAME)\Logging
 
 
@@ -95,13 +106,16 @@
 #endif //LOG_USE_MODULEDEFINITION
 
 /// Use auto debugging. It need for stack trace
-/// On linux it is strongly recommended to build with -rdynamic linker key
+/// On linux without LOG_ELF_SYMBOLS it is strongly recommended to build with -rdynamic linker key
 #ifndef LOG_AUTO_DEBUGGING
 #	define LOG_AUTO_DEBUGGING 1
 #endif //LOG_AUTO_DEBUGGING
 
 /// Catch unhandled exceptions, Logging them and creating mini dumps
 /// If auto debugging enabled it show stack trace
+/// On Posix SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL are handled on alternate signal stack. Stack is set for
+/// thread which initializes logger and for other threads on their first message, so stack overflow in thread
+/// which did not log anything yet is not reported
 #ifndef LOG_UNHANDLED_EXCEPTIONS
 #	define LOG_UNHANDLED_EXCEPTIONS 1
 #endif //LOG_UNHANDLED_EXCEPTIONS
@@ -122,6 +136,47 @@
 #	define LOG_DEFAULT_INI_PATHS "$(EXEDIR)/$(EXEFILENAME).log.ini;$(MODULEDIR)/$(MODULEFILENAME).log.ini;$(CURRENTDIR)/$(EXEFILENAME).log.ini;$(CURRENTDIR)/$(MODULEFILENAME).log.ini"
 #endif //LOG_DEFAULT_INI_PATHS
 
+/// Watch INI file used for configuration and apply its changes on the fly. Linux only, needs LOG_MULTITHREADED
+#ifndef LOG_INI_HOT_RELOAD
+#	define LOG_INI_HOT_RELOAD 0
+#endif //LOG_INI_HOT_RELOAD
+
+/// Restart writer thread in child process after fork(), so child can log asynchronously too. Posix only, needs LOG_MULTITHREADED
+#ifndef LOG_RESTART_AFTER_FORK
+#	define LOG_RESTART_AFTER_FORK 1
+#endif //LOG_RESTART_AFTER_FORK
+
+/// Serve runtime control commands (verbose level, flush, rotate, stats) on local Unix socket. Posix only, needs LOG_MULTITHREADED
+#ifndef LOG_CONTROL_SOCKET
+#	define LOG_CONTROL_SOCKET 0
+#endif //LOG_CONTROL_SOCKET
+
+/// Control socket name. Leading '@' means Linux abstract namespace (no file is created)
+#ifndef LOG_CONTROL_SOCKET_NAME
+#	define LOG_CONTROL_SOCKET_NAME "@$(EXEFILENAME).$(PID).log"
+#endif //LOG_CONTROL_SOCKET_NAME
+
+/// Keep last messages of all verbose levels (filtered ones too) in memory ring. Messages which were filtered out
+/// are written to log when error or fatal message is logged, on crash or by LOG_FLIGHT_RECORDER_DUMP
+#ifndef LOG_FLIGHT_RECORDER
+#	define LOG_FLIGHT_RECORDER 0
+#endif //LOG_FLIGHT_RECORDER
+
+/// Number of messages kept by flight recorder. Must be power of two
+#ifndef LOG_FLIGHT_RECORDER_SIZE
+#	define LOG_FLIGHT_RECORDER_SIZE 256
+#endif //LOG_FLIGHT_RECORDER_SIZE
+
+/// Maximal length of message text in flight recorder, longer messages are truncated
+#ifndef LOG_FLIGHT_RECORDER_RECORD_SIZE
+#	define LOG_FLIGHT_RECORDER_RECORD_SIZE 200
+#endif //LOG_FLIGHT_RECORDER_RECORD_SIZE
+
+/// Verbose levels which cause flight recorder dump by default. Can be changed by configurator or INI (FlightRecorderDumpLevel)
+#ifndef LOG_FLIGHT_RECORDER_DUMP_LEVEL
+#	define LOG_FLIGHT_RECORDER_DUMP_LEVEL logger_verbose_fatal_error
+#endif //LOG_FLIGHT_RECORDER_DUMP_LEVEL
+
 #ifndef LOG_REGISTRY_DEFAULT_KEY
 #	define LOG_REGISTRY_DEFAULT_KEY "HKCU\\Software\\$(EXEFILENAME)\\Logging"
 #endif //LOG_REGISTRY_DEFAULT_KEY
@@ -188,12 +243,124 @@
 #	define LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND 0
 #endif //LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND
 
+/// Read function names for stack traces from ELF symbol table (.symtab) of modules or from their separate
+/// debug files (build-id or .gnu_debuglink), so static functions are named and -rdynamic is not needed. Linux only
+#ifndef LOG_ELF_SYMBOLS
+#	define LOG_ELF_SYMBOLS 1
+#endif //LOG_ELF_SYMBOLS
+
+/// Number of stack trace frames with resolved symbols kept in process-wide cache. Posix only.
+/// Must be power of two, 0 turns cache off
+#ifndef LOG_SYMBOL_CACHE_SIZE
+#	define LOG_SYMBOL_CACHE_SIZE 4096
+#endif //LOG_SYMBOL_CACHE_SIZE
+
+/// LOG_INFO_T("x={} y={}", x, y) and other LOG_*_T macro: {} placeholders are replaced with arguments of any
+/// supported type, their number is checked at compile time, format must be string literal.
+/// LOG_INFO_KV("message", "key", value, ...) and other LOG_*_KV macro write typed key-value fields. Needs C++11
+#ifndef LOG_TEMPLATE_API
+#	define LOG_TEMPLATE_API 1
+#endif //LOG_TEMPLATE_API
+
+/// Take stack traces by walking frame pointer chain instead of backtrace(). Much faster, but frames of functions
+/// compiled without -fno-omit-frame-pointer are lost. Posix only, GCC or Clang on x86, x86-64 and AArch64
+#ifndef LOG_FRAME_POINTER_UNWIND
+#	define LOG_FRAME_POINTER_UNWIND 0
+#endif //LOG_FRAME_POINTER_UNWIND
+
+/// Maximum number of frames in stack trace written by LOG_STACKTRACE_*
+#ifndef LOG_STACKTRACE_MAX_DEPTH
+#	define LOG_STACKTRACE_MAX_DEPTH 1024
+#endif //LOG_STACKTRACE_MAX_DEPTH
+
+/// Number of innermost caller frames not written by LOG_STACKTRACE_*, useful if it is called from own wrapper function
+#ifndef LOG_STACKTRACE_SKIP
+#	define LOG_STACKTRACE_SKIP 0
+#endif //LOG_STACKTRACE_SKIP
+
+/// Number of unique stack traces remembered by LOG_STACKTRACE_*: repeated trace is logged as "Stack trace #<id> (seen N times)".
+/// Posix only. Must be power of two, 0 turns deduplication off
+#ifndef LOG_STACKTRACE_DEDUP_SIZE
+#	define LOG_STACKTRACE_DEDUP_SIZE 0
+#endif //LOG_STACKTRACE_DEDUP_SIZE
+
+/// LOG_STACKTRACE_* macro only capture frame addresses, symbols are resolved by writer thread.
+/// Posix only, used if LOG_MULTITHREADED is set
+#ifndef LOG_DEFERRED_STACKTRACE
+#	define LOG_DEFERRED_STACKTRACE 1
+#endif //LOG_DEFERRED_STACKTRACE
+
+/// LOG_*_T macro only copy arguments with time and thread id, message and header are formatted by writer thread.
+/// Used if LOG_MULTITHREADED is set and LOG_FLIGHT_RECORDER is not
+#ifndef LOG_DEFERRED_FORMAT
+#	define LOG_DEFERRED_FORMAT 1
+#endif //LOG_DEFERRED_FORMAT
+
+/// Log file is written in compact binary format: LOG_*_T messages are stored as call site id, time delta, thread id and
+/// argument values, other messages as text. Expanded to text or JSON by samples/logdecode. Needs LOG_DEFERRED_FORMAT
+#ifndef LOG_BINARY_FORMAT
+#	define LOG_BINARY_FORMAT 0
+#endif //LOG_BINARY_FORMAT
+
+/// Writer thread compares each LOG_* message and its call site with the previous one, consecutive duplicates are not
+/// written, "Last message repeated N times" is written instead when other message comes or after timeout.
+/// Used if LOG_MULTITHREADED is set
+#ifndef LOG_COLLAPSE_REPEATS
+#	define LOG_COLLAPSE_REPEATS 0
+#endif //LOG_COLLAPSE_REPEATS
+
+/// Milliseconds after first not written duplicate when repeat count is written even if no other message comes
+#ifndef LOG_COLLAPSE_REPEATS_TIMEOUT
+#	define LOG_COLLAPSE_REPEATS_TIMEOUT 1000
+#endif //LOG_COLLAPSE_REPEATS_TIMEOUT
+
+/// When writer thread falls behind, DEBUG and then INFO messages are dropped until queue is drained, verbose level
+/// in configuration is not changed. Each change is written to log. Used if LOG_MULTITHREADED is set
+#ifndef LOG_LOAD_SHEDDING
+#	define LOG_LOAD_SHEDDING 0
+#endif //LOG_LOAD_SHEDDING
+
+/// Records in writer queue when DEBUG messages are dropped, they are written again when queue is half of it
+#ifndef LOG_LOAD_SHEDDING_DEBUG_QUEUE
+#	define LOG_LOAD_SHEDDING_DEBUG_QUEUE 10000
+#endif //LOG_LOAD_SHEDDING_DEBUG_QUEUE
+
+/// Records in writer queue when INFO messages are dropped too
+#ifndef LOG_LOAD_SHEDDING_INFO_QUEUE
+#	define LOG_LOAD_SHEDDING_INFO_QUEUE 50000
+#endif //LOG_LOAD_SHEDDING_INFO_QUEUE
+
+/// ERROR and FATAL messages are queued to separate lane which writer thread writes and flushes first, so they are not
+/// delayed by long queue of other messages. Such messages are written out of order, $(seq) header macro restores it
+/// ($(seq) is not stored in LOG_BINARY_FORMAT files). Used if LOG_MULTITHREADED is set
+#ifndef LOG_PRIORITY_QUEUE
+#	define LOG_PRIORITY_QUEUE 0
+#endif //LOG_PRIORITY_QUEUE
+
+/// LOG_CONTEXT("key", value) adds key-value pair to context of current thread until end of scope, $(ctx) header macro
+/// writes context as "key=value key=value". LOG_CONTEXT_CAPTURE / LOG_CONTEXT_RESTORE move context to other thread.
+/// C++ only, not available for clients of logger DLL. Not stored in LOG_BINARY_FORMAT files
+#ifndef LOG_USE_CONTEXT
+#	define LOG_USE_CONTEXT 1
+#endif //LOG_USE_CONTEXT
+
 /// Release logger after dump creation before application will crash. Used only if LOG_UNHANDLED_EXCEPTIONS was set.
 /// Set this value to 0 can cause log file flush issues but may be useful if you using debugger AFTER crash
 #ifndef LOG_RELEASE_ON_APP_CRASH
 #	define LOG_RELEASE_ON_APP_CRASH 1
 #endif //LOG_RELEASE_ON_APP_CRASH
 
+/// Write crash report file next to log file (<log file>__<date>__<time>.crash) with signal info, all registers,
+/// backtraces of all threads and memory map. Linux only, used if LOG_UNHANDLED_EXCEPTIONS is set
+#ifndef LOG_CRASH_REPORT_FILE
+#	define LOG_CRASH_REPORT_FILE 0
+#endif //LOG_CRASH_REPORT_FILE
+
+/// Signal sent to other threads to collect their backtraces for crash report
+#ifndef LOG_CRASH_THREAD_SIGNAL
+#	define LOG_CRASH_THREAD_SIGNAL (SIGRTMAX - 1)
+#endif //LOG_CRASH_THREAD_SIGNAL
+
 /// Use modules cache for detect module name by address. Used only if LOG_USE_MODULEDEFINITION.
 /// Cache is optimizing performance but it is not support modules unload. If you write system-trick tool or application
 /// which very often load-unload DLLs, maybe you need to turn off modules cache
@@ -400,10 +567,26 @@
 
 #ifdef LOG_COMPILER_MSVC
 #	define LOG_FMT_I64	"%I64d"
+#	define LOG_FMT_U64	"%I64u"
 #else //LOG_COMPILER_MSVC
 #	define LOG_FMT_I64	"%lld"
+#	define LOG_FMT_U64	"%llu"
+#endif //LOG_COMPILER_MSVC
+
+#ifdef LOG_COMPILER_MSVC
+#	define LOG_THREAD_LOCAL	__declspec(thread)
+#else //LOG_COMPILER_MSVC
+#	define LOG_THREAD_LOCAL	__thread
 #endif //LOG_COMPILER_MSVC
 
+#if defined(LOG_COMPILER_MSVC) && _MSC_VER < 1800
+#	define LOG_VA_COPY(dst, src)	((dst) = (src))
+#elif defined(LOG_COMPILER_GCC)
+#	define LOG_VA_COPY(dst, src)	__va_copy(dst, src)
+#else //defined(LOG_COMPILER_MSVC) && _MSC_VER < 1800
+#	define LOG_VA_COPY(dst, src)	va_copy(dst, src)
+#endif //defined(LOG_COMPILER_MSVC) && _MSC_VER < 1800
+
 
 #if LOG_ONLY_DEBUG
 #	ifdef DEBUG
@@ -419,6 +602,43 @@
 #	define LOG_ERROR(...)
 #	define LOG_FATAL(...)
 
+#	define LOG_INFO_T(...)
+#	define LOG_WARNING_T(...)
+#	define LOG_DEBUG_T(...)
+#	define LOG_ERROR_T(...)
+#	define LOG_FATAL_T(...)
+
+#	define LOG_INFO_KV(...)
+#	define LOG_WARNING_KV(...)
+#	define LOG_DEBUG_KV(...)
+#	define LOG_ERROR_KV(...)
+#	define LOG_FATAL_KV(...)
+
+#	define LOG_INFO_EVERY_N(n, ...)
+#	define LOG_INFO_FIRST_N(n, ...)
+#	define LOG_INFO_EVERY_MS(ms, ...)
+#	define LOG_INFO_SAMPLED(p, ...)
+
+#	define LOG_DEBUG_EVERY_N(n, ...)
+#	define LOG_DEBUG_FIRST_N(n, ...)
+#	define LOG_DEBUG_EVERY_MS(ms, ...)
+#	define LOG_DEBUG_SAMPLED(p, ...)
+
+#	define LOG_WARNING_EVERY_N(n, ...)
+#	define LOG_WARNING_FIRST_N(n, ...)
+#	define LOG_WARNING_EVERY_MS(ms, ...)
+#	define LOG_WARNING_SAMPLED(p, ...)
+
+#	define LOG_ERROR_EVERY_N(n, ...)
+#	define LOG_ERROR_FIRST_N(n, ...)
+#	define LOG_ERROR_EVERY_MS(ms, ...)
+#	define LOG_ERROR_SAMPLED(p, ...)
+
+#	define LOG_FATAL_EVERY_N(n, ...)
+#	define LOG_FATAL_FIRST_N(n, ...)
+#	define LOG_FATAL_EVERY_MS(ms, ...)
+#	define LOG_FATAL_SAMPLED(p, ...)
+
 #	define LOG_BINARY_INFO(p,stack_frame)
 #	define LOG_BINARY_WARNING(p,stack_frame)
 #	define LOG_BINARY_DEBUG(p,stack_frame)
@@ -443,6 +663,12 @@
 #	define LOG_STACKTRACE_ERROR
 #	define LOG_STACKTRACE_FATAL
 
+#	define LOG_FLIGHT_RECORDER_DUMP
+
+#	define LOG_CONTEXT(key, value)
+#	define LOG_CONTEXT_CAPTURE(name)
+#	define LOG_CONTEXT_RESTORE(name)
+
 #	define DEFINE_LOGGER
 
 #	define LOG_SET_VERBOSE_LEVEL(l)
@@ -500,7 +726,10 @@ void* _ReturnAddress(void);
 #   pragma GCC optimize ("O0")
 #endif // defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW)
 
-
+// Used only by LOG_GET_CALLER_ADDR in code which logs, translation unit without logging calls (logger.cpp) does not reference it
+#if defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC)
+__attribute__((unused))
+#endif // defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC)
 static void* logging_get_caller_address()
 {
 #ifdef LOG_COMPILER_MSVC
@@ -655,6 +884,56 @@ enum logger_verbose_level
 #		define LOG_MULTITHREADED 0
 #	endif //LOG_MULTITHREADED && defined (LOG_PLATFORM_POSIX_BASED) && !defined(LOG_HAVE_PTHREAD)
 
+#	if LOG_INI_HOT_RELOAD && (!LOG_INI_CONFIGURATION || !LOG_MULTITHREADED || !defined(LOG_PLATFORM_LINUX))
+// silently turned off: hot reload is an optional addition to INI configuration
+#		undef LOG_INI_HOT_RELOAD
+#		define LOG_INI_HOT_RELOAD 0
+#	endif //LOG_INI_HOT_RELOAD && (!LOG_INI_CONFIGURATION || !LOG_MULTITHREADED || !defined(LOG_PLATFORM_LINUX))
+
+#	if LOG_RESTART_AFTER_FORK && (!LOG_MULTITHREADED || defined(LOG_PLATFORM_WINDOWS))
+// silently turned off: there is no writer thread to restart or no fork
+#		undef LOG_RESTART_AFTER_FORK
+#		define LOG_RESTART_AFTER_FORK 0
+#	endif //LOG_RESTART_AFTER_FORK && (!LOG_MULTITHREADED || defined(LOG_PLATFORM_WINDOWS))
+
+#	if LOG_CRASH_REPORT_FILE && (!LOG_UNHANDLED_EXCEPTIONS || !defined(LOG_PLATFORM_LINUX))
+// silently turned off: other platforms have own crash dumps or no /proc
+#		undef LOG_CRASH_REPORT_FILE
+#		define LOG_CRASH_REPORT_FILE 0
+#	endif //LOG_CRASH_REPORT_FILE && (!LOG_UNHANDLED_EXCEPTIONS || !defined(LOG_PLATFORM_LINUX))
+
+#	if LOG_TEMPLATE_API && !(defined(__cplusplus) && (__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)))
+// silently turned off: C code or C++98 compiler, printf-like macro are still available
+#		undef LOG_TEMPLATE_API
+#		define LOG_TEMPLATE_API 0
+#	endif //LOG_TEMPLATE_API && !(defined(__cplusplus) && (__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)))
+
+#	if LOG_FRAME_POINTER_UNWIND && (defined(LOG_PLATFORM_WINDOWS) || !defined(__GNUC__) || !(defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)))
+// silently turned off: frame layout is known only for these targets, backtrace() is used
+#		undef LOG_FRAME_POINTER_UNWIND
+#		define LOG_FRAME_POINTER_UNWIND 0
+#	endif //LOG_FRAME_POINTER_UNWIND && (defined(LOG_PLATFORM_WINDOWS) || !defined(__GNUC__) || !(defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)))
+
+#	if LOG_ELF_SYMBOLS && !defined(LOG_PLATFORM_LINUX)
+// silently turned off: dladdr1 and ELF modules are Linux specific
+#		undef LOG_ELF_SYMBOLS
+#		define LOG_ELF_SYMBOLS 0
+#	endif //LOG_ELF_SYMBOLS && !defined(LOG_PLATFORM_LINUX)
+
+#	if LOG_CONTROL_SOCKET && (!LOG_MULTITHREADED || defined(LOG_PLATFORM_WINDOWS))
+#		if LOG_COMPILER_WARNINGS
+
+#			ifdef LOG_COMPILER_MSVC
+#				pragma message("LOGGER: Control socket is not supported on Windows (LOG_CONTROL_SOCKET)")
+#			else //LOG_COMPILER_MSVC
+#				warning("LOGGER: Control socket needs multithreaded logger (LOG_CONTROL_SOCKET, LOG_MULTITHREADED)")
+#			endif //LOG_COMPILER_MSVC
+
+#		endif //LOG_COMPILER_WARNINGS
+#		undef LOG_CONTROL_SOCKET
+#		define LOG_CONTROL_SOCKET 0
+#	endif //LOG_CONTROL_SOCKET && (!LOG_MULTITHREADED || defined(LOG_PLATFORM_WINDOWS))
+
 #	if LOG_UNHANDLED_EXCEPTIONS && !LOG_AUTO_DEBUGGING
 #		if LOG_COMPILER_WARNINGS
 
@@ -719,6 +998,69 @@ enum logger_verbose_level
 
 #	endif //defined(LOG_PLATFORM_WINDOWS) && LOG_USE_SEH && !defined(LOG_COMPILER_MSVC)
 
+#	if LOG_SYMBOL_CACHE_SIZE & (LOG_SYMBOL_CACHE_SIZE - 1)
+#		error "LOGGER: LOG_SYMBOL_CACHE_SIZE must be power of two"
+#	endif //LOG_SYMBOL_CACHE_SIZE & (LOG_SYMBOL_CACHE_SIZE - 1)
+
+#	if LOG_STACKTRACE_DEDUP_SIZE & (LOG_STACKTRACE_DEDUP_SIZE - 1)
+#		error "LOGGER: LOG_STACKTRACE_DEDUP_SIZE must be power of two"
+#	endif //LOG_STACKTRACE_DEDUP_SIZE & (LOG_STACKTRACE_DEDUP_SIZE - 1)
+
+#	if LOG_DEFERRED_STACKTRACE && (!LOG_MULTITHREADED || !LOG_AUTO_DEBUGGING || defined(LOG_PLATFORM_WINDOWS))
+// silently turned off: there is no writer thread to resolve symbols, stack trace is resolved by caller
+#		undef LOG_DEFERRED_STACKTRACE
+#		define LOG_DEFERRED_STACKTRACE 0
+#	endif //LOG_DEFERRED_STACKTRACE && (!LOG_MULTITHREADED || !LOG_AUTO_DEBUGGING || defined(LOG_PLATFORM_WINDOWS))
+
+#	if LOG_DEFERRED_FORMAT && (!LOG_MULTITHREADED || !LOG_TEMPLATE_API || LOG_FLIGHT_RECORDER || (LOG_USE_DLL && !defined(LOG_THIS_IS_DLL)))
+// silently turned off: no writer thread, or flight recorder needs text of every message, or logger is called through C API of DLL
+#		undef LOG_DEFERRED_FORMAT
+#		define LOG_DEFERRED_FORMAT 0
+#	endif //LOG_DEFERRED_FORMAT && (!LOG_MULTITHREADED || !LOG_TEMPLATE_API || LOG_FLIGHT_RECORDER || (LOG_USE_DLL && !defined(LOG_THIS_IS_DLL)))
+
+#	if LOG_COLLAPSE_REPEATS && !LOG_MULTITHREADED
+// silently turned off: there is no writer thread, messages are written by caller
+#		undef LOG_COLLAPSE_REPEATS
+#		define LOG_COLLAPSE_REPEATS 0
+#	endif //LOG_COLLAPSE_REPEATS && !LOG_MULTITHREADED
+
+#	if LOG_LOAD_SHEDDING && !LOG_MULTITHREADED
+// silently turned off: there is no writer queue, caller waits for its message to be written
+#		undef LOG_LOAD_SHEDDING
+#		define LOG_LOAD_SHEDDING 0
+#	endif //LOG_LOAD_SHEDDING && !LOG_MULTITHREADED
+
+#	if LOG_PRIORITY_QUEUE && !LOG_MULTITHREADED
+// silently turned off: there is no writer queue, each message is written by caller
+#		undef LOG_PRIORITY_QUEUE
+#		define LOG_PRIORITY_QUEUE 0
+#	endif //LOG_PRIORITY_QUEUE && !LOG_MULTITHREADED
+
+#	if LOG_USE_CONTEXT && (!defined(__cplusplus) || (LOG_USE_DLL && !defined(LOG_THIS_IS_DLL)))
+// silently turned off: C code, or context of client module is not visible to logger of DLL
+#		undef LOG_USE_CONTEXT
+#		define LOG_USE_CONTEXT 0
+#	endif //LOG_USE_CONTEXT && (!defined(__cplusplus) || (LOG_USE_DLL && !defined(LOG_THIS_IS_DLL)))
+
+#	if LOG_BINARY_FORMAT && (!LOG_DEFERRED_FORMAT || LOG_FLUSH_FILE_EVERY_WRITE || LOG_TEST_DO_NOT_WRITE_FILE)
+#		if LOG_COMPILER_WARNINGS && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
+
+#			ifdef LOG_COMPILER_MSVC
+#				pragma message("LOGGER: LOG_BINARY_FORMAT needs LOG_DEFERRED_FORMAT and LOG_FLUSH_FILE_EVERY_WRITE=0, text format is used")
+#			else //LOG_COMPILER_MSVC
+#				warning("LOGGER: LOG_BINARY_FORMAT needs LOG_DEFERRED_FORMAT and LOG_FLUSH_FILE_EVERY_WRITE=0, text format is used")
+#			endif //LOG_COMPILER_MSVC
+
+#		endif //LOG_COMPILER_WARNINGS && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
+
+#		undef LOG_BINARY_FORMAT
+#		define LOG_BINARY_FORMAT 0
+#	endif //LOG_BINARY_FORMAT && (!LOG_DEFERRED_FORMAT || LOG_FLUSH_FILE_EVERY_WRITE || LOG_TEST_DO_NOT_WRITE_FILE)
+
+#	if LOG_FLIGHT_RECORDER && (LOG_FLIGHT_RECORDER_SIZE & (LOG_FLIGHT_RECORDER_SIZE - 1))
+#		error "LOGGER: LOG_FLIGHT_RECORDER_SIZE must be power of two"
+#	endif //LOG_FLIGHT_RECORDER && (LOG_FLIGHT_RECORDER_SIZE & (LOG_FLIGHT_RECORDER_SIZE - 1))
+
 
 
 
@@ -737,2903 +1079,7369 @@ enum logger_verbose_level
 #endif //LOG_USE_MODULEDEFINITION
 
 
-#if defined(__cplusplus) && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
-
-#ifdef LOG_COMPILER_MSVC
-#	pragma warning(disable:4996)
-#endif //LOG_COMPILER_MSVC
+#if defined(__cplusplus)
 
-#	include <stdio.h>
-#	include <string>
-#	include <sstream>
-#	include <ostream>
-#	include <fstream>
-#	include <map>
-#	include <vector>
-#	include <algorithm>
-#	include <time.h>
-#	include <sys/types.h>
-#	include <sys/timeb.h>
-#	include <list>
 #	include <string.h>
-#	include <stdlib.h>
+#	include <time.h>
+#	include <string>
 
-#if LOG_RTTI_ENABLED
-#   include <typeinfo>
-#endif //LOG_RTTI_ENABLED
+namespace logging {
 
-#if LOG_INI_CONFIGURATION
-#	include <ctype.h>
-#endif //LOG_INI_CONFIGURATION
+enum log_output_format_t
+{
+	log_output_text,	// header by HeaderFormat and message
+	log_output_json,	// JSON object per line, macros of HeaderFormat select its members
+	log_output_logfmt	// key=value pairs per line (logfmt), macros of HeaderFormat select its keys
+};
 
-#if LOG_CHECKED
-#	include <assert.h>
-#endif //LOG_CHECKED
+// Rendering of values for structured output (JSON, key=value) and for LOG_*_T arguments, printf is not used
+class structured_format
+{
+public:
+	static void append_unsigned(std::string& out, unsigned long long value)
+	{
+		char digits[24];
+		char* ptr = digits + sizeof(digits);
 
-#ifdef LOG_PLATFORM_WINDOWS
-#	include <windows.h>
-#	include <Sddl.h>
-#	include <Shlwapi.h>
-#	include <ShlObj.h>
-#	pragma comment(lib,"advapi32.lib")
-#	pragma comment(lib,"shlwapi.lib")
-#else //LOGGER_PLATFORM_WINDOWS
+		do
+		{
+			*--ptr = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value);
 
-#	ifdef LOG_HAVE_UNISTD_H
-#   include <unistd.h>
-#	endif //LOG_HAVE_UNISTD_H
+		out.append(ptr, digits + sizeof(digits) - ptr);
+	}
 
-#   include <dirent.h>
-#   include <fnmatch.h>
-#   include <sys/stat.h>
-#   include <sys/time.h>
-#   include <errno.h>
+	static void append_signed(std::string& out, long long value)
+	{
+		if (value < 0)
+		{
+			out += '-';
+			append_unsigned(out, 0 - static_cast<unsigned long long>(value));
+		}
+		else
+		{
+			append_unsigned(out, static_cast<unsigned long long>(value));
+		}
+	}
 
-#ifdef LOG_HAVE_SYS_SYSCALL_H
-#	include <sys/syscall.h>
-#endif //LOG_HAVE_SYS_SYSCALL_H
+	// Quoted JSON string. Text is scanned by 8 bytes, runs without characters to escape are copied at once
+	static void append_json_string(std::string& out, const char* value, size_t len)
+	{
+		out += '"';
+		append_json_escaped(out, value, len);
+		out += '"';
+	}
 
+	// logfmt value is quoted only when it is empty or has spaces, '=', '"', '\\' or control characters.
+	// Scan stops at first such character, so text before it is not scanned again
+	static void append_logfmt_string(std::string& out, const char* value, size_t len)
+	{
+		const unsigned long long ones = 0x0101010101010101ULL;
+		const unsigned long long high = 0x8080808080808080ULL;
+		const char* end = value + len;
+		const char* ptr = value;
 
-#if LOG_MULTITHREADED && defined(LOG_HAVE_PTHREAD)
-#	include <pthread.h>
-#endif //LOG_MULTITHREADED && defined(LOG_HAVE_PTHREAD)
+		while (ptr < end)
+		{
+			if (end - ptr >= 8)
+			{
+				unsigned long long word;
+				memcpy(&word, ptr, sizeof(word));
+
+				// control characters, space, '"', '\\' and '=' make high bit set in their byte
+				unsigned long long quotes = word ^ (ones * '"');
+				unsigned long long slashes = word ^ (ones * '\\');
+				unsigned long long equals = word ^ (ones * '=');
+				if (!(((word - ones * 0x21) | (quotes - ones) | (slashes - ones) | (equals - ones)) & ~word & high))
+				{
+					ptr += 8;
+					continue;
+				}
+			}
 
-#   if LOG_USE_SYSTEMINFO
-#		ifdef LOG_HAVE_SYS_UTSNAME_H
-#			include <sys/utsname.h>
-#		endif //LOG_HAVE_SYS_UTSNAME_H
+			unsigned char c = static_cast<unsigned char>(*ptr);
+			if (c <= ' ' || c == '"' || c == '\\' || c == '=')
+				break;
 
-#		ifdef LOG_HAVE_PWD_H
-#			include <pwd.h>
-#		endif //LOG_HAVE_PWD_H
+			ptr++;
+		}
 
-#		ifdef LOG_HAVE_SYS_SYSINFO_H
-#			include <sys/sysinfo.h>
-#		endif //LOG_HAVE_SYS_SYSINFO_H
-#   endif //LOG_USE_SYSTEMINFO
+		if (len && ptr == end)
+		{
+			out.append(value, len);
+			return;
+		}
 
-#endif //LOG_PLATFORM_WINDOWS
+		out += '"';
+		out.append(value, ptr - value);
+		append_json_escaped(out, ptr, end - ptr);
+		out += '"';
+	}
 
+	// String value for log_output_json or log_output_logfmt
+	static void append_string(std::string& out, int output_format, const char* value, size_t len)
+	{
+		if (output_format == log_output_json)
+			append_json_string(out, value, len);
+		else
+			append_logfmt_string(out, value, len);
+	}
 
-#ifdef LOG_PLATFORM_WINDOWS
+	// Start of member: "key": for JSON, key= for logfmt. logfmt key is quoted by the same rules as value
+	static void append_key(std::string& out, int output_format, const char* key, size_t len)
+	{
+		if (output_format == log_output_json)
+		{
+			append_json_string(out, key, len);
+			out += ':';
+		}
+		else
+		{
+			append_logfmt_string(out, key, len);
+			out += '=';
+		}
+	}
 
-#	if LOG_USE_MODULEDEFINITION
-#		include <psapi.h>
-#		pragma comment(lib,"psapi.lib")
-#		pragma comment(lib,"version.lib")
-#	endif //LOG_USE_MODULEDEFINITION
+	// ISO 8601 local time: 2024-01-31T23:59:59.999
+	static void append_time(std::string& out, const struct tm& time, int millisec)
+	{
+		char text[23];
+		put_digits(text, 4, time.tm_year + 1900);
+		text[4] = '-';
+		put_digits(text + 5, 2, time.tm_mon + 1);
+		text[7] = '-';
+		put_digits(text + 8, 2, time.tm_mday);
+		text[10] = 'T';
+		put_digits(text + 11, 2, time.tm_hour);
+		text[13] = ':';
+		put_digits(text + 14, 2, time.tm_min);
+		text[16] = ':';
+		put_digits(text + 17, 2, time.tm_sec);
+		text[19] = '.';
+		put_digits(text + 20, 3, millisec);
+		out.append(text, sizeof(text));
+	}
 
-#	if INCLUDE_DBGHELP
-#		include <dbghelp.h>
-#		pragma comment(lib,"dbghelp.lib")
-#	endif //INCLUDE_DBGHELP
+	// Same text as printf %g: 6 significant digits, exponent form for very small and big values
+	static void append_double(std::string& out, double value)
+	{
+		if (value != value)
+		{
+			out += "nan";
+			return;
+		}
 
-#endif //LOG_PLATFORM_WINDOWS
+		if (value < 0 || (value == 0 && 1 / value < 0))
+		{
+			out += '-';
+			value = -value;
+		}
 
-#define LOG_SET_VERBOSE_LEVEL(l)  logging::configurator.set_verbose_level(l)
+		if (value > 1.7976931348623157e308)
+		{
+			out += "inf";
+			return;
+		}
 
-#if LOG_CONFIGURE_FROM_REGISTRY
-#	define LOG_SET_REG_CONFIG_PATH(p)  logging::configurator.set_reg_config_path(p)
-#else //LOG_CONFIGURE_FROM_REGISTRY
-#	define LOG_SET_REG_CONFIG_PATH(p)
-#endif //LOG_CONFIGURE_FROM_REGISTRY
+		if (value == 0)
+		{
+			out += '0';
+			return;
+		}
 
-#if LOG_INI_CONFIGURATION
-#	define LOG_SET_INI_CONFIG_PATHS(p)  logging::configurator.set_ini_file_find_paths(p)
-#else //LOG_INI_CONFIGURATION
-#	define LOG_SET_INI_CONFIG_PATHS(p)
-#endif //LOG_INI_CONFIGURATION
+		int exponent = decimal_exponent(value);
+		unsigned long long digits = round_digits(value, exponent);
 
-#if !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION
-#   include <dlfcn.h>
-#   include <link.h>
-#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION
+		// estimated exponent can be one less or more near powers of ten, rounding can carry to next power
+		if (digits >= 1000000)
+			digits = round_digits(value, ++exponent);
+		else if (digits < 100000)
+			digits = round_digits(value, --exponent);
 
-#if !defined(LOG_PLATFORM_WINDOWS) && LOG_AUTO_DEBUGGING
-#   include <execinfo.h>
-#   include <cxxabi.h>
-#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_AUTO_DEBUGGING
+		if (digits >= 1000000)
+		{
+			digits /= 10;
+			exponent++;
+		}
 
-#if !defined(LOG_PLATFORM_WINDOWS) && LOG_UNHANDLED_EXCEPTIONS
-#   include <signal.h>
-#   include <ucontext.h>
-#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_UNHANDLED_EXCEPTIONS
+		char text[8];
+		for (int i = 5; i >= 0; i--, digits /= 10)
+			text[i] = static_cast<char>('0' + digits % 10);
 
+		int len = 6;
+		while (len > 1 && text[len - 1] == '0')
+			len--;
 
-#	define LOG_INFO(...) logging::_logger->log(logging::logger_verbose_info, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
-#	define LOG_DEBUG(...) logging::_logger->log(logging::logger_verbose_debug, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
-#	define LOG_WARNING(...) logging::_logger->log(logging::logger_verbose_warning, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
-#	define LOG_ERROR(...) logging::_logger->log(logging::logger_verbose_error, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
-#	define LOG_FATAL(...) logging::_logger->log(logging::logger_verbose_fatal, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+		if (exponent < -4 || exponent >= 6)
+		{
+			out += text[0];
+			if (len > 1)
+			{
+				out += '.';
+				out.append(text + 1, len - 1);
+			}
 
-#	define LOG_BINARY_INFO(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_info, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
-#	define LOG_BINARY_DEBUG(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_debug, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
-#	define LOG_BINARY_WARNING(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_warning, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
-#	define LOG_BINARY_ERROR(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_error, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
-#	define LOG_BINARY_FATAL(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_fatal, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+			out += exponent < 0 ? "e-" : "e+";
+			if (exponent > -10 && exponent < 10)
+				out += '0';
+			append_unsigned(out, exponent < 0 ? -exponent : exponent);
+		}
+		else if (exponent < 0)
+		{
+			out += "0.";
+			out.append(-exponent - 1, '0');
+			out.append(text, len);
+		}
+		else
+		{
+			out.append(text, exponent + 1);
+			if (len > exponent + 1)
+			{
+				out += '.';
+				out.append(text + exponent + 1, len - exponent - 1);
+			}
+		}
+	}
 
-#	define LOG_EXCEPTION_DEBUG(e) logging::_logger->log_exception(logging::logger_verbose_debug, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
-#	define LOG_EXCEPTION_WARNING(e) logging::_logger->log_exception(logging::logger_verbose_warning, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
-#	define LOG_EXCEPTION_INFO(e) logging::_logger->log_exception(logging::logger_verbose_info, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
-#	define LOG_EXCEPTION_ERROR(e) logging::_logger->log_exception(logging::logger_verbose_error, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
-#	define LOG_EXCEPTION_FATAL(e) logging::_logger->log_exception(logging::logger_verbose_fatal, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+private:
+	static void append_json_escaped(std::string& out, const char* value, size_t len)
+	{
+		const unsigned long long ones = 0x0101010101010101ULL;
+		const unsigned long long high = 0x8080808080808080ULL;
+		const char* end = value + len;
+		const char* run = value;
+		const char* ptr = value;
 
-#if LOG_USE_MODULEDEFINITION
+		while (ptr < end)
+		{
+			if (end - ptr >= 8)
+			{
+				unsigned long long word;
+				memcpy(&word, ptr, sizeof(word));
 
-#	define LOG_MODULES_DEBUG logging::_logger->log_modules(logging::logger_verbose_debug, \
-	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_MODULES_INFO logging::_logger->log_modules(logging::logger_verbose_info, \
-	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_MODULES_WARNING logging::_logger->log_modules(logging::logger_verbose_warning, \
-	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_MODULES_ERROR logging::_logger->log_modules(logging::logger_verbose_error, \
-	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_MODULES_FATAL logging::_logger->log_modules(logging::logger_verbose_fatal, \
-	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+				// control characters, '"' and '\\' make high bit set in their byte
+				unsigned long long quotes = word ^ (ones * '"');
+				unsigned long long slashes = word ^ (ones * '\\');
+				if (!(((word - ones * 0x20) | (quotes - ones) | (slashes - ones)) & ~word & high))
+				{
+					ptr += 8;
+					continue;
+				}
+			}
 
-#else //LOG_USE_MODULEDEFINITION
+			unsigned char c = static_cast<unsigned char>(*ptr);
+			if (c >= 0x20 && c != '"' && c != '\\')
+			{
+				ptr++;
+				continue;
+			}
 
-#	define LOG_MODULES_DEBUG 
-#	define LOG_MODULES_INFO 
-#	define LOG_MODULES_WARNING 
-#	define LOG_MODULES_ERROR 
-#	define LOG_MODULES_FATAL 
+			out.append(run, ptr - run);
+			append_json_escape(out, c);
+			run = ++ptr;
+		}
 
-#endif //LOG_USE_MODULEDEFINITION
+		out.append(run, ptr - run);
+	}
 
-#if LOG_AUTO_DEBUGGING
+	static void append_json_escape(std::string& out, unsigned char c)
+	{
+		out += '\\';
 
-#	define LOG_STACKTRACE_DEBUG logging::_logger->log_stack_trace(logging::logger_verbose_debug, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_STACKTRACE_INFO logging::_logger->log_stack_trace(logging::logger_verbose_info, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_STACKTRACE_WARNING logging::_logger->log_stack_trace(logging::logger_verbose_warning, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_STACKTRACE_ERROR logging::_logger->log_stack_trace(logging::logger_verbose_error, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
-#	define LOG_STACKTRACE_FATAL logging::_logger->log_stack_trace(logging::logger_verbose_fatal, \
-		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+		switch (c)
+		{
+		case '"':  out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '\n': out += 'n'; break;
+		case '\r': out += 'r'; break;
+		case '\t': out += 't'; break;
+		default:
+			out += "u00";
+			out += "0123456789abcdef"[c >> 4];
+			out += "0123456789abcdef"[c & 0xF];
+		}
+	}
 
-#else //LOG_AUTO_DEBUGGING
+	static void put_digits(char* text, int count, int value)
+	{
+		for (int i = count - 1; i >= 0; i--, value /= 10)
+			text[i] = static_cast<char>('0' + value % 10);
+	}
 
-#	define LOG_STACKTRACE_DEBUG 
-#	define LOG_STACKTRACE_INFO 
-#	define LOG_STACKTRACE_WARNING
-#	define LOG_STACKTRACE_ERROR
-#	define LOG_STACKTRACE_FATAL
+	// Decimal exponent of value, can be one less or more than exact one
+	static int decimal_exponent(double value)
+	{
+		static const double powers[] = { 1e256, 1e128, 1e64, 1e32, 1e16, 1e8, 1e4, 1e2, 1e1 };
+		int exponent = 0;
 
-#endif //LOG_AUTO_DEBUGGING
+		for (int i = 0, step = 256; i < 9; i++, step /= 2)
+		{
+			if (value >= powers[i])
+			{
+				value /= powers[i];
+				exponent += step;
+			}
+			else if (value < 1 && value * powers[i] < 10)
+			{
+				value *= powers[i];
+				exponent -= step;
+			}
+		}
 
-#if LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
-#	define  DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS    LPTOP_LEVEL_EXCEPTION_FILTER logging::unhandled_exceptions_processor::prev_exception_filter = NULL;
-#else //LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
-#	define  DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
-#endif //LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
+		return value < 1 ? exponent - 1 : exponent;
+	}
 
+	// 10^exponent, exact up to 10^22
+	static double power10(int exponent)
+	{
+		double result = 1;
+		double power = 10;
 
-#if LOG_SHARED
-#	define DEFINE_LOGGER   logging::log_configurator logging::configurator; \
-	logging::singleton<logging::logger_interface, logging::logger> logging::_logger ( \
-	&logging::logger_interface::ref, &logging::logger_interface::deref, &logging::logger_interface::ref_counter, \
-	(logging::logger_interface*)logging::shared_obj::try_found_shared_object(0), false); \
-							DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
-#else //LOG_SHARED
-#	define DEFINE_LOGGER   logging::log_configurator logging::configurator; \
-							logging::singleton<logging::logger_interface, logging::logger> logging::_logger; \
-							DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
-#endif //LOG_SHARED
+		for (; exponent; exponent >>= 1, power *= power)
+			if (exponent & 1)
+				result *= power;
 
+		return result;
+	}
 
-#if LOG_INI_CONFIGURATION
+	// Value scaled to 6 digit integer for given decimal exponent, rounded to nearest, ties to even like printf.
+	// Rounding error of scaling is taken exactly (Dekker product), so ties are detected for exact decimal values
+	static unsigned long long round_digits(double value, int exponent)
+	{
+		// scale of denormals does not fit in double
+		if (exponent < -290)
+		{
+			value *= 1e100;
+			exponent += 100;
+		}
 
-// simple INI parser
-namespace logging_ini {
+		double power = power10(exponent >= 5 ? exponent - 5 : 5 - exponent);
+		double scaled, product, error;
 
-/* inih -- simple .INI file parser
-inih is released under the New BSD license (see LICENSE.txt). Go to the project
-home page for more info:
-http://code.google.com/p/inih/
-*/
-/* Nonzero to allow multi-line value parsing, in the style of Python's
-   ConfigParser. If allowed, ini_parse() will call the handler with the same
-   name for each subsequent line parsed. */
-#ifndef INI_ALLOW_MULTILINE
-#define INI_ALLOW_MULTILINE 1
-#endif
+		if (exponent >= 5)
+		{
+			scaled = value / power;
+			exact_product(scaled, power, product, error);
+			error = (value - product) - error;
+		}
+		else
+		{
+			scaled = value * power;
+			exact_product(value, power, product, error);
+		}
 
-/* Nonzero to allow a UTF-8 BOM sequence (0xEF 0xBB 0xBF) at the start of
-   the file. See http://code.google.com/p/inih/issues/detail?id=21 */
-#ifndef INI_ALLOW_BOM
-#define INI_ALLOW_BOM 1
-#endif
+		unsigned long long result = static_cast<unsigned long long>(scaled);
+		double fraction = scaled - static_cast<double>(result);
 
-/* Stop parsing on first error (default is to keep parsing). */
-#ifndef INI_STOP_ON_FIRST_ERROR
-#define INI_STOP_ON_FIRST_ERROR 0
-#endif
+		if (fraction > 0.5 || (fraction == 0.5 && (error > 0 || (error == 0 && (result & 1)))))
+			result++;
 
-/* Maximum line length for any line in INI file. */
-#ifndef INI_MAX_LINE
-#define INI_MAX_LINE 8192
-#endif
+		return result;
+	}
 
+	// a * b == product + error exactly, product is rounded a * b
+	static void exact_product(double a, double b, double& product, double& error)
+	{
+		product = a * b;
 
-#define MAX_SECTION 256
-#define MAX_NAME 256
+		double a_high, a_low, b_high, b_low;
+		split(a, a_high, a_low);
+		split(b, b_high, b_low);
 
-extern "C" {
+		error = ((a_high * b_high - product) + a_high * b_low + a_low * b_high) + a_low * b_low;
+	}
 
-/* Strip whitespace chars off end of given string, in place. Return s. */
-static char* rstrip(char* s)
-{
-    char* p = s + strlen(s);
-    while (p > s && isspace((unsigned char)(*--p)))
-        *p = '\0';
-    return s;
-}
+	static void split(double value, double& high, double& low)
+	{
+		double temp = 134217729.0 * value;
+		high = temp - (temp - value);
+		low = value - high;
+	}
+};
 
-/* Return pointer to first non-whitespace char in given string. */
-static char* lskip(const char* s)
-{
-    while (*s && isspace((unsigned char)(*s)))
-        s++;
-    return (char*)s;
-}
+#if LOG_USE_CONTEXT
 
-/* Return pointer to first char c or ';' comment in given string, or pointer to
-   null at end of string if neither found. ';' must be prefixed by a whitespace
-   character to register as a comment. */
-static char* find_char_or_comment(const char* s, char c)
+// Context of thread taken by log_context::capture
+struct log_context_t
 {
-    int was_whitespace = 0;
-    while (*s && *s != c && !(was_whitespace /*&& *s == ';'*/)) {
-        was_whitespace = isspace((unsigned char)(*s));
-        s++;
-    }
-    return (char*)s;
-}
+	std::string text;	// "key=value key=value" written by $(ctx), values are quoted as in logfmt
+	std::string pairs;	// keys and values for structured output, each one followed by zero character
+};
 
-/* Version of strncpy that ensures dest (size bytes) is null-terminated. */
-static char* strncpy0(char* dest, const char* src, size_t size)
+// Mapped diagnostic context: key-value pairs added by scopes of current thread, see LOG_CONTEXT.
+// Scopes are linked on stack of thread and each one keeps rendered text of the whole context, so header
+// takes it without formatting and leaving scope costs nothing
+class log_context
 {
-    strncpy(dest, src, size);
-    dest[size - 1] = '\0';
-    return dest;
-}
+public:
+	log_context(const char* key, const char* value) { value ? push(key, value, strlen(value)) : push(key, "(null)", 6); }
+	log_context(const char* key, const std::string& value) { push(key, value.data(), value.size()); }
+	log_context(const char* key, int value) { push_signed(key, value); }
+	log_context(const char* key, long value) { push_signed(key, value); }
+	log_context(const char* key, long long value) { push_signed(key, value); }
+	log_context(const char* key, unsigned int value) { push_unsigned(key, value); }
+	log_context(const char* key, unsigned long value) { push_unsigned(key, value); }
+	log_context(const char* key, unsigned long long value) { push_unsigned(key, value); }
+
+	// Replaces context of thread with captured one until end of scope: task of thread pool, resumed coroutine
+	explicit log_context(const log_context_t& captured)
+		:prev_(head())
+		,context_(captured)
+	{
+		link();
+	}
 
-/* See documentation in header file. */
-static int ini_parse_file(FILE* file,
-                   int (*handler)(void*, const char*, const char*,
-                                  const char*),
-                   void* user)
-{
-    /* Uses a fair bit of stack (use heap instead if you need to) */
-    char* line;
+	~log_context()
+	{
+		head() = prev_;
+		version()++;
+	}
 
-    char section[MAX_SECTION] = "";
-    char prev_name[MAX_NAME] = "";
+	static log_context_t capture()
+	{
+		const log_context_t* context = current();
+		return context ? *context : log_context_t();
+	}
 
-    char* start;
-    char* end;
-    char* name;
-    char* value;
-    int lineno = 0;
-    int error = 0;
+	// NULL if thread has no context
+	static __inline const log_context_t* current()
+	{
+		const log_context* scope = head();
+		return scope ? &scope->context_ : NULL;
+	}
 
-    line = (char*)malloc(INI_MAX_LINE);
-    if (!line) {
-        return -2;
-    }
+	// Changed by every push and pop, identifies context of thread for header cache
+	static __inline unsigned long current_version()
+	{
+		return version();
+	}
 
-    /* Scan through file line by line */
-    while (fgets(line, INI_MAX_LINE, file) != NULL) {
-        lineno++;
+private:
+	log_context(const log_context&);
+	log_context& operator=(const log_context&);
 
-        start = line;
-#if INI_ALLOW_BOM
-        if (lineno == 1 && (unsigned char)start[0] == 0xEF &&
-                           (unsigned char)start[1] == 0xBB &&
-                           (unsigned char)start[2] == 0xBF) {
-            start += 3;
-        }
-#endif
-        start = lskip(rstrip(start));
+	void push(const char* key, const char* value, size_t len)
+	{
+		prev_ = head();
+		if (prev_)
+			context_ = prev_->context_;
 
-        if (*start == ';' || *start == '#') {
-            /* Per Python ConfigParser, allow '#' comments at start of line */
-        }
-#if INI_ALLOW_MULTILINE
-        else if (*prev_name && *start && start > line) {
-            /* Non-black line with leading whitespace, treat as continuation
-               of previous name's value (as per Python ConfigParser). */
-            if (!handler(user, section, prev_name, start) && !error)
-                error = lineno;
-        }
-#endif
-        else if (*start == '[') {
-            /* A "[section]" line */
-            end = find_char_or_comment(start + 1, ']');
-            if (*end == ']') {
-                *end = '\0';
-                strncpy0(section, start + 1, sizeof(section));
-                *prev_name = '\0';
-            }
-            else if (!error) {
-                /* No ']' found on section line */
-                error = lineno;
-            }
-        }
-        else if (*start && *start != ';') {
-            /* Not a comment, must be a name[=:]value pair */
-            end = find_char_or_comment(start, '=');
-            if (*end != '=') {
-                end = find_char_or_comment(start, ':');
-            }
-            if (*end == '=' || *end == ':') {
-                *end = '\0';
-                name = rstrip(start);
-                value = lskip(end + 1);
-                end = find_char_or_comment(value, '\0');
-                if (*end == ';')
-                    *end = '\0';
-                rstrip(value);
+		if (context_.text.size())
+			context_.text += ' ';
 
-                /* Valid name[=:]value pair found, call handler */
-                strncpy0(prev_name, name, sizeof(prev_name));
-                if (!handler(user, section, name, value) && !error)
-                    error = lineno;
-            }
-            else if (!error) {
-                /* No '=' or ':' found on name[=:]value line */
-                error = lineno;
-            }
-        }
+		if (!key)
+			key = "(null)";
 
-#if INI_STOP_ON_FIRST_ERROR
-        if (error)
-            break;
-#endif
-    }
+		// key with space or '=' is quoted, otherwise text could not be parsed back
+		structured_format::append_logfmt_string(context_.text, key, strlen(key));
+		context_.text += '=';
+		structured_format::append_logfmt_string(context_.text, value, len);
 
-    free(line);
+		context_.pairs += key;
+		context_.pairs += '\0';
+		context_.pairs.append(value, len);
+		context_.pairs += '\0';
 
-    return error;
-}
+		link();
+	}
 
-/* See documentation in header file. */
-static int ini_parse(const char* filename,
-              int (*handler)(void*, const char*, const char*, const char*),
-              void* user)
-{
-    FILE* file;
-    int error;
+	void push_signed(const char* key, long long value)
+	{
+		std::string text;
+		structured_format::append_signed(text, value);
+		push(key, text.data(), text.size());
+	}
 
-    file = fopen(filename, "r");
-    if (!file)
-        return -1;
-    error = ini_parse_file(file, handler, user);
-    fclose(file);
-    return error;
-}
+	void push_unsigned(const char* key, unsigned long long value)
+	{
+		std::string text;
+		structured_format::append_unsigned(text, value);
+		push(key, text.data(), text.size());
+	}
 
-} //extern "C"
+	void link()
+	{
+		head() = this;
+		version()++;
+	}
 
-}// namespace logging_ini
+	static const log_context*& head()
+	{
+		static LOG_THREAD_LOCAL const log_context* scope = NULL;
+		return scope;
+	}
 
-#endif //LOG_INI_CONFIGURATION
+	static unsigned long& version()
+	{
+		static LOG_THREAD_LOCAL unsigned long value = 0;
+		return value;
+	}
 
+	const log_context* prev_;
+	log_context_t context_;
+};
 
-namespace logging 
-{
-typedef unsigned long uint32_t;
+#endif //LOG_USE_CONTEXT
 
-#if defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC) || defined(LOG_COMPILER_SOLARIS)
-typedef unsigned long long uint64_t;
-#endif //defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC) || defined(LOG_COMPILER_SOLARIS)
+}; // namespace logging
 
-#ifdef LOG_COMPILER_MSVC
-typedef unsigned __int64 uint64_t;
-typedef __int64 int64_t;
-#endif //LOG_COMPILER_MSVC
+#endif //defined(__cplusplus)
 
-typedef unsigned short uint16_t;
-typedef unsigned char uint8_t;
 
-typedef long int32_t;
-typedef short int16_t;
-typedef char int8_t;
+#if LOG_TEMPLATE_API
 
-#if defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
-    typedef uint64_t intptr_t;
-#	define platform_dword_t DWORD64
+#	include <string.h>
+#	include <string>
 
-#   define LOG_PLATFORM_64BIT
+namespace logging {
 
-#else // defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
-	typedef unsigned int intptr_t;
-#	define platform_dword_t DWORD
+// Constant description of LOG_*_T and LOG_*_KV macro call
+struct call_site_t
+{
+	int verb_level;
+	const char* src_file;
+	int line_num;
+	const char* function_name;
+	const char* format;
+	bool fields; // format is message text, arguments are key-value fields
+};
 
-#   define LOG_PLATFORM_32BIT
+// Formatting for LOG_*_T macro. Each {} in format is replaced with next argument, {{ and }} are written as { and }.
+// Number of placeholders is checked at compile time, argument type is checked by overload resolution of append,
+// so argument of unsupported type does not compile
+class template_format
+{
+public:
+	template <int count> struct count_t { static const int value = count; };
 
-#endif // defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
+	// Number of {} in format or -1 if format has unpaired brace. Recursion depth is format length,
+	// longer formats than compiler constexpr depth limit (512 for GCC) need bigger limit
+	static constexpr int count_placeholders(const char* format, int count = 0)
+	{
+		return !*format ? count :
+			((format[0] == '{' && format[1] == '{') || (format[0] == '}' && format[1] == '}')) ? count_placeholders(format + 2, count) :
+			(format[0] == '{' && format[1] == '}') ? count_placeholders(format + 2, count + 1) :
+			(format[0] == '{' || format[0] == '}') ? -1 :
+			count_placeholders(format + 1, count);
+	}
 
+	// Number of arguments as type, used only in decltype
+	template <typename... args_t>
+	static count_t<sizeof...(args_t)> args_count(const args_t&...);
 
-////////////////////    Helpers     ////////////////////
+	static void render(std::string& out, const char* format)
+	{
+		append_literal(out, format, format + strlen(format));
+	}
 
-template<typename _TIf, 
-		typename _TImpl = _TIf>
-class singleton
-{
-public:
-	singleton(void(_TIf::*ref_fn)() = NULL, 
-				void(_TIf::*deref_fn)() = NULL, 
-				int(_TIf::*ref_cnt_fn)() = NULL,
-				_TIf* ptr = NULL,
-				bool need_delete = false)
-		:ptr_(NULL), need_delete_(false), ref_fn_(ref_fn), deref_fn_(deref_fn), ref_cnt_fn_(ref_cnt_fn)
+	template <typename arg_t, typename... args_t>
+	static void render(std::string& out, const char* format, const arg_t& arg, const args_t&... args)
 	{
-		if(ptr)
-			reset(ptr, need_delete);
+		const char* ptr = next_placeholder(format);
+
+		append_literal(out, format, ptr);
+		append(out, arg);
+		render(out, *ptr ? ptr + 2 : ptr, args...);
 	}
 
-	~singleton()
+	// Arguments are stored as type tag and value, strings are copied. Rendered later by render_packed
+	static void pack(std::string& out)
 	{
-		release();
+		(void)out;
 	}
 
-	__inline _TIf* operator ->() { return get(); }
+	template <typename arg_t, typename... args_t>
+	static void pack(std::string& out, const arg_t& arg, const args_t&... args)
+	{
+		pack_value(out, arg);
+		pack(out, args...);
+	}
 
-	_TIf* get()
+	static void render_packed(std::string& out, const char* format, const std::string& packed)
 	{
-		if (!ptr_)
+		size_t position = 0;
+
+		while (true)
 		{
-			ptr_ = new _TImpl();
-			need_delete_ = true;
+			const char* ptr = next_placeholder(format);
+			append_literal(out, format, ptr);
 
-			if (ref_fn_)
-				(ptr_->*ref_fn_)();
+			if (!*ptr)
+				break;
+
+			unpack_value(out, packed, position, log_output_text);
+			format = ptr + 2;
 		}
+	}
 
-		return ptr_;
+	// Key-value fields are packed as key string followed by value
+	static void pack_fields(std::string& out)
+	{
+		(void)out;
 	}
 
-	void reset(_TIf* ptr, bool need_delete = true)
+	template <typename arg_t, typename... args_t>
+	static void pack_fields(std::string& out, const char* key, const arg_t& value, const args_t&... args)
 	{
-		release();
+		pack_string(out, key, strlen(key));
+		pack_value(out, value);
+		pack_fields(out, args...);
+	}
 
-		need_delete_ = need_delete;
-		ptr_ = ptr;
+	// Fields as " key=value" for text and logfmt output, as JSON members ',"key":value'
+	static void render_fields(std::string& out, const std::string& packed, int output_format)
+	{
+		size_t position = 0;
 
-		if (ref_fn_)
-			(ptr_->*ref_fn_)();
+		while (position < packed.size())
+		{
+			position++;
+			size_t len = unpack_raw<size_t>(packed, position);
+
+			out += output_format == log_output_json ? ',' : ' ';
+			structured_format::append_key(out, output_format, packed.data() + position, len);
+
+			position += len;
+			unpack_value(out, packed, position, output_format);
+		}
 	}
 
-	void release()
+	// Message of call site without header
+	static void render_message(std::string& out, const call_site_t& site, const std::string& packed)
 	{
-		if (deref_fn_ && ptr_)
-			(ptr_->*deref_fn_)();
-				
-		if (ref_cnt_fn_ && ptr_)
+		if (site.fields)
 		{
-			if ((ptr_->*ref_cnt_fn_)())
-				ptr_ = NULL;
+			out += site.format;
+			render_fields(out, packed, log_output_text);
+		}
+		else
+		{
+			render_packed(out, site.format, packed);
 		}
+	}
 
-		if (ptr_ && need_delete_) delete ptr_;
-		ptr_ = NULL;
-		need_delete_ = false;
+	static void append(std::string& out, bool value) { out += value ? "true" : "false"; }
+	static void append(std::string& out, char value) { out += value; }
+	static void append(std::string& out, signed char value) { structured_format::append_signed(out, value); }
+	static void append(std::string& out, unsigned char value) { structured_format::append_unsigned(out, value); }
+	static void append(std::string& out, short value) { structured_format::append_signed(out, value); }
+	static void append(std::string& out, unsigned short value) { structured_format::append_unsigned(out, value); }
+	static void append(std::string& out, int value) { structured_format::append_signed(out, value); }
+	static void append(std::string& out, unsigned int value) { structured_format::append_unsigned(out, value); }
+	static void append(std::string& out, long value) { structured_format::append_signed(out, value); }
+	static void append(std::string& out, unsigned long value) { structured_format::append_unsigned(out, value); }
+	static void append(std::string& out, long long value) { structured_format::append_signed(out, value); }
+	static void append(std::string& out, unsigned long long value) { structured_format::append_unsigned(out, value); }
+	static void append(std::string& out, float value) { structured_format::append_double(out, value); }
+	static void append(std::string& out, double value) { structured_format::append_double(out, value); }
+	static void append(std::string& out, const char* value) { out += value ? value : "(null)"; }
+	static void append(std::string& out, const std::string& value) { out += value; }
+
+	template <typename type_t>
+	static void append(std::string& out, const type_t* value)
+	{
+		size_t address = reinterpret_cast<size_t>(value);
+		char digits[2 + sizeof(address) * 2];
+		char* ptr = digits + sizeof(digits);
+
+		do
+		{
+			*--ptr = "0123456789abcdef"[address & 0xF];
+			address >>= 4;
+		} while (address);
+
+		*--ptr = 'x';
+		*--ptr = '0';
+		out.append(ptr, digits + sizeof(digits) - ptr);
 	}
 
 private:
-    _TIf* ptr_;
-    bool need_delete_;
+	static const char* next_placeholder(const char* format)
+	{
+		while (*format && !(format[0] == '{' && format[1] == '}'))
+			format += ((format[0] == '{' || format[0] == '}') && format[1] == format[0]) ? 2 : 1;
 
-    void(_TIf::*ref_fn_)();
-	void(_TIf::*deref_fn_)();
-	int(_TIf::*ref_cnt_fn_)();
-};
+		return format;
+	}
 
-//////////////   String functions    //////////////
+	static void append_literal(std::string& out, const char* begin, const char* end)
+	{
+		for (const char* ptr = begin; ptr < end; ptr++)
+		{
+			out += *ptr;
+			if ((*ptr == '{' || *ptr == '}') && ptr + 1 < end && ptr[1] == *ptr)
+				ptr++;
+		}
+	}
 
-static void format_arguments_list(std::string& result, const char* format, va_list arguments)
-{
-	static const int StartBufferSize = 512;
-	static const int BufferSizeIncrement = 512;
+	enum packed_type_t
+	{
+		packed_bool,
+		packed_char,
+		packed_signed,
+		packed_unsigned,
+		packed_double,
+		packed_string,
+		packed_pointer
+	};
 
-	char staticBuf[StartBufferSize];
-	int bufferSize = StartBufferSize ;
+	template <typename type_t>
+	static void pack_raw(std::string& out, packed_type_t type, type_t value)
+	{
+		out += static_cast<char>(type);
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
 
-	char* buffer = staticBuf;
-	int need_delete = 0;
+	static void pack_string(std::string& out, const char* value, size_t len)
+	{
+		pack_raw(out, packed_string, len);
+		out.append(value, len);
+	}
 
-	do 
+	static void pack_value(std::string& out, bool value) { pack_raw(out, packed_bool, value); }
+	static void pack_value(std::string& out, char value) { pack_raw(out, packed_char, value); }
+	static void pack_value(std::string& out, signed char value) { pack_raw(out, packed_signed, static_cast<long long>(value)); }
+	static void pack_value(std::string& out, unsigned char value) { pack_raw(out, packed_unsigned, static_cast<unsigned long long>(value)); }
+	static void pack_value(std::string& out, short value) { pack_raw(out, packed_signed, static_cast<long long>(value)); }
+	static void pack_value(std::string& out, unsigned short value) { pack_raw(out, packed_unsigned, static_cast<unsigned long long>(value)); }
+	static void pack_value(std::string& out, int value) { pack_raw(out, packed_signed, static_cast<long long>(value)); }
+	static void pack_value(std::string& out, unsigned int value) { pack_raw(out, packed_unsigned, static_cast<unsigned long long>(value)); }
+	static void pack_value(std::string& out, long value) { pack_raw(out, packed_signed, static_cast<long long>(value)); }
+	static void pack_value(std::string& out, unsigned long value) { pack_raw(out, packed_unsigned, static_cast<unsigned long long>(value)); }
+	static void pack_value(std::string& out, long long value) { pack_raw(out, packed_signed, value); }
+	static void pack_value(std::string& out, unsigned long long value) { pack_raw(out, packed_unsigned, value); }
+	static void pack_value(std::string& out, float value) { pack_raw(out, packed_double, static_cast<double>(value)); }
+	static void pack_value(std::string& out, double value) { pack_raw(out, packed_double, value); }
+	static void pack_value(std::string& out, const char* value) { value ? pack_string(out, value, strlen(value)) : pack_string(out, "(null)", 6); }
+	static void pack_value(std::string& out, const std::string& value) { pack_string(out, value.data(), value.size()); }
+
+	template <typename type_t>
+	static void pack_value(std::string& out, const type_t* value)
 	{
-#		ifdef LOG_COMPILER_MSVC
-		int result = _vsnprintf_s(buffer, bufferSize, bufferSize-1, format, arguments);
-#		else //LOG_COMPILER_MSVC
-		int result = vsnprintf(buffer,bufferSize-1,format,arguments);
-#		endif //LOG_COMPILER_MSVC
+		pack_raw(out, packed_pointer, static_cast<const void*>(value));
+	}
 
-		if (result >= 0)
-			break;
+	template <typename type_t>
+	static type_t unpack_raw(const std::string& packed, size_t& position)
+	{
+		type_t value;
+		memcpy(&value, packed.data() + position, sizeof(value));
+		position += sizeof(value);
+		return value;
+	}
 
-		bufferSize += BufferSizeIncrement;
-		if (!need_delete)
+	// Value as in message for text output. JSON: characters, strings and pointers are quoted, infinity and NaN are null.
+	// logfmt: characters and strings are quoted when needed
+	static void unpack_value(std::string& out, const std::string& packed, size_t& position, int output_format)
+	{
+		switch (packed[position++])
 		{
-			need_delete = 1;
-			buffer = NULL;
+		case packed_bool: append(out, unpack_raw<bool>(packed, position)); break;
+		case packed_signed: append(out, unpack_raw<long long>(packed, position)); break;
+		case packed_unsigned: append(out, unpack_raw<unsigned long long>(packed, position)); break;
+		case packed_char:
+			{
+				char value = unpack_raw<char>(packed, position);
+				if (output_format != log_output_text)
+					structured_format::append_string(out, output_format, &value, 1);
+				else
+					append(out, value);
+			}
+			break;
+		case packed_double:
+			{
+				double value = unpack_raw<double>(packed, position);
+				if (output_format == log_output_json && (value != value || value - value != 0))
+					out += "null";
+				else
+					append(out, value);
+			}
+			break;
+		case packed_pointer:
+			{
+				std::string text;
+				append(text, unpack_raw<const void*>(packed, position));
+				if (output_format == log_output_json)
+					structured_format::append_json_string(out, text.data(), text.size());
+				else
+					out += text;
+			}
+			break;
+		case packed_string:
+			{
+				size_t len = unpack_raw<size_t>(packed, position);
+				if (output_format != log_output_text)
+					structured_format::append_string(out, output_format, packed.data() + position, len);
+				else
+					out.append(packed, position, len);
+				position += len;
+			}
+			break;
 		}
+	}
+};
 
-		buffer = (char*) realloc(buffer, bufferSize);
-		if (!buffer)
-			break;
+}; // namespace logging
 
-	} while(true);
-	
-	result = buffer ? buffer : std::string();
-	if (need_delete)
-		free(buffer);
-}
+#endif //LOG_TEMPLATE_API
 
-static std::string stringformat (const char* format, ...)
-{
-	va_list arguments;
-	va_start(arguments, format);
-	std::string result;
-	format_arguments_list(result, format, arguments);
-	va_end(arguments);
-	return result;
-}
 
-static bool contains(const char* str, const char* find_str)
-{
-	return strstr(str,find_str) != NULL;
-}
+#if defined(__cplusplus) && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
 
-static std::string& replace(std::string& str,const char* find_str, const std::string& replaceStr)
-{
-	size_t i=0;
-	const char* ptr = NULL;
-	size_t find_str_len = strlen(find_str);
+#ifdef LOG_COMPILER_MSVC
+#	pragma warning(disable:4996)
+#endif //LOG_COMPILER_MSVC
 
-	while (((ptr = strstr(str.c_str(),find_str)) != NULL) && ptr >= str.c_str())
-	{
-		str = static_cast<std::string>(str).replace(ptr-str.c_str(),find_str_len,replaceStr);
-		i+=replaceStr.length();
-	}
-	return str;
-}
+#	include <stdio.h>
+#	include <string>
+#	include <sstream>
+#	include <ostream>
+#	include <fstream>
+#	include <map>
+#	include <vector>
+#	include <deque>
+#	include <algorithm>
+#	include <time.h>
+#	include <sys/types.h>
+#	include <sys/timeb.h>
+#	include <list>
+#	include <set>
+#	include <string.h>
+#	include <stdlib.h>
 
-static void split(std::string str, std::vector<std::string>& out_strings, char ch = ' ')
-{
-	while (true)
-	{
-		size_t position = str.find_first_of(ch);
-		std::string current = str.substr(0,position);
+#if LOG_RTTI_ENABLED
+#   include <typeinfo>
+#endif //LOG_RTTI_ENABLED
 
-		if (current.size())
-			out_strings.push_back(current);
+#if LOG_INI_CONFIGURATION
+#	include <ctype.h>
+#endif //LOG_INI_CONFIGURATION
 
-		if (position == std::string::npos)
-			break;
+#if LOG_CHECKED
+#	include <assert.h>
+#endif //LOG_CHECKED
 
-		str = str.substr(position);
-		position = str.find_first_not_of(ch);
-		if (position == std::string::npos)
-			break;
+#ifdef LOG_PLATFORM_WINDOWS
+#	include <windows.h>
+#	include <Sddl.h>
+#	include <Shlwapi.h>
+#	include <ShlObj.h>
+#	pragma comment(lib,"advapi32.lib")
+#	pragma comment(lib,"shlwapi.lib")
+#else //LOGGER_PLATFORM_WINDOWS
 
-		str = str.substr(position);
-	}
-}
+#	ifdef LOG_HAVE_UNISTD_H
+#   include <unistd.h>
+#	endif //LOG_HAVE_UNISTD_H
 
+#   include <dirent.h>
+#   include <fnmatch.h>
+#   include <sys/stat.h>
+#   include <sys/time.h>
+#   include <errno.h>
 
-////////////////////  Module Definition components  ////////////////////
+#ifdef LOG_HAVE_SYS_SYSCALL_H
+#	include <sys/syscall.h>
+#endif //LOG_HAVE_SYS_SYSCALL_H
 
-#if LOG_USE_MODULEDEFINITION
 
-#ifdef LOG_PLATFORM_WINDOWS
+// pthread_atfork is used to invalidate cached process and thread IDs even in single threaded mode
+#ifdef LOG_HAVE_PTHREAD
+#	include <pthread.h>
+#endif //LOG_HAVE_PTHREAD
 
-class pe_image
-{
-public:
+#   include <sched.h>
+
+#   if LOG_USE_SYSTEMINFO
+#		ifdef LOG_HAVE_SYS_UTSNAME_H
+#			include <sys/utsname.h>
+#		endif //LOG_HAVE_SYS_UTSNAME_H
+
+#		ifdef LOG_HAVE_PWD_H
+#			include <pwd.h>
+#		endif //LOG_HAVE_PWD_H
+
+#		ifdef LOG_HAVE_SYS_SYSINFO_H
+#			include <sys/sysinfo.h>
+#		endif //LOG_HAVE_SYS_SYSINFO_H
+#   endif //LOG_USE_SYSTEMINFO
+
+#endif //LOG_PLATFORM_WINDOWS
+
+
+#ifdef LOG_PLATFORM_WINDOWS
+
+#	if LOG_USE_MODULEDEFINITION
+#		include <psapi.h>
+#		pragma comment(lib,"psapi.lib")
+#		pragma comment(lib,"version.lib")
+#	endif //LOG_USE_MODULEDEFINITION
+
+#	if INCLUDE_DBGHELP
+#		include <dbghelp.h>
+#		pragma comment(lib,"dbghelp.lib")
+#	endif //INCLUDE_DBGHELP
+
+#endif //LOG_PLATFORM_WINDOWS
+
+#define LOG_SET_VERBOSE_LEVEL(l)  logging::configurator.set_verbose_level(l)
+
+#if LOG_CONFIGURE_FROM_REGISTRY
+#	define LOG_SET_REG_CONFIG_PATH(p)  logging::configurator.set_reg_config_path(p)
+#else //LOG_CONFIGURE_FROM_REGISTRY
+#	define LOG_SET_REG_CONFIG_PATH(p)
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+
+#if LOG_INI_CONFIGURATION
+#	define LOG_SET_INI_CONFIG_PATHS(p)  logging::configurator.set_ini_file_find_paths(p)
+#else //LOG_INI_CONFIGURATION
+#	define LOG_SET_INI_CONFIG_PATHS(p)
+#endif //LOG_INI_CONFIGURATION
+
+#if !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION
+#   include <dlfcn.h>
+#   include <link.h>
+#   include <stddef.h>
+#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION
+
+#if !defined(LOG_PLATFORM_WINDOWS) && LOG_AUTO_DEBUGGING
+#   include <execinfo.h>
+#   include <cxxabi.h>
+#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_AUTO_DEBUGGING
+
+#if LOG_ELF_SYMBOLS && LOG_AUTO_DEBUGGING
+#   include <elf.h>
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#endif //LOG_ELF_SYMBOLS && LOG_AUTO_DEBUGGING
+
+#if LOG_INI_HOT_RELOAD
+#   include <sys/inotify.h>
+#   include <poll.h>
+#endif //LOG_INI_HOT_RELOAD
+
+#if LOG_CONTROL_SOCKET
+#   include <stddef.h>
+#   include <fcntl.h>
+#   include <sys/socket.h>
+#   include <sys/stat.h>
+#   include <sys/un.h>
+#   include <poll.h>
+#endif //LOG_CONTROL_SOCKET
+
+#if !defined(LOG_PLATFORM_WINDOWS) && LOG_UNHANDLED_EXCEPTIONS
+#   include <signal.h>
+#   include <ucontext.h>
+#   include <fcntl.h>
+#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_UNHANDLED_EXCEPTIONS
+
+#if LOG_CRASH_REPORT_FILE
+#	include <sys/syscall.h>
+#endif //LOG_CRASH_REPORT_FILE
+
+
+#if LOG_MULTITHREADED
+
+#	ifdef LOG_PLATFORM_WINDOWS
+#		define LOG_MT_MUTEX CRITICAL_SECTION
+#		define LOG_MT_MUTEX_INIT(x, y) InitializeCriticalSection(x)
+#		define LOG_MT_MUTEX_LOCK(x) EnterCriticalSection(x)
+#		define LOG_MT_MUTEX_UNLOCK(x) LeaveCriticalSection(x)
+#		define LOG_MT_MUTEX_DESTROY(x) DeleteCriticalSection(x)
+#		define LOG_MT_THREAD_EXIT(x)  ExitThread(x)
+#	else //LOG_PLATFORM_WINDOWS
+
+#		define LOG_MT_MUTEX pthread_mutex_t
+#		define LOG_MT_MUTEX_INIT pthread_mutex_init
+#		define LOG_MT_MUTEX_LOCK pthread_mutex_lock
+#		define LOG_MT_MUTEX_UNLOCK pthread_mutex_unlock
+#		define LOG_MT_MUTEX_DESTROY pthread_mutex_destroy
+#		define LOG_MT_THREAD_EXIT pthread_exit
+
+
+#	endif //LOG_PLATFORM_WINDOWS
+
+#endif //LOG_MULTITHREADED
+
+
+#	define LOG_INFO(...) logging::_logger->log(logging::logger_verbose_info, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+#	define LOG_DEBUG(...) logging::_logger->log(logging::logger_verbose_debug, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+#	define LOG_WARNING(...) logging::_logger->log(logging::logger_verbose_warning, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+#	define LOG_ERROR(...) logging::_logger->log(logging::logger_verbose_error, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+#	define LOG_FATAL(...) logging::_logger->log(logging::logger_verbose_fatal, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
+
+// LOG_*_EVERY_N writes every n-th message of call site, LOG_*_FIRST_N first n messages, LOG_*_EVERY_MS at most one
+// message per interval, LOG_*_SAMPLED message with probability p. Arguments of skipped message are not evaluated.
+// EVERY_MS writes number of skipped messages before next written one
+#	define LOG_RATE_LIMITED_LOG(log_macro, check, ...) do { \
+		static logging::rate_limit_site_t log_rate_site; \
+		if (logging::rate_limiter::check) \
+			log_macro(__VA_ARGS__); \
+	} while (0)
+
+#	define LOG_RATE_LIMITED_LOG_SUPPRESSED(log_macro, check, ...) do { \
+		static logging::rate_limit_site_t log_rate_site; \
+		if (logging::rate_limiter::check) { \
+			long log_suppressed = logging::rate_limiter::take_suppressed(log_rate_site); \
+			if (log_suppressed) \
+				log_macro("(%ld messages suppressed)", log_suppressed); \
+			log_macro(__VA_ARGS__); \
+		} \
+	} while (0)
+
+#	define LOG_INFO_EVERY_N(n, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, every_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_INFO_FIRST_N(n, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, first_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_INFO_EVERY_MS(ms, ...)     LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_INFO, every_ms(log_rate_site, ms), __VA_ARGS__)
+#	define LOG_INFO_SAMPLED(p, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, sampled(log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_DEBUG_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, every_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_DEBUG_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, first_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_DEBUG_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_DEBUG, every_ms(log_rate_site, ms), __VA_ARGS__)
+#	define LOG_DEBUG_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, sampled(log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_WARNING_EVERY_N(n, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, every_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_WARNING_FIRST_N(n, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, first_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_WARNING_EVERY_MS(ms, ...)  LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_WARNING, every_ms(log_rate_site, ms), __VA_ARGS__)
+#	define LOG_WARNING_SAMPLED(p, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, sampled(log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_ERROR_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, every_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_ERROR_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, first_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_ERROR_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_ERROR, every_ms(log_rate_site, ms), __VA_ARGS__)
+#	define LOG_ERROR_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, sampled(log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_FATAL_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, every_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_FATAL_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, first_n(log_rate_site, n), __VA_ARGS__)
+#	define LOG_FATAL_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_FATAL, every_ms(log_rate_site, ms), __VA_ARGS__)
+#	define LOG_FATAL_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, sampled(log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_BINARY_INFO(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_info, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+#	define LOG_BINARY_DEBUG(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_debug, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+#	define LOG_BINARY_WARNING(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_warning, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+#	define LOG_BINARY_ERROR(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_error, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+#	define LOG_BINARY_FATAL(p,stack_frame) logging::_logger->log_binary(logging::logger_verbose_fatal, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
+
+#	define LOG_EXCEPTION_DEBUG(e) logging::_logger->log_exception(logging::logger_verbose_debug, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+#	define LOG_EXCEPTION_WARNING(e) logging::_logger->log_exception(logging::logger_verbose_warning, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+#	define LOG_EXCEPTION_INFO(e) logging::_logger->log_exception(logging::logger_verbose_info, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+#	define LOG_EXCEPTION_ERROR(e) logging::_logger->log_exception(logging::logger_verbose_error, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+#	define LOG_EXCEPTION_FATAL(e) logging::_logger->log_exception(logging::logger_verbose_fatal, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__, e)
+
+#if LOG_USE_MODULEDEFINITION
+
+#	define LOG_MODULES_DEBUG logging::_logger->log_modules(logging::logger_verbose_debug, \
+	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_MODULES_INFO logging::_logger->log_modules(logging::logger_verbose_info, \
+	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_MODULES_WARNING logging::_logger->log_modules(logging::logger_verbose_warning, \
+	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_MODULES_ERROR logging::_logger->log_modules(logging::logger_verbose_error, \
+	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_MODULES_FATAL logging::_logger->log_modules(logging::logger_verbose_fatal, \
+	LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+
+#else //LOG_USE_MODULEDEFINITION
+
+#	define LOG_MODULES_DEBUG 
+#	define LOG_MODULES_INFO 
+#	define LOG_MODULES_WARNING 
+#	define LOG_MODULES_ERROR 
+#	define LOG_MODULES_FATAL 
+
+#endif //LOG_USE_MODULEDEFINITION
+
+#if LOG_AUTO_DEBUGGING
+
+#	define LOG_STACKTRACE_DEBUG logging::_logger->log_stack_trace(logging::logger_verbose_debug, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_STACKTRACE_INFO logging::_logger->log_stack_trace(logging::logger_verbose_info, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_STACKTRACE_WARNING logging::_logger->log_stack_trace(logging::logger_verbose_warning, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_STACKTRACE_ERROR logging::_logger->log_stack_trace(logging::logger_verbose_error, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+#	define LOG_STACKTRACE_FATAL logging::_logger->log_stack_trace(logging::logger_verbose_fatal, \
+		LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__)
+
+#else //LOG_AUTO_DEBUGGING
+
+#	define LOG_STACKTRACE_DEBUG 
+#	define LOG_STACKTRACE_INFO 
+#	define LOG_STACKTRACE_WARNING
+#	define LOG_STACKTRACE_ERROR
+#	define LOG_STACKTRACE_FATAL
+
+#endif //LOG_AUTO_DEBUGGING
+
+#if LOG_FLIGHT_RECORDER
+#	define LOG_FLIGHT_RECORDER_DUMP logging::_logger->dump_flight_recorder()
+#else //LOG_FLIGHT_RECORDER
+#	define LOG_FLIGHT_RECORDER_DUMP
+#endif //LOG_FLIGHT_RECORDER
+
+#if LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
+#	define  DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS    LPTOP_LEVEL_EXCEPTION_FILTER logging::unhandled_exceptions_processor::prev_exception_filter = NULL;
+#else //LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
+#	define  DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
+#endif //LOG_UNHANDLED_EXCEPTIONS && defined(LOG_PLATFORM_WINDOWS)
+
+
+#if LOG_SHARED
+#	define DEFINE_LOGGER   logging::log_configurator logging::configurator; \
+	logging::singleton<logging::logger_interface, logging::logger> logging::_logger ( \
+	&logging::logger_interface::ref, &logging::logger_interface::deref, &logging::logger_interface::ref_counter, \
+	(logging::logger_interface*)logging::shared_obj::try_found_shared_object(0), false); \
+							DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
+#else //LOG_SHARED
+#	define DEFINE_LOGGER   logging::log_configurator logging::configurator; \
+							logging::singleton<logging::logger_interface, logging::logger> logging::_logger; \
+							DEFINE_LOG_UNHANDLED_EXCEPTIONS_MEMBERS
+#endif //LOG_SHARED
+
+
+#if LOG_INI_CONFIGURATION
+
+// simple INI parser
+namespace logging_ini {
+
+/* inih -- simple .INI file parser
+inih is released under the New BSD license (see LICENSE.txt). Go to the project
+home page for more info:
+http://code.google.com/p/inih/
+*/
+/* Nonzero to allow multi-line value parsing, in the style of Python's
+   ConfigParser. If allowed, ini_parse() will call the handler with the same
+   name for each subsequent line parsed. */
+#ifndef INI_ALLOW_MULTILINE
+#define INI_ALLOW_MULTILINE 1
+#endif
+
+/* Nonzero to allow a UTF-8 BOM sequence (0xEF 0xBB 0xBF) at the start of
+   the file. See http://code.google.com/p/inih/issues/detail?id=21 */
+#ifndef INI_ALLOW_BOM
+#define INI_ALLOW_BOM 1
+#endif
+
+/* Stop parsing on first error (default is to keep parsing). */
+#ifndef INI_STOP_ON_FIRST_ERROR
+#define INI_STOP_ON_FIRST_ERROR 0
+#endif
+
+/* Maximum line length for any line in INI file. */
+#ifndef INI_MAX_LINE
+#define INI_MAX_LINE 8192
+#endif
+
+
+#define MAX_SECTION 256
+#define MAX_NAME 256
+
+extern "C" {
+
+/* Strip whitespace chars off end of given string, in place. Return s. */
+static char* rstrip(char* s)
+{
+    char* p = s + strlen(s);
+    while (p > s && isspace((unsigned char)(*--p)))
+        *p = '\0';
+    return s;
+}
+
+/* Return pointer to first non-whitespace char in given string. */
+static char* lskip(const char* s)
+{
+    while (*s && isspace((unsigned char)(*s)))
+        s++;
+    return (char*)s;
+}
+
+/* Return pointer to first char c or ';' comment in given string, or pointer to
+   null at end of string if neither found. ';' must be prefixed by a whitespace
+   character to register as a comment. */
+static char* find_char_or_comment(const char* s, char c)
+{
+    int was_whitespace = 0;
+    while (*s && *s != c && !(was_whitespace /*&& *s == ';'*/)) {
+        was_whitespace = isspace((unsigned char)(*s));
+        s++;
+    }
+    return (char*)s;
+}
+
+/* Version of strncpy that ensures dest (size bytes) is null-terminated. */
+static char* strncpy0(char* dest, const char* src, size_t size)
+{
+    strncpy(dest, src, size);
+    dest[size - 1] = '\0';
+    return dest;
+}
+
+/* See documentation in header file. */
+static int ini_parse_file(FILE* file,
+                   int (*handler)(void*, const char*, const char*,
+                                  const char*),
+                   void* user)
+{
+    /* Uses a fair bit of stack (use heap instead if you need to) */
+    char* line;
+
+    char section[MAX_SECTION] = "";
+    char prev_name[MAX_NAME] = "";
+
+    char* start;
+    char* end;
+    char* name;
+    char* value;
+    int lineno = 0;
+    int error = 0;
+
+    line = (char*)malloc(INI_MAX_LINE);
+    if (!line) {
+        return -2;
+    }
+
+    /* Scan through file line by line */
+    while (fgets(line, INI_MAX_LINE, file) != NULL) {
+        lineno++;
+
+        start = line;
+#if INI_ALLOW_BOM
+        if (lineno == 1 && (unsigned char)start[0] == 0xEF &&
+                           (unsigned char)start[1] == 0xBB &&
+                           (unsigned char)start[2] == 0xBF) {
+            start += 3;
+        }
+#endif
+        start = lskip(rstrip(start));
+
+        if (*start == ';' || *start == '#') {
+            /* Per Python ConfigParser, allow '#' comments at start of line */
+        }
+#if INI_ALLOW_MULTILINE
+        else if (*prev_name && *start && start > line) {
+            /* Non-black line with leading whitespace, treat as continuation
+               of previous name's value (as per Python ConfigParser). */
+            if (!handler(user, section, prev_name, start) && !error)
+                error = lineno;
+        }
+#endif
+        else if (*start == '[') {
+            /* A "[section]" line */
+            end = find_char_or_comment(start + 1, ']');
+            if (*end == ']') {
+                *end = '\0';
+                strncpy0(section, start + 1, sizeof(section));
+                *prev_name = '\0';
+            }
+            else if (!error) {
+                /* No ']' found on section line */
+                error = lineno;
+            }
+        }
+        else if (*start && *start != ';') {
+            /* Not a comment, must be a name[=:]value pair */
+            end = find_char_or_comment(start, '=');
+            if (*end != '=') {
+                end = find_char_or_comment(start, ':');
+            }
+            if (*end == '=' || *end == ':') {
+                *end = '\0';
+                name = rstrip(start);
+                value = lskip(end + 1);
+                end = find_char_or_comment(value, '\0');
+                if (*end == ';')
+                    *end = '\0';
+                rstrip(value);
+
+                /* Valid name[=:]value pair found, call handler */
+                strncpy0(prev_name, name, sizeof(prev_name));
+                if (!handler(user, section, name, value) && !error)
+                    error = lineno;
+            }
+            else if (!error) {
+                /* No '=' or ':' found on name[=:]value line */
+                error = lineno;
+            }
+        }
+
+#if INI_STOP_ON_FIRST_ERROR
+        if (error)
+            break;
+#endif
+    }
+
+    free(line);
+
+    return error;
+}
+
+/* See documentation in header file. */
+static int ini_parse(const char* filename,
+              int (*handler)(void*, const char*, const char*, const char*),
+              void* user)
+{
+    FILE* file;
+    int error;
+
+    file = fopen(filename, "r");
+    if (!file)
+        return -1;
+    error = ini_parse_file(file, handler, user);
+    fclose(file);
+    return error;
+}
+
+} //extern "C"
+
+}// namespace logging_ini
+
+#endif //LOG_INI_CONFIGURATION
+
+
+namespace logging 
+{
+typedef unsigned long uint32_t;
+
+#if defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC) || defined(LOG_COMPILER_SOLARIS)
+typedef unsigned long long uint64_t;
+#endif //defined(LOG_COMPILER_GCC) || defined(LOG_COMPILER_MINGW) || defined(LOG_COMPILER_ICC) || defined(LOG_COMPILER_SOLARIS)
+
+#ifdef LOG_COMPILER_MSVC
+typedef unsigned __int64 uint64_t;
+typedef __int64 int64_t;
+#endif //LOG_COMPILER_MSVC
+
+typedef unsigned short uint16_t;
+typedef unsigned char uint8_t;
+
+typedef long int32_t;
+typedef short int16_t;
+typedef char int8_t;
+
+#if defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
+    typedef uint64_t intptr_t;
+#	define platform_dword_t DWORD64
+
+#   define LOG_PLATFORM_64BIT
+
+#else // defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
+	typedef unsigned int intptr_t;
+#	define platform_dword_t DWORD
+
+#   define LOG_PLATFORM_32BIT
+
+#endif // defined(_AMD64_) || defined(__LP64__) || defined(_LP64)
+
+
+////////////////////    Helpers     ////////////////////
+
+// Minimal set of atomic operations used by lock-free parts of logger (configuration snapshots, caches)
+struct atomic_ops
+{
+	static __inline void* load_ptr(void* const volatile* ptr)
+	{
+#ifdef LOG_COMPILER_MSVC
+		void* value = *ptr;
+		_ReadWriteBarrier();
+		return value;
+#else //LOG_COMPILER_MSVC
+		return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline void store_ptr(void* volatile* ptr, void* value)
+	{
+#ifdef LOG_COMPILER_MSVC
+		InterlockedExchangePointer((PVOID volatile*)ptr, value);
+#else //LOG_COMPILER_MSVC
+		__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline bool cas_ptr(void* volatile* ptr, void* expected, void* desired)
+	{
+#ifdef LOG_COMPILER_MSVC
+		return InterlockedCompareExchangePointer((PVOID volatile*)ptr, desired, expected) == expected;
+#else //LOG_COMPILER_MSVC
+		return __sync_bool_compare_and_swap(ptr, expected, desired);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline long load(const volatile long* ptr)
+	{
+#ifdef LOG_COMPILER_MSVC
+		long value = *ptr;
+		_ReadWriteBarrier();
+		return value;
+#else //LOG_COMPILER_MSVC
+		return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline void store(volatile long* ptr, long value)
+	{
+#ifdef LOG_COMPILER_MSVC
+		InterlockedExchange(ptr, value);
+#else //LOG_COMPILER_MSVC
+		__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	// returns previous value
+	static __inline long fetch_add(volatile long* ptr, long value)
+	{
+#ifdef LOG_COMPILER_MSVC
+		return InterlockedExchangeAdd(ptr, value);
+#else //LOG_COMPILER_MSVC
+		return __sync_fetch_and_add(ptr, value);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline bool cas(volatile long* ptr, long expected, long desired)
+	{
+#ifdef LOG_COMPILER_MSVC
+		return InterlockedCompareExchange(ptr, desired, expected) == expected;
+#else //LOG_COMPILER_MSVC
+		return __sync_bool_compare_and_swap(ptr, expected, desired);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	// returns previous value
+	static __inline long exchange(volatile long* ptr, long value)
+	{
+#ifdef LOG_COMPILER_MSVC
+		return InterlockedExchange(ptr, value);
+#else //LOG_COMPILER_MSVC
+		return __sync_lock_test_and_set(ptr, value);
+#endif //LOG_COMPILER_MSVC
+	}
+
+	// full memory barrier
+	static __inline void fence()
+	{
+#ifdef LOG_COMPILER_MSVC
+		MemoryBarrier();
+#else //LOG_COMPILER_MSVC
+		__sync_synchronize();
+#endif //LOG_COMPILER_MSVC
+	}
+
+	static __inline void yield()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		SwitchToThread();
+#else //LOG_PLATFORM_WINDOWS
+		sched_yield();
+#endif //LOG_PLATFORM_WINDOWS
+	}
+};
+
+// Grace period of objects which are read without locks and replaced by one updater at a time (under its lock).
+// Reader enters read section of current epoch, replaced object is tagged by epoch and freed when epoch is advanced
+// twice: every reader which could see it has left its section by then. Readers never wait, updater never waits too,
+// so object is freed by one of next updates after readers of its epoch are gone
+class grace_period
+{
+public:
+	grace_period()
+		:epoch_(0)
+	{
+		readers_[0] = readers_[1] = 0;
+	}
+
+	// Objects which may be read by holder are not freed while section exists. Section is kept on stack only
+	class section
+	{
+	public:
+		explicit section(const grace_period& owner)
+			:owner_(owner), epoch_(owner.enter())
+		{}
+
+		// epoch can not advance twice while other section holds it, so joining it is safe
+		section(const section& other)
+			:owner_(other.owner_), epoch_(other.epoch_)
+		{
+			atomic_ops::fetch_add(&owner_.readers_[epoch_ & 1], 1);
+		}
+
+		~section() { atomic_ops::fetch_add(&owner_.readers_[epoch_ & 1], -1); }
+
+	private:
+		section& operator=(const section&);
+
+		const grace_period& owner_;
+		long epoch_;
+	};
+
+	// Called by updater after new object is published: old one is tagged by returned epoch
+	long retire_epoch() const { return atomic_ops::load(&epoch_); }
+
+	// Called by updater after objects are retired. Objects tagged by returned epoch minus 2 and earlier can be freed
+	long advance()
+	{
+		try_advance();
+		try_advance();
+		return atomic_ops::load(&epoch_);
+	}
+
+	// Threads which read objects in parent process do not exist in child, their sections are dropped
+	void drop_readers_after_fork() { readers_[0] = readers_[1] = 0; }
+
+private:
+	// Counter of epoch parity is incremented, epoch is checked again because it could be advanced between load
+	// and increment
+	long enter() const
+	{
+		for (;;)
+		{
+			long epoch = atomic_ops::load(&epoch_);
+			atomic_ops::fetch_add(&readers_[epoch & 1], 1);
+			if (atomic_ops::load(&epoch_) == epoch)
+				return epoch;
+
+			atomic_ops::fetch_add(&readers_[epoch & 1], -1);
+		}
+	}
+
+	// Epoch E+1 is started only when no reader of epoch E-1 is left
+	void try_advance()
+	{
+		atomic_ops::fence();
+		long epoch = atomic_ops::load(&epoch_);
+		if (atomic_ops::load(&readers_[(epoch + 1) & 1]) == 0)
+			atomic_ops::fetch_add(&epoch_, 1);
+	}
+
+	volatile long epoch_;
+	mutable volatile long readers_[2]; // readers of even and odd epochs
+};
+
+// Objects replaced by updater of grace_period, freed when grace period of each one is over. Used under updater lock
+template <class T>
+class retired_list
+{
+public:
+	~retired_list()
+	{
+		for (size_t i=0; i<items_.size(); i++)
+			delete items_[i].first;
+	}
+
+	void retire(T* item, grace_period& period)
+	{
+		items_.push_back(std::make_pair(item, period.retire_epoch()));
+
+		long epoch = period.advance();
+		while (items_.size() && epoch - items_.front().second >= 2)
+		{
+			delete items_.front().first;
+			items_.pop_front();
+		}
+	}
+
+	size_t size() const { return items_.size(); }
+
+private:
+	std::deque<std::pair<T*, long> > items_;
+};
+
+// Process and thread IDs with their decimal strings are cached to avoid system calls on each message.
+// Both caches are dropped in child process after fork (the only thread of child is the one which called fork)
+class process_ids
+{
+public:
+	static __inline unsigned long pid()
+	{
+		id_cache_t& cache = pid_cache();
+		if (!atomic_ops::load(&cache.id))
+			refresh(cache, query_pid());
+
+		return static_cast<unsigned long>(cache.id);
+	}
+
+	static __inline const char* pid_str()
+	{
+		pid();
+		return static_cast<const char*>(atomic_ops::load_ptr((void* const volatile*)&pid_cache().str));
+	}
+
+	static __inline unsigned long tid()
+	{
+		id_cache_t& cache = tid_cache();
+		if (!cache.id)
+			refresh(cache, query_tid());
+
+		return static_cast<unsigned long>(cache.id);
+	}
+
+	static __inline const char* tid_str()
+	{
+		tid();
+		return tid_cache().str;
+	}
+
+	// Called in child process after fork. Safe to call more than once
+	static void reset_after_fork()
+	{
+		pid_cache().id = 0;
+		tid_cache().id = 0;
+	}
+
+	static unsigned long query_pid()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		return GetCurrentProcessId();
+#elif defined(LOG_HAVE_UNISTD_H)
+		return (unsigned long)getpid();
+#else //LOG_PLATFORM_WINDOWS
+		return 0;
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+	static unsigned long query_tid()
+	{
+		unsigned long tid = 0;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		tid = GetCurrentThreadId();
+#else //LOG_PLATFORM_WINDOWS
+
+#	ifdef gettid
+		tid = (unsigned long) gettid();
+#	else //gettid
+#		if defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
+			tid = (unsigned long)syscall(SYS_gettid);
+#		else //defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
+
+#			ifdef LOG_HAVE_PTHREAD
+				tid = (unsigned long) pthread_self();
+#			endif //LOG_HAVE_PTHREAD
+#		endif //defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
+
+#	endif //gettid
+
+#endif //LOG_PLATFORM_WINDOWS
+		return tid;
+	}
+
+private:
+	struct id_cache_t
+	{
+		volatile long id;
+		char* volatile str; // one of buffers, published after it is written
+		char buffers[2][24];
+	};
+
+	static id_cache_t& pid_cache()
+	{
+		static id_cache_t cache = { 0, NULL, { "", "" } };
+		return cache;
+	}
+
+	static id_cache_t& tid_cache()
+	{
+		static LOG_THREAD_LOCAL id_cache_t cache = { 0, NULL, { "", "" } };
+		return cache;
+	}
+
+	static void refresh(id_cache_t& cache, unsigned long id)
+	{
+		register_fork_handler();
+
+		// string is written to buffer which is not published, so reader of published one never sees it half written
+		char* str = cache.buffers[atomic_ops::load_ptr((void* volatile*)&cache.str) == cache.buffers[0] ? 1 : 0];
+		sprintf(str, "%lu", id);
+		atomic_ops::store_ptr((void* volatile*)&cache.str, str);
+
+		// without pthread_atfork fork cannot be tracked, so value is not cached
+#if defined(LOG_PLATFORM_WINDOWS) || defined(LOG_HAVE_PTHREAD)
+		atomic_ops::store(&cache.id, static_cast<long>(id));
+#endif //defined(LOG_PLATFORM_WINDOWS) || defined(LOG_HAVE_PTHREAD)
+	}
+
+	static void register_fork_handler()
+	{
+#if !defined(LOG_PLATFORM_WINDOWS) && defined(LOG_HAVE_PTHREAD)
+		static volatile long registered = 0;
+
+		if (!atomic_ops::load(&registered) && atomic_ops::cas(&registered, 0, 1))
+			pthread_atfork(NULL, NULL, &reset_after_fork);
+#endif //!defined(LOG_PLATFORM_WINDOWS) && defined(LOG_HAVE_PTHREAD)
+	}
+};
+
+template<typename _TIf,
+		typename _TImpl = _TIf>
+class singleton
+{
+public:
+	singleton(void(_TIf::*ref_fn)() = NULL, 
+				void(_TIf::*deref_fn)() = NULL, 
+				int(_TIf::*ref_cnt_fn)() = NULL,
+				_TIf* ptr = NULL,
+				bool need_delete = false)
+		:ptr_(NULL), need_delete_(false), creating_(0), ref_fn_(ref_fn), deref_fn_(deref_fn), ref_cnt_fn_(ref_cnt_fn)
+	{
+		if(ptr)
+			reset(ptr, need_delete);
+	}
+
+	~singleton()
+	{
+		release();
+	}
+
+	__inline _TIf* operator ->() { return get(); }
+
+	__inline _TIf* get()
+	{
+		_TIf* ptr = static_cast<_TIf*>(atomic_ops::load_ptr((void* const volatile*)&ptr_));
+		return ptr ? ptr : create();
+	}
+
+	void reset(_TIf* ptr, bool need_delete = true)
+	{
+		release();
+
+		need_delete_ = need_delete;
+		ptr_ = ptr;
+
+		if (ref_fn_)
+			(ptr_->*ref_fn_)();
+	}
+
+	void release()
+	{
+		if (deref_fn_ && ptr_)
+			(ptr_->*deref_fn_)();
+				
+		if (ref_cnt_fn_ && ptr_)
+		{
+			if ((ptr_->*ref_cnt_fn_)())
+				ptr_ = NULL;
+		}
+
+		if (ptr_ && need_delete_) delete ptr_;
+		ptr_ = NULL;
+		need_delete_ = false;
+	}
+
+private:
+    _TIf* ptr_;
+    bool need_delete_;
+	volatile long creating_; // PID of process which creates instance right now
+
+	// first access can come from several threads at once: only one of them creates instance, others wait for it.
+	// Creation started by thread of parent process before fork never ends in child, so child takes it over
+	_TIf* create()
+	{
+		long pid = process_ids::pid() ? static_cast<long>(process_ids::pid()) : 1;
+		long expected = 0;
+
+		while (!atomic_ops::cas(&creating_, expected, pid))
+		{
+			long creator = atomic_ops::load(&creating_);
+
+			if (creator == pid)
+			{
+				atomic_ops::yield();
+				creator = 0;
+			}
+
+			expected = creator;
+		}
+
+		if (!ptr_)
+		{
+			_TIf* ptr = new _TImpl();
+			need_delete_ = true;
+
+			if (ref_fn_)
+				(ptr->*ref_fn_)();
+
+			atomic_ops::store_ptr((void* volatile*)&ptr_, ptr);
+		}
+
+		atomic_ops::store(&creating_, 0);
+		return ptr_;
+	}
+
+    void(_TIf::*ref_fn_)();
+	void(_TIf::*deref_fn_)();
+	int(_TIf::*ref_cnt_fn_)();
+};
+
+//////////////   String functions    //////////////
+
+static void format_arguments_list(std::string& result, const char* format, va_list arguments)
+{
+	static const int StartBufferSize = 512;
+	static const int BufferSizeIncrement = 512;
+
+	char staticBuf[StartBufferSize];
+	int bufferSize = StartBufferSize ;
+
+	char* buffer = staticBuf;
+	int need_delete = 0;
+
+	do 
+	{
+#		ifdef LOG_COMPILER_MSVC
+		int result = _vsnprintf_s(buffer, bufferSize, bufferSize-1, format, arguments);
+#		else //LOG_COMPILER_MSVC
+		int result = vsnprintf(buffer,bufferSize-1,format,arguments);
+#		endif //LOG_COMPILER_MSVC
+
+		if (result >= 0)
+			break;
+
+		bufferSize += BufferSizeIncrement;
+		if (!need_delete)
+		{
+			need_delete = 1;
+			buffer = NULL;
+		}
+
+		buffer = (char*) realloc(buffer, bufferSize);
+		if (!buffer)
+			break;
+
+	} while(true);
+	
+	result = buffer ? buffer : std::string();
+	if (need_delete)
+		free(buffer);
+}
+
+static std::string stringformat (const char* format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	std::string result;
+	format_arguments_list(result, format, arguments);
+	va_end(arguments);
+	return result;
+}
+
+static bool contains(const char* str, const char* find_str)
+{
+	return strstr(str,find_str) != NULL;
+}
+
+static std::string& replace(std::string& str,const char* find_str, const std::string& replaceStr)
+{
+	size_t i=0;
+	const char* ptr = NULL;
+	size_t find_str_len = strlen(find_str);
+
+	while (((ptr = strstr(str.c_str(),find_str)) != NULL) && ptr >= str.c_str())
+	{
+		str = static_cast<std::string>(str).replace(ptr-str.c_str(),find_str_len,replaceStr);
+		i+=replaceStr.length();
+	}
+	return str;
+}
+
+static void split(std::string str, std::vector<std::string>& out_strings, char ch = ' ')
+{
+	while (true)
+	{
+		size_t position = str.find_first_of(ch);
+		std::string current = str.substr(0,position);
+
+		if (current.size())
+			out_strings.push_back(current);
+
+		if (position == std::string::npos)
+			break;
+
+		str = str.substr(position);
+		position = str.find_first_not_of(ch);
+		if (position == std::string::npos)
+			break;
+
+		str = str.substr(position);
+	}
+}
+
+
+////////////////////  Module Definition components  ////////////////////
+
+#if LOG_USE_MODULEDEFINITION
+
+#ifdef LOG_PLATFORM_WINDOWS
+
+class pe_image
+{
+public:
 	enum pe_signatures
 	{
-		PE_IMAGE_DOS_SIGNATURE                = 0x5A4D,      // MZ
-		PE_IMAGE_NT_SIGNATURE                 = 0x00004550  // PE00
-	};
+		PE_IMAGE_DOS_SIGNATURE                = 0x5A4D,      // MZ
+		PE_IMAGE_NT_SIGNATURE                 = 0x00004550  // PE00
+	};
+
+	enum pe_image_directory_entry_types
+	{
+		PE_IMAGE_DIRECTORY_ENTRY_EXPORT          = 0,   // Export Directory
+		PE_IMAGE_DIRECTORY_ENTRY_IMPORT          = 1,   // Import Directory
+		PE_IMAGE_DIRECTORY_ENTRY_RESOURCE        = 2,   // Resource Directory
+		PE_IMAGE_DIRECTORY_ENTRY_EXCEPTION       = 3,   // Exception Directory
+		PE_IMAGE_DIRECTORY_ENTRY_SECURITY        = 4,   // Security Directory
+		PE_IMAGE_DIRECTORY_ENTRY_BASERELOC       = 5,   // Base Relocation Table
+		PE_IMAGE_DIRECTORY_ENTRY_DEBUG           = 6,   // Debug Directory
+		PE_IMAGE_DIRECTORY_ENTRY_ARCHITECTURE    = 7,   // Architecture Specific Data
+		PE_IMAGE_DIRECTORY_ENTRY_GLOBALPTR       = 8,   // RVA of GP
+		PE_IMAGE_DIRECTORY_ENTRY_TLS             = 9,   // TLS Directory
+		PE_IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG     = 10,  // Load Configuration Directory
+		PE_IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT    = 11,   // Bound Import Directory in headers
+		PE_IMAGE_DIRECTORY_ENTRY_IAT             = 12,   // Import Address Table
+		PE_IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT    = 13,   // Delay Load Import Descriptors
+		PE_IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR  = 14   // COM Runtime descriptor
+	};
+
+	static const int PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES   = 16;
+
+	typedef struct _pe_image_dos_header_t 
+	{      // DOS .EXE header
+		unsigned short   e_magic;                     // Magic number
+		unsigned short   e_cblp;                      // Bytes on last page of file
+		unsigned short   e_cp;                        // Pages in file
+		unsigned short   e_crlc;                      // Relocations
+		unsigned short   e_cparhdr;                   // Size of header in paragraphs
+		unsigned short   e_minalloc;                  // Minimum extra paragraphs needed
+		unsigned short   e_maxalloc;                  // Maximum extra paragraphs needed
+		unsigned short   e_ss;                        // Initial (relative) SS value
+		unsigned short   e_sp;                        // Initial SP value
+		unsigned short   e_csum;                      // Checksum
+		unsigned short   e_ip;                        // Initial IP value
+		unsigned short   e_cs;                        // Initial (relative) CS value
+		unsigned short   e_lfarlc;                    // File address of relocation table
+		unsigned short   e_ovno;                      // Overlay number
+		unsigned short   e_res[4];                    // Reserved words
+		unsigned short   e_oemid;                     // OEM identifier (for e_oeminfo)
+		unsigned short   e_oeminfo;                   // OEM information; e_oemid specific
+		unsigned short   e_res2[10];                  // Reserved words
+		unsigned long    e_lfanew;                    // File address of new exe header
+	} pe_image_dos_header_t;
+
+	typedef struct _pe_image_file_header_t {
+		unsigned short Machine;
+		unsigned short NumberOfSections;
+		unsigned long TimeDateStamp;
+		unsigned long PointerToSymbolTable;
+		unsigned long NumberOfSymbols;
+		unsigned short SizeOfOptionalHeader;
+		unsigned short Characteristics;
+	} pe_image_file_header_t;
+
+	typedef struct _pe_image_data_directory_t 
+	{
+		unsigned long   VirtualAddress;
+		unsigned long   Size;
+	} pe_image_data_directory_t;
+
+	typedef struct _pe_image_optional_header64_t {
+		unsigned short        Magic;
+		unsigned char        MajorLinkerVersion;
+		unsigned char        MinorLinkerVersion;
+		unsigned long       SizeOfCode;
+		unsigned long       SizeOfInitializedData;
+		unsigned long       SizeOfUninitializedData;
+		unsigned long       AddressOfEntryPoint;
+		unsigned long       BaseOfCode;
+		uint64_t   ImageBase;
+		unsigned long       SectionAlignment;
+		unsigned long       FileAlignment;
+		unsigned short        MajorOperatingSystemVersion;
+		unsigned short        MinorOperatingSystemVersion;
+		unsigned short        MajorImageVersion;
+		unsigned short        MinorImageVersion;
+		unsigned short        MajorSubsystemVersion;
+		unsigned short        MinorSubsystemVersion;
+		unsigned long       Win32VersionValue;
+		unsigned long       SizeOfImage;
+		unsigned long       SizeOfHeaders;
+		unsigned long       CheckSum;
+		unsigned short        Subsystem;
+		unsigned short        DllCharacteristics;
+		uint64_t   SizeOfStackReserve;
+		uint64_t   SizeOfStackCommit;
+		uint64_t   SizeOfHeapReserve;
+		uint64_t   SizeOfHeapCommit;
+		unsigned long       LoaderFlags;
+		unsigned long       NumberOfRvaAndSizes;
+		pe_image_data_directory_t DataDirectory[PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+	} pe_image_optional_header64_t;
+
+	typedef struct _pe_image_optional_header32_t 
+	{
+		unsigned short    Magic;
+		unsigned char    MajorLinkerVersion;
+		unsigned char    MinorLinkerVersion;
+		unsigned long   SizeOfCode;
+		unsigned long   SizeOfInitializedData;
+		unsigned long   SizeOfUninitializedData;
+		unsigned long   AddressOfEntryPoint;
+		unsigned long   BaseOfCode;
+		unsigned long   BaseOfData;
+		unsigned long   ImageBase;
+		unsigned long   SectionAlignment;
+		unsigned long   FileAlignment;
+		unsigned short    MajorOperatingSystemVersion;
+		unsigned short    MinorOperatingSystemVersion;
+		unsigned short    MajorImageVersion;
+		unsigned short    MinorImageVersion;
+		unsigned short    MajorSubsystemVersion;
+		unsigned short    MinorSubsystemVersion;
+		unsigned long   Win32VersionValue;
+		unsigned long   SizeOfImage;
+		unsigned long   SizeOfHeaders;
+		unsigned long   CheckSum;
+		unsigned short    Subsystem;
+		unsigned short    DllCharacteristics;
+		unsigned long   SizeOfStackReserve;
+		unsigned long   SizeOfStackCommit;
+		unsigned long   SizeOfHeapReserve;
+		unsigned long   SizeOfHeapCommit;
+		unsigned long   LoaderFlags;
+		unsigned long   NumberOfRvaAndSizes;
+		pe_image_data_directory_t DataDirectory[PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+	} pe_image_optional_header32_t;
+
+	typedef struct _pe_image_nt_headers64_t
+	{
+		unsigned long Signature;
+		pe_image_file_header_t FileHeader;
+		pe_image_optional_header64_t OptionalHeader;
+	} pe_image_nt_headers64_t;
+
+	typedef struct _pe_image_nt_headers32_t {
+		unsigned long Signature;
+		pe_image_file_header_t FileHeader;
+		pe_image_optional_header32_t OptionalHeader;
+	} pe_image_nt_headers32_t;
+	
+
+#ifdef _WIN64
+	typedef pe_image_nt_headers64_t pe_image_nt_headers_t;
+#else
+	typedef pe_image_nt_headers32_t pe_image_nt_headers_t;
+#endif
+
+public:
+    static void* api_find_module_entry_point(intptr_t some_addr_in_module)
+	{
+#if !LOG_USE_SEH
+		HMODULE h;
+		if (GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCTSTR)(void*)(some_addr_in_module), &h))
+			return reinterpret_cast<void*>(h);
+
+		return NULL;
+#else //LOG_USE_SEH
+		const int max_cycles_find = 0x4000;
+		const int max_exceptions_per_try = 0x100;
+		
+		int cycles = 0;
+		int exceptions = 0;
+
+#ifdef _AMD64_
+		some_addr_in_module &= 0xFFFFFFFFFFFF0000;
+#else //_AMD64_
+		some_addr_in_module &= 0xFFFF0000;
+#endif //_AMD64_
+
+		while(1)
+		{
+			const pe_image_dos_header_t* doshdr = (pe_image_dos_header_t*)some_addr_in_module;
+
+			__try
+			{
+				if (doshdr->e_magic == PE_IMAGE_DOS_SIGNATURE)
+				{
+					if (doshdr->e_lfanew < 0x100000)
+					{
+						const pe_image_nt_headers_t* nthdr = (pe_image_nt_headers_t*)(some_addr_in_module + doshdr->e_lfanew);
+						if (nthdr->Signature == PE_IMAGE_NT_SIGNATURE)
+							break;
+					}
+				}
+
+				exceptions = 0;
+			}
+			__except(1)
+			{
+				++exceptions;
+			}
+
+			++cycles;
+			some_addr_in_module -= 0x1000;
+
+			if (cycles > max_cycles_find)
+				return NULL;
+
+			if (exceptions > max_exceptions_per_try)
+				return NULL;
+		}
+
+		return (void*)some_addr_in_module;
+#endif //LOG_USE_SEH
+	}
+};
+#endif //LOG_PLATFORM_WINDOWS
+
+
+struct module_entry_t
+{
+	std::string imageName;
+	std::string moduleName;
+	intptr_t baseAddress;
+	unsigned long size;
+	std::string file_version;
+	std::string product_version;
+	std::string file_description;
+	std::string company_name;
+	unsigned long lang_id;
+
+	module_entry_t() : baseAddress(0), size(0), lang_id(0) {}
+}; 
+
+class module_definition
+{
+public:
+	static std::string module_name_by_addr(void* functionAddress)
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		HMODULE module = reinterpret_cast<HMODULE>(pe_image::api_find_module_entry_point(
+			reinterpret_cast<intptr_t>(functionAddress)));
+		
+		if (!module)
+			return std::string();
+
+		char fileName[MAX_PATH];
+		GetModuleFileNameA(module,fileName,sizeof(fileName));
+		return fileName;
+#else //LOG_PLATFORM_WINDOWS
+        Dl_info info;
+        if (dladdr(functionAddress, &info))
+        {
+            return info.dli_fname;
+        }
+
+        return "";
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+#ifdef LOG_PLATFORM_WINDOWS
+	static bool module_query_version_info(HMODULE module, std::string& file_version, 
+					std::string& file_description, std::string& product_version, 
+					std::string& company_name,
+					unsigned long& lang_id)
+	{
+		char szFilename[MAX_PATH + 1];
+		
+		if (GetModuleFileNameA(module, szFilename, MAX_PATH) == 0)
+		{
+			return false;
+		}
+
+		// allocate a block of memory for the version info
+		DWORD dummy;
+		DWORD dwSize = GetFileVersionInfoSizeA(szFilename, &dummy);
+		if (dwSize == 0)
+		{
+			return false;
+		}
+
+		uint8_t* data = (uint8_t*) malloc(dwSize);
+		if (!data)
+			return false;
+
+		// load the version info
+		if (!GetFileVersionInfoA(szFilename, 0, dwSize, data))
+		{
+			free(data);
+			return false;
+		}
+
+		DWORD vLen,langD;
+        BOOL ret_val;    
+    
+        LPVOID retbuf=NULL;
+    
+        static char file_entry[256];
+
+        sprintf(file_entry,"\\VarFileInfo\\Translation");
+        ret_val = VerQueryValueA(data,file_entry,&retbuf,(UINT *)&vLen);
+        if (ret_val && vLen==4) 
+        {
+	        static char current_entry[256];
+
+			memcpy(&langD,retbuf,4);            
+
+			lang_id = langD;
+
+			sprintf(file_entry, "\\StringFileInfo\\%02X%02X%02X%02X\\",
+                  (langD & 0xff00)>>8,langD & 0xff,(langD & 0xff000000)>>24, 
+                  (langD & 0xff0000)>>16);            
+
+			strcpy(current_entry, file_entry);
+			strcat(current_entry, "FileVersion");
+
+			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
+				file_version = (char*)retbuf;
+
+			strcpy(current_entry, file_entry);
+			strcat(current_entry, "FileDescription");
+
+			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
+				file_description = (char*)retbuf;
+
+			strcpy(current_entry, file_entry);
+			strcat(current_entry, "ProductVersion");
+
+			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
+				product_version = (char*)retbuf;
+
+			strcpy(current_entry, file_entry);
+			strcat(current_entry, "CompanyName");
+
+			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
+				company_name = (char*)retbuf;
+        }
+
+		free(data);
+
+		return true;
+	}
+
+#endif //LOG_PLATFORM_WINDOWS
+
+
+#if !defined(LOG_PLATFORM_WINDOWS)
+    static int module_callback(struct dl_phdr_info *info, size_t size, void *data)
+    {
+        std::list<module_entry_t>* modules = (std::list<module_entry_t>*)data;
+
+        if (!info || size < sizeof(struct dl_phdr_info))
+            return 0;
+
+        if (!strlen(info->dlpi_name))
+            return 0;
+
+        module_entry_t e;
+        e.baseAddress = info->dlpi_addr;
+
+        e.imageName = info->dlpi_name;
+        e.moduleName = info->dlpi_name;
+
+        size_t last_delim = e.moduleName.find_last_of('/');
+        if (last_delim == std::string::npos)
+            last_delim = 0;
+        else
+            last_delim++;
+
+        e.moduleName = e.moduleName.substr(last_delim);
+
+        e.size = 0;
+
+        for (int j = 0; j < info->dlpi_phnum; j++)
+        {
+            uintptr_t ptr = info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz; // - info->dlpi_addr;
+
+            if (e.size < ptr)
+                e.size = ptr;
+        }
+
+        modules->push_back(e);
+        return 0;
+    }
+#endif
+
+
+	static bool query_module_list(std::list<module_entry_t> &modules)
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		const int MaxModules = 1024;
+		modules.clear();
+
+		HMODULE moduleArray[MaxModules];
+		DWORD bytesNeeded;
+
+		HANDLE processHandle = GetCurrentProcess(); 
+
+		if (!EnumProcessModules(processHandle, moduleArray, MaxModules*sizeof(HMODULE), &bytesNeeded))
+			return false;
+
+		for (size_t i = 0; i < bytesNeeded / sizeof(HMODULE); i++ )
+		{
+			MODULEINFO moduleInfo;
+			GetModuleInformation(processHandle, moduleArray[i], &moduleInfo, sizeof moduleInfo );
+
+			module_entry_t e;
+			e.baseAddress = reinterpret_cast<intptr_t>(moduleInfo.lpBaseOfDll);
+			e.size = moduleInfo.SizeOfImage;
+
+			char name[MAX_PATH];
+			GetModuleFileNameExA(processHandle, moduleArray[i], name, sizeof(name));
+			e.imageName = name;
+
+			GetModuleBaseNameA(processHandle, moduleArray[i], name, sizeof(name));
+			e.moduleName = name;
+
+			module_query_version_info(reinterpret_cast<HMODULE>(moduleInfo.lpBaseOfDll), 
+				e.file_version, e.file_description, e.product_version, e.company_name, e.lang_id);
+
+			modules.push_back(e);
+		}
+
+#else //LOG_PLATFORM_WINDOWS
+        dl_iterate_phdr(&module_callback, &modules);
+#endif //LOG_PLATFORM_WINDOWS
+
+		return true;
+	}
+};
+
+#endif // LOG_USE_MODULEDEFINITION
+
+
+//////////////////////////////////////////////////////////////
+
+class utils
+{
+public:
+
+	// Difference between local time and UTC in seconds
+	static long query_utc_offset()
+	{
+		time_t now = time(NULL);
+		struct tm local_time = get_local_time(now);
+		struct tm utc_time = get_utc_time(now);
+
+		long offset = (local_time.tm_hour - utc_time.tm_hour) * 3600 + (local_time.tm_min - utc_time.tm_min) * 60;
+
+		if (local_time.tm_year != utc_time.tm_year)
+			offset += local_time.tm_year > utc_time.tm_year ? 86400 : -86400;
+		else if (local_time.tm_yday != utc_time.tm_yday)
+			offset += local_time.tm_yday > utc_time.tm_yday ? 86400 : -86400;
+
+		return offset;
+	}
+
+    static struct tm get_time(int& millisec)
+	{
+        struct tm newtime;
+
+#ifdef LOG_PLATFORM_WINDOWS
+
+	#ifdef  LOG_COMPILER_MSVC
+		struct __timeb64 tstruct;
+		_ftime64(&tstruct);
+		_localtime64_s(&newtime, &tstruct.time);
+	#else //LOG_COMPILER_MSVC
+
+		struct timeb tstruct;
+		ftime(&tstruct);
+		newtime = *localtime(&tstruct.time);
+	#endif //LOG_COMPILER_MSVC
+
+		millisec = tstruct.millitm;
+
+#else //LOG_PLATFORM_WINDOWS
+        time_t tim = time(NULL);
+        struct tm *loc_time = localtime(&tim);
+
+        memcpy(&newtime, loc_time,sizeof(struct tm));
+
+        struct timeval tv;
+        gettimeofday(&tv,NULL);
+        millisec = tv.tv_usec / 1000;
+#endif //LOG_PLATFORM_WINDOWS
+
+		return newtime;
+	}
+
+	// Current time split to seconds and milliseconds, converted to local time later by get_local_time
+	static void get_timestamp(time_t& seconds, int& millisec)
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+
+	#ifdef  LOG_COMPILER_MSVC
+		struct __timeb64 tstruct;
+		_ftime64(&tstruct);
+		seconds = static_cast<time_t>(tstruct.time);
+	#else //LOG_COMPILER_MSVC
+		struct timeb tstruct;
+		ftime(&tstruct);
+		seconds = tstruct.time;
+	#endif //LOG_COMPILER_MSVC
+
+		millisec = tstruct.millitm;
+
+#else //LOG_PLATFORM_WINDOWS
+		struct timeval tv;
+		gettimeofday(&tv,NULL);
+		seconds = tv.tv_sec;
+		millisec = tv.tv_usec / 1000;
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+	// Milliseconds of monotonic clock, for intervals only
+	static unsigned long get_tick_count()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		return GetTickCount();
+#else //LOG_PLATFORM_WINDOWS
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<unsigned long>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+	static struct tm get_local_time(time_t seconds)
+	{
+		struct tm result;
+
+#if defined(LOG_COMPILER_MSVC)
+		localtime_s(&result, &seconds);
+#elif defined(LOG_PLATFORM_WINDOWS)
+		result = *localtime(&seconds);
+#else //defined(LOG_COMPILER_MSVC)
+		localtime_r(&seconds, &result);
+#endif //defined(LOG_COMPILER_MSVC)
+
+		return result;
+	}
+
+	static struct tm get_utc_time(time_t seconds)
+	{
+		struct tm result;
+
+#if defined(LOG_COMPILER_MSVC)
+		gmtime_s(&result, &seconds);
+#elif defined(LOG_PLATFORM_WINDOWS)
+		result = *gmtime(&seconds);
+#else //defined(LOG_COMPILER_MSVC)
+		gmtime_r(&seconds, &result);
+#endif //defined(LOG_COMPILER_MSVC)
+
+		return result;
+	}
+
+
+#ifndef _WIN32
+
+    static std::string do_readlink(std::string const& path)
+    {
+        char buff[1024];
+
+#ifdef LOG_HAVE_UNISTD_H
+        ssize_t len = ::readlink(path.c_str(), buff, sizeof(buff)-1);
+#else //LOG_HAVE_UNISTD_H
+	ssize_t len = -1;
+#endif //LOG_HAVE_UNISTD_H
+
+        if (len != -1)
+        {
+            buff[len] = '\0';
+            return std::string(buff);
+        }
+
+        return std::string();
+    }
+
+#endif //_WIN32
+
+#if defined(LOG_PLATFORM_LINUX) || defined(LOG_PLATFORM_CYGWIN)
+#   define LOG_SELF_PROC_LINK "/proc/self/exe"
+#endif //defined(LOG_PLATFORM_LINUX) || defined(LOG_PLATFORM_CYGWIN)
+
+#ifdef LOG_PLATFORM_UNIX
+#   define LOG_SELF_PROC_LINK "/proc/curproc/file"
+#endif //LOG_PLATFORM_UNIX
+
+#ifdef LOG_PLATFORM_SOLARIS
+#   define LOG_SELF_PROC_LINK "/proc/self/path/a.out"
+#endif //LOG_PLATFORM_SOLARIS
+
+
+	static std::string get_process_file_path()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+        char fileName[MAX_PATH];
+
+		GetModuleFileNameA(NULL,fileName,sizeof(fileName));
+		std::string path = fileName;
+
+		size_t lastDelimiter = path.find_last_of("\\");
+		return path.substr(0,lastDelimiter);
+#else //LOG_PLATFORM_WINDOWS
+
+        std::string path = do_readlink(LOG_SELF_PROC_LINK);
+        return path.substr(0,path.find_last_of('/'));
+
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+	static std::string get_process_full_file_name()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+        char file_name[MAX_PATH];
+
+		GetModuleFileNameA(NULL,file_name,sizeof(file_name));
+		std::string path = file_name;
+
+		size_t last_delim = path.find_last_of("\\");
+		if (last_delim != std::string::npos)
+			last_delim++;
+
+		return path.substr(last_delim,std::string::npos);
+#else //LOG_PLATFORM_WINDOWS
+        std::string path = do_readlink(LOG_SELF_PROC_LINK);
+
+        size_t last_delim = path.find_last_of("/");
+        if (last_delim != std::string::npos)
+            last_delim++;
+        else
+	return path;
+
+        return path.substr(last_delim,std::string::npos);
+#endif //LOG_PLATFORM_WINDOWS
+    }
+
+	static std::string get_process_file_name()
+	{
+		std::string full_name = get_process_full_file_name();
+
+        size_t start = full_name.find_last_of('/');
+        if (start != std::string::npos)
+            start++;
+        else
+            start = 0;
+
+		size_t count = full_name.find_last_of(".");
+        return full_name.substr(start,count);
+	}
+};
+
+//////////////////////////////////////////////////////////////
+
+#if LOG_USE_MODULEDEFINITION
+
+// Finds name of module by address. Names are interned, so returned pointer is valid while cache lives.
+// With LOG_USE_MODULES_CACHE lookup is lock free binary search over sorted immutable array of module address ranges
+// published through atomic pointer. Array is rebuilt only on lookup miss and only if set of loaded modules was changed
+class module_cache
+{
+public:
+	module_cache()
+		:table_(NULL)
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_INIT(&lock_, NULL);
+#endif //LOG_MULTITHREADED
+	}
+
+	~module_cache()
+	{
+		delete table_;
+
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_DESTROY(&lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	// Module name found by cache. Name belongs to table of one generation of modules, the table is not freed
+	// while reference exists, so reference is kept on stack only: for one message
+	class name_ref
+	{
+	public:
+		explicit name_ref(const module_cache* owner)
+			:section_(owner->readers_), name_("")
+		{}
+
+		const char* c_str() const
+		{
+#if LOG_USE_MODULES_CACHE
+			return name_;
+#else //LOG_USE_MODULES_CACHE
+			return name_str_.c_str();
+#endif //LOG_USE_MODULES_CACHE
+		}
+
+	private:
+		friend class module_cache;
+
+		grace_period::section section_;
+		const char* name_;
+#if !LOG_USE_MODULES_CACHE
+		std::string name_str_;
+#endif //!LOG_USE_MODULES_CACHE
+	};
+
+	// Returns full image name of module which contains address or empty string. Table is built again when
+	// modules were loaded or unloaded, so name of module loaded again at the same address is not stale
+	name_ref find(void* ptr)
+	{
+		name_ref result(this);
+		intptr_t addr = reinterpret_cast<intptr_t>(ptr);
+
+		if (!addr)
+			return result;
+
+#if LOG_USE_MODULES_CACHE
+		unsigned long generation = query_generation();
+		const table_t* table = get_table();
+		const char* name = table && table->generation == generation ? find_in_table(table, addr) : NULL;
+
+		if (!name)
+		{
+			lock();
+
+			// other thread could rebuild table while this one waited for lock
+			table = get_table();
+			if (!table || table->generation != generation)
+				rebuild(generation);
+
+			name = find_in_table(get_table(), addr);
+			unlock();
+		}
+
+		if (name)
+			result.name_ = name;
+#else //LOG_USE_MODULES_CACHE
+		lock();
+		result.name_str_ = module_definition::module_name_by_addr(ptr);
+		unlock();
+#endif //LOG_USE_MODULES_CACHE
+
+		return result;
+	}
+
+	// Lookup in already built table only: no locks, no allocations, so it can be used from signal handler and
+	// under locks which must not be taken before module cache lock. Base is load address of module
+	name_ref find_no_update(void* ptr, intptr_t& base) const
+	{
+		name_ref result(this);
+		base = 0;
+
+#if LOG_USE_MODULES_CACHE
+		const range_t* range = find_range(get_table(), reinterpret_cast<intptr_t>(ptr));
+
+		if (range)
+		{
+			base = range->bias;
+			result.name_ = range->name;
+		}
+#else //LOG_USE_MODULES_CACHE
+		(void)ptr;
+#endif //LOG_USE_MODULES_CACHE
+
+		return result;
+	}
+
+	// Builds table again if modules were loaded or unloaded, so following find_no_update finds them
+	void update()
+	{
+#if LOG_USE_MODULES_CACHE
+		unsigned long generation = query_generation();
+		const table_t* table = get_table();
+
+		if (table && table->generation == generation)
+			return;
+
+		lock();
+
+		table = get_table();
+		if (!table || table->generation != generation)
+			rebuild(generation);
+
+		unlock();
+#endif //LOG_USE_MODULES_CACHE
+	}
+
+	// Blocks table rebuilding (and so enumeration of modules inside loader lock)
+	void lock()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	void unlock()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	// Threads which used module names in parent process do not exist in child, their references are dropped
+	void drop_readers_after_fork() { readers_.drop_readers_after_fork(); }
+
+	// Changes each time module is loaded or unloaded
+	static unsigned long query_generation()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		HMODULE modules[1];
+		DWORD bytes_needed = 0;
+
+		EnumProcessModules(GetCurrentProcess(), modules, sizeof(modules), &bytes_needed);
+		return bytes_needed / sizeof(HMODULE);
+#else //LOG_PLATFORM_WINDOWS
+		unsigned long generation = 0;
+		dl_iterate_phdr(&generation_callback, &generation);
+		return generation;
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+private:
+	struct range_t
+	{
+		intptr_t start;
+		intptr_t end;
+		intptr_t bias; // load address, offsets relative to it are file addresses of module
+		const char* name; // owned by names of table
+
+		bool operator < (const range_t& other) const { return start < other.start; }
+	};
+
+	// Modules of one generation, table is immutable after it is published
+	struct table_t
+	{
+		std::vector<range_t> ranges;
+		std::set<std::string> names;
+		unsigned long generation;
+
+		const char* intern(const std::string& name)
+		{
+			return names.insert(name).first->c_str();
+		}
+	};
+
+	const table_t* volatile table_;
+	retired_list<table_t> retired_tables_;
+	grace_period readers_;
+
+#if LOG_MULTITHREADED
+	LOG_MT_MUTEX lock_;
+#endif //LOG_MULTITHREADED
+
+	__inline const table_t* get_table() const
+	{
+		return static_cast<const table_t*>(atomic_ops::load_ptr((void* const volatile*)&table_));
+	}
+
+	static const range_t* find_range(const table_t* table, intptr_t addr)
+	{
+		if (!table || !table->ranges.size())
+			return NULL;
+
+		range_t key;
+		key.start = addr;
+
+		// last range which starts not after address
+		std::vector<range_t>::const_iterator it = std::upper_bound(table->ranges.begin(), table->ranges.end(), key);
+		if (it == table->ranges.begin())
+			return NULL;
+
+		--it;
+		return addr < it->end ? &*it : NULL;
+	}
+
+	static const char* find_in_table(const table_t* table, intptr_t addr)
+	{
+		const range_t* range = find_range(table, addr);
+		return range ? range->name : NULL;
+	}
+
+	// Called under lock
+	void rebuild(unsigned long generation)
+	{
+		table_t* table = new table_t();
+		table->generation = generation;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		std::list<module_entry_t> modules;
+		module_definition::query_module_list(modules);
+
+		for (std::list<module_entry_t>::iterator i=modules.begin(); i!=modules.end(); i++)
+		{
+			range_t range;
+			range.start = i->baseAddress;
+			range.end = i->baseAddress + i->size;
+			range.bias = i->baseAddress;
+			range.name = table->intern(i->imageName);
+			table->ranges.push_back(range);
+		}
+#else //LOG_PLATFORM_WINDOWS
+		dl_iterate_phdr(&collect_ranges_callback, table);
+#endif //LOG_PLATFORM_WINDOWS
+
+		std::sort(table->ranges.begin(), table->ranges.end());
+
+		// readers may still use previous table and its names, so it is freed after grace period
+		table_t* retired = const_cast<table_t*>(table_);
+		atomic_ops::store_ptr((void* volatile*)&table_, table);
+
+		if (retired)
+			retired_tables_.retire(retired, readers_);
+	}
+
+#ifndef LOG_PLATFORM_WINDOWS
+	static int generation_callback(struct dl_phdr_info* info, size_t size, void* data)
+	{
+		unsigned long* generation = static_cast<unsigned long*>(data);
+
+		// counters of loaded and unloaded objects are the same for each object, so first one is enough
+		if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+		{
+			*generation = static_cast<unsigned long>(info->dlpi_adds + info->dlpi_subs);
+			return 1;
+		}
+
+		// old loader: number of objects is used instead
+		(*generation)++;
+		return 0;
+	}
+
+	static int collect_ranges_callback(struct dl_phdr_info* info, size_t size, void* data)
+	{
+		table_t* table = static_cast<table_t*>(data);
+
+		if (!info || size < offsetof(struct dl_phdr_info, dlpi_phnum) + sizeof(info->dlpi_phnum))
+			return 0;
+
+		range_t range;
+		range.start = 0;
+		range.end = 0;
+		range.bias = info->dlpi_addr;
+
+		for (int j = 0; j < info->dlpi_phnum; j++)
+		{
+			if (info->dlpi_phdr[j].p_type != PT_LOAD)
+				continue;
+
+			intptr_t start = info->dlpi_addr + info->dlpi_phdr[j].p_vaddr;
+			intptr_t end = start + info->dlpi_phdr[j].p_memsz;
+
+			if (!range.end || start < range.start)
+				range.start = start;
+
+			if (range.end < end)
+				range.end = end;
+		}
+
+		if (!range.end)
+			return 0;
+
+		// main executable has empty name
+		range.name = table->intern(strlen(info->dlpi_name) ? std::string(info->dlpi_name) : utils::do_readlink(LOG_SELF_PROC_LINK));
+		table->ranges.push_back(range);
+
+		return 0;
+	}
+#endif //LOG_PLATFORM_WINDOWS
+};
+
+#endif //LOG_USE_MODULEDEFINITION
+
+//////////////////////////////////////////////////////////////
+#if LOG_UNHANDLED_EXCEPTIONS
+    static void init_unhandled_exceptions_handler();
+#endif //LOG_UNHANDLED_EXCEPTIONS
+
+//////////////////////////////////////////////////////////////
+
+#if (LOG_CONFIGURE_FROM_REGISTRY || LOG_USE_SYSTEMINFO) && defined(LOG_PLATFORM_WINDOWS)
+#	define LOG_DEFINE_REGISTRY_HELPER
+#endif //(LOG_CONFIGURE_FROM_REGISTRY || LOG_USE_SYSTEMINFO) && defined(LOG_PLATFORM_WINDOWS)
+
+#ifdef LOG_DEFINE_REGISTRY_HELPER
+struct log_registry_helper
+{
+	static HKEY reg_base_key_by_string(const std::string& storage)
+	{
+		if (storage == "HKLM" || storage == "HKEY_LOCAL_MACHINE")
+			return HKEY_LOCAL_MACHINE;
+
+		if (storage == "HKCU" || storage == "HKEY_CURRENT_USER")
+			return HKEY_CURRENT_USER;
+
+		if (storage == "HKCR" || storage == "HKEY_CLASSES_ROOT")
+			return HKEY_CLASSES_ROOT;
+
+		if (storage == "HKU" || storage == "HKEY_USERS")
+			return HKEY_USERS;
+
+		return HKEY_CURRENT_USER;
+	}
+
+	static bool get_reg_dword_value(HKEY baseKey, const std::string& regPath, 
+		const std::string& valueName, unsigned long& value)
+	{
+		HKEY   hkey ;
+		LONG ret = RegOpenKeyExA(baseKey, regPath.c_str(), 0, KEY_QUERY_VALUE, &hkey);
+		if (ret != ERROR_SUCCESS)
+			return false;
+
+		DWORD size = 0;
+		DWORD type;
+		ret = -1;
+		RegQueryValueExA(hkey,valueName.c_str(),0,&type,NULL,&size);
+
+		if (type == REG_DWORD)
+		{
+			size = sizeof(long);
+			ret = RegQueryValueExA(hkey,valueName.c_str(),0,&type,(BYTE*)&value,&size);
+		}
+
+		RegCloseKey(hkey);
+		return ret == ERROR_SUCCESS;
+	}
+
+	static bool get_reg_sz_value(HKEY baseKey, const std::string& regPath, 
+		const std::string& valueName, std::string& result)
+	{
+		HKEY   hkey ;
+		LONG ret = RegOpenKeyExA(baseKey, regPath.c_str(), 0, KEY_QUERY_VALUE, &hkey);
+		if (ret != ERROR_SUCCESS)
+			return false;
+
+		DWORD size = 0;
+		DWORD type;
+		ret = -1;
+		RegQueryValueExA(hkey,valueName.c_str(),0,&type,NULL,&size);
+
+		if (type == REG_SZ)
+		{
+			size_t bufSize = 512;
+
+			std::string value;
+			value.resize(bufSize);
+
+			DWORD size = static_cast<DWORD>(value.length())+1;
+			ret = RegQueryValueExA(hkey,valueName.c_str(),0,&type,(BYTE*)value.data(),&size);
+
+			while(ret == ERROR_MORE_DATA)
+			{
+				bufSize += 256;
+				value.resize(bufSize);
+
+				size = static_cast<DWORD>(value.length())+1;
+				ret = RegQueryValueExA(hkey,valueName.c_str(),NULL,&type,(BYTE*)value.data(),&size);
+			}
+
+			if (ret == ERROR_SUCCESS)
+				result = value.c_str();
+		}
+
+		RegCloseKey(hkey);
+		return ret == ERROR_SUCCESS;
+	}
+};
+#endif //LOG_DEFINE_REGISTRY_HELPER
+
+//////////////////////////////////////////////////////////////
+#if LOG_USE_SYSTEMINFO
+
+	static std::string get_processor_arch()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+        SYSTEM_INFO si;
+		::GetSystemInfo(&si);
+
+		std::string processorInfo;
+
+		switch (si.wProcessorArchitecture)
+		{
+			case PROCESSOR_ARCHITECTURE_INTEL:
+				processorInfo += "IA-32";
+				break;
+			case PROCESSOR_ARCHITECTURE_AMD64:
+				processorInfo += "AMD64";
+				break;
+			case PROCESSOR_ARCHITECTURE_IA64:
+				processorInfo += "IA64";
+				break;
+			case PROCESSOR_ARCHITECTURE_UNKNOWN:
+			default:
+				processorInfo += "Unknown";
+		}
+		processorInfo += stringformat(", count: %d", si.dwNumberOfProcessors);
+		return processorInfo;
+#else //LOG_PLATFORM_WINDOWS
+
+
+#ifdef LOG_HAVE_SYS_UTSNAME_H
+        struct utsname osname;
+        uname(&osname);
+
+        return osname.machine;
+#else //LOG_HAVE_SYS_UTSNAME_H
+	if (sizeof(int) == 4)
+	    return "32-bit";
+
+	if (sizeof(int) == 8)
+	    return "64-bit";
+
+	if (sizeof(int) == 2)
+	    return "16-bit";
+
+	if (sizeof(int) == 16)
+	    return "128-bit";
+
+	return std::string();
+#endif //LOG_HAVE_SYS_UTSNAME_H
+
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+#   ifdef LOG_PLATFORM_WINDOWS
+    static bool is_wow64_used()
+	{
+		BOOL isWow;
+		::IsWow64Process(::GetCurrentProcess(),&isWow);
+		return isWow ? true : false;
+	}
+
+	typedef void (WINAPI *GetNativeSystemInfo_t)(LPSYSTEM_INFO);
+	typedef BOOL (WINAPI *GetProductInfo_t)(DWORD, DWORD, DWORD, DWORD, PDWORD);
+
+
+#   endif //LOG_PLATFORM_WINDOWS
+
+	static bool get_os_version_display_string(std::string& os_version)
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+
+#ifndef VER_SUITE_WH_SERVER
+#define VER_SUITE_WH_SERVER 0x00008000
+#endif
+
+#ifndef PRODUCT_PROFESSIONAL
+#define PRODUCT_PROFESSIONAL 0x00000030
+#endif
+
+		OSVERSIONINFOEXA osvi;
+		SYSTEM_INFO si;
+		DWORD dwType;
+
+		os_version = "";
+		ZeroMemory(&si, sizeof(SYSTEM_INFO));
+		ZeroMemory(&osvi, sizeof(OSVERSIONINFOEXA));
+		osvi.dwOSVersionInfoSize = sizeof(OSVERSIONINFOEXA);
+
+		if (!GetVersionExA((OSVERSIONINFOA*) &osvi))
+			return false;
+
+		GetNativeSystemInfo_t getNativeSystemInfoFn = reinterpret_cast<GetNativeSystemInfo_t>(
+			GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetNativeSystemInfo"));
+
+		if (getNativeSystemInfoFn != NULL)
+			getNativeSystemInfoFn(&si);
+		else GetSystemInfo(&si);
+
+		if (VER_PLATFORM_WIN32_NT!=osvi.dwPlatformId || osvi.dwMajorVersion <= 4)
+			return false;
+
+		os_version += "Microsoft ";
+
+		if ( osvi.dwMajorVersion == 6 )
+		{
+			if( osvi.dwMinorVersion == 0 )
+			{
+				if( osvi.wProductType == VER_NT_WORKSTATION )
+					os_version += "Windows Vista ";
+				else 
+					os_version += "Windows Server 2008 ";
+			}
+
+			if ( osvi.dwMinorVersion == 1 )
+			{
+				if( osvi.wProductType == VER_NT_WORKSTATION )
+					os_version += "Windows 7 ";
+				else 
+					os_version += "Windows Server 2008 R2 ";
+			}
+
+			if ( osvi.dwMinorVersion == 2 )
+			{
+				if( osvi.wProductType == VER_NT_WORKSTATION )
+					os_version += "Windows 8 ";
+				else 
+					os_version += "Windows Server 2012 ";
+			}
+
+
+			if ( osvi.dwMinorVersion == 3 )
+			{
+				if( osvi.wProductType == VER_NT_WORKSTATION )
+					os_version += "Windows 8.1 ";
+				else 
+					os_version += "Windows Server 2012 R2 ";
+			}
+
+		 GetProductInfo_t pGPI = reinterpret_cast<GetProductInfo_t>(
+			 GetProcAddress(GetModuleHandle(TEXT("kernel32.dll")), "GetProductInfo"));
+		 pGPI( osvi.dwMajorVersion, osvi.dwMinorVersion, 0, 0, &dwType);
+
+		 switch( dwType )
+		 {
+			case PRODUCT_ULTIMATE: os_version += "Ultimate Edition";  break;
+			case PRODUCT_PROFESSIONAL: os_version += "Professional";  break;
+			case PRODUCT_HOME_PREMIUM: os_version += "Home Premium Edition";  break;
+			case PRODUCT_HOME_BASIC: os_version += "Home Basic Edition";  break;
+			case PRODUCT_ENTERPRISE:  os_version += "Enterprise Edition";  break;
+			case PRODUCT_BUSINESS: os_version += "Business Edition";  break;
+			case PRODUCT_STARTER: os_version += "Starter Edition";  break;
+			case PRODUCT_CLUSTER_SERVER:  os_version += "Cluster Server Edition";  break;
+			case PRODUCT_DATACENTER_SERVER:  os_version += "Datacenter Edition";  break;
+			case PRODUCT_DATACENTER_SERVER_CORE:  os_version += "Datacenter Edition (core installation)";  break;
+			case PRODUCT_ENTERPRISE_SERVER:  os_version += "Enterprise Edition";  break;
+			case PRODUCT_ENTERPRISE_SERVER_CORE: os_version += "Enterprise Edition (core installation)"; break;
+			case PRODUCT_ENTERPRISE_SERVER_IA64: os_version += "Enterprise Edition for Itanium-based Systems"; break;
+			case PRODUCT_SMALLBUSINESS_SERVER: os_version += "Small Business Server";  break;
+			case PRODUCT_SMALLBUSINESS_SERVER_PREMIUM: os_version += "Small Business Server Premium Edition"; break;
+			case PRODUCT_STANDARD_SERVER: os_version += "Standard Edition"; break;
+			case PRODUCT_STANDARD_SERVER_CORE:  os_version += "Standard Edition (core installation)";  break;
+			case PRODUCT_WEB_SERVER: os_version += "Web Server Edition";  break;
+		 }
+		}
+
+		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 2 )
+		{
+		 if( GetSystemMetrics(SM_SERVERR2) )
+			os_version += "Windows Server 2003 R2, ";
+		 else if ( osvi.wSuiteMask & VER_SUITE_STORAGE_SERVER )
+			os_version +=  "Windows Storage Server 2003";
+		 else if ( osvi.wSuiteMask & VER_SUITE_WH_SERVER )
+			os_version += "Windows Home Server";
+		 else if( osvi.wProductType == VER_NT_WORKSTATION &&
+				  si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64)
+		 {
+			os_version += "Windows XP Professional x64 Edition";
+		 }
+		 else os_version += "Windows Server 2003, ";
+
+		 // Test for the server type.
+		 if ( osvi.wProductType != VER_NT_WORKSTATION )
+		 {
+			if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_IA64 )
+			{
+				if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
+				   os_version +=  "Datacenter Edition for Itanium-based Systems";
+				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
+				   os_version += "Enterprise Edition for Itanium-based Systems";
+			}
+
+			else if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64 )
+			{
+				if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
+				   os_version += "Datacenter x64 Edition";
+				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
+				   os_version += "Enterprise x64 Edition";
+				else os_version += "Standard x64 Edition";
+			}
+			else
+			{
+				if ( osvi.wSuiteMask & VER_SUITE_COMPUTE_SERVER )
+				   os_version += "Compute Cluster Edition";
+				else if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
+				   os_version += "Datacenter Edition";
+				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
+				   os_version += "Enterprise Edition";
+				else if ( osvi.wSuiteMask & VER_SUITE_BLADE )
+				   os_version += "Web Edition";
+				else os_version += "Standard Edition";
+			}
+		 }
+		}
+
+		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 1 )
+		{
+		 os_version += "Windows XP ";
+		 if( osvi.wSuiteMask & VER_SUITE_PERSONAL )
+			os_version += "Home Edition";
+		 else os_version += "Professional";
+		}
+
+		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 0 )
+		{
+		 os_version += "Windows 2000 ";
+
+		 if ( osvi.wProductType == VER_NT_WORKSTATION )
+		 {
+			os_version += "Professional";
+		 }
+		 else 
+		 {
+			if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
+			   os_version += "Datacenter Server";
+			else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
+			   os_version += "Advanced Server";
+			else os_version += "Server";
+		 }
+		}
+
+		if( strlen(osvi.szCSDVersion) > 0 )
+		{
+		  os_version += " ";
+		  os_version += osvi.szCSDVersion;
+		}
+
+		os_version += stringformat(" (build %d)", osvi.dwBuildNumber);
+
+		if ( osvi.dwMajorVersion >= 6 )
+		{
+		 if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64 )
+			os_version += ", 64-bit";
+		 else if (si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_INTEL )
+			os_version += ", 32-bit";
+		}
+
+		return true; 
+#else //LOG_PLATFORM_WINDOWS
+
+#ifdef LOG_HAVE_SYS_UTSNAME_H
+        struct utsname osname;
+        uname(&osname);
+
+        os_version = osname.sysname;
+        os_version += " ";
+        os_version += osname.release;
+        os_version += " ";
+        os_version += osname.version;
+
+#else //LOG_HAVE_SYS_UTSNAME_H
+
+	os_version = "Posix-based ";
+#	ifdef LOG_PLATFORM_UNIX
+	os_version += "Unix ";
+#	endif //LOG_PLATFORM_UNIX
+
+#	ifdef LOG_PLATFORM_BSD
+	os_version += "BSD ";
+#	endif //LOG_PLATFORM_BSD
+
+#	ifdef LOG_PLATFORM_LINUX
+	os_version += "Linux ";
+#	endif //LOG_PLATFORM_LINUX
+
+#	ifdef LOG_PLATFORM_CYGWIN
+	os_version += "CYGWIN ";
+#	endif //LOG_PLATFORM_CYGWIN
+
+#	ifdef LOG_PLATFORM_FREEBSD
+	os_version += "FreeBSD ";
+#	endif //LOG_PLATFORM_FREEBSD
+
+#	ifdef LOG_PLATFORM_NETBSD
+	os_version += "NetBSD ";
+#	endif //LOG_PLATFORM_NETBSD
+
+#	ifdef LOG_PLATFORM_DRAGONFLYBSD
+	os_version += "DragonFlyBSD";
+#	endif //LOG_PLATFORM_DRAGONFLYBSD
+
+#	ifdef LOG_PLATFORM_SOLARIS
+	os_version += "Solaris ";
+#	endif //LOG_PLATFORM_SOLARIS
+
+#	ifdef LOG_PLATFORM_MAC
+	os_version += "Mac-based ";
+#	endif //LOG_PLATFORM_MAC
+
+#	ifdef LOG_PLATFORM_MACOSX
+	os_version += "MacOSX ";
+#	endif //LOG_PLATFORM_MACOSX
+
+#	ifdef LOG_PLATFORM_IPHONE
+	os_version += "IPhone ";
+#	endif //LOG_PLATFORM_IPHONE
+
+#	ifdef LOG_PLATFORM_IPHONESIMULATOR
+	os_version += "Simulator ";
+#	endif //LOG_PLATFORM_IPHONESIMULATOR
+
+#endif //LOG_HAVE_SYS_UTSNAME_H
+
+        return true;
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+#ifdef LOG_PLATFORM_WINDOWS
+	static bool get_os_version_display_string2(std::string& os_version)
+	{
+		bool result;
+		
+		os_version = "";
+
+		// Get version from registry
+		std::string regProductName;
+		std::string regEditionId;
+		std::string regCurrentVersion;
+		std::string regCurrentBuildNumber;
+
+		result = log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "ProductName", regProductName);
+		result &= log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "CurrentVersion", regCurrentVersion);
+		result &= log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "CurrentBuildNumber", regCurrentBuildNumber);
+		log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "EditionID", regEditionId);
+
+		if (result)
+			os_version = regProductName + std::string(" (") + regEditionId + std::string(") / Version ") + regCurrentVersion + std::string(" / Build ") + regCurrentBuildNumber;
+
+		return result;
+	}
+#endif //LOG_PLATFORM_WINDOWS
+
+
+	static bool get_host_name(std::string& name)
+	{
+	    name = "";
+
+#ifdef LOG_PLATFORM_WINDOWS
+        char buffer[MAX_PATH];
+		DWORD size = sizeof(buffer);
+
+		if (!::GetComputerNameExA(ComputerNamePhysicalDnsFullyQualified, buffer, &size))
+		{
+			if (!::GetComputerNameA(buffer, &size))
+				return false;
+		}
+
+		name = buffer;
+#else //LOG_PLATFORM_WINDOWS
+
+#ifdef LOG_HAVE_SYS_UTSNAME_H
+        struct utsname osname;
+        uname(&osname);
+        name = osname.nodename;
+#endif //LOG_HAVE_SYS_UTSNAME_H
+
+#endif //LOG_PLATFORM_WINDOWS
+		return true;
+	}
+
+
+	static std::string get_memory_status()
+	{
+        std::string memoryString;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		MEMORYSTATUSEX memoryStatus;
+		memset(&memoryStatus,0,sizeof(MEMORYSTATUSEX));
+		memoryStatus.dwLength = sizeof(MEMORYSTATUSEX);
+
+		if (!GlobalMemoryStatusEx(&memoryStatus))
+			return "";
+
+        memoryString = stringformat("Total physical " LOG_FMT_I64 ", Total virtual " LOG_FMT_I64, memoryStatus.ullTotalPhys, memoryStatus.ullTotalVirtual);
+		memoryString += stringformat("\nAvailable physical " LOG_FMT_I64 ", available virtual " LOG_FMT_I64 ", Load %d%%", memoryStatus.ullAvailPhys, memoryStatus.ullAvailVirtual, memoryStatus.dwMemoryLoad);
+		memoryString += stringformat("\nPage file size: " LOG_FMT_I64 ", page memory available " LOG_FMT_I64, memoryStatus.ullTotalPageFile, memoryStatus.ullAvailPageFile);
+#else //LOG_PLATFORM_WINDOWS
+
+#ifdef LOG_HAVE_SYS_SYSINFO_H
+        struct sysinfo info;
+        sysinfo(&info);
+
+        memoryString = stringformat("Total avail RAM %d, total swap %d, total high %d", info.totalram, info.totalswap, info.totalhigh);
+        memoryString += stringformat("\nFree RAM %d, free swap %d, free high %d", info.freeram, info.freeswap, info.freehigh);
+        memoryString += stringformat("\nMem used by buffers %d, shared RAM %d", info.bufferram, info.sharedram);
+        memoryString += stringformat("\nMemory unit in bytes %d, process count: %d", info.mem_unit, info.procs);
+        memoryString += stringformat("\nAvg load 1 min : 5 min : 15 min  --  %d:%d:%d", info.loads[0], info.loads[1], info.loads[2]);
+#endif //LOG_HAVE_SYS_SYSINFO_H
+
+#endif //LOG_PLATFORM_WINDOWS
+
+		return memoryString;
+	}
+
+	static std::string get_current_user_name()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+		char buf[MAX_PATH];
+		unsigned long bufferSize = sizeof(buf);
+		GetUserNameA(buf,&bufferSize);
+		return buf;
+#else //LOG_PLATFORM_WINDOWS
+
+#ifdef LOG_HAVE_PWD_H
+        struct passwd* pass;
+        pass = getpwuid(getuid());
+
+        if (!pass)
+            return "(unknown)";
+
+        return pass->pw_name;
+#else //LOG_HAVE_PWD_H
+	return "(cannot be obtained)";
+#endif //LOG_HAVE_PWD_H
+
+#endif //LOG_PLATFORM_WINDOWS
+	}
+
+	static std::string get_current_user_sid()
+	{
+#ifdef LOG_PLATFORM_WINDOWS
+        HANDLE hToken;
+
+		OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken);
+
+		DWORD len = 0;
+		GetTokenInformation(hToken, TokenUser, 0, 0, &len);
+
+		TOKEN_USER* pUser = (TOKEN_USER*)malloc(len);
+
+		GetTokenInformation(hToken, TokenUser, pUser, len, &len);
+
+		char* sid = 0;
+		ConvertSidToStringSidA(pUser->User.Sid, &sid);
+		
+		std::string result = sid;
+
+		CloseHandle(hToken);
+		LocalFree(sid);
+		free(pUser);
+
+		return result;
+#else // LOG_PLATFORM_WINDOWS
+
+#ifdef LOG_HAVE_PWD_H
+        std::string result = stringformat("%d", getuid());
+
+        struct passwd* pass;
+        pass = getpwuid(getuid());
+        if (pass)
+        {
+            result += std::string(":");
+            result += stringformat("%d",pass->pw_gid);
+        }
+
+        return result;
+#else //LOG_HAVE_PWD_H
+	return std::string();
+#endif //LOG_HAVE_PWD_H
+
+#endif // LOG_PLATFORM_WINDOWS
+	}
+
+
+	static std::string query_system_info()
+	{
+		std::stringstream system_info;
+		system_info << "*********** SYSTEM INFORMATION *************" << std::endl;
+
+		std::string os_info;
+		if (get_os_version_display_string(os_info))
+			system_info << "OS: " << os_info << std::endl;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		if (get_os_version_display_string2(os_info))
+			system_info << "OS from registry: " << os_info << std::endl;
+#endif //LOG_PLATFORM_WINDOWS
+
+		system_info << "Processor architecture: " << get_processor_arch() << std::endl;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		if (is_wow64_used())
+			system_info << "Used WOW64" << std::endl;
+#endif //LOG_PLATFORM_WINDOWS
+
+		std::string hostName;
+		if (get_host_name(hostName))
+			system_info << "Host Name: " << hostName << std::endl;
+
+#ifdef LOG_PLATFORM_WINDOWS
+        system_info << stringformat("Current tick count: %d",GetTickCount()) << std::endl;
+#else //LOG_PLATFORM_WINDOWS
+
+#	ifdef LOG_HAVE_SYS_SYSINFO_H
+        struct sysinfo info;
+        sysinfo(&info);
+
+        system_info << stringformat("Uptime, seconds: %d", info.uptime) << std::endl;
+#	endif //LOG_HAVE_SYS_SYSINFO_H
+
+#endif //LOG_PLATFORM_WINDOWS
+
+        system_info << "Current user SID: " << get_current_user_sid() << std::endl;
+		system_info << "Current user name: " <<  get_current_user_name() << std::endl;
+
+		system_info << "--- MEMORY ---" << std::endl;
+		system_info << get_memory_status() << std::endl;
+
+		system_info << "--- CURRENT MODULE ---" << std::endl;
+
+		std::string module_name = utils::get_process_file_name();
+
+#if LOG_USE_MODULEDEFINITION
+		std::string detected_name = module_definition::module_name_by_addr((void*)&query_system_info);
+		if (detected_name.length())
+			module_name = detected_name;
+#endif //LOG_USE_MODULEDEFINITION
+
+		system_info << "Module Name: " << module_name << std::endl;
+
+#if LOG_USE_MODULEDEFINITION && defined(LOG_PLATFORM_WINDOWS)
+		HMODULE module = reinterpret_cast<HMODULE>(pe_image::api_find_module_entry_point(
+			reinterpret_cast<intptr_t>(logging_get_caller_address())));
+		
+		std::string file_version, file_description;
+        std::string product_version, company_name;
+        unsigned long lang_id = 0;
+
+        if (module_definition::module_query_version_info(module, file_version, file_description, product_version, company_name, lang_id))
+		{
+			if (file_version.size())
+				system_info << "Module file version: " << file_version << std::endl;
+
+			if (file_description.size())
+				system_info << "Module file description: " << file_description << std::endl;
+
+			if (product_version.size())
+				system_info << "Product version: " << product_version << std::endl;
+
+			if (company_name.size())
+				system_info << "Module company name: " << company_name << std::endl;
+
+			if (lang_id)
+				system_info << "Module language ID: " << stringformat("%.X", lang_id) << std::endl;
+		}
+#endif //LOG_USE_MODULEDEFINITION && defined(LOG_PLATFORM_WINDOWS)
+
+#ifdef LOG_PLATFORM_WINDOWS
+		system_info << "--- SYSTEM PATHS ---" << std::endl;
+		
+		char buffer[MAX_PATH+1];
+		GetWindowsDirectoryA(buffer, MAX_PATH);
+		system_info << "Windows dir: " << buffer << std::endl;
+
+		GetSystemDirectoryA(buffer, MAX_PATH);
+		system_info << "System dir: " << buffer << std::endl;
+
+		GetTempPathA(MAX_PATH, buffer);
+		system_info << "Temp dir: " << buffer << std::endl;
+#endif //LOG_PLATFORM_WINDOWS
+
+		system_info << "********************************************" << std::endl;
+		return system_info.str();
+	}
+#endif // LOG_USE_SYSTEMINFO
+	
+////////////////////////////////////////////
+
+
+static const char* default_hdr_format = "[$(V)] $(dd).$(MM).$(yyyy) $(hh):$(mm):$(ss).$(ttt) [$(PID):$(TID)] [$(module)!$(function)]";
+
+// Header macros which have own member in structured output
+enum log_header_field_t
+{
+	log_field_level = 1,		// $(V), $(v)
+	log_field_time = 2,			// any of date and time macros
+	log_field_pid = 4,			// $(PID)
+	log_field_tid = 8,			// $(TID)
+	log_field_module = 16,		// $(module)
+	log_field_module_path = 32,	// $(MODULE)
+	log_field_function = 64,	// $(function)
+	log_field_srcfile = 128,	// $(srcfile)
+	log_field_line = 256,		// $(line)
+	log_field_ctx = 512,		// $(ctx)
+	log_field_seq = 1024		// $(seq)
+};
+
+// Immutable configuration snapshot. Published by log_configurator, never changed after publishing
+struct log_config_t
+{
+	std::string log_file_name;
+	std::string log_path;
+	std::string full_log_file_path;
+	std::string hdr_format;
+	int hdr_fields; // log_header_field_t flags of hdr_format
+	int output_format;
+	bool need_sys_info;
+	int verb_level;
+	size_t scroll_file_size;
+	size_t scroll_file_count;
+	bool scroll_file_every_run;
+	std::string fork_log_file_name; // macros are processed in child process, so $(PID) is PID of child
+#if LOG_FLIGHT_RECORDER
+	int flight_recorder_dump_level;
+#endif //LOG_FLIGHT_RECORDER
+	unsigned long version; // number of snapshot, compared instead of pointer because retired snapshots are freed
+
+	log_config_t()
+		:hdr_fields(0), output_format(log_output_text), need_sys_info(true), verb_level(logger_verbose_optimal),
+		scroll_file_size(2097152), scroll_file_count(15), scroll_file_every_run(false)
+#if LOG_FLIGHT_RECORDER
+		,flight_recorder_dump_level(LOG_FLIGHT_RECORDER_DUMP_LEVEL)
+#endif //LOG_FLIGHT_RECORDER
+		,version(1)
+	{}
+};
+
+class log_configurator
+{
+public:
+	log_configurator()
+		:config_(NULL)
+#if LOG_LOAD_SHEDDING
+		,shed_levels_(0)
+		,shed_dropped_(0)
+#endif //LOG_LOAD_SHEDDING
+#if LOG_CONFIGURE_FROM_REGISTRY
+		,reg_config_path_("")
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+
+#if LOG_INI_CONFIGURATION
+		,ini_file_find_paths_(process_config_macro(LOG_DEFAULT_INI_PATHS))
+#endif //LOG_INI_CONFIGURATION
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_INIT(&update_lock_, NULL);
+#endif //LOG_MULTITHREADED
+
+		log_config_t* config = new log_config_t();
+		config->log_file_name = utils::get_process_file_name() + ".log";
+		config->log_path = utils::get_process_file_path();
+		config->hdr_format = default_hdr_format;
+		config->hdr_fields = query_hdr_fields(config->hdr_format);
+		config->full_log_file_path = config->log_path + "/" + config->log_file_name;
+		config_ = config;
+
+#if LOG_UNHANDLED_EXCEPTIONS
+		init_unhandled_exceptions_handler();
+#endif //LOG_UNHANDLED_EXCEPTIONS
+	}
+
+	~log_configurator()
+	{
+		delete config_;
+
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_DESTROY(&update_lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	// Reference to configuration snapshot. While any reference exists, snapshot it points to and all snapshots
+	// published after it are not freed. Reference is kept on stack only: for one message or one writer iteration
+	class config_ref
+	{
+	public:
+		explicit config_ref(const log_configurator* owner)
+			:section_(owner->readers_)
+		{
+			config_ = static_cast<const log_config_t*>(atomic_ops::load_ptr((void* const volatile*)&owner->config_));
+		}
+
+		const log_config_t* get() const { return config_; }
+		const log_config_t* operator->() const { return config_; }
+		const log_config_t& operator*() const { return *config_; }
+
+	private:
+		grace_period::section section_;
+		const log_config_t* config_;
+	};
+
+	// Current configuration snapshot, object is never changed. Retired snapshot is freed after grace period:
+	// when all references taken before it was replaced are released
+	__inline config_ref get_config() const
+	{
+		return config_ref(this);
+	}
+
+	// Start batch modification: returns copy of current snapshot. Must be finished by commit_update or cancel_update
+	log_config_t* begin_update()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&update_lock_);
+#endif //LOG_MULTITHREADED
+		return new log_config_t(*config_);
+	}
+
+	void commit_update(log_config_t* config)
+	{
+		config->full_log_file_path = config->log_path + "/" + config->log_file_name;
+		config->hdr_fields = query_hdr_fields(config->hdr_format);
+
+		config->version = config_->version + 1;
+
+		// readers may still hold previous snapshot, so it is freed after grace period
+		log_config_t* retired = const_cast<log_config_t*>(config_);
+		atomic_ops::store_ptr((void* volatile*)&config_, config);
+		retired_configs_.retire(retired, readers_);
+
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&update_lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	void cancel_update(log_config_t* config)
+	{
+		delete config;
+
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&update_lock_);
+#endif //LOG_MULTITHREADED
+	}
+
+	std::string get_hdr_format() const { return get_config()->hdr_format; }
+	void set_hdr_format(const std::string& headerFormat) { log_config_t* c = begin_update(); c->hdr_format = process_config_macro(headerFormat, false); commit_update(c); };
+
+	// log_output_format_t value
+	void set_output_format(int outputFormat) { log_config_t* c = begin_update(); c->output_format = outputFormat; commit_update(c); }
+	int get_output_format() const { return get_config()->output_format; }
+
+#if LOG_USE_SYSTEMINFO
+	void set_need_sys_info(bool needSystemInfo) { log_config_t* c = begin_update(); c->need_sys_info = needSystemInfo; commit_update(c); }
+	bool get_need_sys_info() const { return get_config()->need_sys_info; };
+#endif //LOG_USE_SYSTEMINFO
+
+	void set_log_file_name(std::string fileName) { log_config_t* c = begin_update(); c->log_file_name = process_config_macro(fileName); commit_update(c); }
+	std::string get_log_file_name() const { return get_config()->log_file_name; }
+
+	void set_verbose_level(int verboseLevel) { log_config_t* c = begin_update(); c->verb_level = verboseLevel; commit_update(c); }
+	int get_verbose_level() const { return get_config()->verb_level; }
+
+#if LOG_LOAD_SHEDDING
+	// Levels dropped by load shedding now, not part of configuration
+	void set_shed_levels(int levels) { atomic_ops::store(&shed_levels_, levels); }
+	int get_shed_levels() const { return static_cast<int>(atomic_ops::load(&shed_levels_)); }
+
+	// Messages dropped by load shedding since it was started
+	long get_shed_dropped() const { return atomic_ops::load(&shed_dropped_); }
+	void reset_shed_dropped() { atomic_ops::store(&shed_dropped_, 0); }
+
+	// true if message of this level is written now, messages dropped by load shedding are counted
+	bool is_level_enabled(int verb_level)
+	{
+		if (!(get_verbose_level() & verb_level))
+			return false;
+
+		if (get_shed_levels() & verb_level)
+		{
+			atomic_ops::fetch_add(&shed_dropped_, 1);
+			return false;
+		}
+
+		return true;
+	}
+#else //LOG_LOAD_SHEDDING
+	bool is_level_enabled(int verb_level) const { return (get_verbose_level() & verb_level) ? true : false; }
+#endif //LOG_LOAD_SHEDDING
+
+	void set_log_path(std::string logPath) { log_config_t* c = begin_update(); c->log_path = process_config_macro(logPath); commit_update(c); }
+	std::string get_log_path() const { return get_config()->log_path; }
+
+	void set_log_scroll_file_size(size_t scrollFileSize) { log_config_t* c = begin_update(); c->scroll_file_size = scrollFileSize; commit_update(c); }
+	size_t get_log_scroll_file_size() const { return get_config()->scroll_file_size; }
+
+	void set_log_scroll_file_count(size_t scrollFileCount) { log_config_t* c = begin_update(); c->scroll_file_count = scrollFileCount; commit_update(c); }
+	size_t get_log_scroll_file_count() const { return get_config()->scroll_file_count; }
+
+	void set_log_scroll_file_every_run(bool force_scroll) { log_config_t* c = begin_update(); c->scroll_file_every_run = force_scroll; commit_update(c); }
+	bool get_log_scroll_file_every_run() const { return get_config()->scroll_file_every_run; }
+
+	std::string get_full_log_file_path() const { return get_config()->full_log_file_path; }
+
+	// Log file name for child processes after fork. Empty name means same file as parent
+	void set_fork_log_file_name(std::string fileName) { log_config_t* c = begin_update(); c->fork_log_file_name = fileName; commit_update(c); }
+	std::string get_fork_log_file_name() const { return get_config()->fork_log_file_name; }
+
+#if LOG_FLIGHT_RECORDER
+	// Verbose levels of messages which cause flight recorder dump before them
+	void set_flight_recorder_dump_level(int verboseLevel) { log_config_t* c = begin_update(); c->flight_recorder_dump_level = verboseLevel; commit_update(c); }
+	int get_flight_recorder_dump_level() const { return get_config()->flight_recorder_dump_level; }
+#endif //LOG_FLIGHT_RECORDER
+
+#if LOG_MULTITHREADED
+	// Blocks configuration changes, used to bring update lock through fork in consistent state
+	void lock_updates() { LOG_MT_MUTEX_LOCK(&update_lock_); }
+	void unlock_updates() { LOG_MT_MUTEX_UNLOCK(&update_lock_); }
+
+	// Threads which read configuration in parent process do not exist in child, their references are dropped
+	void drop_readers_after_fork() { readers_.drop_readers_after_fork(); }
+#endif //LOG_MULTITHREADED
+
+#if LOG_CONFIGURE_FROM_REGISTRY
+	void set_reg_config_path(std::string registryConfigurationPath) { reg_config_path_ = process_config_macro(registryConfigurationPath); }
+	std::string get_reg_config_path() const { return reg_config_path_; }
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+
+#if LOG_INI_CONFIGURATION
+	void set_ini_file_find_paths(std::string ini_file_find_paths) { ini_file_find_paths_ = process_config_macro(ini_file_find_paths); }
+	std::string get_ini_file_find_paths() const { return ini_file_find_paths_; }
+#endif //LOG_INI_CONFIGURATION
+
+	static int query_hdr_fields(const std::string& format)
+	{
+		const char* str = format.c_str();
+		int fields = 0;
+
+		if (contains(str, "$(V)") || contains(str, "$(v)")) fields |= log_field_level;
+
+		static const char* time_macros[] = { "$(yyyy)", "$(yy)", "$(MM)", "$(M)", "$(dd)", "$(d)", "$(hh)", "$(h)",
+			"$(mm)", "$(m)", "$(ss)", "$(s)", "$(ttt)", "$(t)" };
+
+		for (size_t i = 0; i < sizeof(time_macros) / sizeof(time_macros[0]); i++)
+			if (contains(str, time_macros[i])) fields |= log_field_time;
+
+		if (contains(str, "$(PID)")) fields |= log_field_pid;
+		if (contains(str, "$(TID)")) fields |= log_field_tid;
+		if (contains(str, "$(module)")) fields |= log_field_module;
+		if (contains(str, "$(MODULE)")) fields |= log_field_module_path;
+		if (contains(str, "$(function)")) fields |= log_field_function;
+		if (contains(str, "$(srcfile)")) fields |= log_field_srcfile;
+		if (contains(str, "$(line)")) fields |= log_field_line;
+		if (contains(str, "$(ctx)")) fields |= log_field_ctx;
+		if (contains(str, "$(seq)")) fields |= log_field_seq;
+
+		return fields;
+	}
+
+	// OutputFormat value of INI file or registry: text, json or logfmt
+	static int parse_output_format(const char* value)
+	{
+		if (!strcmp(value, "json"))
+			return log_output_json;
+
+		if (!strcmp(value, "logfmt"))
+			return log_output_logfmt;
+
+		return log_output_text;
+	}
+
+	// replace_pid is false for header format where $(PID) is resolved for each record, so forked child writes own PID
+    static std::string process_config_macro(std::string str, bool replace_pid = true)
+	{
+        if (contains(str.c_str(),"$(CURRENTDIR)"))
+        {
+#ifdef LOG_PLATFORM_WINDOWS
+            char current_dir[MAX_PATH+1];
+            GetCurrentDirectoryA(MAX_PATH, current_dir);
+#else //LOG_PLATFORM_WINDOWS
+            char current_dir[512];
+
+#	ifdef LOG_HAVE_UNISTD_H
+            if (getcwd(current_dir,512))
+                current_dir[0] = 0;
+#	else //LOG_HAVE_UNISTD_H
+	    strcpy(current_dir,"./");
+#	endif //LOG_HAVE_UNISTD_H
+
+#endif //LOG_PLATFORM_WINDOWS
+
+            str = replace(str,"$(CURRENTDIR)", current_dir);
+        }
+
+        if (contains(str.c_str(),"$(TEMPPATH)"))
+        {
+#ifdef LOG_PLATFORM_WINDOWS
+            char temp_path[MAX_PATH+1];
+            GetTempPathA(MAX_PATH, temp_path);
+#else //LOG_PLATFORM_WINDOWS
+            const char* temp_path = P_tmpdir;
+#endif //LOG_PLATFORM_WINDOWS
+
+            str = replace(str,"$(TEMPPATH)", temp_path);
+        }
+
+
+#ifdef LOG_PLATFORM_WINDOWS
+		if (contains(str.c_str(),"$(SYSTEMPATH)"))
+		{
+			char system_path[MAX_PATH+1];
+			GetSystemDirectoryA(system_path, MAX_PATH);
+
+			str = replace(str,"$(SYSTEMPATH)", system_path);
+		}
+
+		if (contains(str.c_str(),"$(WINDOWSPATH)"))
+		{
+			char windows_path[MAX_PATH+1];
+			GetWindowsDirectoryA(windows_path, MAX_PATH);
+
+			str = replace(str,"$(WINDOWSPATH)", windows_path);
+		}
+
+		if (contains(str.c_str(), "$(COMMONAPPDATA)"))
+		{
+			char appdata_path[MAX_PATH];
+			appdata_path[0] = 0;
+
+			SHGetFolderPathA(NULL, CSIDL_COMMON_APPDATA, NULL, 0, appdata_path);
+
+			str = replace(str,"$(COMMONAPPDATA)", appdata_path);
+		}
+
+		if (contains(str.c_str(), "$(USERAPPDATA)"))
+		{
+			char appdata_path[MAX_PATH];
+			appdata_path[0] = 0;
+
+			SHGetFolderPathA(NULL, CSIDL_APPDATA, NULL, 0, appdata_path);
+
+			str = replace(str,"$(USERAPPDATA)", appdata_path);
+		}
+
+		if (contains(str.c_str(), "$(DESKTOPDIR)"))
+		{
+			char desktop_path[MAX_PATH];
+			desktop_path[0] = 0;
+
+			SHGetFolderPathA(NULL, CSIDL_DESKTOPDIRECTORY, NULL, 0, desktop_path);
+
+			str = replace(str,"$(DESKTOPDIR)", desktop_path);
+		}
+#endif //LOG_PLATFORM_WINDOWS
+
+		str = replace(str,"$(EXEDIR)", utils::get_process_file_path());
+		str = replace(str,"$(EXEFILENAME)", utils::get_process_file_name());
+		str = replace(str,"$(EXEFULLFILENAME)", utils::get_process_full_file_name());
+
+		if (replace_pid) str = replace(str,"$(PID)", process_ids::pid_str());
+
+#if LOG_USE_MODULEDEFINITION
+        std::string module_path = module_definition::module_name_by_addr((void*)&process_config_macro);
+
+        size_t last_delim = module_path.find_last_of("\\/");
+
+		std::string module_dir = module_path.substr(0,last_delim);
+
+		if (last_delim != std::string::npos)
+			last_delim++;
+
+		std::string module_full_file_name = module_path.substr(last_delim,std::string::npos);
+
+		size_t count = module_path.find_last_of(".");
+		if (count != std::string::npos)
+			count -= last_delim;
+
+		std::string module_file_name = module_path.substr(last_delim, count);
+
+		str = replace(str,"$(MODULEDIR)", module_dir);
+		str = replace(str,"$(MODULEFULLFILENAME)", module_full_file_name);
+		str = replace(str,"$(MODULEFILENAME)", module_file_name);
+#endif //LOG_USE_MODULEDEFINITION
+
+		return str;
+	}
+
+private:
+	const log_config_t* volatile config_;
+	retired_list<log_config_t> retired_configs_;
+	grace_period readers_;
+
+#if LOG_LOAD_SHEDDING
+	volatile long shed_levels_;
+	volatile long shed_dropped_;
+#endif //LOG_LOAD_SHEDDING
+
+#if LOG_MULTITHREADED
+	LOG_MT_MUTEX update_lock_;
+#endif //LOG_MULTITHREADED
+
+#if LOG_CONFIGURE_FROM_REGISTRY
+	std::string reg_config_path_;
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+
+#if LOG_INI_CONFIGURATION
+	std::string ini_file_find_paths_;
+#endif //LOG_INI_CONFIGURATION
+};
+
+
+#if LOG_TEST_DO_NOT_WRITE_FILE
+#	include <sstream>
+#	undef LOG_FLUSH_FILE_EVERY_WRITE
+#	define LOG_FLUSH_FILE_EVERY_WRITE 1
+#endif //LOG_TEST_DO_NOT_WRITE_FILE
+
+
+extern log_configurator configurator;
+
+//////////////////////////////////////////////////////////////
+#if LOG_INI_CONFIGURATION
+class log_ini_configurator
+{
+public:
+	// Finds first existing INI file from the list and applies it as single configuration snapshot
+	static bool configure(const char* ini_file_paths, std::string* found_path = NULL)
+	{
+		std::vector<std::string> ini_paths;
+		split(ini_file_paths, ini_paths, ';');
+
+		for (size_t i=0; i<ini_paths.size(); i++)
+		{
+			if (configure_from_file(ini_paths[i].c_str()))
+			{
+				if (found_path)
+					*found_path = ini_paths[i];
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static bool configure_from_file(const char* ini_file_path)
+	{
+		log_config_t* config = configurator.begin_update();
+
+		if (logging_ini::ini_parse(ini_file_path, handler, config) < 0)
+		{
+			configurator.cancel_update(config);
+			return false;
+		}
+
+		configurator.commit_update(config);
+		return true;
+	}
+
+    static int LOG_CDECL handler(void* user, const char* section, const char* name,
+					   const char* value)
+	{
+		log_config_t* config = static_cast<log_config_t*>(user);
 
-	enum pe_image_directory_entry_types
+		if (!strcmp(section,"logger") && !strcmp(name, "LogPath")) 
+		{
+			config->log_path = log_configurator::process_config_macro(value);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "Verbose")) 
+		{
+			config->verb_level = atoi(value);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "HeaderFormat")) 
+		{
+			config->hdr_format = log_configurator::process_config_macro(value, false);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "OutputFormat")) 
+		{
+			config->output_format = log_configurator::parse_output_format(value);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "LogFileName")) 
+		{
+			config->log_file_name = log_configurator::process_config_macro(value);
+		} 
+#if LOG_USE_SYSTEMINFO
+        else if (!strcmp(section,"logger") && !strcmp(name, "LogSysInfo"))
+		{
+			config->need_sys_info = atoi(value) ? true : false;
+		} 
+#endif //LOG_USE_SYSTEMINFO
+		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileCount")) 
+		{
+			config->scroll_file_count = atoi(value);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileSize")) 
+		{
+			config->scroll_file_size = atoi(value);
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "ForkLogFileName")) 
+		{
+			config->fork_log_file_name = value;
+		} 
+		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileEveryRun")) 
+		{
+			config->scroll_file_every_run = atoi(value) ? true : false;
+		} 
+#if LOG_FLIGHT_RECORDER
+		else if (!strcmp(section,"logger") && !strcmp(name, "FlightRecorderDumpLevel")) 
+		{
+			config->flight_recorder_dump_level = atoi(value);
+		} 
+#endif //LOG_FLIGHT_RECORDER
+#if LOG_CONFIGURE_FROM_REGISTRY
+        else if (!strcmp(section,"logger") && !strcmp(name, "RegistryConfigPath"))
+		{
+			configurator.set_reg_config_path(value);
+		} 
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+		else {
+			return 0;  /* unknown section/name, error */
+		}
+		return 1;
+	}
+
+};
+
+#endif //LOG_INI_CONFIGURATION
+
+#if LOG_CONFIGURE_FROM_REGISTRY
+
+class log_registry_configurator
+{
+public:
+	static bool configure(std::string key_path)
 	{
-		PE_IMAGE_DIRECTORY_ENTRY_EXPORT          = 0,   // Export Directory
-		PE_IMAGE_DIRECTORY_ENTRY_IMPORT          = 1,   // Import Directory
-		PE_IMAGE_DIRECTORY_ENTRY_RESOURCE        = 2,   // Resource Directory
-		PE_IMAGE_DIRECTORY_ENTRY_EXCEPTION       = 3,   // Exception Directory
-		PE_IMAGE_DIRECTORY_ENTRY_SECURITY        = 4,   // Security Directory
-		PE_IMAGE_DIRECTORY_ENTRY_BASERELOC       = 5,   // Base Relocation Table
-		PE_IMAGE_DIRECTORY_ENTRY_DEBUG           = 6,   // Debug Directory
-		PE_IMAGE_DIRECTORY_ENTRY_ARCHITECTURE    = 7,   // Architecture Specific Data
-		PE_IMAGE_DIRECTORY_ENTRY_GLOBALPTR       = 8,   // RVA of GP
-		PE_IMAGE_DIRECTORY_ENTRY_TLS             = 9,   // TLS Directory
-		PE_IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG     = 10,  // Load Configuration Directory
-		PE_IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT    = 11,   // Bound Import Directory in headers
-		PE_IMAGE_DIRECTORY_ENTRY_IAT             = 12,   // Import Address Table
-		PE_IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT    = 13,   // Delay Load Import Descriptors
-		PE_IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR  = 14   // COM Runtime descriptor
-	};
+		if (key_path == "")
+			key_path = LOG_REGISTRY_DEFAULT_KEY;
 
-	static const int PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES   = 16;
+		size_t storage_delim = key_path.find_first_of("\\/");
+		if (storage_delim == key_path.npos)
+			return false;
 
-	typedef struct _pe_image_dos_header_t 
-	{      // DOS .EXE header
-		unsigned short   e_magic;                     // Magic number
-		unsigned short   e_cblp;                      // Bytes on last page of file
-		unsigned short   e_cp;                        // Pages in file
-		unsigned short   e_crlc;                      // Relocations
-		unsigned short   e_cparhdr;                   // Size of header in paragraphs
-		unsigned short   e_minalloc;                  // Minimum extra paragraphs needed
-		unsigned short   e_maxalloc;                  // Maximum extra paragraphs needed
-		unsigned short   e_ss;                        // Initial (relative) SS value
-		unsigned short   e_sp;                        // Initial SP value
-		unsigned short   e_csum;                      // Checksum
-		unsigned short   e_ip;                        // Initial IP value
-		unsigned short   e_cs;                        // Initial (relative) CS value
-		unsigned short   e_lfarlc;                    // File address of relocation table
-		unsigned short   e_ovno;                      // Overlay number
-		unsigned short   e_res[4];                    // Reserved words
-		unsigned short   e_oemid;                     // OEM identifier (for e_oeminfo)
-		unsigned short   e_oeminfo;                   // OEM information; e_oemid specific
-		unsigned short   e_res2[10];                  // Reserved words
-		unsigned long    e_lfanew;                    // File address of new exe header
-	} pe_image_dos_header_t;
+		std::string storage = key_path.substr(0,storage_delim);
+		HKEY base_key = log_registry_helper::reg_base_key_by_string(storage);
+		
+		std::string path = key_path.substr(storage_delim+1);
 
-	typedef struct _pe_image_file_header_t {
-		unsigned short Machine;
-		unsigned short NumberOfSections;
-		unsigned long TimeDateStamp;
-		unsigned long PointerToSymbolTable;
-		unsigned long NumberOfSymbols;
-		unsigned short SizeOfOptionalHeader;
-		unsigned short Characteristics;
-	} pe_image_file_header_t;
+		std::string log_path;
+		if (log_registry_helper::get_reg_sz_value(base_key,path,"LogPath",log_path))
+			configurator.set_log_path(log_path);
 
-	typedef struct _pe_image_data_directory_t 
+		std::string hdr_format;
+		if (log_registry_helper::get_reg_sz_value(base_key,path,"HeaderFormat",hdr_format))
+			configurator.set_hdr_format(hdr_format);
+
+		std::string output_format;
+		if (log_registry_helper::get_reg_sz_value(base_key,path,"OutputFormat",output_format))
+			configurator.set_output_format(log_configurator::parse_output_format(output_format.c_str()));
+
+		unsigned long verbose_level;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"Verbose",verbose_level))
+			configurator.set_verbose_level(verbose_level);
+
+#if LOG_USE_SYSTEMINFO
+		unsigned long log_sys_info;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"LogSystemInfo",log_sys_info))
+			configurator.set_need_sys_info(log_sys_info ? true : false);
+#endif //LOG_USE_SYSTEMINFO
+
+		unsigned long log_scroll_file_size;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileSize",log_scroll_file_size))
+			configurator.set_log_scroll_file_size(log_scroll_file_size);
+
+		unsigned long log_scroll_file_count;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileCount",log_scroll_file_count))
+			configurator.set_log_scroll_file_count(log_scroll_file_count);
+
+		unsigned long log_scroll_file_every_run;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileEveryRun",log_scroll_file_every_run))
+			configurator.set_log_scroll_file_every_run(log_scroll_file_every_run ? true : false);
+
+		unsigned long log_enabled;
+		if (log_registry_helper::get_reg_dword_value(base_key,path,"LogEnabled",log_enabled))
+		{
+			if (!log_enabled)
+				configurator.set_verbose_level(logger_verbose_mute);
+		}
+
+		return true;
+	}
+	
+};
+
+#endif //LOG_CONFIGURE_FROM_REGISTRY
+
+//////////////////////////////////////////////////////////////
+
+struct logger_interface
+{
+	virtual ~logger_interface() {};
+
+	virtual void log_binary(int verbLevel, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber, const char* data, int len) = 0;
+
+    virtual void /*__cdecl*/ log(int verbLevel, void* addr, const char* functionName,
+		const char* sourceFile, int lineNumber, const char* format, ...) = 0;
+
+	virtual void log_args(int verb_level, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber, const char* format, va_list arguments) = 0;
+
+#if LOG_USE_MODULEDEFINITION
+	virtual void log_modules(int verbLevel, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber) = 0;
+#endif //LOG_USE_MODULEDEFINITION
+
+#if LOG_AUTO_DEBUGGING
+	virtual void log_stack_trace(int verbLevel, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber) = 0;
+#endif //LOG_AUTO_DEBUGGING
+
+	virtual void log_exception(int verbLevel, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber, const char* userMessage) = 0;
+
+	virtual void log_exception(int verbLevel, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber, std::exception* e) = 0;
+
+	virtual void ref() = 0;
+	virtual void deref() = 0;
+	virtual int ref_counter() = 0;
+
+	// New methods are added after existing ones: logger of other module (LOG_SHARED, DLL) can be older
+
+	// Write buffered data to log file
+	virtual void flush() = 0;
+
+	// Scroll log files as if current file reached its size limit
+	virtual void rotate() = 0;
+
+	// Internal statistics, one "name=value" pair per line
+	virtual std::string query_stats() = 0;
+
+#if LOG_FLIGHT_RECORDER
+	// Write flight recorder messages which were filtered out and not dumped yet
+	virtual void dump_flight_recorder() = 0;
+#endif //LOG_FLIGHT_RECORDER
+
+	// Writes already formatted text, used by LOG_*_T macro
+	virtual void log_text(int verb_level, void* addr, const char* functionName, 
+		const char* sourceFile, int lineNumber, const char* text) = 0;
+
+#if LOG_TEMPLATE_API
+	// Writes message of call site with arguments packed by template_format::pack or pack_fields.
+	// With LOG_DEFERRED_FORMAT message is formatted by writer thread. Takes content of args
+	virtual void log_packed(const call_site_t& site, void* addr, std::string& args) = 0;
+#endif //LOG_TEMPLATE_API
+};
+
+//////////////////////////////////////////////////////////////
+
+#if LOG_INI_HOT_RELOAD
+
+// Watches INI file used for configuration and reapplies it when file is changed
+class log_ini_watcher
+{
+public:
+	log_ini_watcher() : owner_(NULL), inotify_fd_(-1), terminating_(0), started_(false) {}
+	~log_ini_watcher() { stop(); }
+
+	bool start(const std::string& ini_file_path, logger_interface* owner)
 	{
-		unsigned long   VirtualAddress;
-		unsigned long   Size;
-	} pe_image_data_directory_t;
+		if (started_)
+			return true;
 
-	typedef struct _pe_image_optional_header64_t {
-		unsigned short        Magic;
-		unsigned char        MajorLinkerVersion;
-		unsigned char        MinorLinkerVersion;
-		unsigned long       SizeOfCode;
-		unsigned long       SizeOfInitializedData;
-		unsigned long       SizeOfUninitializedData;
-		unsigned long       AddressOfEntryPoint;
-		unsigned long       BaseOfCode;
-		uint64_t   ImageBase;
-		unsigned long       SectionAlignment;
-		unsigned long       FileAlignment;
-		unsigned short        MajorOperatingSystemVersion;
-		unsigned short        MinorOperatingSystemVersion;
-		unsigned short        MajorImageVersion;
-		unsigned short        MinorImageVersion;
-		unsigned short        MajorSubsystemVersion;
-		unsigned short        MinorSubsystemVersion;
-		unsigned long       Win32VersionValue;
-		unsigned long       SizeOfImage;
-		unsigned long       SizeOfHeaders;
-		unsigned long       CheckSum;
-		unsigned short        Subsystem;
-		unsigned short        DllCharacteristics;
-		uint64_t   SizeOfStackReserve;
-		uint64_t   SizeOfStackCommit;
-		uint64_t   SizeOfHeapReserve;
-		uint64_t   SizeOfHeapCommit;
-		unsigned long       LoaderFlags;
-		unsigned long       NumberOfRvaAndSizes;
-		pe_image_data_directory_t DataDirectory[PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
-	} pe_image_optional_header64_t;
+		path_ = ini_file_path;
+		owner_ = owner;
+
+		size_t last_delim = path_.find_last_of('/');
+		dir_ = last_delim == std::string::npos ? std::string(".") : path_.substr(0, last_delim);
+		file_name_ = last_delim == std::string::npos ? path_ : path_.substr(last_delim + 1);
+
+		inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd_ < 0)
+			return false;
+
+		// directory is watched instead of file, because editors usually replace file by rename
+		if (inotify_add_watch(inotify_fd_, dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+			|| pthread_create(&thread_, NULL, &watch_thread_fn, this) != 0)
+		{
+			close(inotify_fd_);
+			inotify_fd_ = -1;
+			return false;
+		}
 
-	typedef struct _pe_image_optional_header32_t 
-	{
-		unsigned short    Magic;
-		unsigned char    MajorLinkerVersion;
-		unsigned char    MinorLinkerVersion;
-		unsigned long   SizeOfCode;
-		unsigned long   SizeOfInitializedData;
-		unsigned long   SizeOfUninitializedData;
-		unsigned long   AddressOfEntryPoint;
-		unsigned long   BaseOfCode;
-		unsigned long   BaseOfData;
-		unsigned long   ImageBase;
-		unsigned long   SectionAlignment;
-		unsigned long   FileAlignment;
-		unsigned short    MajorOperatingSystemVersion;
-		unsigned short    MinorOperatingSystemVersion;
-		unsigned short    MajorImageVersion;
-		unsigned short    MinorImageVersion;
-		unsigned short    MajorSubsystemVersion;
-		unsigned short    MinorSubsystemVersion;
-		unsigned long   Win32VersionValue;
-		unsigned long   SizeOfImage;
-		unsigned long   SizeOfHeaders;
-		unsigned long   CheckSum;
-		unsigned short    Subsystem;
-		unsigned short    DllCharacteristics;
-		unsigned long   SizeOfStackReserve;
-		unsigned long   SizeOfStackCommit;
-		unsigned long   SizeOfHeapReserve;
-		unsigned long   SizeOfHeapCommit;
-		unsigned long   LoaderFlags;
-		unsigned long   NumberOfRvaAndSizes;
-		pe_image_data_directory_t DataDirectory[PE_IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
-	} pe_image_optional_header32_t;
+		started_ = true;
+		return true;
+	}
 
-	typedef struct _pe_image_nt_headers64_t
+	void stop()
 	{
-		unsigned long Signature;
-		pe_image_file_header_t FileHeader;
-		pe_image_optional_header64_t OptionalHeader;
-	} pe_image_nt_headers64_t;
+		if (!started_)
+			return;
 
-	typedef struct _pe_image_nt_headers32_t {
-		unsigned long Signature;
-		pe_image_file_header_t FileHeader;
-		pe_image_optional_header32_t OptionalHeader;
-	} pe_image_nt_headers32_t;
-	
+		atomic_ops::store(&terminating_, 1);
+		pthread_join(thread_, NULL);
 
-#ifdef _WIN64
-	typedef pe_image_nt_headers64_t pe_image_nt_headers_t;
-#else
-	typedef pe_image_nt_headers32_t pe_image_nt_headers_t;
-#endif
+		close(inotify_fd_);
+		inotify_fd_ = -1;
+		started_ = false;
+	}
 
-public:
-    static void* api_find_module_entry_point(intptr_t some_addr_in_module)
+	// Watch thread does not exist in child process after fork: drops inherited state and starts again
+	void restart_after_fork()
 	{
-#if !LOG_USE_SEH
-		HMODULE h;
-		if (GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCTSTR)(void*)(some_addr_in_module), &h))
-			return reinterpret_cast<void*>(h);
+		if (!started_)
+			return;
 
-		return NULL;
-#else //LOG_USE_SEH
-		const int max_cycles_find = 0x4000;
-		const int max_exceptions_per_try = 0x100;
-		
-		int cycles = 0;
-		int exceptions = 0;
+		close(inotify_fd_);
+		inotify_fd_ = -1;
+		started_ = false;
 
-#ifdef _AMD64_
-		some_addr_in_module &= 0xFFFFFFFFFFFF0000;
-#else //_AMD64_
-		some_addr_in_module &= 0xFFFF0000;
-#endif //_AMD64_
+		start(path_, owner_);
+	}
 
-		while(1)
+private:
+	static const int poll_timeout_ms = 500;
+
+	static void* watch_thread_fn(void* data)
+	{
+		log_ini_watcher* watcher = reinterpret_cast<log_ini_watcher*>(data);
+		char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+		while (!atomic_ops::load(&watcher->terminating_))
 		{
-			const pe_image_dos_header_t* doshdr = (pe_image_dos_header_t*)some_addr_in_module;
+			struct pollfd pfd;
+			pfd.fd = watcher->inotify_fd_;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
 
-			__try
+			if (poll(&pfd, 1, poll_timeout_ms) <= 0)
+				continue;
+
+			bool changed = false;
+			ssize_t len;
+
+			while ((len = read(watcher->inotify_fd_, buffer, sizeof(buffer))) > 0)
 			{
-				if (doshdr->e_magic == PE_IMAGE_DOS_SIGNATURE)
+				const struct inotify_event* event;
+				for (char* ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + event->len)
 				{
-					if (doshdr->e_lfanew < 0x100000)
-					{
-						const pe_image_nt_headers_t* nthdr = (pe_image_nt_headers_t*)(some_addr_in_module + doshdr->e_lfanew);
-						if (nthdr->Signature == PE_IMAGE_NT_SIGNATURE)
-							break;
-					}
+					event = reinterpret_cast<const struct inotify_event*>(ptr);
+					if (event->len && watcher->file_name_ == event->name)
+						changed = true;
 				}
-
-				exceptions = 0;
-			}
-			__except(1)
-			{
-				++exceptions;
 			}
 
-			++cycles;
-			some_addr_in_module -= 0x1000;
-
-			if (cycles > max_cycles_find)
-				return NULL;
-
-			if (exceptions > max_exceptions_per_try)
-				return NULL;
+			if (changed)
+				watcher->reload();
 		}
 
-		return (void*)some_addr_in_module;
-#endif //LOG_USE_SEH
+		return NULL;
+	}
+
+	void reload()
+	{
+		if (log_ini_configurator::configure_from_file(path_.c_str()))
+			owner_->log(logger_verbose_info, (void*)&watch_thread_fn, "log_ini_watcher::reload", __FILE__, __LINE__, "Logger configuration reloaded from %s", path_.c_str());
 	}
+
+	logger_interface* owner_;
+	std::string path_;
+	std::string dir_;
+	std::string file_name_;
+
+	int inotify_fd_;
+	pthread_t thread_;
+	volatile long terminating_;
+	bool started_;
 };
-#endif //LOG_PLATFORM_WINDOWS
 
+#endif //LOG_INI_HOT_RELOAD
 
-struct module_entry_t
-{
-	std::string imageName;
-	std::string moduleName;
-	intptr_t baseAddress;
-	unsigned long size;
-	std::string file_version;
-	std::string product_version;
-	std::string file_description;
-	std::string company_name;
-	unsigned long lang_id;
+//////////////////////////////////////////////////////////////
 
-	module_entry_t() : baseAddress(0), size(0), lang_id(0) {}
-}; 
+#if LOG_CONTROL_SOCKET
 
-class module_definition
+#	ifndef MSG_NOSIGNAL
+#		define MSG_NOSIGNAL 0
+#	endif //MSG_NOSIGNAL
+
+// Serves runtime control commands on local Unix socket. One request line per connection, reply is sent back and connection is closed
+// Commands: verbose [level [seconds]], flush, rotate, stats, config, reload, help
+class log_control_server
 {
 public:
-	static std::string module_name_by_addr(void* functionAddress)
+	log_control_server() : owner_(NULL), listen_fd_(-1), terminating_(0), started_(false), restore_verb_level_(0), restore_time_(0) {}
+	~log_control_server() { stop(); }
+
+	bool start(logger_interface* owner, const std::string& ini_file_path)
 	{
-#ifdef LOG_PLATFORM_WINDOWS
-		HMODULE module = reinterpret_cast<HMODULE>(pe_image::api_find_module_entry_point(
-			reinterpret_cast<intptr_t>(functionAddress)));
-		
-		if (!module)
-			return std::string();
+		if (started_)
+			return true;
 
-		char fileName[MAX_PATH];
-		GetModuleFileNameA(module,fileName,sizeof(fileName));
-		return fileName;
-#else //LOG_PLATFORM_WINDOWS
-        Dl_info info;
-        if (dladdr(functionAddress, &info))
-        {
-            return info.dli_fname;
-        }
+		owner_ = owner;
+		ini_file_path_ = ini_file_path;
+		name_ = log_configurator::process_config_macro(LOG_CONTROL_SOCKET_NAME);
 
-        return "";
-#endif //LOG_PLATFORM_WINDOWS
-	}
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
 
-#ifdef LOG_PLATFORM_WINDOWS
-	static bool module_query_version_info(HMODULE module, std::string& file_version, 
-					std::string& file_description, std::string& product_version, 
-					std::string& company_name,
-					unsigned long& lang_id)
-	{
-		char szFilename[MAX_PATH + 1];
-		
-		if (GetModuleFileNameA(module, szFilename, MAX_PATH) == 0)
+		socklen_t addr_len = 0;
+		std::string path = name_;
+
+		if (path.size() && path[0] == '@')
 		{
-			return false;
+#ifdef LOG_PLATFORM_LINUX
+			// abstract namespace: leading zero byte, name is not zero terminated
+			if (path.size() > sizeof(addr.sun_path))
+				return false;
+
+			memcpy(addr.sun_path + 1, path.c_str() + 1, path.size() - 1);
+			addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size());
+#else //LOG_PLATFORM_LINUX
+			path = std::string(P_tmpdir) + "/" + path.substr(1);
+#endif //LOG_PLATFORM_LINUX
 		}
 
-		// allocate a block of memory for the version info
-		DWORD dummy;
-		DWORD dwSize = GetFileVersionInfoSizeA(szFilename, &dummy);
-		if (dwSize == 0)
+		if (!addr_len)
 		{
-			return false;
+			if (path.size() >= sizeof(addr.sun_path))
+				return false;
+
+			socket_path_ = path;
+			unlink(socket_path_.c_str());
+
+			strcpy(addr.sun_path, socket_path_.c_str());
+			addr_len = static_cast<socklen_t>(sizeof(addr));
 		}
 
-		uint8_t* data = (uint8_t*) malloc(dwSize);
-		if (!data)
+		listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listen_fd_ < 0)
 			return false;
 
-		// load the version info
-		if (!GetFileVersionInfoA(szFilename, 0, dwSize, data))
+		fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+		// socket file is accessible only for owner, mode is changed before listen so nobody can connect earlier
+		if (bind(listen_fd_, (struct sockaddr*)&addr, addr_len) != 0
+			|| (socket_path_.size() && chmod(socket_path_.c_str(), S_IRUSR | S_IWUSR) != 0)
+			|| listen(listen_fd_, 4) != 0
+			|| pthread_create(&thread_, NULL, &control_thread_fn, this) != 0)
 		{
-			free(data);
+			close_socket();
 			return false;
 		}
 
-		DWORD vLen,langD;
-        BOOL ret_val;    
-    
-        LPVOID retbuf=NULL;
-    
-        static char file_entry[256];
+		started_ = true;
+		return true;
+	}
+
+	void stop()
+	{
+		if (!started_)
+			return;
+
+		atomic_ops::store(&terminating_, 1);
+		pthread_join(thread_, NULL);
+
+		close_socket();
+		started_ = false;
+	}
+
+	const std::string& get_name() const { return name_; }
+
+	// Control thread does not exist in child process after fork: drops inherited socket and listens again,
+	// if socket name depends on PID (otherwise child would steal socket of parent)
+	void restart_after_fork()
+	{
+		if (!started_)
+			return;
+
+		socket_path_.clear();
+		close_socket();
+		started_ = false;
+
+		if (log_configurator::process_config_macro(LOG_CONTROL_SOCKET_NAME) != name_)
+			start(owner_, ini_file_path_);
+	}
+
+	// Executes one command line and returns reply text
+	std::string execute(const std::string& command_line)
+	{
+		std::vector<std::string> args;
+		std::stringstream parser(command_line);
+		std::string arg;
+
+		while (parser >> arg)
+			args.push_back(arg);
+
+		if (!args.size() || args[0] == "help")
+			return "commands: verbose [level [seconds]], flush, rotate, stats, config, reload\n";
+
+		if (args[0] == "verbose")
+		{
+			if (args.size() == 1)
+				return stringformat("verbose=%d\n", configurator.get_verbose_level());
+
+			int verb_level = parse_verbose_level(args[1]);
+			if (verb_level < 0)
+				return "error: unknown verbose level " + args[1] + "\n";
+
+			int seconds = args.size() > 2 ? atoi(args[2].c_str()) : 0;
+
+			// temporary level restores the level which was set before first temporary change
+			if (seconds > 0)
+			{
+				if (!restore_time_)
+					restore_verb_level_ = configurator.get_verbose_level();
+
+				restore_time_ = time(NULL) + seconds;
+			}
+			else
+			{
+				restore_time_ = 0;
+			}
+
+			configurator.set_verbose_level(verb_level);
+			owner_->log(logger_verbose_info, (void*)&control_thread_fn, "log_control_server::execute", __FILE__, __LINE__,
+				"Verbose level changed to %d by control socket%s", verb_level, seconds > 0 ? stringformat(" for %d seconds", seconds).c_str() : "");
+
+			return "ok\n";
+		}
+
+		if (args[0] == "flush")
+		{
+			owner_->flush();
+			return "ok\n";
+		}
+
+		if (args[0] == "rotate")
+		{
+			owner_->rotate();
+			return "ok\n";
+		}
+
+		if (args[0] == "stats")
+			return owner_->query_stats();
+
+#if LOG_FLIGHT_RECORDER
+		if (args[0] == "recorder")
+		{
+			owner_->dump_flight_recorder();
+			return "ok\n";
+		}
+#endif //LOG_FLIGHT_RECORDER
+
+		if (args[0] == "config")
+		{
+			log_configurator::config_ref current = configurator.get_config();
+			const log_config_t* config = current.get();
+			std::string reply;
+
+			reply += "file=" + config->full_log_file_path + "\n";
+			reply += stringformat("verbose=%d\n", config->verb_level);
+			reply += "header_format=" + config->hdr_format + "\n";
+			reply += stringformat("scroll_file_size=%lu\n", (unsigned long)config->scroll_file_size);
+			reply += stringformat("scroll_file_count=%lu\n", (unsigned long)config->scroll_file_count);
+
+#if LOG_INI_CONFIGURATION
+			reply += "ini_file=" + ini_file_path_ + "\n";
+#endif //LOG_INI_CONFIGURATION
+
+			return reply;
+		}
+
+#if LOG_INI_CONFIGURATION
+		if (args[0] == "reload")
+		{
+			bool result = ini_file_path_.size() 
+				? log_ini_configurator::configure_from_file(ini_file_path_.c_str())
+				: log_ini_configurator::configure(configurator.get_ini_file_find_paths().c_str(), &ini_file_path_);
+
+			return result ? "ok\n" : "error: configuration file was not loaded\n";
+		}
+#endif //LOG_INI_CONFIGURATION
+
+		return "error: unknown command " + args[0] + "\n";
+	}
+
+private:
+	static const int poll_timeout_ms = 500;
+	static const int max_request_size = 256;
+
+	static int parse_verbose_level(const std::string& name)
+	{
+		static const struct { const char* name; int level; } levels[] = {
+			{"mute", logger_verbose_mute}, {"fatal", logger_verbose_fatal}, {"error", logger_verbose_fatal_error},
+			{"normal", logger_verbose_normal}, {"optimal", logger_verbose_optimal}, {"all", logger_verbose_all}
+		};
+
+		for (size_t i=0; i<sizeof(levels)/sizeof(levels[0]); i++)
+		{
+			if (name == levels[i].name)
+				return levels[i].level;
+		}
+
+		if (name.find_first_not_of("0123456789") != std::string::npos)
+			return -1;
+
+		return atoi(name.c_str());
+	}
+
+	void close_socket()
+	{
+		if (listen_fd_ >= 0)
+			close(listen_fd_);
 
-        sprintf(file_entry,"\\VarFileInfo\\Translation");
-        ret_val = VerQueryValueA(data,file_entry,&retbuf,(UINT *)&vLen);
-        if (ret_val && vLen==4) 
-        {
-	        static char current_entry[256];
+		listen_fd_ = -1;
 
-			memcpy(&langD,retbuf,4);            
+		if (socket_path_.size())
+			unlink(socket_path_.c_str());
+	}
 
-			lang_id = langD;
+	// Only processes of same effective user may control logger (abstract socket has no file permissions)
+	static bool is_peer_allowed(int fd)
+	{
+#if defined(LOG_PLATFORM_LINUX) && defined(SO_PEERCRED)
+		struct ucred cred;
+		socklen_t cred_len = sizeof(cred);
 
-			sprintf(file_entry, "\\StringFileInfo\\%02X%02X%02X%02X\\",
-                  (langD & 0xff00)>>8,langD & 0xff,(langD & 0xff000000)>>24, 
-                  (langD & 0xff0000)>>16);            
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred_len != sizeof(cred))
+			return false;
 
-			strcpy(current_entry, file_entry);
-			strcat(current_entry, "FileVersion");
+		return cred.uid == geteuid();
+#elif defined(LOG_PLATFORM_MAC) || defined(LOG_PLATFORM_BSD)
+		uid_t uid;
+		gid_t gid;
 
-			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
-				file_version = (char*)retbuf;
+		if (getpeereid(fd, &uid, &gid) != 0)
+			return false;
 
-			strcpy(current_entry, file_entry);
-			strcat(current_entry, "FileDescription");
+		return uid == geteuid();
+#else //LOG_PLATFORM_LINUX
+		(void)fd;
+		return true;
+#endif //LOG_PLATFORM_LINUX
+	}
 
-			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
-				file_description = (char*)retbuf;
+	void serve_client(int fd)
+	{
+		if (!is_peer_allowed(fd))
+		{
+			static const char reply[] = "error: access denied\n";
+			send(fd, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+			return;
+		}
 
-			strcpy(current_entry, file_entry);
-			strcat(current_entry, "ProductVersion");
+		struct timeval timeout;
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
-				product_version = (char*)retbuf;
+		char buffer[max_request_size];
+		size_t received = 0;
 
-			strcpy(current_entry, file_entry);
-			strcat(current_entry, "CompanyName");
+		while (received < sizeof(buffer) - 1)
+		{
+			ssize_t len = recv(fd, buffer + received, sizeof(buffer) - 1 - received, 0);
+			if (len <= 0)
+				break;
 
-			if (VerQueryValueA(data,current_entry,&retbuf,(UINT *)&vLen)) 
-				company_name = (char*)retbuf;
-        }
+			received += len;
+			if (memchr(buffer, '\n', received))
+				break;
+		}
 
-		free(data);
+		buffer[received] = 0;
 
-		return true;
+		std::string reply = execute(std::string(buffer, strcspn(buffer, "\r\n")));
+
+		for (size_t sent = 0; sent < reply.size(); )
+		{
+			ssize_t len = send(fd, reply.c_str() + sent, reply.size() - sent, MSG_NOSIGNAL);
+			if (len <= 0)
+				break;
+
+			sent += len;
+		}
 	}
 
-#endif //LOG_PLATFORM_WINDOWS
+	static void* control_thread_fn(void* data)
+	{
+		log_control_server* server = reinterpret_cast<log_control_server*>(data);
 
+		while (!atomic_ops::load(&server->terminating_))
+		{
+			if (server->restore_time_ && time(NULL) >= server->restore_time_)
+			{
+				server->restore_time_ = 0;
+				configurator.set_verbose_level(server->restore_verb_level_);
+				server->owner_->log(logger_verbose_info, (void*)&control_thread_fn, "log_control_server::restore", __FILE__, __LINE__,
+					"Verbose level restored to %d", server->restore_verb_level_);
+			}
 
-#if !defined(LOG_PLATFORM_WINDOWS)
-    static int module_callback(struct dl_phdr_info *info, size_t size, void *data)
-    {
-        std::list<module_entry_t>* modules = (std::list<module_entry_t>*)data;
+			struct pollfd pfd;
+			pfd.fd = server->listen_fd_;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
 
-        if (!info || size < sizeof(struct dl_phdr_info))
-            return 0;
+			if (poll(&pfd, 1, poll_timeout_ms) <= 0)
+				continue;
 
-        if (!strlen(info->dlpi_name))
-            return 0;
+			int client_fd = accept(server->listen_fd_, NULL, NULL);
+			if (client_fd < 0)
+				continue;
 
-        module_entry_t e;
-        e.baseAddress = info->dlpi_addr;
+			server->serve_client(client_fd);
+			close(client_fd);
+		}
 
-        e.imageName = info->dlpi_name;
-        e.moduleName = info->dlpi_name;
+		return NULL;
+	}
 
-        size_t last_delim = e.moduleName.find_last_of('/');
-        if (last_delim == std::string::npos)
-            last_delim = 0;
-        else
-            last_delim++;
+	logger_interface* owner_;
+	std::string name_;
+	std::string socket_path_;
+	std::string ini_file_path_;
 
-        e.moduleName = e.moduleName.substr(last_delim);
+	int listen_fd_;
+	pthread_t thread_;
+	volatile long terminating_;
+	bool started_;
 
-        e.size = 0;
+	int restore_verb_level_;
+	time_t restore_time_;
+};
 
-        for (int j = 0; j < info->dlpi_phnum; j++)
-        {
-            uintptr_t ptr = info->dlpi_phdr[j].p_vaddr + info->dlpi_phdr[j].p_memsz; // - info->dlpi_addr;
+#endif //LOG_CONTROL_SOCKET
 
-            if (e.size < ptr)
-                e.size = ptr;
-        }
+//////////////////////////////////////////////////////////////
 
-        modules->push_back(e);
-        return 0;
-    }
-#endif
+#if LOG_AUTO_DEBUGGING
 
+#if LOG_ELF_SYMBOLS
 
-	static bool query_module_list(std::list<module_entry_t> &modules)
+// Function symbols of loaded modules read from ELF .symtab, which contains static functions too.
+// If module is stripped, symbols are read from separate debug file found by build-id or .gnu_debuglink.
+// Each file is mapped once and stays mapped until process exit: symbol names point into mapping.
+// Symbols are read again if other file is loaded by the same path, it is checked when modules generation changes
+class elf_symbols
+{
+public:
+	static elf_symbols& instance()
 	{
-#ifdef LOG_PLATFORM_WINDOWS
-		const int MaxModules = 1024;
-		modules.clear();
+		static elf_symbols symbols;
+		return symbols;
+	}
 
-		HMODULE moduleArray[MaxModules];
-		DWORD bytesNeeded;
+	// Returns mangled name of function containing addr and offset of addr from function start, or NULL
+	const char* find(void* addr, uintptr_t& offset)
+	{
+		Dl_info info;
+		struct link_map* map = NULL;
 
-		HANDLE processHandle = GetCurrentProcess(); 
+		if (!dladdr1(addr, &info, reinterpret_cast<void**>(&map), RTLD_DL_LINKMAP) || !map)
+			return NULL;
 
-		if (!EnumProcessModules(processHandle, moduleArray, MaxModules*sizeof(HMODULE), &bytesNeeded))
-			return false;
+		// main executable has empty name in link map
+		std::string path = (map->l_name && *map->l_name) ? map->l_name : "/proc/self/exe";
+		uintptr_t file_addr = reinterpret_cast<uintptr_t>(addr) - map->l_addr;
+		unsigned long generation = module_cache::query_generation();
+		const char* name = NULL;
 
-		for (size_t i = 0; i < bytesNeeded / sizeof(HMODULE); i++ )
-		{
-			MODULEINFO moduleInfo;
-			GetModuleInformation(processHandle, moduleArray[i], &moduleInfo, sizeof moduleInfo );
+		lock();
 
-			module_entry_t e;
-			e.baseAddress = reinterpret_cast<intptr_t>(moduleInfo.lpBaseOfDll);
-			e.size = moduleInfo.SizeOfImage;
+		module_t& module = modules_[path];
+		if (!module.checked || module.generation != generation)
+		{
+			struct stat st;
+			module.generation = generation;
 
-			char name[MAX_PATH];
-			GetModuleFileNameExA(processHandle, moduleArray[i], name, sizeof(name));
-			e.imageName = name;
+			if (stat(path.c_str(), &st) == 0 && (!module.checked || st.st_dev != module.dev
+				|| st.st_ino != module.ino || st.st_mtime != module.mtime))
+			{
+				module.symbols.clear();
+				module.dev = st.st_dev;
+				module.ino = st.st_ino;
+				module.mtime = st.st_mtime;
+				load_module(path, module);
+			}
 
-			GetModuleBaseNameA(processHandle, moduleArray[i], name, sizeof(name));
-			e.moduleName = name;
+			module.checked = true;
+		}
 
-			module_query_version_info(reinterpret_cast<HMODULE>(moduleInfo.lpBaseOfDll), 
-				e.file_version, e.file_description, e.product_version, e.company_name, e.lang_id);
+		// return address points after call instruction, which can be the last one in function
+		const std::vector<symbol_t>& symbols = module.symbols;
+		symbol_t key;
+		key.start = file_addr - 1;
 
-			modules.push_back(e);
+		std::vector<symbol_t>::const_iterator sym = std::upper_bound(symbols.begin(), symbols.end(), key);
+		if (sym != symbols.begin())
+		{
+			--sym;
+			if (!sym->size || file_addr - 1 < sym->start + sym->size)
+			{
+				name = sym->name;
+				offset = file_addr - sym->start;
+			}
 		}
 
-#else //LOG_PLATFORM_WINDOWS
-        dl_iterate_phdr(&module_callback, &modules);
-#endif //LOG_PLATFORM_WINDOWS
-
-		return true;
+		unlock();
+		return name;
 	}
-};
 
-#endif // LOG_USE_MODULEDEFINITION
+private:
+	struct symbol_t
+	{
+		uintptr_t start;
+		uintptr_t size;
+		const char* name;
 
+		bool operator < (const symbol_t& other) const { return start < other.start; }
+	};
 
-//////////////////////////////////////////////////////////////
+	struct module_t
+	{
+		std::vector<symbol_t> symbols;
+		bool checked; // file identity was taken
+		unsigned long generation; // module_cache::query_generation when file identity was checked
+		dev_t dev;
+		ino_t ino;
+		time_t mtime;
+
+		module_t() : checked(false), generation(0), dev(0), ino(0), mtime(0) {}
+	};
 
-class utils
-{
-public:
+	struct file_t
+	{
+		const char* data;
+		size_t size;
+	};
 
-    static struct tm get_time(int& millisec)
+	std::map<std::string, module_t> modules_;
+
+#if LOG_MULTITHREADED
+	LOG_MT_MUTEX lock_;
+#endif //LOG_MULTITHREADED
+
+	elf_symbols()
 	{
-        struct tm newtime;
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_INIT(&lock_, NULL);
+#endif //LOG_MULTITHREADED
+	}
 
-#ifdef LOG_PLATFORM_WINDOWS
+	~elf_symbols()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_DESTROY(&lock_);
+#endif //LOG_MULTITHREADED
+	}
 
-	#ifdef  LOG_COMPILER_MSVC
-		struct __timeb64 tstruct;
-		_ftime64(&tstruct);
-		_localtime64_s(&newtime, &tstruct.time);
-	#else //LOG_COMPILER_MSVC
+	void lock()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
 
-		struct timeb tstruct;
-		ftime(&tstruct);
-		newtime = *localtime(&tstruct.time);
-	#endif //LOG_COMPILER_MSVC
+	void unlock()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
 
-		millisec = tstruct.millitm;
+	static void load_module(const std::string& path, module_t& module)
+	{
+		file_t file;
+		if (!map_file(path.c_str(), file))
+			return;
 
-#else //LOG_PLATFORM_WINDOWS
-        time_t tim = time(NULL);
-        struct tm *loc_time = localtime(&tim);
+		if (!read_symbols(file, module.symbols))
+		{
+			munmap(const_cast<char*>(file.data), file.size);
 
-        memcpy(&newtime, loc_time,sizeof(struct tm));
+			file_t debug_file;
+			if (!map_debug_file(path, debug_file))
+				return;
 
-        struct timeval tv;
-        gettimeofday(&tv,NULL);
-        millisec = tv.tv_usec / 1000;
-#endif //LOG_PLATFORM_WINDOWS
+			if (!read_symbols(debug_file, module.symbols))
+			{
+				munmap(const_cast<char*>(debug_file.data), debug_file.size);
+				return;
+			}
+		}
 
-		return newtime;
+		std::sort(module.symbols.begin(), module.symbols.end());
 	}
 
+	static bool map_file(const char* path, file_t& file)
+	{
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
 
-#ifndef _WIN32
+		struct stat st;
+		void* data = MAP_FAILED;
 
-    static std::string do_readlink(std::string const& path)
-    {
-        char buff[1024];
+		if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ElfW(Ehdr)))
+			data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-#ifdef LOG_HAVE_UNISTD_H
-        ssize_t len = ::readlink(path.c_str(), buff, sizeof(buff)-1);
-#else //LOG_HAVE_UNISTD_H
-	ssize_t len = -1;
-#endif //LOG_HAVE_UNISTD_H
+		close(fd);
 
-        if (len != -1)
-        {
-            buff[len] = '\0';
-            return std::string(buff);
-        }
+		if (data == MAP_FAILED)
+			return false;
 
-        return std::string();
-    }
+		file.data = static_cast<const char*>(data);
+		file.size = st.st_size;
 
-#endif //_WIN32
+		const ElfW(Ehdr)* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(file.data);
+		if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32)
+			|| ehdr->e_shentsize != sizeof(ElfW(Shdr)) || !in_file(file, ehdr->e_shoff, ehdr->e_shnum * sizeof(ElfW(Shdr))))
+		{
+			munmap(data, file.size);
+			return false;
+		}
 
-#if defined(LOG_PLATFORM_LINUX) || defined(LOG_PLATFORM_CYGWIN)
-#   define LOG_SELF_PROC_LINK "/proc/self/exe"
-#endif //defined(LOG_PLATFORM_LINUX) || defined(LOG_PLATFORM_CYGWIN)
+		return true;
+	}
 
-#ifdef LOG_PLATFORM_UNIX
-#   define LOG_SELF_PROC_LINK "/proc/curproc/file"
-#endif //LOG_PLATFORM_UNIX
+	static bool in_file(const file_t& file, uintptr_t offset, uintptr_t size)
+	{
+		return offset <= file.size && size <= file.size - offset;
+	}
 
-#ifdef LOG_PLATFORM_SOLARIS
-#   define LOG_SELF_PROC_LINK "/proc/self/path/a.out"
-#endif //LOG_PLATFORM_SOLARIS
+	static const ElfW(Shdr)* get_sections(const file_t& file, int& count)
+	{
+		const ElfW(Ehdr)* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(file.data);
+		count = ehdr->e_shnum;
+		return reinterpret_cast<const ElfW(Shdr)*>(file.data + ehdr->e_shoff);
+	}
+
+	static const ElfW(Shdr)* find_section(const file_t& file, const char* name)
+	{
+		int count;
+		const ElfW(Shdr)* sections = get_sections(file, count);
+		int names_index = reinterpret_cast<const ElfW(Ehdr)*>(file.data)->e_shstrndx;
+
+		if (names_index >= count || !in_file(file, sections[names_index].sh_offset, sections[names_index].sh_size))
+			return NULL;
 
+		const ElfW(Shdr)& names = sections[names_index];
 
-	static std::string get_process_file_path()
+		for (int i=0; i<count; i++)
+		{
+			if (sections[i].sh_name < names.sh_size && sections[i].sh_type != SHT_NOBITS
+				&& in_file(file, sections[i].sh_offset, sections[i].sh_size)
+				&& !strncmp(file.data + names.sh_offset + sections[i].sh_name, name, names.sh_size - sections[i].sh_name))
+				return &sections[i];
+		}
+
+		return NULL;
+	}
+
+	// Adds function symbols from .symtab, returns false if there is no .symtab
+	static bool read_symbols(const file_t& file, std::vector<symbol_t>& symbols)
 	{
-#ifdef LOG_PLATFORM_WINDOWS
-        char fileName[MAX_PATH];
+		int count;
+		const ElfW(Shdr)* sections = get_sections(file, count);
+		bool found = false;
 
-		GetModuleFileNameA(NULL,fileName,sizeof(fileName));
-		std::string path = fileName;
+		for (int i=0; i<count; i++)
+		{
+			const ElfW(Shdr)& symtab = sections[i];
+			if (symtab.sh_type != SHT_SYMTAB || symtab.sh_entsize != sizeof(ElfW(Sym)) || symtab.sh_link >= static_cast<unsigned>(count)
+				|| !in_file(file, symtab.sh_offset, symtab.sh_size))
+				continue;
 
-		size_t lastDelimiter = path.find_last_of("\\");
-		return path.substr(0,lastDelimiter);
-#else //LOG_PLATFORM_WINDOWS
+			const ElfW(Shdr)& strtab = sections[symtab.sh_link];
+			if (!in_file(file, strtab.sh_offset, strtab.sh_size) || !strtab.sh_size || file.data[strtab.sh_offset + strtab.sh_size - 1])
+				continue;
+
+			const ElfW(Sym)* sym = reinterpret_cast<const ElfW(Sym)*>(file.data + symtab.sh_offset);
+			const ElfW(Sym)* sym_end = sym + symtab.sh_size / sizeof(ElfW(Sym));
+
+			for (; sym != sym_end; sym++)
+			{
+				// symbol type is in low bits of st_info for both ELF classes
+				if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF || !sym->st_value
+					|| !sym->st_name || sym->st_name >= strtab.sh_size)
+					continue;
 
-        std::string path = do_readlink(LOG_SELF_PROC_LINK);
-        return path.substr(0,path.find_last_of('/'));
+				symbol_t symbol;
+				symbol.start = sym->st_value;
+				symbol.size = sym->st_size;
+				symbol.name = file.data + strtab.sh_offset + sym->st_name;
+				symbols.push_back(symbol);
+			}
 
-#endif //LOG_PLATFORM_WINDOWS
+			found = true;
+		}
+
+		return found;
 	}
 
-	static std::string get_process_full_file_name()
+	// Separate debug file: /usr/lib/debug/.build-id/xx/yyyy.debug, or file named in .gnu_debuglink
+	// next to module, in its .debug subdirectory or under /usr/lib/debug. Debug link CRC is not checked
+	static bool map_debug_file(const std::string& path, file_t& debug_file)
 	{
-#ifdef LOG_PLATFORM_WINDOWS
-        char file_name[MAX_PATH];
+		file_t file;
+		if (!map_file(path.c_str(), file))
+			return false;
 
-		GetModuleFileNameA(NULL,file_name,sizeof(file_name));
-		std::string path = file_name;
+		std::vector<std::string> candidates;
 
-		size_t last_delim = path.find_last_of("\\");
-		if (last_delim != std::string::npos)
-			last_delim++;
+		const ElfW(Shdr)* build_id = find_section(file, ".note.gnu.build-id");
+		if (build_id && build_id->sh_size > sizeof(ElfW(Nhdr)))
+		{
+			const ElfW(Nhdr)* note = reinterpret_cast<const ElfW(Nhdr)*>(file.data + build_id->sh_offset);
+			size_t desc_offset = sizeof(ElfW(Nhdr)) + ((note->n_namesz + 3) & ~3);
 
-		return path.substr(last_delim,std::string::npos);
-#else //LOG_PLATFORM_WINDOWS
-        std::string path = do_readlink(LOG_SELF_PROC_LINK);
+			if (note->n_type == NT_GNU_BUILD_ID && note->n_descsz > 1 && desc_offset + note->n_descsz <= build_id->sh_size)
+			{
+				const unsigned char* id = reinterpret_cast<const unsigned char*>(note) + desc_offset;
+				std::string name = stringformat("/usr/lib/debug/.build-id/%02x/", id[0]);
 
-        size_t last_delim = path.find_last_of("/");
-        if (last_delim != std::string::npos)
-            last_delim++;
-        else
-	return path;
+				for (size_t i=1; i<note->n_descsz; i++)
+					name += stringformat("%02x", id[i]);
 
-        return path.substr(last_delim,std::string::npos);
-#endif //LOG_PLATFORM_WINDOWS
-    }
+				candidates.push_back(name + ".debug");
+			}
+		}
 
-	static std::string get_process_file_name()
-	{
-		std::string full_name = get_process_full_file_name();
+		const ElfW(Shdr)* debug_link = find_section(file, ".gnu_debuglink");
+		if (debug_link && debug_link->sh_size && memchr(file.data + debug_link->sh_offset, 0, debug_link->sh_size))
+		{
+			std::string name = file.data + debug_link->sh_offset;
+			std::string dir;
 
-        size_t start = full_name.find_last_of('/');
-        if (start != std::string::npos)
-            start++;
-        else
-            start = 0;
+			char* real_path = realpath(path.c_str(), NULL);
+			if (real_path)
+			{
+				dir = real_path;
+				dir.erase(dir.rfind('/') + 1);
+				free(real_path);
+			}
 
-		size_t count = full_name.find_last_of(".");
-        return full_name.substr(start,count);
+			if (dir.size())
+			{
+				candidates.push_back(dir + name);
+				candidates.push_back(dir + ".debug/" + name);
+				candidates.push_back("/usr/lib/debug" + dir + name);
+			}
+		}
+
+		munmap(const_cast<char*>(file.data), file.size);
+
+		for (size_t i=0; i<candidates.size(); i++)
+		{
+			if (candidates[i] != path && map_file(candidates[i].c_str(), debug_file))
+				return true;
+		}
+
+		return false;
 	}
 };
 
-//////////////////////////////////////////////////////////////
-#if LOG_UNHANDLED_EXCEPTIONS
-    static void init_unhandled_exceptions_handler();
-#endif //LOG_UNHANDLED_EXCEPTIONS
-
-//////////////////////////////////////////////////////////////
+#endif //LOG_ELF_SYMBOLS
 
-#if (LOG_CONFIGURE_FROM_REGISTRY || LOG_USE_SYSTEMINFO) && defined(LOG_PLATFORM_WINDOWS)
-#	define LOG_DEFINE_REGISTRY_HELPER
-#endif //(LOG_CONFIGURE_FROM_REGISTRY || LOG_USE_SYSTEMINFO) && defined(LOG_PLATFORM_WINDOWS)
+#if !defined(LOG_PLATFORM_WINDOWS) && LOG_SYMBOL_CACHE_SIZE
 
-#ifdef LOG_DEFINE_REGISTRY_HELPER
-struct log_registry_helper
+// Process-wide cache of resolved stack trace frames: return address -> frame text.
+// Direct-mapped table, colliding address replaces previous entry, so memory is bounded by table size.
+// Entries are valid only for module generation they were resolved in, any module load or unload invalidates them
+class symbol_cache
 {
-	static HKEY reg_base_key_by_string(const std::string& storage)
+public:
+	static symbol_cache& instance()
 	{
-		if (storage == "HKLM" || storage == "HKEY_LOCAL_MACHINE")
-			return HKEY_LOCAL_MACHINE;
+		static symbol_cache cache;
+		return cache;
+	}
 
-		if (storage == "HKCU" || storage == "HKEY_CURRENT_USER")
-			return HKEY_CURRENT_USER;
+	bool find(void* addr, unsigned long generation, std::string& text)
+	{
+		size_t index = get_index(addr);
+		bool found = false;
 
-		if (storage == "HKCR" || storage == "HKEY_CLASSES_ROOT")
-			return HKEY_CLASSES_ROOT;
+		lock(index);
 
-		if (storage == "HKU" || storage == "HKEY_USERS")
-			return HKEY_USERS;
+		const entry_t& entry = entries_[index];
+		if (entry.addr == addr && entry.generation == generation)
+		{
+			text = entry.text;
+			found = true;
+		}
 
-		return HKEY_CURRENT_USER;
+		unlock(index);
+		return found;
 	}
 
-	static bool get_reg_dword_value(HKEY baseKey, const std::string& regPath, 
-		const std::string& valueName, unsigned long& value)
+	void insert(void* addr, unsigned long generation, const std::string& text)
 	{
-		HKEY   hkey ;
-		LONG ret = RegOpenKeyExA(baseKey, regPath.c_str(), 0, KEY_QUERY_VALUE, &hkey);
-		if (ret != ERROR_SUCCESS)
-			return false;
+		size_t index = get_index(addr);
 
-		DWORD size = 0;
-		DWORD type;
-		ret = -1;
-		RegQueryValueExA(hkey,valueName.c_str(),0,&type,NULL,&size);
+		lock(index);
 
-		if (type == REG_DWORD)
-		{
-			size = sizeof(long);
-			ret = RegQueryValueExA(hkey,valueName.c_str(),0,&type,(BYTE*)&value,&size);
-		}
+		entry_t& entry = entries_[index];
+		entry.addr = addr;
+		entry.generation = generation;
+		entry.text = text;
 
-		RegCloseKey(hkey);
-		return ret == ERROR_SUCCESS;
+		unlock(index);
 	}
 
-	static bool get_reg_sz_value(HKEY baseKey, const std::string& regPath, 
-		const std::string& valueName, std::string& result)
+private:
+	static const size_t table_size = LOG_SYMBOL_CACHE_SIZE;
+	static const size_t stripes_count = 16;
+
+	struct entry_t
 	{
-		HKEY   hkey ;
-		LONG ret = RegOpenKeyExA(baseKey, regPath.c_str(), 0, KEY_QUERY_VALUE, &hkey);
-		if (ret != ERROR_SUCCESS)
-			return false;
+		void* addr;
+		unsigned long generation;
+		std::string text;
 
-		DWORD size = 0;
-		DWORD type;
-		ret = -1;
-		RegQueryValueExA(hkey,valueName.c_str(),0,&type,NULL,&size);
+		entry_t() : addr(NULL), generation(0) {}
+	};
 
-		if (type == REG_SZ)
-		{
-			size_t bufSize = 512;
+	entry_t entries_[table_size];
 
-			std::string value;
-			value.resize(bufSize);
+#if LOG_MULTITHREADED
+	LOG_MT_MUTEX stripes_[stripes_count];
+#endif //LOG_MULTITHREADED
 
-			DWORD size = static_cast<DWORD>(value.length())+1;
-			ret = RegQueryValueExA(hkey,valueName.c_str(),0,&type,(BYTE*)value.data(),&size);
+	symbol_cache()
+	{
+#if LOG_MULTITHREADED
+		for (size_t i=0; i<stripes_count; i++)
+			LOG_MT_MUTEX_INIT(&stripes_[i], NULL);
+#endif //LOG_MULTITHREADED
+	}
 
-			while(ret == ERROR_MORE_DATA)
-			{
-				bufSize += 256;
-				value.resize(bufSize);
+	~symbol_cache()
+	{
+#if LOG_MULTITHREADED
+		for (size_t i=0; i<stripes_count; i++)
+			LOG_MT_MUTEX_DESTROY(&stripes_[i]);
+#endif //LOG_MULTITHREADED
+	}
 
-				size = static_cast<DWORD>(value.length())+1;
-				ret = RegQueryValueExA(hkey,valueName.c_str(),NULL,&type,(BYTE*)value.data(),&size);
-			}
+	static size_t get_index(void* addr)
+	{
+		uintptr_t value = reinterpret_cast<uintptr_t>(addr);
+		value ^= value >> 15;
+		value *= 0x9E3779B1u;
+		return (value ^ (value >> 16)) & (table_size - 1);
+	}
 
-			if (ret == ERROR_SUCCESS)
-				result = value.c_str();
-		}
+	void lock(size_t index)
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&stripes_[index & (stripes_count - 1)]);
+#else //LOG_MULTITHREADED
+		(void)index;
+#endif //LOG_MULTITHREADED
+	}
 
-		RegCloseKey(hkey);
-		return ret == ERROR_SUCCESS;
+	void unlock(size_t index)
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&stripes_[index & (stripes_count - 1)]);
+#else //LOG_MULTITHREADED
+		(void)index;
+#endif //LOG_MULTITHREADED
 	}
 };
-#endif //LOG_DEFINE_REGISTRY_HELPER
 
-//////////////////////////////////////////////////////////////
-#if LOG_USE_SYSTEMINFO
+#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_SYMBOL_CACHE_SIZE
 
-	static std::string get_processor_arch()
+#if !defined(LOG_PLATFORM_WINDOWS) && LOG_STACKTRACE_DEDUP_SIZE
+
+// Counts logged stack traces by hash of frame addresses. Direct-mapped table: trace displaced
+// by collision is counted from the beginning again, so it is logged in full once more with the same id
+class stack_dedup
+{
+public:
+	static stack_dedup& instance()
 	{
-#ifdef LOG_PLATFORM_WINDOWS
-        SYSTEM_INFO si;
-		::GetSystemInfo(&si);
+		static stack_dedup dedup;
+		return dedup;
+	}
 
-		std::string processorInfo;
+	// Returns number of times trace was seen including this one and short trace id
+	unsigned long register_trace(void* const* frames, int frames_count, std::string& id)
+	{
+		uint64_t hash = get_hash(frames, frames_count);
+		entry_t& entry = entries_[static_cast<size_t>(hash) & (table_size - 1)];
+		unsigned long count;
 
-		switch (si.wProcessorArchitecture)
+		lock();
+
+		if (entry.hash != hash || !entry.count)
 		{
-			case PROCESSOR_ARCHITECTURE_INTEL:
-				processorInfo += "IA-32";
-				break;
-			case PROCESSOR_ARCHITECTURE_AMD64:
-				processorInfo += "AMD64";
-				break;
-			case PROCESSOR_ARCHITECTURE_IA64:
-				processorInfo += "IA64";
-				break;
-			case PROCESSOR_ARCHITECTURE_UNKNOWN:
-			default:
-				processorInfo += "Unknown";
+			entry.hash = hash;
+			entry.count = 0;
 		}
-		processorInfo += stringformat(", count: %d", si.dwNumberOfProcessors);
-		return processorInfo;
-#else //LOG_PLATFORM_WINDOWS
 
+		count = ++entry.count;
 
-#ifdef LOG_HAVE_SYS_UTSNAME_H
-        struct utsname osname;
-        uname(&osname);
+		unlock();
 
-        return osname.machine;
-#else //LOG_HAVE_SYS_UTSNAME_H
-	if (sizeof(int) == 4)
-	    return "32-bit";
+		id = stringformat("%08lx", static_cast<unsigned long>((hash ^ (hash >> 32)) & 0xFFFFFFFF));
+		return count;
+	}
 
-	if (sizeof(int) == 8)
-	    return "64-bit";
+private:
+	static const size_t table_size = LOG_STACKTRACE_DEDUP_SIZE;
 
-	if (sizeof(int) == 2)
-	    return "16-bit";
+	struct entry_t
+	{
+		uint64_t hash;
+		unsigned long count;
+	};
 
-	if (sizeof(int) == 16)
-	    return "128-bit";
+	entry_t entries_[table_size];
 
-	return std::string();
-#endif //LOG_HAVE_SYS_UTSNAME_H
+#if LOG_MULTITHREADED
+	LOG_MT_MUTEX lock_;
+#endif //LOG_MULTITHREADED
 
-#endif //LOG_PLATFORM_WINDOWS
+	stack_dedup()
+	{
+		memset(entries_, 0, sizeof(entries_));
+
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_INIT(&lock_, NULL);
+#endif //LOG_MULTITHREADED
 	}
 
-#   ifdef LOG_PLATFORM_WINDOWS
-    static bool is_wow64_used()
+	~stack_dedup()
 	{
-		BOOL isWow;
-		::IsWow64Process(::GetCurrentProcess(),&isWow);
-		return isWow ? true : false;
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_DESTROY(&lock_);
+#endif //LOG_MULTITHREADED
 	}
 
-	typedef void (WINAPI *GetNativeSystemInfo_t)(LPSYSTEM_INFO);
-	typedef BOOL (WINAPI *GetProductInfo_t)(DWORD, DWORD, DWORD, DWORD, PDWORD);
+	// FNV-1a over frame addresses
+	static uint64_t get_hash(void* const* frames, int frames_count)
+	{
+		const uint64_t prime = (static_cast<uint64_t>(0x100) << 32) | 0x1B3;
+		uint64_t hash = (static_cast<uint64_t>(0xCBF29CE4) << 32) | 0x84222325;
 
+		for (int i=0; i<frames_count; i++)
+		{
+			hash ^= static_cast<uint64_t>(reinterpret_cast<uintptr_t>(frames[i]));
+			hash *= prime;
+		}
 
-#   endif //LOG_PLATFORM_WINDOWS
+		return hash;
+	}
 
-	static bool get_os_version_display_string(std::string& os_version)
+	void lock()
 	{
-#ifdef LOG_PLATFORM_WINDOWS
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
 
-#ifndef VER_SUITE_WH_SERVER
-#define VER_SUITE_WH_SERVER 0x00008000
-#endif
+	void unlock()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_UNLOCK(&lock_);
+#endif //LOG_MULTITHREADED
+	}
+};
 
-#ifndef PRODUCT_PROFESSIONAL
-#define PRODUCT_PROFESSIONAL 0x00000030
-#endif
+#endif //!defined(LOG_PLATFORM_WINDOWS) && LOG_STACKTRACE_DEDUP_SIZE
 
-		OSVERSIONINFOEXA osvi;
-		SYSTEM_INFO si;
-		DWORD dwType;
+class runtime_debugging
+{
 
-		os_version = "";
-		ZeroMemory(&si, sizeof(SYSTEM_INFO));
-		ZeroMemory(&osvi, sizeof(OSVERSIONINFOEXA));
-		osvi.dwOSVersionInfoSize = sizeof(OSVERSIONINFOEXA);
 
-		if (!GetVersionExA((OSVERSIONINFOA*) &osvi))
-			return false;
+#if defined(LOG_PLATFORM_WINDOWS)
 
-		GetNativeSystemInfo_t getNativeSystemInfoFn = reinterpret_cast<GetNativeSystemInfo_t>(
-			GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetNativeSystemInfo"));
+private:
+	static std::string get_pdb_search_path()
+	{
+		char pathBuffer[MAX_PATH];
+		std::stringstream symSearchPath;
+
+		const char* PdbCurrDir = "\\pdb";
+		const int PdbCurrDirLength = 5;
+
+		if (GetCurrentDirectoryA(sizeof(pathBuffer), pathBuffer))
+		  symSearchPath << pathBuffer << ";";
 
-		if (getNativeSystemInfoFn != NULL)
-			getNativeSystemInfoFn(&si);
-		else GetSystemInfo(&si);
+		if (strlen(pathBuffer) < sizeof(pathBuffer) - PdbCurrDirLength)
+		{
+			strcat(pathBuffer, PdbCurrDir);
+			symSearchPath << pathBuffer << ";";
+		}
 
-		if (VER_PLATFORM_WIN32_NT!=osvi.dwPlatformId || osvi.dwMajorVersion <= 4)
-			return false;
+		symSearchPath << utils::get_process_file_path() << ";";
+		symSearchPath << utils::get_process_file_path() << PdbCurrDir << ";";
 
-		os_version += "Microsoft ";
+		symSearchPath << configurator.get_log_path() << ";";
+		symSearchPath << configurator.get_log_path() << PdbCurrDir << ";";
 
-		if ( osvi.dwMajorVersion == 6 )
+		if (strlen(pathBuffer) && strlen(pathBuffer) < sizeof(pathBuffer) - PdbCurrDirLength)
 		{
-			if( osvi.dwMinorVersion == 0 )
-			{
-				if( osvi.wProductType == VER_NT_WORKSTATION )
-					os_version += "Windows Vista ";
-				else 
-					os_version += "Windows Server 2008 ";
-			}
+			strcat(pathBuffer, PdbCurrDir);
+		}
 
-			if ( osvi.dwMinorVersion == 1 )
-			{
-				if( osvi.wProductType == VER_NT_WORKSTATION )
-					os_version += "Windows 7 ";
-				else 
-					os_version += "Windows Server 2008 R2 ";
-			}
+		if (GetEnvironmentVariableA("_NT_SYMBOL_PATH", pathBuffer, sizeof(pathBuffer)))
+		  symSearchPath << pathBuffer << ";";
 
-			if ( osvi.dwMinorVersion == 2 )
-			{
-				if( osvi.wProductType == VER_NT_WORKSTATION )
-					os_version += "Windows 8 ";
-				else 
-					os_version += "Windows Server 2012 ";
-			}
+		if (GetEnvironmentVariableA("_NT_ALTERNATE_SYMBOL_PATH", pathBuffer, sizeof(pathBuffer)))
+		  symSearchPath << pathBuffer << ";";
 
+		if (GetEnvironmentVariableA("SYSTEMROOT", pathBuffer, sizeof(pathBuffer)))
+		  symSearchPath << pathBuffer << ";";
 
-			if ( osvi.dwMinorVersion == 3 )
-			{
-				if( osvi.wProductType == VER_NT_WORKSTATION )
-					os_version += "Windows 8.1 ";
-				else 
-					os_version += "Windows Server 2012 R2 ";
-			}
+		std::string result = symSearchPath.str();
+		if (result.size() > 0)
+			result = result.substr(0,result.size()-1);
 
-		 GetProductInfo_t pGPI = reinterpret_cast<GetProductInfo_t>(
-			 GetProcAddress(GetModuleHandle(TEXT("kernel32.dll")), "GetProductInfo"));
-		 pGPI( osvi.dwMajorVersion, osvi.dwMinorVersion, 0, 0, &dwType);
+		return result;
+	}
 
-		 switch( dwType )
-		 {
-			case PRODUCT_ULTIMATE: os_version += "Ultimate Edition";  break;
-			case PRODUCT_PROFESSIONAL: os_version += "Professional";  break;
-			case PRODUCT_HOME_PREMIUM: os_version += "Home Premium Edition";  break;
-			case PRODUCT_HOME_BASIC: os_version += "Home Basic Edition";  break;
-			case PRODUCT_ENTERPRISE:  os_version += "Enterprise Edition";  break;
-			case PRODUCT_BUSINESS: os_version += "Business Edition";  break;
-			case PRODUCT_STARTER: os_version += "Starter Edition";  break;
-			case PRODUCT_CLUSTER_SERVER:  os_version += "Cluster Server Edition";  break;
-			case PRODUCT_DATACENTER_SERVER:  os_version += "Datacenter Edition";  break;
-			case PRODUCT_DATACENTER_SERVER_CORE:  os_version += "Datacenter Edition (core installation)";  break;
-			case PRODUCT_ENTERPRISE_SERVER:  os_version += "Enterprise Edition";  break;
-			case PRODUCT_ENTERPRISE_SERVER_CORE: os_version += "Enterprise Edition (core installation)"; break;
-			case PRODUCT_ENTERPRISE_SERVER_IA64: os_version += "Enterprise Edition for Itanium-based Systems"; break;
-			case PRODUCT_SMALLBUSINESS_SERVER: os_version += "Small Business Server";  break;
-			case PRODUCT_SMALLBUSINESS_SERVER_PREMIUM: os_version += "Small Business Server Premium Edition"; break;
-			case PRODUCT_STANDARD_SERVER: os_version += "Standard Edition"; break;
-			case PRODUCT_STANDARD_SERVER_CORE:  os_version += "Standard Edition (core installation)";  break;
-			case PRODUCT_WEB_SERVER: os_version += "Web Server Edition";  break;
-		 }
+	static const char* get_symbol_type_string(int sym_type)
+	{
+		switch (sym_type)
+		{
+			case SymNone: return "-nosymbols-"; 
+			case SymCoff: return "COFF";
+			case SymCv: return "CV";
+			case SymPdb: return "PDB";
+			case SymExport: return "-exported-";
+			case SymDeferred: return "-deferred-";
+			case SymSym: return "SYM";
+			default: return stringformat("symtype=%ld",sym_type).c_str();
 		}
+	}
 
-		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 2 )
+	static void init_current_process_symbols()
+	{
+		static bool isFirstTime = TRUE;
+		if (isFirstTime) 
 		{
-		 if( GetSystemMetrics(SM_SERVERR2) )
-			os_version += "Windows Server 2003 R2, ";
-		 else if ( osvi.wSuiteMask & VER_SUITE_STORAGE_SERVER )
-			os_version +=  "Windows Storage Server 2003";
-		 else if ( osvi.wSuiteMask & VER_SUITE_WH_SERVER )
-			os_version += "Windows Home Server";
-		 else if( osvi.wProductType == VER_NT_WORKSTATION &&
-				  si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64)
-		 {
-			os_version += "Windows XP Professional x64 Edition";
-		 }
-		 else os_version += "Windows Server 2003, ";
+			if (!::SymInitialize(GetCurrentProcess(), get_pdb_search_path().c_str(), false))
+				return;
 
-		 // Test for the server type.
-		 if ( osvi.wProductType != VER_NT_WORKSTATION )
-		 {
-			if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_IA64 )
-			{
-				if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
-				   os_version +=  "Datacenter Edition for Itanium-based Systems";
-				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
-				   os_version += "Enterprise Edition for Itanium-based Systems";
-			}
+			unsigned long symOptions = SymGetOptions();
+			symOptions |= SYMOPT_LOAD_LINES;
+			symOptions &= ~SYMOPT_UNDNAME;
+			symOptions &= ~SYMOPT_DEFERRED_LOADS;
+			SymSetOptions(symOptions);
 
-			else if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64 )
-			{
-				if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
-				   os_version += "Datacenter x64 Edition";
-				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
-				   os_version += "Enterprise x64 Edition";
-				else os_version += "Standard x64 Edition";
-			}
-			else
-			{
-				if ( osvi.wSuiteMask & VER_SUITE_COMPUTE_SERVER )
-				   os_version += "Compute Cluster Edition";
-				else if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
-				   os_version += "Datacenter Edition";
-				else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
-				   os_version += "Enterprise Edition";
-				else if ( osvi.wSuiteMask & VER_SUITE_BLADE )
-				   os_version += "Web Edition";
-				else os_version += "Standard Edition";
-			}
-		 }
-		}
+			std::list<module_entry_t> modules;
+			module_definition::query_module_list(modules);
+			load_modules_pdbs(modules);
 
-		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 1 )
+			isFirstTime = FALSE;
+		} 
+	}
+
+	static void load_modules_pdbs(const std::list<module_entry_t>& modules)
+	{
+		for (std::list<module_entry_t>::const_iterator it = modules.begin(); it != modules.end(); ++it)
 		{
-		 os_version += "Windows XP ";
-		 if( osvi.wSuiteMask & VER_SUITE_PERSONAL )
-			os_version += "Home Edition";
-		 else os_version += "Professional";
+			SymLoadModule(GetCurrentProcess(), 0, it->imageName.c_str(), it->moduleName.c_str(), 
+				it->baseAddress, it->size );
 		}
+	}
 
-		if ( osvi.dwMajorVersion == 5 && osvi.dwMinorVersion == 0 )
+public:
+	static const char* get_system_expection_code_text(unsigned long exceptionCode) 
+	{
+		switch(exceptionCode) 
 		{
-		 os_version += "Windows 2000 ";
-
-		 if ( osvi.wProductType == VER_NT_WORKSTATION )
-		 {
-			os_version += "Professional";
-		 }
-		 else 
-		 {
-			if( osvi.wSuiteMask & VER_SUITE_DATACENTER )
-			   os_version += "Datacenter Server";
-			else if( osvi.wSuiteMask & VER_SUITE_ENTERPRISE )
-			   os_version += "Advanced Server";
-			else os_version += "Server";
-		 }
+			case EXCEPTION_ACCESS_VIOLATION: return "ACCESS VIOLATION";
+			case EXCEPTION_ARRAY_BOUNDS_EXCEEDED: return "ARRAY BOUNDS EXCEEDED";
+			case EXCEPTION_BREAKPOINT: return "BREAKPOINT";
+			case EXCEPTION_DATATYPE_MISALIGNMENT: return "DATATYPE MISALIGNMENT";
+			case EXCEPTION_FLT_DENORMAL_OPERAND: return "FLT DENORMAL OPERAND";
+			case EXCEPTION_FLT_DIVIDE_BY_ZERO: return "FLT DIVIDE BY ZERO";
+			case EXCEPTION_FLT_INEXACT_RESULT: return "FLT INEXACT RESULT";
+			case EXCEPTION_FLT_INVALID_OPERATION: return "FLT INVALID OPERATION";
+			case EXCEPTION_FLT_OVERFLOW: return "FLT OVERFLOW";
+			case EXCEPTION_FLT_STACK_CHECK: return "FLT STACK CHECK";
+			case EXCEPTION_FLT_UNDERFLOW: return "FLT UNDERFLOW";
+			case EXCEPTION_ILLEGAL_INSTRUCTION: return "ILLEGAL INSTRUCTION";
+			case EXCEPTION_IN_PAGE_ERROR: return "IN PAGE ERROR";
+			case EXCEPTION_INT_DIVIDE_BY_ZERO: return "INT DIVIDE BY ZERO";
+			case EXCEPTION_INT_OVERFLOW: return "INT OVERFLOW";
+			case EXCEPTION_INVALID_DISPOSITION: return "INVALID DISPOSITION";
+			case EXCEPTION_NONCONTINUABLE_EXCEPTION: return "NONCONTINUABLE EXCEPTION";
+			case EXCEPTION_PRIV_INSTRUCTION: return "PRIV INSTRUCTION";
+			case EXCEPTION_SINGLE_STEP: return "SINGLE STEP";
+			case EXCEPTION_STACK_OVERFLOW: return "STACK OVERFLOW";
+			case DBG_CONTROL_C : return "DBG CONTROL C ";
+			default:
+			return "<unkown exception>";
 		}
+	}
+	
+	struct stack_frame_t
+	{
+		std::string undecorated_sym_name;
+		std::string undecorated_full_sym_name;
 
-		if( strlen(osvi.szCSDVersion) > 0 )
+		DWORD offset_from_line_bytes;
+		
+		platform_dword_t offset_from_symbol_bytes;
+		platform_dword_t program_counter;
+		platform_dword_t module_base;
+
+		const char* sym_type;
+
+		std::string module_file_name;
+		std::string module_name;
+
+		std::string src_file_name;
+		int src_file_line;
+
+		stack_frame_t() : offset_from_symbol_bytes(0), sym_type(NULL), src_file_line(0), 
+			offset_from_line_bytes(0), program_counter(0), module_base(0)
+		{}
+	};
+
+	static std::list<stack_frame_t> get_stack_frames(HANDLE threadHandle, CONTEXT& c) 
+	{
+		static CRITICAL_SECTION cs;
+		static bool cs_initialized = false;
+
+		if (!cs_initialized)
 		{
-		  os_version += " ";
-		  os_version += osvi.szCSDVersion;
+			InitializeCriticalSection(&cs);
+			cs_initialized = true;
 		}
 
-		os_version += stringformat(" (build %d)", osvi.dwBuildNumber);
+		EnterCriticalSection(&cs);
+
+#ifdef _AMD64_
+		const intptr_t debug_failed_rip = 0xCCCCCCCCCCCCCCCC;
+		DWORD image_type = IMAGE_FILE_MACHINE_AMD64; 
+#else //_AMD64_
+		const intptr_t debug_failed_rip = 0xCCCCCCCC;
+		DWORD image_type = IMAGE_FILE_MACHINE_I386;
+#endif //_AMD64_
+		HANDLE process_handle = GetCurrentProcess();
+
+		std::list<stack_frame_t> frames;
 
-		if ( osvi.dwMajorVersion >= 6 )
+		static IMAGEHLP_SYMBOL *sym_ptr = NULL;
+		if (sym_ptr == NULL) 
 		{
-		 if ( si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_AMD64 )
-			os_version += ", 64-bit";
-		 else if (si.wProcessorArchitecture==PROCESSOR_ARCHITECTURE_INTEL )
-			os_version += ", 32-bit";
+			sym_ptr = (IMAGEHLP_SYMBOL*) malloc(MAX_PATH + sizeof(IMAGEHLP_SYMBOL));
+			if (!sym_ptr) 
+			{
+				LeaveCriticalSection(&cs);
+				return frames;
+			}
 		}
 
-		return true; 
-#else //LOG_PLATFORM_WINDOWS
-
-#ifdef LOG_HAVE_SYS_UTSNAME_H
-        struct utsname osname;
-        uname(&osname);
+		init_current_process_symbols();
 
-        os_version = osname.sysname;
-        os_version += " ";
-        os_version += osname.release;
-        os_version += " ";
-        os_version += osname.version;
+#ifndef _AMD64_
+		STACKFRAME stack_frame;
+#else //_AMD64_
+		STACKFRAME64 stack_frame;
+#endif //_AMD64_
 
-#else //LOG_HAVE_SYS_UTSNAME_H
+		memset(&stack_frame, 0, sizeof(stack_frame));
 
-	os_version = "Posix-based ";
-#	ifdef LOG_PLATFORM_UNIX
-	os_version += "Unix ";
-#	endif //LOG_PLATFORM_UNIX
+#ifndef _AMD64_
+		stack_frame.AddrPC.Offset = c.Eip;
+		stack_frame.AddrFrame.Offset = c.Ebp;
+		stack_frame.AddrStack.Offset = c.Esp;
+#else //_AMD64_
+		stack_frame.AddrPC.Offset = c.Rip;
+		stack_frame.AddrFrame.Offset = c.Rbp;
+		stack_frame.AddrStack.Offset = c.Rsp;
+#endif //_AMD64_
+		stack_frame.AddrPC.Mode = AddrModeFlat;
+		stack_frame.AddrFrame.Mode = AddrModeFlat;
+		stack_frame.AddrStack.Mode = AddrModeFlat;
 
-#	ifdef LOG_PLATFORM_BSD
-	os_version += "BSD ";
-#	endif //LOG_PLATFORM_BSD
+		memset(sym_ptr, 0, MAX_PATH + sizeof(IMAGEHLP_SYMBOL));
+		sym_ptr->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL);
+		sym_ptr->MaxNameLength = MAX_PATH;
 
-#	ifdef LOG_PLATFORM_LINUX
-	os_version += "Linux ";
-#	endif //LOG_PLATFORM_LINUX
+		IMAGEHLP_LINE line_info;
+		memset(&line_info, 0, sizeof line_info);
+		line_info.SizeOfStruct = sizeof(line_info);
 
-#	ifdef LOG_PLATFORM_CYGWIN
-	os_version += "CYGWIN ";
-#	endif //LOG_PLATFORM_CYGWIN
+		IMAGEHLP_MODULE module_info;
+		memset(&module_info, 0, sizeof(module_info));
+		module_info.SizeOfStruct = sizeof(module_info);
 
-#	ifdef LOG_PLATFORM_FREEBSD
-	os_version += "FreeBSD ";
-#	endif //LOG_PLATFORM_FREEBSD
+		for (int walkedStackFrames = 0; ; ++walkedStackFrames)
+		{
+//WARNING: in some cases we need to provide NULL as context when running in x86 context. But in most cases it does not working, try to provide context
+//			in all cases
 
-#	ifdef LOG_PLATFORM_NETBSD
-	os_version += "NetBSD ";
-#	endif //LOG_PLATFORM_NETBSD
+			if (!::StackWalk(image_type, process_handle, threadHandle, &stack_frame,  /*image_type == IMAGE_FILE_MACHINE_I386 ? NULL :*/ &c, NULL, 
+				&::SymFunctionTableAccess, &::SymGetModuleBase, NULL ))
+			{
+				break;
+			}
 
-#	ifdef LOG_PLATFORM_DRAGONFLYBSD
-	os_version += "DragonFlyBSD";
-#	endif //LOG_PLATFORM_DRAGONFLYBSD
+			stack_frame_t frame;
+			frame.sym_type = get_symbol_type_string(SymNone);
 
-#	ifdef LOG_PLATFORM_SOLARIS
-	os_version += "Solaris ";
-#	endif //LOG_PLATFORM_SOLARIS
+			if ( stack_frame.AddrPC.Offset != 0 
+				&& stack_frame.AddrPC.Offset != debug_failed_rip)
+			{
+				frame.program_counter = stack_frame.AddrPC.Offset;
 
-#	ifdef LOG_PLATFORM_MAC
-	os_version += "Mac-based ";
-#	endif //LOG_PLATFORM_MAC
+				if (::SymGetSymFromAddr(process_handle, stack_frame.AddrPC.Offset, &frame.offset_from_symbol_bytes, sym_ptr))
+				{
+					char undName[MAX_PATH] = {0};
+					char undFullName[MAX_PATH] = {0};
 
-#	ifdef LOG_PLATFORM_MACOSX
-	os_version += "MacOSX ";
-#	endif //LOG_PLATFORM_MACOSX
+					UnDecorateSymbolName(sym_ptr->Name, undName, MAX_PATH, UNDNAME_NAME_ONLY);
+					UnDecorateSymbolName(sym_ptr->Name, undFullName, MAX_PATH, UNDNAME_COMPLETE);
 
-#	ifdef LOG_PLATFORM_IPHONE
-	os_version += "IPhone ";
-#	endif //LOG_PLATFORM_IPHONE
+					frame.undecorated_sym_name = strlen(undName) > 0 ? undName : sym_ptr->Name;
+					frame.undecorated_full_sym_name = undFullName;
+				}
 
-#	ifdef LOG_PLATFORM_IPHONESIMULATOR
-	os_version += "Simulator ";
-#	endif //LOG_PLATFORM_IPHONESIMULATOR
+				if (::SymGetLineFromAddr(process_handle, stack_frame.AddrPC.Offset, &frame.offset_from_line_bytes, &line_info))
+				{
+					frame.src_file_name = line_info.FileName;
+					frame.src_file_line = line_info.LineNumber;
+				}
 
-#endif //LOG_HAVE_SYS_UTSNAME_H
+				if (::SymGetModuleInfo(process_handle, stack_frame.AddrPC.Offset, &module_info))
+				{
+					frame.module_name = module_info.ModuleName;
+					frame.module_base = module_info.BaseOfImage;
+					frame.sym_type = get_symbol_type_string(module_info.SymType);
+					frame.module_file_name = module_info.LoadedImageName;
+				}
+			} 
+			frames.push_back(frame);
+		} 
 
-        return true;
-#endif //LOG_PLATFORM_WINDOWS
+		LeaveCriticalSection(&cs);
+		return frames;
 	}
 
-#ifdef LOG_PLATFORM_WINDOWS
-	static bool get_os_version_display_string2(std::string& os_version)
+	static std::string get_stack_trace_string(HANDLE threadHandle, CONTEXT& c, int ignoreFunctions = 0) 
 	{
-		bool result;
-		
-		os_version = "";
-
-		// Get version from registry
-		std::string regProductName;
-		std::string regEditionId;
-		std::string regCurrentVersion;
-		std::string regCurrentBuildNumber;
+		std::stringstream stream;
+		std::list<stack_frame_t> stackFrames = get_stack_frames(threadHandle,c);
 
-		result = log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "ProductName", regProductName);
-		result &= log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "CurrentVersion", regCurrentVersion);
-		result &= log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "CurrentBuildNumber", regCurrentBuildNumber);
-		log_registry_helper::get_reg_sz_value(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion", "EditionID", regEditionId);
+		int n = 0;
 
-		if (result)
-			os_version = regProductName + std::string(" (") + regEditionId + std::string(") / Version ") + regCurrentVersion + std::string(" / Build ") + regCurrentBuildNumber;
+		for(std::list<stack_frame_t>::iterator i=stackFrames.begin(); i!=stackFrames.end(); i++, n++)
+		{
+			if (ignoreFunctions-- > 0)
+				continue;
+			
+			stack_frame_t& frame = *i;
 
-		return result;
-	}
-#endif //LOG_PLATFORM_WINDOWS
+			stream << "[" << n << "] " << "<--";
+			if (frame.undecorated_sym_name.size())
+				stream << stringformat(" %s %+ld bytes ", frame.undecorated_sym_name.c_str(), frame.offset_from_symbol_bytes);
 
+			if (frame.undecorated_full_sym_name.size())
+				stream << stringformat("[FUNCTION: %s] ", frame.undecorated_full_sym_name.c_str()); 
 
-	static bool get_host_name(std::string& name)
-	{
-	    name = "";
+			if (frame.src_file_name.size() || frame.src_file_line)
+				stream << stringformat("[Line: %s(%lu) %+ld bytes] ", frame.src_file_name.c_str(), frame.src_file_line, frame.offset_from_line_bytes);
 
-#ifdef LOG_PLATFORM_WINDOWS
-        char buffer[MAX_PATH];
-		DWORD size = sizeof(buffer);
+			if (frame.module_name.size())
+			{
+#ifdef _AMD64_
+                stream << stringformat("[Mod:  %s, base: %.8X%.8X] ",frame.module_name.c_str(), (uint32_t)(frame.module_base >> 32), (uint32_t)frame.module_base);
+#else //_AMD64_
+				stream << stringformat("[Mod:  %s, base: %08lxh] ",frame.module_name.c_str(), frame.module_base);
+#endif //_AMD64_
+			}
 
-		if (!::GetComputerNameExA(ComputerNamePhysicalDnsFullyQualified, buffer, &size))
-		{
-			if (!::GetComputerNameA(buffer, &size))
-				return false;
-		}
+#if LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND
+			if (!frame.module_name.size() && frame.program_counter)
+			{
+				std::string mod_detected_name = module_definition::module_name_by_addr(reinterpret_cast<void*>(frame.program_counter));
+				if (mod_detected_name.size())
+					stream << stringformat("[DETECTED Mod:  %s] ", mod_detected_name.c_str());
+			}
+#endif //LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND
 
-		name = buffer;
-#else //LOG_PLATFORM_WINDOWS
+#ifdef _AMD64_
+            stream << stringformat("\n Offset: 0x%.8X%.8X", (uint32_t)(frame.program_counter >> 32), (uint32_t)frame.program_counter);
+#else //_AMD64_
+            stream << stringformat("\n Offset: 0x%8.8X", frame.program_counter);
+#endif //_AMD64_
 
-#ifdef LOG_HAVE_SYS_UTSNAME_H
-        struct utsname osname;
-        uname(&osname);
-        name = osname.nodename;
-#endif //LOG_HAVE_SYS_UTSNAME_H
+			stream << stringformat(" Sym:  type: %s, file: %s\n", frame.sym_type, frame.module_file_name.c_str());
+		}
+		return stream.str();
+	}
 
-#endif //LOG_PLATFORM_WINDOWS
-		return true;
+	static std::string get_stack_trace_string(CONTEXT* c, int ignoreFunctions = 0)
+	{
+		return get_stack_trace_string(NULL,*c,ignoreFunctions);
 	}
 
 
-	static std::string get_memory_status()
-	{
-        std::string memoryString;
+#else //defined(LOG_PLATFORM_WINDOWS)
 
-#ifdef LOG_PLATFORM_WINDOWS
-		MEMORYSTATUSEX memoryStatus;
-		memset(&memoryStatus,0,sizeof(MEMORYSTATUSEX));
-		memoryStatus.dwLength = sizeof(MEMORYSTATUSEX);
+public:
+    // Fills frames with return addresses like backtrace(): first one is in function which called capture_stack_trace
+    static int __attribute__((noinline)) capture_stack_trace(void** frames, int max_frames)
+    {
+#if LOG_FRAME_POINTER_UNWIND
+        uintptr_t stack_low, stack_high;
+        if (get_stack_bounds(stack_low, stack_high))
+        {
+            // each frame starts with saved frame pointer of caller followed by return address
+            void** fp = static_cast<void**>(__builtin_frame_address(0));
+            int count = 0;
 
-		if (!GlobalMemoryStatusEx(&memoryStatus))
-			return "";
+            while (count < max_frames)
+            {
+                uintptr_t addr = reinterpret_cast<uintptr_t>(fp);
+                if (addr < stack_low || addr > stack_high - 2 * sizeof(void*) || addr % sizeof(void*))
+                    break;
 
-        memoryString = stringformat("Total physical " LOG_FMT_I64 ", Total virtual " LOG_FMT_I64, memoryStatus.ullTotalPhys, memoryStatus.ullTotalVirtual);
-		memoryString += stringformat("\nAvailable physical " LOG_FMT_I64 ", available virtual " LOG_FMT_I64 ", Load %d%%", memoryStatus.ullAvailPhys, memoryStatus.ullAvailVirtual, memoryStatus.dwMemoryLoad);
-		memoryString += stringformat("\nPage file size: " LOG_FMT_I64 ", page memory available " LOG_FMT_I64, memoryStatus.ullTotalPageFile, memoryStatus.ullAvailPageFile);
-#else //LOG_PLATFORM_WINDOWS
+                if (!fp[1])
+                    break;
 
-#ifdef LOG_HAVE_SYS_SYSINFO_H
-        struct sysinfo info;
-        sysinfo(&info);
+                frames[count++] = fp[1];
 
-        memoryString = stringformat("Total avail RAM %d, total swap %d, total high %d", info.totalram, info.totalswap, info.totalhigh);
-        memoryString += stringformat("\nFree RAM %d, free swap %d, free high %d", info.freeram, info.freeswap, info.freehigh);
-        memoryString += stringformat("\nMem used by buffers %d, shared RAM %d", info.bufferram, info.sharedram);
-        memoryString += stringformat("\nMemory unit in bytes %d, process count: %d", info.mem_unit, info.procs);
-        memoryString += stringformat("\nAvg load 1 min : 5 min : 15 min  --  %d:%d:%d", info.loads[0], info.loads[1], info.loads[2]);
-#endif //LOG_HAVE_SYS_SYSINFO_H
+                // stack grows down, so caller frame has higher address
+                void** next = static_cast<void**>(fp[0]);
+                if (next <= fp)
+                    break;
+
+                fp = next;
+            }
 
-#endif //LOG_PLATFORM_WINDOWS
+            return count;
+        }
+#endif //LOG_FRAME_POINTER_UNWIND
 
-		return memoryString;
-	}
+        int count = backtrace(frames, max_frames);
 
-	static std::string get_current_user_name()
-	{
-#ifdef LOG_PLATFORM_WINDOWS
-		char buf[MAX_PATH];
-		unsigned long bufferSize = sizeof(buf);
-		GetUserNameA(buf,&bufferSize);
-		return buf;
-#else //LOG_PLATFORM_WINDOWS
+        // first frame is capture_stack_trace itself
+        if (count > 0)
+        {
+            count--;
+            memmove(frames, frames + 1, count * sizeof(void*));
+        }
 
-#ifdef LOG_HAVE_PWD_H
-        struct passwd* pass;
-        pass = getpwuid(getuid());
+        return count;
+    }
 
-        if (!pass)
-            return "(unknown)";
+    static std::string get_stack_trace_string(void* trace[], int trace_len, int ignore_functions = 0)
+    {
+        std::string result;
+        std::string frame_text;
+        int index = 1;
 
-        return pass->pw_name;
-#else //LOG_HAVE_PWD_H
-	return "(cannot be obtained)";
-#endif //LOG_HAVE_PWD_H
+#if LOG_SYMBOL_CACHE_SIZE
+        symbol_cache& cache = symbol_cache::instance();
+        unsigned long generation = module_cache::query_generation();
+#endif //LOG_SYMBOL_CACHE_SIZE
 
-#endif //LOG_PLATFORM_WINDOWS
-	}
+        for (int i = 1 + ignore_functions; i < trace_len; i++)
+        {
+            result += stringformat(" [%d] <-- (%p) ", index++, trace[i]);
 
-	static std::string get_current_user_sid()
-	{
-#ifdef LOG_PLATFORM_WINDOWS
-        HANDLE hToken;
+#if LOG_SYMBOL_CACHE_SIZE
+            if (!cache.find(trace[i], generation, frame_text))
+            {
+                frame_text = resolve_frame(trace[i]);
 
-		OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken);
+                // frame resolved after modules were changed is not stored under previous generation
+                if (module_cache::query_generation() == generation)
+                    cache.insert(trace[i], generation, frame_text);
+            }
+#else //LOG_SYMBOL_CACHE_SIZE
+            frame_text = resolve_frame(trace[i]);
+#endif //LOG_SYMBOL_CACHE_SIZE
 
-		DWORD len = 0;
-		GetTokenInformation(hToken, TokenUser, 0, 0, &len);
+            result += frame_text;
+        }
 
-		TOKEN_USER* pUser = (TOKEN_USER*)malloc(len);
+        return result;
+    }
 
-		GetTokenInformation(hToken, TokenUser, pUser, len, &len);
+private:
+#if LOG_FRAME_POINTER_UNWIND
+    // Stack of current thread, queried once per thread
+    static bool get_stack_bounds(uintptr_t& stack_low, uintptr_t& stack_high)
+    {
+        static LOG_THREAD_LOCAL uintptr_t low = 0;
+        static LOG_THREAD_LOCAL uintptr_t high = 0;
 
-		char* sid = 0;
-		ConvertSidToStringSidA(pUser->User.Sid, &sid);
-		
-		std::string result = sid;
+        if (!high)
+        {
+            pthread_attr_t attr;
+            void* addr = NULL;
+            size_t size = 0;
 
-		CloseHandle(hToken);
-		LocalFree(sid);
-		free(pUser);
+            if (pthread_getattr_np(pthread_self(), &attr) != 0)
+                return false;
 
-		return result;
-#else // LOG_PLATFORM_WINDOWS
+            if (pthread_attr_getstack(&attr, &addr, &size) == 0)
+            {
+                low = reinterpret_cast<uintptr_t>(addr);
+                high = low + size;
+            }
 
-#ifdef LOG_HAVE_PWD_H
-        std::string result = stringformat("%d", getuid());
+            pthread_attr_destroy(&attr);
 
-        struct passwd* pass;
-        pass = getpwuid(getuid());
-        if (pass)
-        {
-            result += std::string(":");
-            result += stringformat("%d",pass->pw_gid);
+            if (!high)
+                return false;
         }
 
-        return result;
-#else //LOG_HAVE_PWD_H
-	return std::string();
-#endif //LOG_HAVE_PWD_H
+        stack_low = low;
+        stack_high = high;
+        return true;
+    }
+#endif //LOG_FRAME_POINTER_UNWIND
 
-#endif // LOG_PLATFORM_WINDOWS
-	}
+    // Demangled symbol of frame followed by raw backtrace_symbols line
+    static std::string resolve_frame(void* addr)
+    {
+        std::string result;
+        char **bt_syms = backtrace_symbols(&addr, 1);
 
+        if (!bt_syms)
+            return "\n";
 
-	static std::string query_system_info()
-	{
-		std::stringstream system_info;
-		system_info << "*********** SYSTEM INFORMATION *************" << std::endl;
+        std::string cur_full_sym = bt_syms[0];
+        char *begin_name = 0, *begin_offset = 0, *end_offset = 0;
 
-		std::string os_info;
-		if (get_os_version_display_string(os_info))
-			system_info << "OS: " << os_info << std::endl;
+        // find parentheses and +address offset surrounding the mangled name:
+        // ./module(function+0x15c) [0x8048a6d]
+        for (char *p = bt_syms[0]; *p; ++p)
+        {
+            if (*p == '(')
+                begin_name = p;
+            else if (*p == '+')
+                begin_offset = p;
+            else if (*p == ')' && begin_offset)
+            {
+                end_offset = p;
+                break;
+            }
+        }
 
-#ifdef LOG_PLATFORM_WINDOWS
-		if (get_os_version_display_string2(os_info))
-			system_info << "OS from registry: " << os_info << std::endl;
-#endif //LOG_PLATFORM_WINDOWS
+        if (begin_name && begin_offset && end_offset
+            && begin_name < begin_offset)
+        {
+            *begin_name++ = '\0';
+            *begin_offset++ = '\0';
+            *end_offset = '\0';
+
+            const char* name = begin_name;
+            std::string offset = begin_offset;
+
+#if LOG_ELF_SYMBOLS
+            // backtrace_symbols knows only exported symbols
+            uintptr_t elf_offset = 0;
+            const char* elf_name = elf_symbols::instance().find(addr, elf_offset);
+            if (elf_name)
+            {
+                name = elf_name;
+                offset = stringformat("0x%lx", static_cast<unsigned long>(elf_offset));
+            }
+#endif //LOG_ELF_SYMBOLS
 
-		system_info << "Processor architecture: " << get_processor_arch() << std::endl;
+            int status;
+            char* funcname = abi::__cxa_demangle(name, NULL, NULL, &status);
+            if (status == 0)
+            {
+                result += stringformat(" %s: %s+%s\n", bt_syms[0], funcname, offset.c_str());
+            }
+            else
+            {
+                // demangling failed. Output function name as a C function with
+                // no arguments.
+                result += stringformat(" %s: %s()+%s\n",bt_syms[0], name, offset.c_str());
+            }
 
-#ifdef LOG_PLATFORM_WINDOWS
-		if (is_wow64_used())
-			system_info << "Used WOW64" << std::endl;
-#endif //LOG_PLATFORM_WINDOWS
+            free(funcname);
+        }
+        else
+        {
+            // couldn't parse the line? print the whole line.
+            result += stringformat(" %s\n", bt_syms[0]);
+        }
 
-		std::string hostName;
-		if (get_host_name(hostName))
-			system_info << "Host Name: " << hostName << std::endl;
+        result += "    ";
+        result += cur_full_sym;
+        result += "\n";
 
-#ifdef LOG_PLATFORM_WINDOWS
-        system_info << stringformat("Current tick count: %d",GetTickCount()) << std::endl;
-#else //LOG_PLATFORM_WINDOWS
+        free(bt_syms);
+        return result;
+    }
 
-#	ifdef LOG_HAVE_SYS_SYSINFO_H
-        struct sysinfo info;
-        sysinfo(&info);
+#endif //defined(LOG_PLATFORM_WINDOWS)
 
-        system_info << stringformat("Uptime, seconds: %d", info.uptime) << std::endl;
-#	endif //LOG_HAVE_SYS_SYSINFO_H
+};
+#endif //LOG_AUTO_DEBUGGING
 
-#endif //LOG_PLATFORM_WINDOWS
+//////////////////////////////////////////////////////////////
 
-        system_info << "Current user SID: " << get_current_user_sid() << std::endl;
-		system_info << "Current user name: " <<  get_current_user_name() << std::endl;
+#if LOG_SHARED
 
-		system_info << "--- MEMORY ---" << std::endl;
-		system_info << get_memory_status() << std::endl;
+struct shared_obj
+{
+	static const intptr_t start_shared_page = 0x04320000;
+	static const int shared_page_size = 0x100000;
+	static const int shared_pages_find = 0x30;
+	static const unsigned long shared_page_mem_size = 0x100;
+	static const unsigned long shared_mem_signature_1 = 0x12345678;
+	static const unsigned long shared_mem_signature_2 = 0xA0B0C0D0;
 
-		system_info << "--- CURRENT MODULE ---" << std::endl;
 
-		std::string module_name = utils::get_process_file_name();
+#ifndef LOG_PLATFORM_WINDOWS
+    static inline bool get_page_bits(void *addr, int *bits)
+    {
+	// On linux, first check /proc/self/maps
+	unsigned long laddr = reinterpret_cast<unsigned long>(addr);
 
-#if LOG_USE_MODULEDEFINITION
-		std::string detected_name = module_definition::module_name_by_addr((void*)&query_system_info);
-		if (detected_name.length())
-			module_name = detected_name;
-#endif //LOG_USE_MODULEDEFINITION
+	FILE *pF = fopen("/proc/self/maps", "r");
+	if (pF) {
+	    // Linux /proc/self/maps -> parse
+	    // Format:
+	    // lower    upper    prot     stuff                 path
+	    // 08048000-0804c000 r-xp 00000000 03:03 1010107    /bin/cat
+	    unsigned long rlower, rupper;
+	    char r, w, x;
+	    while (fscanf(pF, "%lx-%lx %c%c%c", &rlower, &rupper, &r, &w, &x) != EOF) {
+		// Check whether we're IN THERE!
+		if (laddr >= rlower && laddr < rupper) {
+		    fclose(pF);
+		    *bits = 0;
+		    if (r == 'r')
+			*bits |= SH_MEM_READ;
+		    if (w == 'w')
+			*bits |= SH_MEM_WRITE;
+		    if (x == 'x')
+			*bits |= SH_MEM_EXEC;
 
-		system_info << "Module Name: " << module_name << std::endl;
+		    return true;
+		}
+		// Read to end of line
+		int c;
+		while ((c = fgetc(pF)) != '\n') {
+		    if (c == EOF)
+			break;
+		}
+		if (c == EOF)
+		    break;
+	    }
+	    fclose(pF);
+	    return false;
+	}
+	
+	pF = fopen("/proc/curproc/map","r");
+	if (pF) {
+	    // FreeBSD /proc/curproc/map
+	    // 0x804800 0x805500 13 15 0xc6e18960 r-x 21 0x0 COW NC vnode
+	    unsigned long rlower, rupper, ignoreLong;
+	    int ignoreInt;
+	    char r,w,x;
+	    while(fscanf(pF, "0x%lx 0x%lx %d %d 0x%lx %c%c%c", &rlower, &rupper, &ignoreInt, 
+		&ignoreInt, &ignoreLong, &r, &w, &x) != EOF)
+	    {
+		if(laddr >= rlower && laddr < rupper)
+		{
+		    fclose(pF);
+		    *bits = 0;
+		    if (r == 'r')
+			*bits |= SH_MEM_READ;
+		    if (w == 'w')
+			*bits |= SH_MEM_WRITE;
+		    if (x == 'x')
+			*bits |= SH_MEM_EXEC;
+		    return true;
+		}
 
-#if LOG_USE_MODULEDEFINITION && defined(LOG_PLATFORM_WINDOWS)
-		HMODULE module = reinterpret_cast<HMODULE>(pe_image::api_find_module_entry_point(
-			reinterpret_cast<intptr_t>(logging_get_caller_address())));
+		// Read to end of line
+		int c;
+		while ((c = fgetc(pF)) != '\n')
+		{
+		    if (c == EOF)
+			break;
+		}
+		if (c == EOF)
+		    break;
+	    }
+	    fclose(pF);
+	    return false;
+	}
+	return false;
+    }
+#endif //LOG_PLATFORM_WINDOWS
+
+	static void* create_shared_object(unsigned char object_id, void* object)
+	{
+		intptr_t shared_page = get_start_address(object_id);
+		void* result_ptr = NULL;
 		
-		std::string file_version, file_description;
-        std::string product_version, company_name;
-        unsigned long lang_id = 0;
+		for (intptr_t page = shared_page; 
+			page < shared_page + (shared_pages_find*shared_page_size); 
+			page += shared_page_size)
+		{
+#ifdef LOG_PLATFORM_WINDOWS
+			MEMORY_BASIC_INFORMATION mem_info;
+			if (!VirtualQuery((LPCVOID)page, &mem_info, sizeof(MEMORY_BASIC_INFORMATION)))
+				continue;
+
+			if (mem_info.State != MEM_FREE)
+				continue;
+
+			result_ptr = VirtualAlloc((LPVOID)page, shared_page_mem_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else //LOG_PLATFORM_WINDOWS
+			int page_bits;
+
+			if (get_page_bits((void*)page, &page_bits))
+			    continue;
 
-        if (module_definition::module_query_version_info(module, file_version, file_description, product_version, company_name, lang_id))
-		{
-			if (file_version.size())
-				system_info << "Module file version: " << file_version << std::endl;
+			result_ptr = mmap((void*)page, shared_page_mem_size, PROT_READ|PROT_WRITE|PROT_EXEC,MAP_PRIVATE|MAP_FIXED|MAP_ANONYMOUS,-1,0);
+#endif //LOG_PLATFORM_WINDOWS
 
-			if (file_description.size())
-				system_info << "Module file description: " << file_description << std::endl;
+			if (result_ptr)
+			{
+				memset(result_ptr, 0, shared_page_mem_size);
 
-			if (product_version.size())
-				system_info << "Product version: " << product_version << std::endl;
+				unsigned long* ptr = (unsigned long*)page;
+				*ptr = shared_mem_signature_1;
 
-			if (company_name.size())
-				system_info << "Module company name: " << company_name << std::endl;
+				ptr++;
 
-			if (lang_id)
-				system_info << "Module language ID: " << stringformat("%.X", lang_id) << std::endl;
+				*ptr = shared_mem_signature_2;
+
+				*(intptr_t*)(page + 8) = (intptr_t)object;
+
+				break;
+			}
 		}
-#endif //LOG_USE_MODULEDEFINITION && defined(LOG_PLATFORM_WINDOWS)
+		
+		return result_ptr;
+	}
 
+	static intptr_t try_found_shared_object_page(unsigned short object_id)
+	{
+		for (intptr_t page = start_shared_page; 
+			page < start_shared_page + (shared_pages_find*shared_page_size); 
+			page += shared_page_size)
+		{
 #ifdef LOG_PLATFORM_WINDOWS
-		system_info << "--- SYSTEM PATHS ---" << std::endl;
-		
-		char buffer[MAX_PATH+1];
-		GetWindowsDirectoryA(buffer, MAX_PATH);
-		system_info << "Windows dir: " << buffer << std::endl;
+			MEMORY_BASIC_INFORMATION mem_info;
+			if (!VirtualQuery((LPCVOID)page, &mem_info, sizeof(MEMORY_BASIC_INFORMATION)))
+				continue;
 
-		GetSystemDirectoryA(buffer, MAX_PATH);
-		system_info << "System dir: " << buffer << std::endl;
+			if (mem_info.State == MEM_COMMIT 
+				&& mem_info.Protect & PAGE_READWRITE)
+#else //LOG_PLATFORM_WINDOWS
+			int page_bits;
+			if (!get_page_bits((void*)page, &page_bits))
+			    continue;
 
-		GetTempPathA(MAX_PATH, buffer);
-		system_info << "Temp dir: " << buffer << std::endl;
+			if ((page_bits & SH_MEM_READ) && (page_bits & SH_MEM_WRITE))
 #endif //LOG_PLATFORM_WINDOWS
+			{
+				if (*((unsigned long*)page) != shared_mem_signature_1)
+					continue;
 
-		system_info << "********************************************" << std::endl;
-		return system_info.str();
+				if (*((unsigned long*)page + 1) != shared_mem_signature_2)
+					continue;
+
+				return page;
+			}
+		}
+		return (intptr_t)NULL;
 	}
-#endif // LOG_USE_SYSTEMINFO
 	
-////////////////////////////////////////////
+	static void* try_found_shared_object(unsigned short object_id)
+	{
+		intptr_t page = try_found_shared_object_page(object_id);
+		if (!page)
+			return NULL;
 
+		intptr_t* ptr = (intptr_t*)(page + 8);
+		return (void*)*ptr;
+	}
 
-static const char* default_hdr_format = "[$(V)] $(dd).$(MM).$(yyyy) $(hh):$(mm):$(ss).$(ttt) [$(PID):$(TID)] [$(module)!$(function)]";
+	static bool free_shared_object(unsigned char object_id)
+	{
+		void* obj = (void*)try_found_shared_object_page(object_id);
+		if (!obj)
+			return false;
 
-class log_configurator
-{
-public:
-	log_configurator()
-        :log_file_name_(utils::get_process_file_name() + ".log"),
-		log_path_(utils::get_process_file_path()),
-        hdr_format_(default_hdr_format),
-        need_sys_info_(true),
-		verb_level_(logger_verbose_optimal),
-		scroll_file_size_(2097152),
-		scroll_file_count_(15),
-		scroll_file_every_run_(false)
-#if LOG_CONFIGURE_FROM_REGISTRY
-		,reg_config_path_("")
-#endif //LOG_CONFIGURE_FROM_REGISTRY
+#ifdef LOG_PLATFORM_WINDOWS
+		VirtualFree(obj, 0, MEM_DECOMMIT);
+		return VirtualFree(obj, 0, MEM_RELEASE) ? true : false;
+#else //LOG_PLATFORM_WINDOWS
+		return munmap(obj, shared_page_mem_size) == 0;
+#endif //LOG_PLATFORM_WINDOWS
+	}
 
-#if LOG_INI_CONFIGURATION
-		,ini_file_find_paths_(process_config_macro(LOG_DEFAULT_INI_PATHS))
-#endif //LOG_INI_CONFIGURATION
+private:
+	static intptr_t get_start_address(unsigned char object_id)
 	{
-#if LOG_UNHANDLED_EXCEPTIONS
-		init_unhandled_exceptions_handler();
-#endif //LOG_UNHANDLED_EXCEPTIONS
-	}
+		return start_shared_page + ((intptr_t)object_id << 22);
+	}	
+};
 
-	const std::string& get_hdr_format() const { return hdr_format_; }
-	void set_hdr_format(const std::string& headerFormat) { hdr_format_ = process_config_macro(headerFormat); };
+#endif //LOG_SHARED
 
-#if LOG_USE_SYSTEMINFO
-	void set_need_sys_info(bool needSystemInfo) { need_sys_info_ = needSystemInfo; }
-	bool get_need_sys_info() const { return need_sys_info_; };
-#endif //LOG_USE_SYSTEMINFO
 
-	void set_log_file_name(std::string fileName) { log_file_name_ = process_config_macro(fileName); cached_log_file_path_.clear(); }
-	std::string get_log_file_name() const { return log_file_name_; }
+#if LOG_FLIGHT_RECORDER
 
-	void set_verbose_level(int verboseLevel) { verb_level_ = verboseLevel; }
-	int get_verbose_level() const { return verb_level_; }
+// Ring of last messages of all verbose levels, filtered ones too. Writers do not take locks: each message gets
+// its own index, slot sequence is odd while slot is written, so readers skip slots changed during copying.
+// Records are rendered without allocations and locks, so ring can be dumped from crash handler
+class flight_recorder
+{
+public:
+	static const unsigned long ring_size = LOG_FLIGHT_RECORDER_SIZE;
+	static const size_t text_size = LOG_FLIGHT_RECORDER_RECORD_SIZE;
+	static const size_t line_size = text_size + 64; // dumped record with time, level and thread id
 
-	void set_log_path(std::string logPath) { log_path_ = process_config_macro(logPath); cached_log_file_path_.clear(); }
-	std::string get_log_path() const { return log_path_; }
+	typedef void (*output_t)(void* context, const char* data, size_t len);
 
-	void set_log_scroll_file_size(size_t scrollFileSize) { scroll_file_size_ = scrollFileSize; }
-	size_t get_log_scroll_file_size() const { return scroll_file_size_; }
+	// Written flag means message passed verbose filter and is in log already, so it is not dumped
+	static void record(int verb_level, bool written, const char* src_file, int line_num,
+		const char* function_name, const char* format, va_list arguments)
+	{
+		unsigned long index;
+		size_t used;
+		record_t& rec = begin_record(verb_level, written, src_file, line_num, function_name, index, used);
 
-	void set_log_scroll_file_count(size_t scrollFileCount) { scroll_file_count_ = scrollFileCount; }
-	size_t get_log_scroll_file_count() const { return scroll_file_count_; }
+#ifdef LOG_COMPILER_MSVC
+		_vsnprintf_s(rec.text + used, text_size - used, _TRUNCATE, format, arguments);
+#else //LOG_COMPILER_MSVC
+		vsnprintf(rec.text + used, text_size - used, format, arguments);
+#endif //LOG_COMPILER_MSVC
 
-	void set_log_scroll_file_every_run(bool force_scroll) { scroll_file_every_run_ = force_scroll; }
-	bool get_log_scroll_file_every_run() const { return scroll_file_every_run_; }
+		atomic_ops::store(&rec.sequence, static_cast<long>(index * 2 + 2));
+	}
 
-	const std::string& get_full_log_file_path() 
+	// Same as above for already formatted text
+	static void record(int verb_level, bool written, const char* src_file, int line_num,
+		const char* function_name, const char* text)
 	{
-		if (!cached_log_file_path_.size())
-			cached_log_file_path_ = get_log_path() + "/" + get_log_file_name();
+		unsigned long index;
+		size_t used;
+		record_t& rec = begin_record(verb_level, written, src_file, line_num, function_name, index, used);
 
-		return cached_log_file_path_;
+		append(rec.text, text_size, used, text);
+
+		atomic_ops::store(&rec.sequence, static_cast<long>(index * 2 + 2));
 	}
 
-#if LOG_CONFIGURE_FROM_REGISTRY
-	void set_reg_config_path(std::string registryConfigurationPath) { reg_config_path_ = process_config_macro(registryConfigurationPath); }
-	std::string get_reg_config_path() const { return reg_config_path_; }
-#endif //LOG_CONFIGURE_FROM_REGISTRY
+	// Renders records which are not in log and were not dumped before. Empty string if there are no such records
+	static std::string dump()
+	{
+		update_utc_offset();
 
-#if LOG_INI_CONFIGURATION
-	void set_ini_file_find_paths(std::string ini_file_find_paths) { ini_file_find_paths_ = process_config_macro(ini_file_find_paths); }
-	std::string get_ini_file_find_paths() const { return ini_file_find_paths_; }
-#endif //LOG_INI_CONFIGURATION
+		std::string result;
+		write_records(&append_to_string, &result);
+		return result;
+	}
 
-private:
-    static std::string process_config_macro(std::string str)
+	// Same as dump, but async-signal-safe. Used from crash handler
+	static void dump(output_t output, void* context)
 	{
-        if (contains(str.c_str(),"$(CURRENTDIR)"))
-        {
-#ifdef LOG_PLATFORM_WINDOWS
-            char current_dir[MAX_PATH+1];
-            GetCurrentDirectoryA(MAX_PATH, current_dir);
-#else //LOG_PLATFORM_WINDOWS
-            char current_dir[512];
+		write_records(output, context);
+	}
 
-#	ifdef LOG_HAVE_UNISTD_H
-            if (getcwd(current_dir,512))
-                current_dir[0] = 0;
-#	else //LOG_HAVE_UNISTD_H
-	    strcpy(current_dir,"./");
-#	endif //LOG_HAVE_UNISTD_H
+	// Local time offset used for rendering, so it is not queried from crash handler
+	static void update_utc_offset()
+	{
+		atomic_ops::store(&state().utc_offset, utils::query_utc_offset());
+	}
 
-#endif //LOG_PLATFORM_WINDOWS
+private:
+	struct record_t
+	{
+		volatile long sequence; // index * 2 + 2 when record is complete
+		time_t seconds;
+		int millisec;
+		int verb_level;
+		bool written;
+		unsigned long tid;
+		char text[text_size];
+	};
 
-            str = replace(str,"$(CURRENTDIR)", current_dir);
-        }
+	struct recorder_state_t
+	{
+		volatile long next_index;
+		volatile long dumped_index;
+		volatile long utc_offset;
+		record_t ring[ring_size];
+	};
 
-        if (contains(str.c_str(),"$(TEMPPATH)"))
-        {
+	static recorder_state_t& state()
+	{
+		static recorder_state_t recorder_state;
+		return recorder_state;
+	}
+
+	static void query_time(time_t& seconds, int& millisec)
+	{
 #ifdef LOG_PLATFORM_WINDOWS
-            char temp_path[MAX_PATH+1];
-            GetTempPathA(MAX_PATH, temp_path);
+		FILETIME file_time;
+		GetSystemTimeAsFileTime(&file_time);
+
+		uint64_t time_100ns = (static_cast<uint64_t>(file_time.dwHighDateTime) << 32) | file_time.dwLowDateTime;
+		time_100ns -= 116444736000000000ULL; // 1601-01-01 to 1970-01-01
+
+		seconds = static_cast<time_t>(time_100ns / 10000000);
+		millisec = static_cast<int>((time_100ns / 10000) % 1000);
 #else //LOG_PLATFORM_WINDOWS
-            const char* temp_path = P_tmpdir;
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+
+		seconds = tv.tv_sec;
+		millisec = static_cast<int>(tv.tv_usec / 1000);
 #endif //LOG_PLATFORM_WINDOWS
+	}
 
-            str = replace(str,"$(TEMPPATH)", temp_path);
-        }
+	static void append_to_string(void* context, const char* data, size_t len)
+	{
+		static_cast<std::string*>(context)->append(data, len);
+	}
 
+	// Takes next slot, marks it as being written and fills everything except message text
+	static record_t& begin_record(int verb_level, bool written, const char* src_file, int line_num,
+		const char* function_name, unsigned long& index, size_t& used)
+	{
+		recorder_state_t& st = state();
+		index = static_cast<unsigned long>(atomic_ops::fetch_add(&st.next_index, 1));
+		record_t& rec = st.ring[index & (ring_size - 1)];
 
-#ifdef LOG_PLATFORM_WINDOWS
-		if (contains(str.c_str(),"$(SYSTEMPATH)"))
-		{
-			char system_path[MAX_PATH+1];
-			GetSystemDirectoryA(system_path, MAX_PATH);
+		atomic_ops::store(&rec.sequence, static_cast<long>(index * 2 + 1));
+		atomic_ops::fence();
 
-			str = replace(str,"$(SYSTEMPATH)", system_path);
-		}
+		query_time(rec.seconds, rec.millisec);
+		rec.verb_level = verb_level;
+		rec.written = written;
+		rec.tid = process_ids::tid();
 
-		if (contains(str.c_str(),"$(WINDOWSPATH)"))
+		const char* file_name = src_file;
+		for (const char* ptr = src_file; *ptr; ptr++)
 		{
-			char windows_path[MAX_PATH+1];
-			GetWindowsDirectoryA(windows_path, MAX_PATH);
-
-			str = replace(str,"$(WINDOWSPATH)", windows_path);
+			if (*ptr == '/' || *ptr == '\\')
+				file_name = ptr + 1;
 		}
 
-		if (contains(str.c_str(), "$(COMMONAPPDATA)"))
-		{
-			char appdata_path[MAX_PATH];
-			appdata_path[0] = 0;
+		used = 0;
+		append(rec.text, text_size, used, file_name);
+		append(rec.text, text_size, used, ":");
+		append_dec(rec.text, text_size, used, line_num, 0);
+		append(rec.text, text_size, used, " ");
+		append(rec.text, text_size, used, function_name);
+		append(rec.text, text_size, used, ": ");
 
-			SHGetFolderPathA(NULL, CSIDL_COMMON_APPDATA, NULL, 0, appdata_path);
+		return rec;
+	}
 
-			str = replace(str,"$(COMMONAPPDATA)", appdata_path);
-		}
+	static void write_records(output_t output, void* context)
+	{
+		recorder_state_t& st = state();
+		unsigned long end = static_cast<unsigned long>(atomic_ops::load(&st.next_index));
+		unsigned long begin;
 
-		if (contains(str.c_str(), "$(USERAPPDATA)"))
+		// each record is dumped once, even if several threads dump concurrently
+		do
 		{
-			char appdata_path[MAX_PATH];
-			appdata_path[0] = 0;
+			begin = static_cast<unsigned long>(atomic_ops::load(&st.dumped_index));
+			if (static_cast<long>(end - begin) <= 0)
+				return;
+		} while (!atomic_ops::cas(&st.dumped_index, static_cast<long>(begin), static_cast<long>(end)));
 
-			SHGetFolderPathA(NULL, CSIDL_APPDATA, NULL, 0, appdata_path);
+		if (end - begin > ring_size)
+			begin = end - ring_size;
 
-			str = replace(str,"$(USERAPPDATA)", appdata_path);
-		}
+		long utc_offset = atomic_ops::load(&st.utc_offset);
+		bool header_written = false;
+		char line[line_size];
 
-		if (contains(str.c_str(), "$(DESKTOPDIR)"))
+		for (unsigned long index = begin; index != end; index++)
 		{
-			char desktop_path[MAX_PATH];
-			desktop_path[0] = 0;
+			record_t rec;
+			if (!read_record(index, rec) || rec.written)
+				continue;
 
-			SHGetFolderPathA(NULL, CSIDL_DESKTOPDIRECTORY, NULL, 0, desktop_path);
+			if (!header_written)
+			{
+				const char header[] = "*** FLIGHT RECORDER ***\n";
+				output(context, header, sizeof(header) - 1);
+				header_written = true;
+			}
 
-			str = replace(str,"$(DESKTOPDIR)", desktop_path);
+			size_t used = render(rec, utc_offset, line);
+			output(context, line, used);
 		}
-#endif //LOG_PLATFORM_WINDOWS
-
-		str = replace(str,"$(EXEDIR)", utils::get_process_file_path());
-		str = replace(str,"$(EXEFILENAME)", utils::get_process_file_name());
-		str = replace(str,"$(EXEFULLFILENAME)", utils::get_process_full_file_name());
-
-#if LOG_USE_MODULEDEFINITION
-        std::string module_path = module_definition::module_name_by_addr((void*)&process_config_macro);
-
-        size_t last_delim = module_path.find_last_of("\\/");
-
-		std::string module_dir = module_path.substr(0,last_delim);
-
-		if (last_delim != std::string::npos)
-			last_delim++;
-
-		std::string module_full_file_name = module_path.substr(last_delim,std::string::npos);
-
-		size_t count = module_path.find_last_of(".");
-		if (count != std::string::npos)
-			count -= last_delim;
-
-		std::string module_file_name = module_path.substr(last_delim, count);
-
-		str = replace(str,"$(MODULEDIR)", module_dir);
-		str = replace(str,"$(MODULEFULLFILENAME)", module_full_file_name);
-		str = replace(str,"$(MODULEFILENAME)", module_file_name);
-#endif //LOG_USE_MODULEDEFINITION
-
-		return str;
-	}
-
-	std::string log_file_name_;
-    std::string log_path_;
-    std::string hdr_format_;
-	bool need_sys_info_;
-	int verb_level_;
-	size_t scroll_file_size_;
-	size_t scroll_file_count_;
-	bool scroll_file_every_run_;
-
-	std::string cached_log_file_path_;
-
-#if LOG_CONFIGURE_FROM_REGISTRY
-	std::string reg_config_path_;
-#endif //LOG_CONFIGURE_FROM_REGISTRY
 
-#if LOG_INI_CONFIGURATION
-	std::string ini_file_find_paths_;
-#endif //LOG_INI_CONFIGURATION
-};
+		if (header_written)
+		{
+			const char footer[] = "*** END FLIGHT RECORDER ***\n";
+			output(context, footer, sizeof(footer) - 1);
+		}
+	}
 
+	// Copies record, false if it was overwritten or is being written now
+	static bool read_record(unsigned long index, record_t& rec)
+	{
+		const record_t& slot = state().ring[index & (ring_size - 1)];
+		long sequence = static_cast<long>(index * 2 + 2);
 
-#if LOG_TEST_DO_NOT_WRITE_FILE
-#	include <sstream>
-#	undef LOG_FLUSH_FILE_EVERY_WRITE
-#	define LOG_FLUSH_FILE_EVERY_WRITE 1
-#endif //LOG_TEST_DO_NOT_WRITE_FILE
+		if (atomic_ops::load(&slot.sequence) != sequence)
+			return false;
 
+		rec.seconds = slot.seconds;
+		rec.millisec = slot.millisec;
+		rec.verb_level = slot.verb_level;
+		rec.written = slot.written;
+		rec.tid = slot.tid;
+		memcpy(rec.text, slot.text, text_size);
+		rec.text[text_size - 1] = 0;
 
-extern log_configurator configurator;
+		atomic_ops::fence();
+		return atomic_ops::load(&slot.sequence) == sequence;
+	}
 
-//////////////////////////////////////////////////////////////
-#if LOG_INI_CONFIGURATION
-class log_ini_configurator
-{
-public:
-	static bool configure(const char* ini_file_paths)
+	// [DEBUG] hh:mm:ss.ttt [tid] file:line function: text
+	static size_t render(const record_t& rec, long utc_offset, char* line)
 	{
-		std::vector<std::string> ini_paths;
-		split(ini_file_paths, ini_paths, ';');
+		long day_seconds = static_cast<long>((rec.seconds + utc_offset) % 86400);
+		if (day_seconds < 0)
+			day_seconds += 86400;
+
+		size_t used = 0;
+		append(line, line_size, used, "[");
+		append(line, line_size, used, get_verbose_name(rec.verb_level));
+		append(line, line_size, used, "] ");
+		append_dec(line, line_size, used, day_seconds / 3600, 2);
+		append(line, line_size, used, ":");
+		append_dec(line, line_size, used, day_seconds / 60 % 60, 2);
+		append(line, line_size, used, ":");
+		append_dec(line, line_size, used, day_seconds % 60, 2);
+		append(line, line_size, used, ".");
+		append_dec(line, line_size, used, rec.millisec, 3);
+		append(line, line_size, used, " [");
+		append_dec(line, line_size, used, static_cast<long>(rec.tid), 0);
+		append(line, line_size, used, "] ");
+		append(line, line_size, used, rec.text);
+
+		line[used++] = '\n';
+		return used;
+	}
 
-		for (size_t i=0; i<ini_paths.size(); i++)
+	static const char* get_verbose_name(int verb_level)
+	{
+		switch (verb_level)
 		{
-		    if (logging_ini::ini_parse(ini_paths[i].c_str(), handler, NULL) >= 0) 
-				return true;
+		case logger_verbose_fatal: return "FATAL";
+		case logger_verbose_error: return "ERROR";
+		case logger_verbose_warning: return "WARNING";
+		case logger_verbose_info: return "INFO";
+		case logger_verbose_debug: return "DEBUG";
+		default: return "?";
 		}
+	}
 
-		return false;
+	// appends while there is space for at least terminating zero in buffer
+	static void append(char* buffer, size_t size, size_t& used, const char* str)
+	{
+		for (; *str && used < size - 1; str++)
+			buffer[used++] = *str;
+
+		buffer[used] = 0;
 	}
 
-    static int LOG_CDECL handler(void* user, const char* section, const char* name,
-					   const char* value)
+	static void append_dec(char* buffer, size_t size, size_t& used, long value, int min_width)
 	{
-        (void)user;
+		char digits[24];
+		char* ptr = digits + sizeof(digits) - 1;
+		unsigned long abs_value = value < 0 ? 0 - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
 
-		if (!strcmp(section,"logger") && !strcmp(name, "LogPath")) 
-		{
-			configurator.set_log_path(value);
-		} 
-		else if (!strcmp(section,"logger") && !strcmp(name, "Verbose")) 
-		{
-			configurator.set_verbose_level(atoi(value));
-		} 
-		else if (!strcmp(section,"logger") && !strcmp(name, "HeaderFormat")) 
-		{
-			configurator.set_hdr_format(value);
-		} 
-		else if (!strcmp(section,"logger") && !strcmp(name, "LogFileName")) 
-		{
-			configurator.set_log_file_name(value);
-		} 
-#if LOG_USE_SYSTEMINFO
-        else if (!strcmp(section,"logger") && !strcmp(name, "LogSysInfo"))
-		{
-			configurator.set_need_sys_info(atoi(value) ? true : false);
-		} 
-#endif //LOG_USE_SYSTEMINFO
-		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileCount")) 
-		{
-			configurator.set_log_scroll_file_count(atoi(value));
-		} 
-		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileSize")) 
+		*ptr = 0;
+		do
 		{
-			configurator.set_log_scroll_file_size(atoi(value));
-		} 
-		else if (!strcmp(section,"logger") && !strcmp(name, "ScrollFileEveryRun")) 
-		{
-			configurator.set_log_scroll_file_every_run(atoi(value) ? true : false);
-		} 
-#if LOG_CONFIGURE_FROM_REGISTRY
-        else if (!strcmp(section,"logger") && !strcmp(name, "RegistryConfigPath"))
-		{
-			configurator.set_reg_config_path(value);
-		} 
-#endif //LOG_CONFIGURE_FROM_REGISTRY
-		else {
-			return 0;  /* unknown section/name, error */
-		}
-		return 1;
-	}
+			*--ptr = static_cast<char>('0' + abs_value % 10);
+			abs_value /= 10;
+			min_width--;
+		} while (abs_value || min_width > 0);
+
+		if (value < 0)
+			*--ptr = '-';
 
+		append(buffer, size, used, ptr);
+	}
 };
 
-#endif //LOG_INI_CONFIGURATION
+#endif //LOG_FLIGHT_RECORDER
 
-#if LOG_CONFIGURE_FROM_REGISTRY
+#if LOG_BINARY_FORMAT
+// Starts text written by crash handler to binary log file, it is not a type of any record
+static const char binary_text_marker = '\xFF';
+#endif //LOG_BINARY_FORMAT
 
-class log_registry_configurator
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
+// Writes crash report from signal handler. Text is rendered into buffer reserved at startup and written by write(2)
+// to log file descriptor opened in advance. No heap allocations and no locks are used on this path
+class crash_writer
 {
 public:
-	static bool configure(std::string key_path)
+	static const int max_frames = 256;
+
+	static const size_t alt_stack_size = 65536;
+
+	// Prepares crash output: first backtrace() call loads unwinder library and allocates, so it is done here
+	static void init()
 	{
-		if (key_path == "")
-			key_path = LOG_REGISTRY_DEFAULT_KEY;
+		void* frame;
+		backtrace(&frame, 1);
+	}
 
-		size_t storage_delim = key_path.find_first_of("\\/");
-		if (storage_delim == key_path.npos)
-			return false;
+	// Sets alternate signal stack for calling thread once, so crash report can be written on stack overflow.
+	// Stack is freed when thread exits. Thread which already has alternate stack is not changed
+	static __inline void ensure_alt_stack()
+	{
+		static LOG_THREAD_LOCAL bool alt_stack_checked = false;
 
-		std::string storage = key_path.substr(0,storage_delim);
-		HKEY base_key = log_registry_helper::reg_base_key_by_string(storage);
-		
-		std::string path = key_path.substr(storage_delim+1);
+		if (alt_stack_checked)
+			return;
 
-		std::string log_path;
-		if (log_registry_helper::get_reg_sz_value(base_key,path,"LogPath",log_path))
-			configurator.set_log_path(log_path);
+		alt_stack_checked = true;
+		set_alt_stack();
+	}
 
-		std::string hdr_format;
-		if (log_registry_helper::get_reg_sz_value(base_key,path,"HeaderFormat",hdr_format))
-			configurator.set_hdr_format(hdr_format);
+	// Opens log file for crash output in advance. Called each time log file is changed or rotated
+	static void set_log_file(const char* path)
+	{
+		int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+			return;
 
-		unsigned long verbose_level;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"Verbose",verbose_level))
-			configurator.set_verbose_level(verbose_level);
+		long prev_fd = atomic_ops::exchange(&state().fd, fd);
+		if (prev_fd >= 0)
+			close(static_cast<int>(prev_fd));
 
-#if LOG_USE_SYSTEMINFO
-		unsigned long log_sys_info;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"LogSystemInfo",log_sys_info))
-			configurator.set_need_sys_info(log_sys_info ? true : false);
-#endif //LOG_USE_SYSTEMINFO
+#if LOG_CRASH_REPORT_FILE
+		// path is written to inactive copy, then copy is published
+		crash_state_t& st = state();
+		long index = 1 - atomic_ops::load(&st.log_path_index);
 
-		unsigned long log_scroll_file_size;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileSize",log_scroll_file_size))
-			configurator.set_log_scroll_file_size(log_scroll_file_size);
+		if (strlen(path) < sizeof(st.log_paths[index]))
+		{
+			strcpy(st.log_paths[index], path);
+			atomic_ops::store(&st.utc_offset, utils::query_utc_offset());
+			atomic_ops::store(&st.log_path_index, index);
+		}
+#endif //LOG_CRASH_REPORT_FILE
+	}
 
-		unsigned long log_scroll_file_count;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileCount",log_scroll_file_count))
-			configurator.set_log_scroll_file_count(log_scroll_file_count);
+#if LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+	static void set_modules(const module_cache* modules)
+	{
+		atomic_ops::store_ptr((void* volatile*)&state().modules, const_cast<module_cache*>(modules));
+	}
+#endif //LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
 
-		unsigned long log_scroll_file_every_run;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"ScrollFileEveryRun",log_scroll_file_every_run))
-			configurator.set_log_scroll_file_every_run(log_scroll_file_every_run ? true : false);
+	typedef void (*pending_writer_t)(void* context);
 
-		unsigned long log_enabled;
-		if (log_registry_helper::get_reg_dword_value(base_key,path,"LogEnabled",log_enabled))
+	// Sets function which writes records not yet written by logger before crash report. NULL resets it
+	static void set_pending_writer(pending_writer_t writer, void* context)
+	{
+		crash_state_t& st = state();
+
+		if (writer)
 		{
-			if (!log_enabled)
-				configurator.set_verbose_level(logger_verbose_mute);
+			atomic_ops::store_ptr(&st.pending_context, context);
+			atomic_ops::store_ptr(&st.pending_writer, reinterpret_cast<void*>(writer));
+		}
+		else
+		{
+			atomic_ops::store_ptr(&st.pending_writer, NULL);
+			atomic_ops::store_ptr(&st.pending_context, NULL);
 		}
+	}
 
-		return true;
+	// Writes data as is to crash output. Can be called only from pending writer
+	static void write_raw(const char* data, size_t len)
+	{
+		flush();
+		write_output(data, len);
 	}
-	
-};
 
-#endif //LOG_CONFIGURE_FROM_REGISTRY
+#if LOG_BINARY_FORMAT
+	// Writes records encoded by binary_log_encoder to log file, they must be written before any text.
+	// Can be called only from pending writer
+	static void write_records(const char* data, size_t len)
+	{
+		flush();
+		long fd = atomic_ops::load(&state().fd);
+		if (fd >= 0)
+			write_all(static_cast<int>(fd), data, len);
+	}
+#endif //LOG_BINARY_FORMAT
 
-//////////////////////////////////////////////////////////////
+	// Writes frame addresses with module offsets. Can be called only from pending writer
+	static void write_frames(void* const* frames, int frames_count)
+	{
+		put_frames(frames, frames_count);
+		flush();
+	}
 
-struct logger_interface
-{
-	virtual ~logger_interface() {};
+	static void report(int sig, siginfo_t* info, void* context)
+	{
+		ucontext_t* uc = static_cast<ucontext_t*>(context);
+		void* pc = get_pc(uc);
 
-	virtual void log_binary(int verbLevel, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber, const char* data, int len) = 0;
+		pending_writer_t pending_writer = reinterpret_cast<pending_writer_t>(atomic_ops::load_ptr(&state().pending_writer));
+		if (pending_writer)
+			pending_writer(atomic_ops::load_ptr(&state().pending_context));
 
-    virtual void /*__cdecl*/ log(int verbLevel, void* addr, const char* functionName,
-		const char* sourceFile, int lineNumber, const char* format, ...) = 0;
+#if LOG_FLIGHT_RECORDER
+		flight_recorder::dump(&write_recorder_output, NULL);
+#endif //LOG_FLIGHT_RECORDER
 
-	virtual void log_args(int verb_level, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber, const char* format, va_list arguments) = 0;
+		put_signal(sig, info, pc);
 
-#if LOG_USE_MODULEDEFINITION
-	virtual void log_modules(int verbLevel, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber) = 0;
-#endif //LOG_USE_MODULEDEFINITION
+#if LOG_SHOW_MESSAGE_ON_FATAL_CRASH
+		write_all(STDOUT_FILENO, state().buffer, state().used);
+#endif //LOG_SHOW_MESSAGE_ON_FATAL_CRASH
 
-#if LOG_AUTO_DEBUGGING
-	virtual void log_stack_trace(int verbLevel, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber) = 0;
-#endif //LOG_AUTO_DEBUGGING
+		put_registers(uc, false);
 
-	virtual void log_exception(int verbLevel, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber, const char* userMessage) = 0;
+		void** frames = state().frames;
+		int frames_count = backtrace(frames, max_frames);
 
-	virtual void log_exception(int verbLevel, void* addr, const char* functionName, 
-		const char* sourceFile, int lineNumber, std::exception* e) = 0;
+		put("*** STACKTRACE ***\n");
+		put_stack(frames, frames_count, pc);
+		put("*** END STACKTRACE ***\n");
 
-	virtual void ref() = 0;
-	virtual void deref() = 0;
-	virtual int ref_counter() = 0;
-};
+#if LOG_CRASH_REPORT_FILE
+		int report_fd = open_report_file();
+		if (report_fd >= 0)
+		{
+			put("Crash report: ");
+			put(state().report_path);
+			put("\n");
+			flush();
 
-//////////////////////////////////////////////////////////////
+			state().report_fd = report_fd;
 
-#if LOG_AUTO_DEBUGGING
+			put_signal(sig, info, pc);
+			put_signal_info(info);
+			put_registers(uc, true);
 
-class runtime_debugging
-{
+			put("*** THREAD ");
+			put_thread_name(static_cast<long>(process_ids::query_tid()));
+			put(" (crashed) ***\n");
+			put_stack(frames, frames_count, pc);
 
+			put_threads();
+			put_maps();
+			flush();
 
-#if defined(LOG_PLATFORM_WINDOWS)
+			state().report_fd = -1;
+			close(report_fd);
+		}
+#endif //LOG_CRASH_REPORT_FILE
+
+		flush();
+	}
 
 private:
-	static std::string get_pdb_search_path()
+	static void set_alt_stack()
 	{
-		char pathBuffer[MAX_PATH];
-		std::stringstream symSearchPath;
+		stack_t current;
+		if (sigaltstack(NULL, &current) != 0 || !(current.ss_flags & SS_DISABLE))
+			return;
 
-		const char* PdbCurrDir = "\\pdb";
-		const int PdbCurrDirLength = 5;
+		stack_t alt_stack;
+		alt_stack.ss_sp = malloc(alt_stack_size);
+		alt_stack.ss_size = alt_stack_size;
+		alt_stack.ss_flags = 0;
 
-		if (GetCurrentDirectoryA(sizeof(pathBuffer), pathBuffer))
-		  symSearchPath << pathBuffer << ";";
+		if (!alt_stack.ss_sp)
+			return;
 
-		if (strlen(pathBuffer) < sizeof(pathBuffer) - PdbCurrDirLength)
+		if (sigaltstack(&alt_stack, NULL) != 0)
 		{
-			strcat(pathBuffer, PdbCurrDir);
-			symSearchPath << pathBuffer << ";";
+			free(alt_stack.ss_sp);
+			return;
 		}
 
-		symSearchPath << utils::get_process_file_path() << ";";
-		symSearchPath << utils::get_process_file_path() << PdbCurrDir << ";";
+#ifdef LOG_HAVE_PTHREAD
+		static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+		pthread_once(&key_once, &create_alt_stack_key);
+		pthread_setspecific(alt_stack_key(), alt_stack.ss_sp);
+#endif //LOG_HAVE_PTHREAD
+	}
 
-		symSearchPath << configurator.get_log_path() << ";";
-		symSearchPath << configurator.get_log_path() << PdbCurrDir << ";";
+#ifdef LOG_HAVE_PTHREAD
+	static pthread_key_t& alt_stack_key()
+	{
+		static pthread_key_t key;
+		return key;
+	}
 
-		if (strlen(pathBuffer) && strlen(pathBuffer) < sizeof(pathBuffer) - PdbCurrDirLength)
-		{
-			strcat(pathBuffer, PdbCurrDir);
-		}
+	static void create_alt_stack_key()
+	{
+		pthread_key_create(&alt_stack_key(), &free_alt_stack);
+	}
 
-		if (GetEnvironmentVariableA("_NT_SYMBOL_PATH", pathBuffer, sizeof(pathBuffer)))
-		  symSearchPath << pathBuffer << ";";
+	// called on thread exit
+	static void free_alt_stack(void* stack)
+	{
+		stack_t disabled;
+		disabled.ss_sp = NULL;
+		disabled.ss_size = 0;
+		disabled.ss_flags = SS_DISABLE;
 
-		if (GetEnvironmentVariableA("_NT_ALTERNATE_SYMBOL_PATH", pathBuffer, sizeof(pathBuffer)))
-		  symSearchPath << pathBuffer << ";";
+		sigaltstack(&disabled, NULL);
+		free(stack);
+	}
+#endif //LOG_HAVE_PTHREAD
 
-		if (GetEnvironmentVariableA("SYSTEMROOT", pathBuffer, sizeof(pathBuffer)))
-		  symSearchPath << pathBuffer << ";";
+#if LOG_CRASH_REPORT_FILE
+	static const int max_thread_frames = 64;
 
-		std::string result = symSearchPath.str();
-		if (result.size() > 0)
-			result = result.substr(0,result.size()-1);
+	// Milliseconds crashed thread waits for backtrace of one thread and for backtraces of all threads
+	static const long thread_wait_ms = 50;
+	static const long threads_wait_ms = 1000;
 
-		return result;
+	// Backtrace of other thread, filled by its LOG_CRASH_THREAD_SIGNAL handler. Request id is sent with signal,
+	// handler of this request and thread claims buffer by changing open from request id to its negative value,
+	// so late handler of previous request never writes it
+	struct thread_dump_t
+	{
+		volatile long open; // request id while crashed thread waits for it, 0 when buffer is not available
+		volatile long tid; // thread asked by current request
+		volatile long done; // request id when buffer is filled
+		int frames_count;
+		void* pc;
+		void* frames[max_thread_frames];
+	};
+
+	struct linux_dirent64_t
+	{
+		unsigned long long d_ino;
+		long long d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[1];
+	};
+#endif //LOG_CRASH_REPORT_FILE
+
+	struct crash_state_t
+	{
+		volatile long fd;
+		size_t used;
+		char buffer[4096];
+		void* frames[max_frames];
+		void* volatile modules;
+		void* volatile pending_writer;
+		void* volatile pending_context;
+
+#if LOG_BINARY_FORMAT
+		bool text_started; // text marker is written to log file
+#endif //LOG_BINARY_FORMAT
+
+#if LOG_CRASH_REPORT_FILE
+		int report_fd; // output is redirected to report file while it is written
+		char log_paths[2][1024];
+		volatile long log_path_index;
+		volatile long utc_offset;
+		char report_path[1100];
+		thread_dump_t thread_dump;
+#endif //LOG_CRASH_REPORT_FILE
+	};
+
+	static crash_state_t& state()
+	{
+		static crash_state_t crash_state = { -1, 0, "", { NULL }, NULL, NULL, NULL
+#if LOG_BINARY_FORMAT
+			, false
+#endif //LOG_BINARY_FORMAT
+#if LOG_CRASH_REPORT_FILE
+			, -1, { "", "" }, 0, 0, "", { 0, 0, 0, NULL, { NULL } }
+#endif //LOG_CRASH_REPORT_FILE
+		};
+		return crash_state;
 	}
 
-	static const char* get_symbol_type_string(int sym_type)
+	static void put_signal(int sig, siginfo_t* info, void* pc)
 	{
-		switch (sym_type)
+		put("[FATAL] *** Got signal ");
+		put_dec(sig);
+		put(" (");
+		put(get_signal_name(sig));
+		put("), code ");
+		put_dec(info->si_code);
+
+		// signal sent by kill/raise/abort has no fault address
+		if (info->si_code > 0)
 		{
-			case SymNone: return "-nosymbols-"; 
-			case SymCoff: return "COFF";
-			case SymCv: return "CV";
-			case SymPdb: return "PDB";
-			case SymExport: return "-exported-";
-			case SymDeferred: return "-deferred-";
-			case SymSym: return "SYM";
-			default: return stringformat("symtype=%ld",sym_type).c_str();
+			put(", faulty address ");
+			put_hex(reinterpret_cast<uintptr_t>(info->si_addr));
 		}
+
+		put(", from ");
+		put_hex(reinterpret_cast<uintptr_t>(pc));
+		put(" [");
+		put_dec(static_cast<long>(process_ids::query_pid()));
+		put(":");
+		put_dec(static_cast<long>(process_ids::query_tid()));
+		put("]\n");
 	}
 
-	static void init_current_process_symbols()
+	static void put_stack(void** frames, int frames_count, void* pc)
 	{
-		static bool isFirstTime = TRUE;
-		if (isFirstTime) 
+		// frames of signal handler and signal trampoline are skipped: trace starts from interrupted instruction
+		int first_frame = 0;
+		while (first_frame < frames_count && frames[first_frame] != pc)
+			first_frame++;
+
+		if (first_frame == frames_count)
+			first_frame = 0;
+
+		put_frames(frames + first_frame, frames_count - first_frame);
+	}
+
+	static void put_frames(void* const* frames, int frames_count)
+	{
+		for (int i=0; i<frames_count; i++)
 		{
-			if (!::SymInitialize(GetCurrentProcess(), get_pdb_search_path().c_str(), false))
-				return;
+			put("[");
+			put_dec(i);
+			put("] ");
+			put_hex(reinterpret_cast<uintptr_t>(frames[i]));
+			put_module(frames[i]);
+			put("\n");
+		}
+	}
 
-			unsigned long symOptions = SymGetOptions();
-			symOptions |= SYMOPT_LOAD_LINES;
-			symOptions &= ~SYMOPT_UNDNAME;
-			symOptions &= ~SYMOPT_DEFERRED_LOADS;
-			SymSetOptions(symOptions);
+#if LOG_CRASH_REPORT_FILE
+	static char* append_str(char* dst, const char* end, const char* str)
+	{
+		while (*str && dst < end)
+			*dst++ = *str++;
 
-			std::list<module_entry_t> modules;
-			module_definition::query_module_list(modules);
-			load_modules_pdbs(modules);
+		*dst = 0;
+		return dst;
+	}
+
+	static char* append_dec(char* dst, const char* end, long value, int min_width)
+	{
+		char digits[24];
+		char* ptr = digits + sizeof(digits) - 1;
+
+		*ptr = 0;
+		do
+		{
+			*--ptr = static_cast<char>('0' + value % 10);
+			value /= 10;
+			min_width--;
+		} while (value > 0 || min_width > 0);
 
-			isFirstTime = FALSE;
-		} 
+		return append_str(dst, end, ptr);
 	}
 
-	static void load_modules_pdbs(const std::list<module_entry_t>& modules)
+	// <log file>__yyyy_MM_dd__hh_mm_ss.crash, same naming as minidump on Windows
+	static int open_report_file()
 	{
-		for (std::list<module_entry_t>::const_iterator it = modules.begin(); it != modules.end(); ++it)
-		{
-			SymLoadModule(GetCurrentProcess(), 0, it->imageName.c_str(), it->moduleName.c_str(), 
-				it->baseAddress, it->size );
-		}
+		crash_state_t& st = state();
+		const char* log_path = st.log_paths[atomic_ops::load(&st.log_path_index)];
+
+		if (!*log_path)
+			return -1;
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		long seconds = static_cast<long>(now.tv_sec) + atomic_ops::load(&st.utc_offset);
+		long days = seconds / 86400;
+		long day_seconds = seconds % 86400;
+
+		// civil date from days since 1970-01-01
+		long z = days + 719468;
+		long era = z / 146097;
+		long doe = z - era * 146097;
+		long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		long mp = (5 * doy + 2) / 153;
+		long day = doy - (153 * mp + 2) / 5 + 1;
+		long month = mp < 10 ? mp + 3 : mp - 9;
+		long year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+		char* end = st.report_path + sizeof(st.report_path) - 1;
+		char* ptr = append_str(st.report_path, end, log_path);
+		ptr = append_str(ptr, end, "__");
+		ptr = append_dec(ptr, end, year, 4);
+		ptr = append_str(ptr, end, "_");
+		ptr = append_dec(ptr, end, month, 2);
+		ptr = append_str(ptr, end, "_");
+		ptr = append_dec(ptr, end, day, 2);
+		ptr = append_str(ptr, end, "__");
+		ptr = append_dec(ptr, end, day_seconds / 3600, 2);
+		ptr = append_str(ptr, end, "_");
+		ptr = append_dec(ptr, end, day_seconds / 60 % 60, 2);
+		ptr = append_str(ptr, end, "_");
+		ptr = append_dec(ptr, end, day_seconds % 60, 2);
+		append_str(ptr, end, ".crash");
+
+		return open(st.report_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
 	}
 
-public:
-	static const char* get_system_expection_code_text(unsigned long exceptionCode) 
+	static void put_signal_info(siginfo_t* info)
 	{
-		switch(exceptionCode) 
+		put("*** SIGNAL INFO ***\n");
+		put_register("signo", static_cast<uintptr_t>(info->si_signo));
+		put_register("errno", static_cast<uintptr_t>(info->si_errno));
+		put_register("code", static_cast<uintptr_t>(static_cast<unsigned int>(info->si_code)));
+
+		if (info->si_code > 0)
 		{
-			case EXCEPTION_ACCESS_VIOLATION: return "ACCESS VIOLATION";
-			case EXCEPTION_ARRAY_BOUNDS_EXCEEDED: return "ARRAY BOUNDS EXCEEDED";
-			case EXCEPTION_BREAKPOINT: return "BREAKPOINT";
-			case EXCEPTION_DATATYPE_MISALIGNMENT: return "DATATYPE MISALIGNMENT";
-			case EXCEPTION_FLT_DENORMAL_OPERAND: return "FLT DENORMAL OPERAND";
-			case EXCEPTION_FLT_DIVIDE_BY_ZERO: return "FLT DIVIDE BY ZERO";
-			case EXCEPTION_FLT_INEXACT_RESULT: return "FLT INEXACT RESULT";
-			case EXCEPTION_FLT_INVALID_OPERATION: return "FLT INVALID OPERATION";
-			case EXCEPTION_FLT_OVERFLOW: return "FLT OVERFLOW";
-			case EXCEPTION_FLT_STACK_CHECK: return "FLT STACK CHECK";
-			case EXCEPTION_FLT_UNDERFLOW: return "FLT UNDERFLOW";
-			case EXCEPTION_ILLEGAL_INSTRUCTION: return "ILLEGAL INSTRUCTION";
-			case EXCEPTION_IN_PAGE_ERROR: return "IN PAGE ERROR";
-			case EXCEPTION_INT_DIVIDE_BY_ZERO: return "INT DIVIDE BY ZERO";
-			case EXCEPTION_INT_OVERFLOW: return "INT OVERFLOW";
-			case EXCEPTION_INVALID_DISPOSITION: return "INVALID DISPOSITION";
-			case EXCEPTION_NONCONTINUABLE_EXCEPTION: return "NONCONTINUABLE EXCEPTION";
-			case EXCEPTION_PRIV_INSTRUCTION: return "PRIV INSTRUCTION";
-			case EXCEPTION_SINGLE_STEP: return "SINGLE STEP";
-			case EXCEPTION_STACK_OVERFLOW: return "STACK OVERFLOW";
-			case DBG_CONTROL_C : return "DBG CONTROL C ";
-			default:
-			return "<unkown exception>";
+			put_register("addr", reinterpret_cast<uintptr_t>(info->si_addr));
 		}
+		else
+		{
+			put("sender pid=");
+			put_dec(static_cast<long>(info->si_pid));
+			put(" uid=");
+			put_dec(static_cast<long>(info->si_uid));
+		}
+
+		put("\n");
 	}
-	
-	struct stack_frame_t
+
+	// thread id with name from /proc
+	static void put_thread_name(long tid)
 	{
-		std::string undecorated_sym_name;
-		std::string undecorated_full_sym_name;
+		char path[64] = {0};
+		char* end = path + sizeof(path) - 1;
+		char* ptr = append_str(path, end, "/proc/self/task/");
+		ptr = append_dec(ptr, end, tid, 0);
+		append_str(ptr, end, "/comm");
 
-		DWORD offset_from_line_bytes;
-		
-		platform_dword_t offset_from_symbol_bytes;
-		platform_dword_t program_counter;
-		platform_dword_t module_base;
+		put_dec(tid);
 
-		const char* sym_type;
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
 
-		std::string module_file_name;
-		std::string module_name;
+		char name[32] = {0};
+		ssize_t len = read(fd, name, sizeof(name) - 1);
+		close(fd);
 
-		std::string src_file_name;
-		int src_file_line;
+		if (len <= 0)
+			return;
 
-		stack_frame_t() : offset_from_symbol_bytes(0), sym_type(NULL), src_file_line(0), 
-			offset_from_line_bytes(0), program_counter(0), module_base(0)
-		{}
-	};
+		name[len] = 0;
+		if (name[len - 1] == '\n')
+			name[len - 1] = 0;
 
-	static std::list<stack_frame_t> get_stack_frames(HANDLE threadHandle, CONTEXT& c) 
+		put(" \"");
+		put(name);
+		put("\"");
+	}
+
+	static void thread_dump_handler(int sig, siginfo_t* info, void* context)
 	{
-		static CRITICAL_SECTION cs;
-		static bool cs_initialized = false;
+		(void)sig;
 
-		if (!cs_initialized)
-		{
-			InitializeCriticalSection(&cs);
-			cs_initialized = true;
-		}
+		if (info->si_code != SI_QUEUE)
+			return;
 
-		EnterCriticalSection(&cs);
+		thread_dump_t& dump = state().thread_dump;
+		long request = static_cast<long>(info->si_value.sival_int);
 
-#ifdef _AMD64_
-		const intptr_t debug_failed_rip = 0xCCCCCCCCCCCCCCCC;
-		DWORD image_type = IMAGE_FILE_MACHINE_AMD64; 
-#else //_AMD64_
-		const intptr_t debug_failed_rip = 0xCCCCCCCC;
-		DWORD image_type = IMAGE_FILE_MACHINE_I386;
-#endif //_AMD64_
-		HANDLE process_handle = GetCurrentProcess();
+		if (atomic_ops::load(&dump.open) != request || atomic_ops::load(&dump.tid) != syscall(SYS_gettid))
+			return;
 
-		std::list<stack_frame_t> frames;
+		void* frames[max_thread_frames];
+		int frames_count = backtrace(frames, max_thread_frames);
 
-		static IMAGEHLP_SYMBOL *sym_ptr = NULL;
-		if (sym_ptr == NULL) 
+		// crashed thread could stop waiting for this request
+		if (!atomic_ops::cas(&dump.open, request, -request))
+			return;
+
+		memcpy(dump.frames, frames, frames_count * sizeof(void*));
+		dump.frames_count = frames_count;
+		dump.pc = get_pc(static_cast<ucontext_t*>(context));
+		atomic_ops::store(&dump.done, request);
+	}
+
+	static long get_monotonic_ms()
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return static_cast<long>(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+	}
+
+	// Each thread from /proc/self/task is signalled in turn and writes own backtrace from signal handler
+	static void put_threads()
+	{
+		int dir = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dir < 0)
+			return;
+
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = thread_dump_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+		sigaction(LOG_CRASH_THREAD_SIGNAL, &sa, NULL);
+
+		long pid = static_cast<long>(process_ids::query_pid());
+		long own_tid = static_cast<long>(process_ids::query_tid());
+		long long entries[256];
+
+		// threads blocked with signals masked do not answer, so total wait is limited too
+		long deadline = get_monotonic_ms() + threads_wait_ms;
+		bool available = true;
+
+		for (;;)
 		{
-			sym_ptr = (IMAGEHLP_SYMBOL*) malloc(MAX_PATH + sizeof(IMAGEHLP_SYMBOL));
-			if (!sym_ptr) 
+			long len = syscall(SYS_getdents64, dir, entries, sizeof(entries));
+			if (len <= 0)
+				break;
+
+			for (long offset = 0; offset < len; )
 			{
-				LeaveCriticalSection(&cs);
-				return frames;
+				const linux_dirent64_t* entry = reinterpret_cast<const linux_dirent64_t*>(reinterpret_cast<const char*>(entries) + offset);
+				offset += entry->d_reclen;
+
+				long tid = 0;
+				for (const char* ptr = entry->d_name; *ptr >= '0' && *ptr <= '9'; ptr++)
+					tid = tid * 10 + (*ptr - '0');
+
+				if (tid > 0 && tid != own_tid)
+					available = put_thread(pid, tid, available, deadline);
 			}
 		}
 
-		init_current_process_symbols();
-
-#ifndef _AMD64_
-		STACKFRAME stack_frame;
-#else //_AMD64_
-		STACKFRAME64 stack_frame;
-#endif //_AMD64_
+		close(dir);
+	}
 
-		memset(&stack_frame, 0, sizeof(stack_frame));
+	// Returns false if handler of thread claimed buffer and did not fill it, so buffer can not be used any more
+	static bool put_thread(long pid, long tid, bool available, long deadline)
+	{
+		static volatile long last_request = 0;
+		thread_dump_t& dump = state().thread_dump;
 
-#ifndef _AMD64_
-		stack_frame.AddrPC.Offset = c.Eip;
-		stack_frame.AddrFrame.Offset = c.Ebp;
-		stack_frame.AddrStack.Offset = c.Esp;
-#else //_AMD64_
-		stack_frame.AddrPC.Offset = c.Rip;
-		stack_frame.AddrFrame.Offset = c.Rbp;
-		stack_frame.AddrStack.Offset = c.Rsp;
-#endif //_AMD64_
-		stack_frame.AddrPC.Mode = AddrModeFlat;
-		stack_frame.AddrFrame.Mode = AddrModeFlat;
-		stack_frame.AddrStack.Mode = AddrModeFlat;
+		put("*** THREAD ");
+		put_thread_name(tid);
+		put(" ***\n");
 
-		memset(sym_ptr, 0, MAX_PATH + sizeof(IMAGEHLP_SYMBOL));
-		sym_ptr->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL);
-		sym_ptr->MaxNameLength = MAX_PATH;
+		long now = get_monotonic_ms();
+		if (!available || now >= deadline)
+		{
+			put("not requested, time limit is over\n");
+			return available;
+		}
 
-		IMAGEHLP_LINE line_info;
-		memset(&line_info, 0, sizeof line_info);
-		line_info.SizeOfStruct = sizeof(line_info);
+		long request = atomic_ops::fetch_add(&last_request, 1) + 1;
+		atomic_ops::store(&dump.tid, tid);
+		atomic_ops::store(&dump.open, request);
 
-		IMAGEHLP_MODULE module_info;
-		memset(&module_info, 0, sizeof(module_info));
-		module_info.SizeOfStruct = sizeof(module_info);
+		siginfo_t info;
+		memset(&info, 0, sizeof(info));
+		info.si_signo = LOG_CRASH_THREAD_SIGNAL;
+		info.si_code = SI_QUEUE;
+		info.si_pid = static_cast<pid_t>(pid);
+		info.si_uid = getuid();
+		info.si_value.sival_int = static_cast<int>(request);
 
-		for (int walkedStackFrames = 0; ; ++walkedStackFrames)
+		if (syscall(SYS_rt_tgsigqueueinfo, pid, tid, LOG_CRASH_THREAD_SIGNAL, &info) != 0)
 		{
-//WARNING: in some cases we need to provide NULL as context when running in x86 context. But in most cases it does not working, try to provide context
-//			in all cases
+			atomic_ops::store(&dump.open, 0);
+			put("not available\n");
+			return true;
+		}
 
-			if (!::StackWalk(image_type, process_handle, threadHandle, &stack_frame,  /*image_type == IMAGE_FILE_MACHINE_I386 ? NULL :*/ &c, NULL, 
-				&::SymFunctionTableAccess, &::SymGetModuleBase, NULL ))
-			{
-				break;
-			}
+		// thread can be blocked in lock which is held by crashed thread, so waiting is limited
+		long thread_deadline = now + thread_wait_ms < deadline ? now + thread_wait_ms : deadline;
+		struct timespec delay = { 0, 1000000 };
 
-			stack_frame_t frame;
-			frame.sym_type = get_symbol_type_string(SymNone);
+		while (atomic_ops::load(&dump.done) != request && get_monotonic_ms() < thread_deadline)
+			nanosleep(&delay, NULL);
 
-			if ( stack_frame.AddrPC.Offset != 0 
-				&& stack_frame.AddrPC.Offset != debug_failed_rip)
-			{
-				frame.program_counter = stack_frame.AddrPC.Offset;
+		// request is closed, unless handler has claimed buffer already: then it is filled in a moment
+		if (atomic_ops::load(&dump.done) != request && atomic_ops::cas(&dump.open, request, 0))
+		{
+			put("no response\n");
+			return true;
+		}
 
-				if (::SymGetSymFromAddr(process_handle, stack_frame.AddrPC.Offset, &frame.offset_from_symbol_bytes, sym_ptr))
-				{
-					char undName[MAX_PATH] = {0};
-					char undFullName[MAX_PATH] = {0};
+		for (int i=0; i<thread_wait_ms && atomic_ops::load(&dump.done) != request; i++)
+			nanosleep(&delay, NULL);
 
-					UnDecorateSymbolName(sym_ptr->Name, undName, MAX_PATH, UNDNAME_NAME_ONLY);
-					UnDecorateSymbolName(sym_ptr->Name, undFullName, MAX_PATH, UNDNAME_COMPLETE);
+		if (atomic_ops::load(&dump.done) != request)
+		{
+			put("no response\n");
+			return false;
+		}
 
-					frame.undecorated_sym_name = strlen(undName) > 0 ? undName : sym_ptr->Name;
-					frame.undecorated_full_sym_name = undFullName;
-				}
+		atomic_ops::store(&dump.open, 0);
+		put_stack(dump.frames, dump.frames_count, dump.pc);
+		return true;
+	}
 
-				if (::SymGetLineFromAddr(process_handle, stack_frame.AddrPC.Offset, &frame.offset_from_line_bytes, &line_info))
-				{
-					frame.src_file_name = line_info.FileName;
-					frame.src_file_line = line_info.LineNumber;
-				}
+	static void put_maps()
+	{
+		put("*** MAPS ***\n");
+		flush();
 
-				if (::SymGetModuleInfo(process_handle, stack_frame.AddrPC.Offset, &module_info))
-				{
-					frame.module_name = module_info.ModuleName;
-					frame.module_base = module_info.BaseOfImage;
-					frame.sym_type = get_symbol_type_string(module_info.SymType);
-					frame.module_file_name = module_info.LoadedImageName;
-				}
-			} 
-			frames.push_back(frame);
-		} 
+		int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
 
-		LeaveCriticalSection(&cs);
-		return frames;
+		char data[4096];
+		ssize_t len;
+
+		while ((len = read(fd, data, sizeof(data))) > 0 || (len < 0 && errno == EINTR))
+		{
+			if (len > 0)
+				write_all(state().report_fd, data, static_cast<size_t>(len));
+		}
+
+		close(fd);
 	}
+#endif //LOG_CRASH_REPORT_FILE
 
-	static std::string get_stack_trace_string(HANDLE threadHandle, CONTEXT& c, int ignoreFunctions = 0) 
+#if LOG_FLIGHT_RECORDER
+	static void write_recorder_output(void* context, const char* data, size_t len)
 	{
-		std::stringstream stream;
-		std::list<stack_frame_t> stackFrames = get_stack_frames(threadHandle,c);
-
-		int n = 0;
+		(void)context;
+		write_raw(data, len);
+	}
+#endif //LOG_FLIGHT_RECORDER
 
-		for(std::list<stack_frame_t>::iterator i=stackFrames.begin(); i!=stackFrames.end(); i++, n++)
+	static void write_all(int fd, const char* data, size_t len)
+	{
+		while (len)
 		{
-			if (ignoreFunctions-- > 0)
+			ssize_t written = write(fd, data, len);
+			if (written < 0 && errno == EINTR)
 				continue;
-			
-			stack_frame_t& frame = *i;
 
-			stream << "[" << n << "] " << "<--";
-			if (frame.undecorated_sym_name.size())
-				stream << stringformat(" %s %+ld bytes ", frame.undecorated_sym_name.c_str(), frame.offset_from_symbol_bytes);
+			if (written <= 0)
+				return;
 
-			if (frame.undecorated_full_sym_name.size())
-				stream << stringformat("[FUNCTION: %s] ", frame.undecorated_full_sym_name.c_str()); 
+			data += written;
+			len -= written;
+		}
+	}
 
-			if (frame.src_file_name.size() || frame.src_file_line)
-				stream << stringformat("[Line: %s(%lu) %+ld bytes] ", frame.src_file_name.c_str(), frame.src_file_line, frame.offset_from_line_bytes);
+	static void flush()
+	{
+		crash_state_t& st = state();
+		write_output(st.buffer, st.used);
+		st.used = 0;
+	}
 
-			if (frame.module_name.size())
-			{
-#ifdef _AMD64_
-                stream << stringformat("[Mod:  %s, base: %.8X%.8X] ",frame.module_name.c_str(), (uint32_t)(frame.module_base >> 32), (uint32_t)frame.module_base);
-#else //_AMD64_
-				stream << stringformat("[Mod:  %s, base: %08lxh] ",frame.module_name.c_str(), frame.module_base);
-#endif //_AMD64_
-			}
+	// Writes to report file while it is written, otherwise to log file or to stderr if log file is not opened.
+	// Text in binary log file is preceded by marker, so it is not taken for records
+	static void write_output(const char* data, size_t len)
+	{
+		crash_state_t& st = state();
+		long fd = atomic_ops::load(&st.fd);
 
-#if LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND
-			if (!frame.module_name.size() && frame.program_counter)
-			{
-				std::string mod_detected_name = module_definition::module_name_by_addr(reinterpret_cast<void*>(frame.program_counter));
-				if (mod_detected_name.size())
-					stream << stringformat("[DETECTED Mod:  %s] ", mod_detected_name.c_str());
-			}
-#endif //LOG_STACKTRACE_DETECT_MODNAME_IF_NOT_FOUND
+		if (!len)
+			return;
 
-#ifdef _AMD64_
-            stream << stringformat("\n Offset: 0x%.8X%.8X", (uint32_t)(frame.program_counter >> 32), (uint32_t)frame.program_counter);
-#else //_AMD64_
-            stream << stringformat("\n Offset: 0x%8.8X", frame.program_counter);
-#endif //_AMD64_
+#if LOG_CRASH_REPORT_FILE
+		if (st.report_fd >= 0)
+		{
+			write_all(st.report_fd, data, len);
+			return;
+		}
+#endif //LOG_CRASH_REPORT_FILE
 
-			stream << stringformat(" Sym:  type: %s, file: %s\n", frame.sym_type, frame.module_file_name.c_str());
+		if (fd < 0)
+		{
+			write_all(STDERR_FILENO, data, len);
+			return;
 		}
-		return stream.str();
+
+#if LOG_BINARY_FORMAT
+		if (!st.text_started)
+		{
+			const char marker = binary_text_marker;
+			st.text_started = true;
+			write_all(static_cast<int>(fd), &marker, 1);
+		}
+#endif //LOG_BINARY_FORMAT
+
+		write_all(static_cast<int>(fd), data, len);
 	}
 
-	static std::string get_stack_trace_string(CONTEXT* c, int ignoreFunctions = 0)
+	static void put(const char* str)
 	{
-		return get_stack_trace_string(NULL,*c,ignoreFunctions);
-	}
+		crash_state_t& st = state();
 
+		for (; *str; str++)
+		{
+			if (st.used == sizeof(st.buffer))
+				flush();
 
-#else //defined(LOG_PLATFORM_WINDOWS)
+			st.buffer[st.used++] = *str;
+		}
+	}
 
-public:
-    static std::string get_stack_trace_string(void* trace[], int trace_len, int ignore_functions = 0)
-    {
-        std::string result;
-        char **bt_syms;
-        int i;
+	static void put_dec(long value)
+	{
+		char digits[24];
+		char* ptr = digits + sizeof(digits) - 1;
+		unsigned long abs_value = value < 0 ? 0 - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
 
-        size_t funcnamesize = 256;
-        char* funcname = (char*)malloc(funcnamesize);
+		*ptr = 0;
+		do
+		{
+			*--ptr = static_cast<char>('0' + abs_value % 10);
+			abs_value /= 10;
+		} while (abs_value);
 
-        bt_syms = backtrace_symbols(trace, trace_len);
+		if (value < 0)
+			*--ptr = '-';
 
-        int index = 1;
+		put(ptr);
+	}
 
-        for (i = 1 + ignore_functions; i < trace_len; i++)
-        {
-            std::string cur_full_sym = bt_syms[i];
-            char *begin_name = 0, *begin_offset = 0, *end_offset = 0;
+	static void put_hex(uintptr_t value)
+	{
+		char digits[2 + sizeof(value) * 2 + 1];
+		char* ptr = digits + sizeof(digits) - 1;
 
-            result += stringformat(" [%d] <-- (%p) ", index++, trace[i]);
+		*ptr = 0;
+		do
+		{
+			*--ptr = "0123456789abcdef"[value & 0xF];
+			value >>= 4;
+		} while (value);
 
-            // find parentheses and +address offset surrounding the mangled name:
-            // ./module(function+0x15c) [0x8048a6d]
-            for (char *p = bt_syms[i]; *p; ++p)
-            {
-                if (*p == '(')
-                    begin_name = p;
-                else if (*p == '+')
-                    begin_offset = p;
-                else if (*p == ')' && begin_offset)
-                {
-                    end_offset = p;
-                    break;
-                }
-            }
+		*--ptr = 'x';
+		*--ptr = '0';
 
-            if (begin_name && begin_offset && end_offset
-                && begin_name < begin_offset)
-            {
-                *begin_name++ = '\0';
-                *begin_offset++ = '\0';
-                *end_offset = '\0';
-
-                int status;
-                char* ret = abi::__cxa_demangle(begin_name,
-                                funcname, &funcnamesize, &status);
-                if (status == 0)
-                {
-                    funcname = ret; // use possibly realloc()-ed string
-                    result += stringformat(" %s: %s+%s\n", bt_syms[i], funcname, begin_offset);
-                }
-                else
-                {
-                    // demangling failed. Output function name as a C function with
-                    // no arguments.
-                    result += stringformat(" %s: %s()+%s\n",bt_syms[i], begin_name, begin_offset);
-                }
-            }
-            else
-            {
-                // couldn't parse the line? print the whole line.
-                result += stringformat(" %s\n", bt_syms[i]);
-            }
+		put(ptr);
+	}
 
-            result += "    ";
-            result += cur_full_sym;
-            result += "\n";
-        }
+	static void put_module(void* addr)
+	{
+#if LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+		const module_cache* modules = static_cast<const module_cache*>(atomic_ops::load_ptr(&state().modules));
+		if (!modules)
+			return;
 
-        free(bt_syms);
-        free(funcname);
+		intptr_t base = 0;
+		module_cache::name_ref name = modules->find_no_update(addr, base);
 
+		if (*name.c_str())
+		{
+			put(" ");
+			put(name.c_str());
+			put("+");
+			put_hex(reinterpret_cast<intptr_t>(addr) - base);
+		}
+#else //LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+		(void)addr;
+#endif //LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+	}
 
-        return result;
-    }
+	static void put_register(const char* name, uintptr_t value)
+	{
+		put(name);
+		put("=");
+		put_hex(value);
+		put(" ");
+	}
 
-#endif //defined(LOG_PLATFORM_WINDOWS)
+	static void* get_pc(ucontext_t* uc)
+	{
+#if defined(__x86_64__)
+		return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+		return reinterpret_cast<void*>(uc->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+		return reinterpret_cast<void*>(uc->uc_mcontext.pc);
+#else //defined(__x86_64__)
+		(void)uc;
+		return NULL;
+#endif //defined(__x86_64__)
+	}
 
-};
-#endif //LOG_AUTO_DEBUGGING
+	// Full set adds system and floating point registers
+	static void put_registers(ucontext_t* uc, bool full)
+	{
+#if defined(__x86_64__)
+		static const char* names[] = { "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+			"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "rip", "eflags" };
+		static const int indexes[] = { REG_RAX, REG_RBX, REG_RCX, REG_RDX, REG_RSI, REG_RDI, REG_RBP, REG_RSP,
+			REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15, REG_RIP, REG_EFL };
+#elif defined(__i386__)
+		static const char* names[] = { "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp", "eip", "eflags" };
+		static const int indexes[] = { REG_EAX, REG_EBX, REG_ECX, REG_EDX, REG_ESI, REG_EDI, REG_EBP, REG_ESP, REG_EIP, REG_EFL };
+#endif //defined(__x86_64__)
+
+		put("*** REGISTERS ***\n");
+
+#if defined(__x86_64__) || defined(__i386__)
+		for (size_t i=0; i<sizeof(indexes)/sizeof(indexes[0]); i++)
+		{
+			put_register(names[i], static_cast<uintptr_t>(uc->uc_mcontext.gregs[indexes[i]]));
+			if (i % 4 == 3)
+				put("\n");
+		}
+#elif defined(__aarch64__)
+		static const char* names[] = { "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9", "x10",
+			"x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+			"x24", "x25", "x26", "x27", "x28", "fp", "lr" };
 
-//////////////////////////////////////////////////////////////
+		for (size_t i=0; i<sizeof(names)/sizeof(names[0]); i++)
+		{
+			put_register(names[i], static_cast<uintptr_t>(uc->uc_mcontext.regs[i]));
+			if (i % 4 == 3)
+				put("\n");
+		}
 
-#if LOG_SHARED
+		put_register("sp", static_cast<uintptr_t>(uc->uc_mcontext.sp));
+		put_register("pc", static_cast<uintptr_t>(uc->uc_mcontext.pc));
+		put_register("pstate", static_cast<uintptr_t>(uc->uc_mcontext.pstate));
 
-struct shared_obj
-{
-	static const intptr_t start_shared_page = 0x04320000;
-	static const int shared_page_size = 0x100000;
-	static const int shared_pages_find = 0x30;
-	static const unsigned long shared_page_mem_size = 0x100;
-	static const unsigned long shared_mem_signature_1 = 0x12345678;
-	static const unsigned long shared_mem_signature_2 = 0xA0B0C0D0;
+		if (full)
+			put_register("fault_address", static_cast<uintptr_t>(uc->uc_mcontext.fault_address));
+#else //defined(__x86_64__) || defined(__i386__)
+		(void)uc;
+		put("not available on this architecture");
+#endif //defined(__x86_64__) || defined(__i386__)
 
+		put("\n");
 
-#ifndef LOG_PLATFORM_WINDOWS
-    static inline bool get_page_bits(void *addr, int *bits)
-    {
-	// On linux, first check /proc/self/maps
-	unsigned long laddr = reinterpret_cast<unsigned long>(addr);
+#if defined(__x86_64__)
+		if (full)
+		{
+			put_register("cs_gs_fs", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_CSGSFS]));
+			put_register("err", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_ERR]));
+			put_register("trapno", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_TRAPNO]));
+			put_register("oldmask", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_OLDMASK]));
+			put_register("cr2", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_CR2]));
+			put("\n");
+
+			if (uc->uc_mcontext.fpregs)
+			{
+				put_register("mxcsr", static_cast<uintptr_t>(uc->uc_mcontext.fpregs->mxcsr));
+				put_register("fcw", static_cast<uintptr_t>(uc->uc_mcontext.fpregs->cwd));
+				put_register("fsw", static_cast<uintptr_t>(uc->uc_mcontext.fpregs->swd));
+				put("\n");
 
-	FILE *pF = fopen("/proc/self/maps", "r");
-	if (pF) {
-	    // Linux /proc/self/maps -> parse
-	    // Format:
-	    // lower    upper    prot     stuff                 path
-	    // 08048000-0804c000 r-xp 00000000 03:03 1010107    /bin/cat
-	    unsigned long rlower, rupper;
-	    char r, w, x;
-	    while (fscanf(pF, "%lx-%lx %c%c%c", &rlower, &rupper, &r, &w, &x) != EOF) {
-		// Check whether we're IN THERE!
-		if (laddr >= rlower && laddr < rupper) {
-		    fclose(pF);
-		    *bits = 0;
-		    if (r == 'r')
-			*bits |= SH_MEM_READ;
-		    if (w == 'w')
-			*bits |= SH_MEM_WRITE;
-		    if (x == 'x')
-			*bits |= SH_MEM_EXEC;
+				for (int i=0; i<16; i++)
+				{
+					put("xmm");
+					put_dec(i);
+					put("=");
 
-		    return true;
-		}
-		// Read to end of line
-		int c;
-		while ((c = fgetc(pF)) != '\n') {
-		    if (c == EOF)
-			break;
+					for (int j=3; j>=0; j--)
+					{
+						put_hex(static_cast<uintptr_t>(uc->uc_mcontext.fpregs->_xmm[i].element[j]));
+						put(j ? ":" : "\n");
+					}
+				}
+			}
 		}
-		if (c == EOF)
-		    break;
-	    }
-	    fclose(pF);
-	    return false;
-	}
-	
-	pF = fopen("/proc/curproc/map","r");
-	if (pF) {
-	    // FreeBSD /proc/curproc/map
-	    // 0x804800 0x805500 13 15 0xc6e18960 r-x 21 0x0 COW NC vnode
-	    unsigned long rlower, rupper, ignoreLong;
-	    int ignoreInt;
-	    char r,w,x;
-	    while(fscanf(pF, "0x%lx 0x%lx %d %d 0x%lx %c%c%c", &rlower, &rupper, &ignoreInt, 
-		&ignoreInt, &ignoreLong, &r, &w, &x) != EOF)
-	    {
-		if(laddr >= rlower && laddr < rupper)
+#elif defined(__i386__)
+		if (full)
 		{
-		    fclose(pF);
-		    *bits = 0;
-		    if (r == 'r')
-			*bits |= SH_MEM_READ;
-		    if (w == 'w')
-			*bits |= SH_MEM_WRITE;
-		    if (x == 'x')
-			*bits |= SH_MEM_EXEC;
-		    return true;
+			put_register("cs", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_CS]));
+			put_register("ss", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_SS]));
+			put_register("err", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_ERR]));
+			put_register("trapno", static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_TRAPNO]));
+			put_register("cr2", static_cast<uintptr_t>(uc->uc_mcontext.cr2));
+			put("\n");
 		}
+#else //defined(__x86_64__)
+		(void)full;
+#endif //defined(__x86_64__)
+	}
 
-		// Read to end of line
-		int c;
-		while ((c = fgetc(pF)) != '\n')
+	static const char* get_signal_name(int sig)
+	{
+		switch (sig)
 		{
-		    if (c == EOF)
-			break;
+			case SIGSEGV: return "SIGSEGV";
+			case SIGABRT: return "SIGABRT";
+			case SIGBUS:  return "SIGBUS";
+			case SIGFPE:  return "SIGFPE";
+			case SIGILL:  return "SIGILL";
+			default:      return "unknown";
 		}
-		if (c == EOF)
-		    break;
-	    }
-	    fclose(pF);
-	    return false;
 	}
-	return false;
-    }
-#endif //LOG_PLATFORM_WINDOWS
+};
 
-	static void* create_shared_object(unsigned char object_id, void* object)
-	{
-		intptr_t shared_page = get_start_address(object_id);
-		void* result_ptr = NULL;
-		
-		for (intptr_t page = shared_page; 
-			page < shared_page + (shared_pages_find*shared_page_size); 
-			page += shared_page_size)
-		{
-#ifdef LOG_PLATFORM_WINDOWS
-			MEMORY_BASIC_INFORMATION mem_info;
-			if (!VirtualQuery((LPCVOID)page, &mem_info, sizeof(MEMORY_BASIC_INFORMATION)))
-				continue;
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
 
-			if (mem_info.State != MEM_FREE)
-				continue;
 
-			result_ptr = VirtualAlloc((LPVOID)page, shared_page_mem_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-#else //LOG_PLATFORM_WINDOWS
-			int page_bits;
+#if LOG_BINARY_FORMAT
 
-			if (get_page_bits((void*)page, &page_bits))
-			    continue;
+// Encodes records of binary log file. Segment is started each time file is opened, so file can hold several of them:
+//   'S' "CLB1" <pointer size> <pid> <time> <header format>         time is milliseconds since epoch
+//   'D' <id> <verb level> <line> <file> <function> <module> <format>  call site, once per segment before its messages
+//   'M' <id> <time delta> <tid> <arguments>                         LOG_*_T message, see template_format::pack
+//   'T' <text>                                                      message with header formatted by caller
+//   0xFF <text until end of file>                                   text written by crash handler
+// Numbers are LEB128 varints, time delta from previous record is zigzag encoded, strings are prefixed by length.
+// Packed arguments are in native byte order
+class binary_log_encoder
+{
+public:
+	binary_log_encoder() : started_(false), last_time_(0) {}
 
-			result_ptr = mmap((void*)page, shared_page_mem_size, PROT_READ|PROT_WRITE|PROT_EXEC,MAP_PRIVATE|MAP_FIXED|MAP_ANONYMOUS,-1,0);
-#endif //LOG_PLATFORM_WINDOWS
+	const std::string& header_format() const { return header_format_; }
 
-			if (result_ptr)
-			{
-				memset(result_ptr, 0, shared_page_mem_size);
+	// Next record starts new segment
+	void reset(const std::string& header_format)
+	{
+		started_ = false;
+		header_format_ = header_format;
+		sites_.clear();
+	}
 
-				unsigned long* ptr = (unsigned long*)page;
-				*ptr = shared_mem_signature_1;
+	void encode_message(std::string& out, const call_site_t* site, const char* module_name,
+		time_t seconds, int millisec, unsigned long tid, const std::string& args)
+	{
+		long long time = static_cast<long long>(seconds) * 1000 + millisec;
+		begin_segment(out, time);
 
-				ptr++;
+		std::map<const call_site_t*, unsigned long>::iterator it = sites_.find(site);
+		if (it == sites_.end())
+		{
+			it = sites_.insert(std::make_pair(site, static_cast<unsigned long>(sites_.size()))).first;
+
+			out += 'D';
+			put_number(out, it->second);
+			put_number(out, site->verb_level);
+			put_number(out, site->line_num);
+			put_string(out, site->src_file, strlen(site->src_file));
+			put_string(out, site->function_name, strlen(site->function_name));
+			put_string(out, module_name, strlen(module_name));
+			put_string(out, site->format, strlen(site->format));
+		}
 
-				*ptr = shared_mem_signature_2;
+		long long delta = time - last_time_;
+		last_time_ = time;
 
-				*(intptr_t*)(page + 8) = (intptr_t)object;
+		out += 'M';
+		put_number(out, it->second);
+		put_number(out, (static_cast<unsigned long long>(delta) << 1) ^ static_cast<unsigned long long>(delta >> 63));
+		put_number(out, tid);
+		put_string(out, args.data(), args.size());
+	}
 
-				break;
-			}
+	void encode_text(std::string& out, const std::string& text)
+	{
+		if (!started_)
+		{
+			time_t seconds;
+			int millisec;
+			utils::get_timestamp(seconds, millisec);
+			begin_segment(out, static_cast<long long>(seconds) * 1000 + millisec);
 		}
-		
-		return result_ptr;
+
+		out += 'T';
+		put_string(out, text.data(), text.size());
 	}
 
-	static intptr_t try_found_shared_object_page(unsigned short object_id)
+private:
+	bool started_;
+	long long last_time_;
+	std::string header_format_;
+	std::map<const call_site_t*, unsigned long> sites_;
+
+	void begin_segment(std::string& out, long long time)
 	{
-		for (intptr_t page = start_shared_page; 
-			page < start_shared_page + (shared_pages_find*shared_page_size); 
-			page += shared_page_size)
+		if (started_)
+			return;
+
+		started_ = true;
+		last_time_ = time;
+
+		out += 'S';
+		out.append("CLB1", 4);
+		out += static_cast<char>(sizeof(void*));
+		put_number(out, process_ids::pid());
+		put_number(out, static_cast<unsigned long long>(time));
+		put_string(out, header_format_.data(), header_format_.size());
+	}
+
+	static void put_number(std::string& out, unsigned long long value)
+	{
+		while (value >= 0x80)
 		{
-#ifdef LOG_PLATFORM_WINDOWS
-			MEMORY_BASIC_INFORMATION mem_info;
-			if (!VirtualQuery((LPCVOID)page, &mem_info, sizeof(MEMORY_BASIC_INFORMATION)))
-				continue;
+			out += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
 
-			if (mem_info.State == MEM_COMMIT 
-				&& mem_info.Protect & PAGE_READWRITE)
-#else //LOG_PLATFORM_WINDOWS
-			int page_bits;
-			if (!get_page_bits((void*)page, &page_bits))
-			    continue;
+		out += static_cast<char>(value);
+	}
 
-			if ((page_bits & SH_MEM_READ) && (page_bits & SH_MEM_WRITE))
-#endif //LOG_PLATFORM_WINDOWS
-			{
-				if (*((unsigned long*)page) != shared_mem_signature_1)
-					continue;
+	static void put_string(std::string& out, const char* value, size_t len)
+	{
+		put_number(out, len);
+		out.append(value, len);
+	}
+};
 
-				if (*((unsigned long*)page + 1) != shared_mem_signature_2)
-					continue;
+#endif //LOG_BINARY_FORMAT
 
-				return page;
-			}
-		}
-		return (intptr_t)NULL;
+// State of LOG_*_EVERY_N, LOG_*_FIRST_N, LOG_*_EVERY_MS and LOG_*_SAMPLED call site: static object, zero initialized
+struct rate_limit_site_t
+{
+	volatile long count;		// calls passed to counter of EVERY_N and FIRST_N
+	volatile long last_ms;		// utils::get_tick_count of last written message of EVERY_MS, 0 before first one
+	volatile long suppressed;	// EVERY_MS messages skipped since last written one
+};
+
+// Decides if message of call site is written. Called before arguments of message are evaluated, lock-free
+class rate_limiter
+{
+public:
+	static __inline bool every_n(rate_limit_site_t& site, long n)
+	{
+		return n <= 1 || static_cast<unsigned long>(atomic_ops::fetch_add(&site.count, 1)) % n == 0;
 	}
-	
-	static void* try_found_shared_object(unsigned short object_id)
+
+	static __inline bool first_n(rate_limit_site_t& site, long n)
 	{
-		intptr_t page = try_found_shared_object_page(object_id);
-		if (!page)
-			return NULL;
+		// counter stops at n, so it does not overflow
+		return atomic_ops::load(&site.count) < n && atomic_ops::fetch_add(&site.count, 1) < n;
+	}
 
-		intptr_t* ptr = (intptr_t*)(page + 8);
-		return (void*)*ptr;
+	static bool every_ms(rate_limit_site_t& site, long interval_ms)
+	{
+		// message is claimed by publishing its time, so only one thread passes per interval. Zero is kept for first call
+		long now = static_cast<long>(utils::get_tick_count());
+		if (!now)
+			now = 1;
+
+		long last = atomic_ops::load(&site.last_ms);
+		if ((!last || static_cast<unsigned long>(now - last) >= static_cast<unsigned long>(interval_ms))
+			&& atomic_ops::cas(&site.last_ms, last, now))
+			return true;
+
+		atomic_ops::fetch_add(&site.suppressed, 1);
+		return false;
 	}
 
-	static bool free_shared_object(unsigned char object_id)
+	// probability is 0..1
+	static __inline bool sampled(rate_limit_site_t& site, double probability)
 	{
-		void* obj = (void*)try_found_shared_object_page(object_id);
-		if (!obj)
-			return false;
+		(void)site;
+		return next_random() < probability * 4294967296.0;
+	}
 
-#ifdef LOG_PLATFORM_WINDOWS
-		VirtualFree(obj, 0, MEM_DECOMMIT);
-		return VirtualFree(obj, 0, MEM_RELEASE) ? true : false;
-#else //LOG_PLATFORM_WINDOWS
-		return munmap(obj, shared_page_mem_size) == 0;
-#endif //LOG_PLATFORM_WINDOWS
+	// Number of messages skipped since last written one, reset to zero
+	static __inline long take_suppressed(rate_limit_site_t& site)
+	{
+		return atomic_ops::load(&site.suppressed) ? atomic_ops::exchange(&site.suppressed, 0) : 0;
 	}
 
 private:
-	static intptr_t get_start_address(unsigned char object_id)
+	// xorshift generator of thread, not shared between threads, so it needs no atomics
+	static unsigned long next_random()
 	{
-		return start_shared_page + ((intptr_t)object_id << 22);
-	}	
-};
+		static LOG_THREAD_LOCAL unsigned int state = 0;
 
-#endif //LOG_SHARED
+		if (!state)
+			state = static_cast<unsigned int>(process_ids::tid() * 2654435761UL) | 1;
 
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+};
 
 ////////////////////  Logger implementation  //////////////////////////
 
@@ -3641,6 +8449,18 @@ class logger
 	: public logger_interface
 {
 private:
+	// Time and thread of message formatted not by its thread, see LOG_DEFERRED_FORMAT
+	struct message_stamp_t
+	{
+		struct tm time;
+		int millisec;
+		unsigned long tid;
+		unsigned long sequence;
+#if LOG_USE_CONTEXT
+		const log_context_t* context;
+#endif //LOG_USE_CONTEXT
+	};
+
 	static int get_log_file_index(const std::string& name)
 	{
 		std::string idx = name.substr(name.find_last_of('.'));
@@ -3653,18 +8473,73 @@ private:
 
 	int cur_file_size_;
 
+	// writer side statistics, changed only by thread which writes to file
+	uint64_t stat_messages_;
+	uint64_t stat_bytes_;
+	unsigned long stat_rotations_;
+
+	// number of last record with $(seq), common for all threads
+	volatile long sequence_;
+
+	unsigned long next_sequence()
+	{
+		return static_cast<unsigned long>(atomic_ops::fetch_add(&sequence_, 1) + 1);
+	}
+
+	// Stamp of record which writer thread adds on behalf of thread tid: current time, no context
+	message_stamp_t make_stamp(unsigned long tid)
+	{
+		message_stamp_t stamp;
+		stamp.time = utils::get_time(stamp.millisec);
+		stamp.tid = tid;
+		stamp.sequence = next_sequence();
+#if LOG_USE_CONTEXT
+		stamp.context = NULL;
+#endif //LOG_USE_CONTEXT
+		return stamp;
+	}
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+	unsigned long crash_config_version_;
+	std::string crash_path_;
+
+	// keeps crash output descriptor on the current log file
+	__inline void update_crash_file(const log_config_t* config, bool force)
+	{
+		if (!force && config->version == crash_config_version_)
+			return;
+
+		crash_config_version_ = config->version;
+
+		if (force || crash_path_ != config->full_log_file_path)
+		{
+			crash_path_ = config->full_log_file_path;
+			crash_writer::set_log_file(crash_path_.c_str());
+		}
+	}
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
 	void scroll_files(bool force = false)
 	{
-		if (!force && !configurator.get_log_scroll_file_size())
+		log_configurator::config_ref current = configurator.get_config();
+		const log_config_t* config = current.get();
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		update_crash_file(config, false);
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
+		if (!force && !config->scroll_file_size)
 			return;
 
         bool need_scroll = force;
 
 		if (!need_scroll)
-			need_scroll = cur_file_size_ > configurator.get_log_scroll_file_size();
+			need_scroll = cur_file_size_ > config->scroll_file_size;
 
 		if (need_scroll)
 		{
+			stat_rotations_++;
+
 			std::map<int,std::string> log_files;
 			std::vector<int> log_indexes;
             int max_index = 0;
@@ -3674,7 +8549,7 @@ private:
 #ifdef LOG_PLATFORM_WINDOWS
             WIN32_FIND_DATAA find_data;
 
-            std::string mask = configurator.get_full_log_file_path() + ".*";
+            std::string mask = config->full_log_file_path + ".*";
 			HANDLE find_handle = FindFirstFileA(mask.c_str(), &find_data);
 
 
@@ -3701,9 +8576,9 @@ private:
 
 #else //LOG_PLATFORM_WINDOWS
 
-            std::string find_pattern = configurator.get_log_file_name() + ".*";
+            std::string find_pattern = config->log_file_name + ".*";
 
-            DIR* pDirectory = opendir(configurator.get_log_path().c_str());
+            DIR* pDirectory = opendir(config->log_path.c_str());
             if (pDirectory)
             {
                 struct dirent* pFile = NULL;
@@ -3743,96 +8618,778 @@ private:
 				unsigned int new_index = i + 1;
 				std::string name = log_files[i];
 
-				if (configurator.get_log_scroll_file_count() 
-					&& configurator.get_log_scroll_file_count() < new_index)
+				if (config->scroll_file_count 
+					&& config->scroll_file_count < new_index)
 				{
 #ifdef LOG_PLATFORM_WINDOWS
-                    DeleteFileA((configurator.get_log_path() + "/" + name).c_str());
+                    DeleteFileA((config->log_path + "/" + name).c_str());
 #else //LOG_PLATFORM_WINDOWS
 
 #	ifdef LOG_HAVE_UNISTD_H
-                    unlink((configurator.get_log_path() + "/" + name).c_str());
+                    unlink((config->log_path + "/" + name).c_str());
 #	else //LOG_HAVE_UNISTD_H
-		    std::remove((configurator.get_log_path() + "/" + name).c_str());
+		    std::remove((config->log_path + "/" + name).c_str());
 #	endif //LOG_HAVE_UNISTD_H
 
-#endif //LOG_PLATFORM_WINDOWS
+#endif //LOG_PLATFORM_WINDOWS
+
+					continue;
+				}
+
+				std::string new_name = name.substr(0, name.find_last_of('.')) + stringformat(".%d", new_index);
+
+#ifdef LOG_PLATFORM_WINDOWS
+                MoveFileA((config->log_path + "/" + name).c_str(),
+					(config->log_path + "/" + new_name).c_str());
+#else //LOG_PLATFORM_WINDOWS
+                rename((config->log_path + "/" + name).c_str(),
+                       (config->log_path + "/" + new_name).c_str());
+#endif //LOG_PLATFORM_WINDOWS
+			}
+
+#ifdef LOG_PLATFORM_WINDOWS
+			MoveFileExA(config->full_log_file_path.c_str(), (config->full_log_file_path + ".1").c_str(), 
+						MOVEFILE_WRITE_THROUGH | MOVEFILE_REPLACE_EXISTING);
+#else //LOG_PLATFORM_WINDOWS
+            rename(config->full_log_file_path.c_str(), (config->full_log_file_path + ".1").c_str());
+#endif //LOG_PLATFORM_WINDOWS
+
+#if !LOG_FLUSH_FILE_EVERY_WRITE
+			open_stream(config);
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+			update_crash_file(config, true);
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		}
+	}
+
+	int ref_counter_;
+
+#if LOG_SHARED
+	bool shared_master_;
+	void* shared_obj_ptr_;
+#endif //LOG_SHARED
+
+
+
+#if LOG_MULTITHREADED
+	// Queued message. Records are linked before publishing, so list can be walked without lock from crash handler
+#if LOG_COLLAPSE_REPEATS
+	// Call site and text of message, hash and len are calculated by writer thread
+	struct message_key_t
+	{
+		const char* src_file; // NULL if message is never collapsed
+		const char* function_name;
+		int line_num;
+		int verb_level;
+		void* addr;
+		unsigned long tid;
+		uint64_t hash;
+		size_t len;
+	};
+#endif //LOG_COLLAPSE_REPEATS
+
+	struct mt_record
+	{
+		mt_record* volatile next;
+		std::string text;
+
+#if LOG_DEFERRED_STACKTRACE
+		// stack trace captured by LOG_STACKTRACE_*, resolved by writer thread and written after text
+		std::vector<void*> frames;
+		unsigned long generation;
+#endif //LOG_DEFERRED_STACKTRACE
+
+#if LOG_DEFERRED_FORMAT
+		// LOG_*_T message: text holds arguments packed by template_format::pack, formatted by writer thread
+		const call_site_t* site;
+		void* addr;
+		time_t seconds;
+		int millisec;
+		unsigned long tid;
+		unsigned long sequence; // taken only if header has $(seq)
+#	if LOG_USE_CONTEXT
+		log_context_t context; // copied only if header has $(ctx)
+#	endif //LOG_USE_CONTEXT
+#endif //LOG_DEFERRED_FORMAT
+
+#if LOG_COLLAPSE_REPEATS
+		// LOG_* message compared by writer thread with previous one, its text starts at message_pos.
+		// LOG_*_T record is compared by its site and packed arguments
+		message_key_t message;
+		size_t message_pos;
+#endif //LOG_COLLAPSE_REPEATS
+
+#if LOG_PRIORITY_QUEUE
+		bool priority; // ERROR or FATAL message, queued to priority lane
+#endif //LOG_PRIORITY_QUEUE
+
+#if LOG_BINARY_FORMAT
+		bool encoded; // text holds binary records
+#endif //LOG_BINARY_FORMAT
+
+		mt_record() : next(NULL)
+#if LOG_DEFERRED_STACKTRACE
+			, generation(0)
+#endif //LOG_DEFERRED_STACKTRACE
+#if LOG_DEFERRED_FORMAT
+			, site(NULL)
+#endif //LOG_DEFERRED_FORMAT
+#if LOG_COLLAPSE_REPEATS
+			, message(), message_pos(0)
+#endif //LOG_COLLAPSE_REPEATS
+#if LOG_PRIORITY_QUEUE
+			, priority(false)
+#endif //LOG_PRIORITY_QUEUE
+#if LOG_BINARY_FORMAT
+			, encoded(false)
+#endif //LOG_BINARY_FORMAT
+		{}
+	};
+
+	LOG_MT_MUTEX mt_buffer_lock;
+
+	// Queue of records not yet released: head is the oldest one, flushed is the first one not flushed to file
+	// (crash handler starts from it), next_write is the first one not yet passed to stream. Changed under mt_buffer_lock
+	mt_record* volatile mt_queue_head;
+	mt_record* volatile mt_queue_flushed;
+	mt_record* mt_queue_next_write;
+	mt_record* mt_queue_tail;
+	unsigned long mt_queue_size;
+
+#if LOG_PRIORITY_QUEUE
+	// Priority lane: the same list for ERROR and FATAL records, writer thread writes them before records of queue
+	mt_record* volatile mt_priority_head;
+	mt_record* volatile mt_priority_flushed;
+	mt_record* mt_priority_next_write;
+	mt_record* mt_priority_tail;
+#endif //LOG_PRIORITY_QUEUE
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+	// Set by crash handler before it writes queue: writer thread stops and records are not freed any more
+	volatile long mt_crashing;
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
+#	ifdef LOG_PLATFORM_WINDOWS
+	HANDLE log_thread_handle;
+	HANDLE write_event;
+#	else //LOG_PLATFORM_WINDOWS
+	pthread_t log_thread_handle;
+	pthread_cond_t write_event;
+#	endif //LOG_PLATFORM_WINDOWS
+
+	int mt_terminating;
+
+	enum mt_request_flags
+	{
+		mt_request_flush = 1,
+		mt_request_rotate = 2
+	};
+
+	// requests to writer thread, guarded by mt_buffer_lock
+	int mt_requests;
+
+#if LOG_RESTART_AFTER_FORK
+	// Set in child process after fork: writer and service threads are started on first use of logger
+	volatile long mt_fork_restart;
+#endif //LOG_RESTART_AFTER_FORK
+
+#if LOG_LOAD_SHEDDING
+	// levels dropped now, writer throughput in records per second and busy time and records it is measured by.
+	// Changed under mt_buffer_lock
+	int mt_shed_levels;
+	unsigned long mt_shed_tid; // thread which queued the last record, change of levels by writer thread is written with it
+	unsigned long mt_write_rate;
+	unsigned long mt_rate_busy_ms;
+	unsigned long mt_rate_written;
+#endif //LOG_LOAD_SHEDDING
+
+#if LOG_COLLAPSE_REPEATS
+	// last written message and count of the same messages after it which were not written, used by writer thread
+	message_key_t repeat_message_;
+	unsigned long repeat_count_;
+	unsigned long repeat_since_; // utils::get_tick_count of first not written message
+#endif //LOG_COLLAPSE_REPEATS
+
+	// Starts threads of logger in child process after fork, if they are not started yet
+	__inline void restart_after_fork()
+	{
+#if LOG_RESTART_AFTER_FORK
+		if (atomic_ops::load(&mt_fork_restart) && atomic_ops::cas(&mt_fork_restart, 1, 0))
+			restart_in_child();
+#endif //LOG_RESTART_AFTER_FORK
+	}
+
+	void post_request(int request)
+	{
+		restart_after_fork();
+
+		LOG_MT_MUTEX_LOCK(&mt_buffer_lock);
+		mt_requests |= request;
+
+#ifdef LOG_PLATFORM_WINDOWS
+		SetEvent(write_event);
+#else //LOG_PLATFORM_WINDOWS
+		pthread_cond_signal(&write_event);
+#endif //LOG_PLATFORM_WINDOWS
+
+		LOG_MT_MUTEX_UNLOCK(&mt_buffer_lock);
+	}
+
+#if LOG_RESTART_AFTER_FORK
+	// logger which owns running writer thread
+	static logger*& fork_instance()
+	{
+		static logger* instance = NULL;
+		return instance;
+	}
+
+	static void register_fork_handlers()
+	{
+		static volatile long registered = 0;
+
+		if (!atomic_ops::load(&registered) && atomic_ops::cas(&registered, 0, 1))
+			pthread_atfork(&fork_prepare, &fork_parent, &fork_child);
+	}
+
+	// Takes all logger locks, so no other thread holds them at the moment of fork.
+	// Written part of queue is flushed, so buffered data is not written twice by parent and child
+	static void fork_prepare()
+	{
+		logger* log = fork_instance();
+		if (!log)
+			return;
+
+#if LOG_USE_MODULEDEFINITION
+		log->modules_.lock();
+#endif //LOG_USE_MODULEDEFINITION
+
+		configurator.lock_updates();
+
+#if LOG_USE_MACRO_HEADER_CACHE
+		log->cache.lock();
+#endif //LOG_USE_MACRO_HEADER_CACHE
+
+		LOG_MT_MUTEX_LOCK(&log->mt_buffer_lock);
+
+#if !LOG_FLUSH_FILE_EVERY_WRITE
+		log->stream.flush();
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+	}
+
+	static void fork_parent()
+	{
+		logger* log = fork_instance();
+		if (!log)
+			return;
+
+		LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
+
+#if LOG_USE_MACRO_HEADER_CACHE
+		log->cache.unlock();
+#endif //LOG_USE_MACRO_HEADER_CACHE
+
+		configurator.unlock_updates();
+
+#if LOG_USE_MODULEDEFINITION
+		log->modules_.unlock();
+#endif //LOG_USE_MODULEDEFINITION
+	}
+
+	// Child has only the thread which called fork, it owns all logger locks taken in fork_prepare.
+	// Queued messages are dropped (parent writes them). Fork handler must be async-signal-safe, so writer and
+	// service threads are started and configuration is changed on first use of logger in child
+	static void fork_child()
+	{
+		logger* log = fork_instance();
+		if (!log)
+			return;
+
+		process_ids::reset_after_fork();
+
+		log->queue_clear();
+		log->mt_requests = 0;
+		pthread_cond_init(&log->write_event, NULL);
+		configurator.drop_readers_after_fork();
+
+#if LOG_USE_MODULEDEFINITION
+		log->modules_.drop_readers_after_fork();
+#endif //LOG_USE_MODULEDEFINITION
+
+		LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
+
+#if LOG_USE_MACRO_HEADER_CACHE
+		log->cache.unlock();
+#endif //LOG_USE_MACRO_HEADER_CACHE
+
+		configurator.unlock_updates();
+
+#if LOG_USE_MODULEDEFINITION
+		log->modules_.unlock();
+#endif //LOG_USE_MODULEDEFINITION
+
+		atomic_ops::store(&log->mt_fork_restart, 1);
+	}
+
+	// Called by the first thread which uses logger in child process after fork
+	void restart_in_child()
+	{
+		std::string fork_log_file_name = configurator.get_fork_log_file_name();
+		if (fork_log_file_name.size())
+			configurator.set_log_file_name(fork_log_file_name);
+
+		pthread_create(&log_thread_handle, NULL, (void*(*)(void*))&log_thread_fn, this);
+
+#if LOG_INI_HOT_RELOAD
+		ini_watcher_.restart_after_fork();
+#endif //LOG_INI_HOT_RELOAD
+
+#if LOG_CONTROL_SOCKET
+		control_server_.restart_after_fork();
+#endif //LOG_CONTROL_SOCKET
+	}
+#endif //LOG_RESTART_AFTER_FORK
+
+	// Appends record to list of queue or priority lane
+	static void list_push(mt_record* volatile& head, mt_record* volatile& flushed, mt_record*& next_write, mt_record*& tail, mt_record* record)
+	{
+		if (tail)
+			atomic_ops::store_ptr((void* volatile*)&tail->next, record);
+		else
+			atomic_ops::store_ptr((void* volatile*)&head, record);
+
+		if (!flushed)
+			atomic_ops::store_ptr((void* volatile*)&flushed, record);
+
+		if (!next_write)
+			next_write = record;
+
+		tail = record;
+	}
+
+	// Removes records of list already flushed to file, returns their count
+	static unsigned long list_release_written(mt_record* volatile& head, mt_record* flushed, mt_record*& tail)
+	{
+		mt_record* record = head;
+		unsigned long count = 0;
+		atomic_ops::store_ptr((void* volatile*)&head, flushed);
+
+		for (; record != flushed; count++)
+		{
+			mt_record* next = record->next;
+			delete record;
+			record = next;
+		}
+
+		if (!head)
+			tail = NULL;
+
+		return count;
+	}
+
+	// Appends record to queue, called under mt_buffer_lock
+	void queue_push(mt_record* record)
+	{
+#if LOG_PRIORITY_QUEUE
+		if (record->priority)
+		{
+			list_push(mt_priority_head, mt_priority_flushed, mt_priority_next_write, mt_priority_tail, record);
+			return;
+		}
+#endif //LOG_PRIORITY_QUEUE
+
+		list_push(mt_queue_head, mt_queue_flushed, mt_queue_next_write, mt_queue_tail, record);
+		mt_queue_size++;
+	}
+
+#if LOG_PRIORITY_QUEUE
+	static bool is_priority_level(int verb_level)
+	{
+		return (verb_level & logger_verbose_fatal_error) != 0;
+	}
+#endif //LOG_PRIORITY_QUEUE
+
+	// Pointer to next record to write, of priority lane if it has one. Called under mt_buffer_lock
+	mt_record*& queue_next_write()
+	{
+#if LOG_PRIORITY_QUEUE
+		if (mt_priority_next_write)
+			return mt_priority_next_write;
+#endif //LOG_PRIORITY_QUEUE
+
+		return mt_queue_next_write;
+	}
+
+	bool queue_has_records() const
+	{
+#if LOG_PRIORITY_QUEUE
+		if (mt_priority_head)
+			return true;
+#endif //LOG_PRIORITY_QUEUE
+
+		return mt_queue_head != NULL;
+	}
+
+#if LOG_LOAD_SHEDDING
+	// Drops DEBUG and then INFO messages while writer queue is too long, each change is written to log
+	// with thread id of thread which queued the last record. Called under mt_buffer_lock
+	void update_load_shedding()
+	{
+		int shed = mt_shed_levels;
+
+		if (mt_queue_size >= LOG_LOAD_SHEDDING_INFO_QUEUE)
+			shed = logger_verbose_debug | logger_verbose_info;
+		else if (mt_queue_size >= LOG_LOAD_SHEDDING_DEBUG_QUEUE)
+			shed |= logger_verbose_debug;
+
+		if (mt_queue_size < LOG_LOAD_SHEDDING_INFO_QUEUE / 2)
+			shed &= ~logger_verbose_info;
+
+		if (mt_queue_size < LOG_LOAD_SHEDDING_DEBUG_QUEUE / 2)
+			shed &= ~logger_verbose_debug;
+
+		if (shed == mt_shed_levels)
+			return;
+
+		mt_shed_levels = shed;
+		configurator.set_shed_levels(shed);
+
+		std::string text = stringformat("Load shedding: %s, queued %lu records, writer %lu records/s, %ld messages dropped",
+			shed & logger_verbose_info ? "DEBUG and INFO messages are dropped" : shed ? "DEBUG messages are dropped" : "all messages are written",
+			mt_queue_size, mt_write_rate, configurator.get_shed_dropped());
+
+		if (!shed)
+			configurator.reset_shed_dropped();
+
+		message_stamp_t stamp = make_stamp(mt_shed_tid);
+		mt_record* record = new mt_record;
+		record->text = make_record(configurator.get_config().get(), logger_verbose_warning, __LINE__, __FILE__,
+			"logger::update_load_shedding", try_get_cached_module_name((void*)&log_thread_fn).c_str(), text.data(), text.size(),
+			" ", true, NULL, &stamp);
+		queue_push(record);
+	}
+
+	// Accumulates time when writer was busy and records written in it since previous call, idle time is not counted.
+	// Called by writer thread under mt_buffer_lock
+	void measure_write_rate(unsigned long& busy_since, uint64_t& written_before)
+	{
+		unsigned long now = utils::get_tick_count();
+
+		mt_rate_busy_ms += now - busy_since;
+		mt_rate_written += static_cast<unsigned long>(stat_messages_ - written_before);
+		busy_since = now;
+		written_before = stat_messages_;
+
+		// first estimate is taken as soon as possible, then it is updated after each 100 ms of work
+		if (!mt_rate_busy_ms || (mt_write_rate && mt_rate_busy_ms < 100))
+			return;
+
+		mt_write_rate = mt_rate_written / mt_rate_busy_ms * 1000 + mt_rate_written % mt_rate_busy_ms * 1000 / mt_rate_busy_ms;
+		mt_rate_busy_ms = 0;
+		mt_rate_written = 0;
+	}
+#endif //LOG_LOAD_SHEDDING
+
+	// Publishes that records passed to stream are in file, called under mt_buffer_lock after stream is flushed
+	void queue_mark_flushed()
+	{
+		atomic_ops::store_ptr((void* volatile*)&mt_queue_flushed, mt_queue_next_write);
+
+#if LOG_PRIORITY_QUEUE
+		atomic_ops::store_ptr((void* volatile*)&mt_priority_flushed, mt_priority_next_write);
+#endif //LOG_PRIORITY_QUEUE
+	}
+
+	bool is_crashing()
+	{
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		return atomic_ops::load(&mt_crashing) != 0;
+#else //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		return false;
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+	}
+
+	// Removes records already flushed to file, called under mt_buffer_lock
+	void queue_release_written()
+	{
+		// pairs with write_queue_on_crash: either crash handler sees published flushed pointers and does not walk
+		// records before them, or flag is seen here and records are kept until process exits
+		atomic_ops::fence();
+		if (is_crashing())
+			return;
+
+		mt_queue_size -= list_release_written(mt_queue_head, mt_queue_flushed, mt_queue_tail);
+
+#if LOG_PRIORITY_QUEUE
+		list_release_written(mt_priority_head, mt_priority_flushed, mt_priority_tail);
+#endif //LOG_PRIORITY_QUEUE
+	}
+
+	void queue_clear()
+	{
+		mt_queue_next_write = NULL;
+#if LOG_PRIORITY_QUEUE
+		mt_priority_next_write = NULL;
+#endif //LOG_PRIORITY_QUEUE
+		queue_mark_flushed();
+		queue_release_written();
+	}
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+	// Called from crash handler: writes records which are not flushed to file yet, starting from published flushed pointers.
+	// No locks are taken: writer thread stops and frees nothing after it sees the flag, so list is walked as is.
+	// Only records which were being written or flushed by writer thread at the moment of crash can be duplicated
+	static void write_queue_on_crash(void* context)
+	{
+		logger* log = static_cast<logger*>(context);
+
+		atomic_ops::store(&log->mt_crashing, 1);
+		atomic_ops::fence();
+
+		const mt_record* queue = static_cast<const mt_record*>(atomic_ops::load_ptr((void* volatile*)&log->mt_queue_flushed));
+#if LOG_PRIORITY_QUEUE
+		const mt_record* priority = static_cast<const mt_record*>(atomic_ops::load_ptr((void* volatile*)&log->mt_priority_flushed));
+#endif //LOG_PRIORITY_QUEUE
+
+#if LOG_BINARY_FORMAT
+		// records encoded by writer thread go before text, which lasts until end of file
+#	if LOG_PRIORITY_QUEUE
+		write_list_on_crash(priority, true);
+#	endif //LOG_PRIORITY_QUEUE
+		write_list_on_crash(queue, true);
+#endif //LOG_BINARY_FORMAT
+
+#if LOG_PRIORITY_QUEUE
+		write_list_on_crash(priority, false);
+#endif //LOG_PRIORITY_QUEUE
+
+		write_list_on_crash(queue, false);
+	}
+
+	// Writes records encoded to binary format or others
+	static void write_list_on_crash(const mt_record* record, bool encoded)
+	{
+		for (; record; record = static_cast<const mt_record*>(atomic_ops::load_ptr((void* volatile*)&record->next)))
+		{
+#if LOG_BINARY_FORMAT
+			if (record->encoded != encoded)
+				continue;
+
+			// stack trace is encoded with text
+			if (encoded)
+			{
+				crash_writer::write_records(record->text.data(), record->text.size());
+				continue;
+			}
+#else //LOG_BINARY_FORMAT
+			(void)encoded;
+#endif //LOG_BINARY_FORMAT
+
+#if LOG_DEFERRED_FORMAT
+			// formatting is not safe here, so format string is written without arguments
+			const call_site_t* site = static_cast<const call_site_t*>(atomic_ops::load_ptr((void* volatile*)&record->site));
+			if (site)
+			{
+				crash_writer::write_raw(site->format, strlen(site->format));
+				crash_writer::write_raw("\n", 1);
+				continue;
+			}
+#endif //LOG_DEFERRED_FORMAT
+
+			crash_writer::write_raw(record->text.data(), record->text.size());
+
+#if LOG_DEFERRED_STACKTRACE
+			// symbols can not be resolved here, first frame is log_stack_trace itself
+			if (record->frames.size() > 1)
+				crash_writer::write_frames(&record->frames[1], static_cast<int>(record->frames.size() - 1));
+#endif //LOG_DEFERRED_STACKTRACE
+		}
+	}
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
+#if LOG_DEFERRED_STACKTRACE
+	// Called by writer thread without lock, record is not released until it is written
+	static std::string resolve_stack_trace(mt_record* record)
+	{
+		std::string result;
+
+		if (record->frames.empty())
+			return result;
+
+		if (record->generation != module_cache::query_generation())
+			result += "(modules were loaded or unloaded after stack trace was taken, symbols can be wrong)\n";
+
+		result += runtime_debugging::get_stack_trace_string(&record->frames[0], static_cast<int>(record->frames.size()));
+		result += "\n";
+		return result;
+	}
+#endif //LOG_DEFERRED_STACKTRACE
+
+#if LOG_BINARY_FORMAT
+	binary_log_encoder binary_encoder_;
+
+	// Replaces record text with binary records, called by writer thread under mt_buffer_lock
+	void encode_binary(mt_record* record, std::string& stack)
+	{
+		std::string out;
 
-					continue;
-				}
+		if (record->site)
+		{
+			binary_encoder_.encode_message(out, record->site, try_get_cached_module_name(record->addr).c_str(),
+				record->seconds, record->millisec, record->tid, record->text);
+			atomic_ops::store_ptr((void* volatile*)&record->site, NULL);
+		}
+		else
+		{
+			binary_encoder_.encode_text(out, record->text + stack);
+			stack.clear();
+		}
 
-				std::string new_name = name.substr(0, name.find_last_of('.')) + stringformat(".%d", new_index);
+		record->text.swap(out);
+		record->encoded = true;
+	}
+#endif //LOG_BINARY_FORMAT
 
-#ifdef LOG_PLATFORM_WINDOWS
-                MoveFileA((configurator.get_log_path() + "/" + name).c_str(),
-					(configurator.get_log_path() + "/" + new_name).c_str());
-#else //LOG_PLATFORM_WINDOWS
-                rename((configurator.get_log_path() + "/" + name).c_str(),
-                       (configurator.get_log_path() + "/" + new_name).c_str());
-#endif //LOG_PLATFORM_WINDOWS
-			}
+#if LOG_DEFERRED_FORMAT && !LOG_BINARY_FORMAT
+	// Called by writer thread without lock: replaces packed arguments of LOG_*_T record with formatted message
+	void format_deferred(mt_record* record)
+	{
+		const call_site_t* site = record->site;
+
+		message_stamp_t stamp;
+		stamp.time = utils::get_local_time(record->seconds);
+		stamp.millisec = record->millisec;
+		stamp.tid = record->tid;
+		stamp.sequence = record->sequence;
+#if LOG_USE_CONTEXT
+		stamp.context = &record->context;
+#endif //LOG_USE_CONTEXT
+
+		std::string str = make_packed_record(configurator.get_config().get(), *site, record->addr, record->text, &stamp);
+		record->text.swap(str);
+		atomic_ops::store_ptr((void* volatile*)&record->site, NULL);
+	}
+#endif //LOG_DEFERRED_FORMAT && !LOG_BINARY_FORMAT
 
-#ifdef LOG_PLATFORM_WINDOWS
-			MoveFileExA(configurator.get_full_log_file_path().c_str(), (configurator.get_full_log_file_path() + ".1").c_str(), 
-						MOVEFILE_WRITE_THROUGH | MOVEFILE_REPLACE_EXISTING);
-#else //LOG_PLATFORM_WINDOWS
-            rename(configurator.get_full_log_file_path().c_str(), (configurator.get_full_log_file_path() + ".1").c_str());
-#endif //LOG_PLATFORM_WINDOWS
+#if LOG_COLLAPSE_REPEATS
+	// FNV-1a hash of message text or packed arguments
+	static uint64_t hash_message(const char* data, size_t len)
+	{
+		uint64_t hash = 14695981039346656037ULL;
 
-#if !LOG_FLUSH_FILE_EVERY_WRITE
-			if (!stream.is_open())   
-				stream.open(configurator.get_full_log_file_path().c_str(),std::ios::app);
-#endif //LOG_FLUSH_FILE_EVERY_WRITE
+		for (size_t i = 0; i < len; i++)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 1099511628211ULL;
 		}
+
+		return hash;
 	}
 
-	int ref_counter_;
+	// Called by writer thread: true if record is the same message from the same call site as previous one,
+	// such record is only counted. Otherwise count of previous message is written before record
+	bool collapse_repeated(const mt_record* record)
+	{
+		message_key_t key = record->message;
 
-#if LOG_SHARED
-	bool shared_master_;
-	void* shared_obj_ptr_;
-#endif //LOG_SHARED
+#if LOG_DEFERRED_FORMAT
+		if (record->site)
+		{
+			key.src_file = record->site->src_file;
+			key.function_name = record->site->function_name;
+			key.line_num = record->site->line_num;
+			key.verb_level = record->site->verb_level;
+			key.addr = record->addr;
+			key.tid = record->tid;
+		}
+#endif //LOG_DEFERRED_FORMAT
 
+		if (key.src_file)
+		{
+			key.len = record->text.size() - record->message_pos;
+			key.hash = hash_message(record->text.data() + record->message_pos, key.len);
 
+			if (key.src_file == repeat_message_.src_file && key.line_num == repeat_message_.line_num &&
+				key.verb_level == repeat_message_.verb_level && key.len == repeat_message_.len && key.hash == repeat_message_.hash)
+			{
+				if (!repeat_count_++)
+					repeat_since_ = utils::get_tick_count();
 
-#if LOG_MULTITHREADED
+				// count is written with thread id of the last collapsed message
+				repeat_message_.tid = key.tid;
+				return true;
+			}
+		}
 
-#	ifdef LOG_PLATFORM_WINDOWS
-#		define LOG_MT_MUTEX CRITICAL_SECTION
-#		define LOG_MT_MUTEX_INIT(x, y) InitializeCriticalSection(x)
-#		define LOG_MT_MUTEX_LOCK(x) EnterCriticalSection(x)
-#		define LOG_MT_MUTEX_UNLOCK(x) LeaveCriticalSection(x)
-#		define LOG_MT_MUTEX_DESTROY(x) DeleteCriticalSection(x)
-#		define LOG_MT_THREAD_EXIT(x)  ExitThread(x)
-#	else //LOG_PLATFORM_WINDOWS
+		write_repeated();
+		repeat_message_ = key;
+		return false;
+	}
 
-#		define LOG_MT_MUTEX pthread_mutex_t
-#		define LOG_MT_MUTEX_INIT pthread_mutex_init
-#		define LOG_MT_MUTEX_LOCK pthread_mutex_lock
-#		define LOG_MT_MUTEX_UNLOCK pthread_mutex_unlock
-#		define LOG_MT_MUTEX_DESTROY pthread_mutex_destroy
-#		define LOG_MT_THREAD_EXIT pthread_exit
+	// Writes count of not written messages with header of repeated message. Called under mt_buffer_lock
+	void write_repeated()
+	{
+		if (!repeat_count_)
+			return;
 
+		const message_key_t& key = repeat_message_;
+		std::string message = stringformat("Last message repeated %lu times", repeat_count_);
+		message_stamp_t stamp = make_stamp(key.tid);
+		std::string text = make_record(configurator.get_config().get(), key.verb_level, key.line_num, key.src_file,
+			key.function_name, try_get_cached_module_name(key.addr).c_str(), message.data(), message.size(), " ", true, NULL, &stamp);
 
-#	endif //LOG_PLATFORM_WINDOWS
+		repeat_count_ = 0;
+		scroll_files();
 
-#endif //LOG_MULTITHREADED
+#if LOG_BINARY_FORMAT
+		open_stream(configurator.get_config().get());
+		std::string out;
+		binary_encoder_.encode_text(out, text);
+		text.swap(out);
+#endif //LOG_BINARY_FORMAT
+
+		cur_file_size_ += static_cast<int>(text.size());
+		stat_messages_++;
+		stat_bytes_ += text.size();
+
+#if LOG_FLUSH_FILE_EVERY_WRITE
+#	if !LOG_TEST_DO_NOT_WRITE_FILE
+		std::ofstream stream(configurator.get_full_log_file_path().c_str(),std::ios::app);
+		stream << text;
+#	endif //LOG_TEST_DO_NOT_WRITE_FILE
+#else //LOG_FLUSH_FILE_EVERY_WRITE
+		open_stream(configurator.get_config().get());
+		stream << text;
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+	}
 
+	bool is_repeat_timeout()
+	{
+		return utils::get_tick_count() - repeat_since_ >= LOG_COLLAPSE_REPEATS_TIMEOUT;
+	}
 
+#	ifndef LOG_PLATFORM_WINDOWS
+	// Waits for record not longer than until repeat count should be written, called under mt_buffer_lock
+	void wait_repeat_timeout()
+	{
+		unsigned long left = LOG_COLLAPSE_REPEATS_TIMEOUT - (utils::get_tick_count() - repeat_since_);
 
-#if LOG_MULTITHREADED
-	LOG_MT_MUTEX mt_buffer_lock;
-	std::list<std::string> mt_buffer;
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += left / 1000;
+		deadline.tv_nsec += (left % 1000) * 1000000;
 
-#	ifdef LOG_PLATFORM_WINDOWS
-	HANDLE log_thread_handle;
-	HANDLE write_event;
-#	else //LOG_PLATFORM_WINDOWS
-	pthread_t log_thread_handle;
-	pthread_cond_t write_event;
-#	endif //LOG_PLATFORM_WINDOWS
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
 
-	int mt_terminating;
+		pthread_cond_timedwait(&write_event, &mt_buffer_lock, &deadline);
+	}
+#	endif //LOG_PLATFORM_WINDOWS
+#endif //LOG_COLLAPSE_REPEATS
 
 	static unsigned long 
 #	ifdef LOG_PLATFORM_WINDOWS
@@ -3843,8 +9400,7 @@ private:
 		logger* log = reinterpret_cast<logger*>(data);
 		
 #if !LOG_FLUSH_FILE_EVERY_WRITE
-		if (!log->stream.is_open())   
-			log->stream.open(configurator.get_full_log_file_path().c_str(),std::ios::app);
+		log->open_stream(configurator.get_config().get());
 #endif //LOG_FLUSH_FILE_EVERY_WRITE
 
 		while(true)
@@ -3853,35 +9409,168 @@ private:
 			WaitForSingleObject(log->write_event, 100);
 #endif //LOG_PLATFORM_WINDOWS
 
+#if LOG_USE_MODULEDEFINITION
+			// module names are found without module cache lock under mt_buffer_lock, so modules loaded
+			// since previous iteration are added to cache before it
+			log->modules_.update();
+#endif //LOG_USE_MODULEDEFINITION
+
 			LOG_MT_MUTEX_LOCK(&log->mt_buffer_lock);
 
 #ifndef LOG_PLATFORM_WINDOWS
-			pthread_cond_wait(&log->write_event, &log->mt_buffer_lock);
+			while (!log->queue_next_write() && !log->mt_requests && !log->mt_terminating)
+			{
+#	if LOG_COLLAPSE_REPEATS
+				// count of repeated message is written by timeout even if nothing else is logged
+				if (log->repeat_count_)
+				{
+					if (log->is_repeat_timeout())
+						break;
+
+					log->wait_repeat_timeout();
+					continue;
+				}
+#	endif //LOG_COLLAPSE_REPEATS
+
+				pthread_cond_wait(&log->write_event, &log->mt_buffer_lock);
+			}
 #endif //LOG_PLATFORM_WINDOWS
 
-			while (log->mt_buffer.size())
+#if LOG_LOAD_SHEDDING
+			unsigned long busy_since = utils::get_tick_count();
+			uint64_t written_before = log->stat_messages_;
+#endif //LOG_LOAD_SHEDDING
+
+			while (log->queue_next_write() && !log->is_crashing())
 			{
+				mt_record*& next_write = log->queue_next_write();
+				mt_record* record = next_write;
+				std::string stack;
+
+#if LOG_COLLAPSE_REPEATS
+				if (log->collapse_repeated(record))
+				{
+					next_write = record->next;
+					continue;
+				}
+#endif //LOG_COLLAPSE_REPEATS
+
+#if LOG_DEFERRED_STACKTRACE
+				// symbols are resolved without lock, so callers are not blocked
+				if (record->frames.size())
+				{
+					LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
+					stack = resolve_stack_trace(record);
+					LOG_MT_MUTEX_LOCK(&log->mt_buffer_lock);
+				}
+#endif //LOG_DEFERRED_STACKTRACE
+
+#if LOG_DEFERRED_FORMAT && !LOG_BINARY_FORMAT
+				// record is not released until it is written, so text is replaced without lock
+				if (record->site)
+				{
+					LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
+					log->format_deferred(record);
+					LOG_MT_MUTEX_LOCK(&log->mt_buffer_lock);
+				}
+#endif //LOG_DEFERRED_FORMAT && !LOG_BINARY_FORMAT
+
 				log->scroll_files();
-				std::string str = *log->mt_buffer.begin();
-				log->cur_file_size_ += static_cast<int>(str.size());
+
+#if LOG_BINARY_FORMAT
+				// encoded after rotation: new file starts new segment with own call sites
+				log->open_stream(configurator.get_config().get());
+				log->encode_binary(record, stack);
+#endif //LOG_BINARY_FORMAT
+				const std::string& str = record->text;
+				log->cur_file_size_ += static_cast<int>(str.size() + stack.size());
+				log->stat_messages_++;
+				log->stat_bytes_ += str.size() + stack.size();
 
 #if LOG_FLUSH_FILE_EVERY_WRITE
 #	if !LOG_TEST_DO_NOT_WRITE_FILE
 				{
 					std::ofstream stream(configurator.get_full_log_file_path().c_str(),std::ios::app);
-					stream << str;
+					stream << str << stack;
 				}
 #	endif //LOG_TEST_DO_NOT_WRITE_FILE
 #else //LOG_FLUSH_FILE_EVERY_WRITE
-				log->stream << str;
+				log->open_stream(configurator.get_config().get());
+				log->stream << str << stack;
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+
+				next_write = record->next;
+
+#if LOG_FLUSH_FILE_EVERY_WRITE
+				log->queue_mark_flushed();
+#elif LOG_PRIORITY_QUEUE
+				// ERROR and FATAL records reach file without waiting for end of long batch
+				if (record->priority)
+				{
+					log->stream.flush();
+					log->queue_mark_flushed();
+				}
 #endif //LOG_FLUSH_FILE_EVERY_WRITE
 
-				log->mt_buffer.pop_front();
+#if LOG_LOAD_SHEDDING
+				// long batch is measured while it is written, so shedding messages show current rate
+				if (!(log->stat_messages_ & 1023))
+					log->measure_write_rate(busy_since, written_before);
+#endif //LOG_LOAD_SHEDDING
+			}
+
+			// crash handler writes records not flushed yet, so writer stops without flush and they are not written twice
+			if (log->is_crashing())
+			{
+				LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
+				break;
+			}
+
+#if LOG_COLLAPSE_REPEATS
+			if (log->repeat_count_ && (log->mt_terminating || (log->mt_requests & mt_request_flush) || log->is_repeat_timeout()))
+			{
+				log->write_repeated();
+#	if !LOG_FLUSH_FILE_EVERY_WRITE
+				log->stream.flush();
+#	endif //LOG_FLUSH_FILE_EVERY_WRITE
+			}
+#endif //LOG_COLLAPSE_REPEATS
+
+#if !LOG_FLUSH_FILE_EVERY_WRITE
+			// records stay in queue until stream is flushed, so crash handler still can write them
+			if (log->queue_has_records())
+			{
+				log->stream.flush();
+				log->queue_mark_flushed();
 			}
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+
+#if LOG_LOAD_SHEDDING
+			log->measure_write_rate(busy_since, written_before);
+#endif //LOG_LOAD_SHEDDING
+
+			log->queue_release_written();
+
+#if LOG_LOAD_SHEDDING
+			log->update_load_shedding();
+#endif //LOG_LOAD_SHEDDING
+
+			if (log->mt_requests & mt_request_rotate)
+				log->scroll_files(true);
+
+#if !LOG_FLUSH_FILE_EVERY_WRITE
+			if (log->mt_requests & mt_request_flush)
+				log->stream.flush();
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
+
+			log->mt_requests = 0;
+
+			// record queued by writer thread itself (end of load shedding) is written before thread exits
+			bool finished = log->mt_terminating && !log->queue_next_write();
 
 			LOG_MT_MUTEX_UNLOCK(&log->mt_buffer_lock);
 
-			if (log->mt_terminating)
+			if (finished)
 			{
 #if !LOG_FLUSH_FILE_EVERY_WRITE 
 				log->stream.flush();
@@ -3898,8 +9587,22 @@ private:
 
 	void put_to_stream(const std::string& what)
 	{
+		mt_record* record = new mt_record;
+		record->text = what;
+		put_to_stream(record);
+	}
+
+	void put_to_stream(mt_record* record)
+	{
+		restart_after_fork();
+
 		LOG_MT_MUTEX_LOCK(&mt_buffer_lock);
-		mt_buffer.push_back(what);
+		queue_push(record);
+
+#if LOG_LOAD_SHEDDING
+		mt_shed_tid = process_ids::tid();
+		update_load_shedding();
+#endif //LOG_LOAD_SHEDDING
 
 #ifdef LOG_PLATFORM_WINDOWS
 		SetEvent(write_event);
@@ -3921,19 +9624,64 @@ private:
 		stream << what;
 #	endif //LOG_TEST_DO_NOT_WRITE_FILE
 #else  //LOG_FLUSH_FILE_EVERY_WRITE
-		if (!stream.is_open())   
-			stream.open(configurator.get_full_log_file_path().c_str(),std::ios::app);
+		open_stream(configurator.get_config().get());
 
 		stream << what;
 #endif //LOG_FLUSH_FILE_EVERY_WRITE
 		cur_file_size_ += static_cast<int>(what.size());
+		stat_messages_++;
+		stat_bytes_ += what.size();
 	}
 #endif //LOG_MULTITHREADED
 
 #if !LOG_FLUSH_FILE_EVERY_WRITE
 	std::ofstream stream;
+	unsigned long stream_config_version_;
+	std::string stream_path_;
+
+	// (Re)opens log file if it was not opened yet or log file path was changed in configuration
+	__inline void open_stream(const log_config_t* config)
+	{
+		if (config->version == stream_config_version_ && stream.is_open())
+			return;
+
+		stream_config_version_ = config->version;
+
+#if LOG_BINARY_FORMAT
+		// header format is stored in segment header, so changed one starts new segment
+		if (config->hdr_format != binary_encoder_.header_format())
+			binary_encoder_.reset(config->hdr_format);
+#endif //LOG_BINARY_FORMAT
+
+		if (stream.is_open())
+		{
+			if (stream_path_ == config->full_log_file_path)
+				return;
+
+			stream.flush();
+			stream.close();
+			cur_file_size_ = 0;
+		}
+
+		stream_path_ = config->full_log_file_path;
+
+#if LOG_BINARY_FORMAT
+		binary_encoder_.reset(config->hdr_format);
+		stream.open(stream_path_.c_str(),std::ios::app | std::ios::binary);
+#else //LOG_BINARY_FORMAT
+		stream.open(stream_path_.c_str(),std::ios::app);
+#endif //LOG_BINARY_FORMAT
+	}
 #endif //LOG_FLUSH_FILE_EVERY_WRITE
 
+#if LOG_INI_HOT_RELOAD
+	log_ini_watcher ini_watcher_;
+#endif //LOG_INI_HOT_RELOAD
+
+#if LOG_CONTROL_SOCKET
+	log_control_server control_server_;
+#endif //LOG_CONTROL_SOCKET
+
 public:
 	void ref() { ref_counter_++; }
 	void deref() { ref_counter_--; }
@@ -3995,14 +9743,57 @@ public:
 	logger()
 		:ref_counter_(0)
 		,cur_file_size_(0)
+		,stat_messages_(0)
+		,stat_bytes_(0)
+		,stat_rotations_(0)
+		,sequence_(0)
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		,crash_config_version_(0)
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
 #if LOG_SHARED
 		, shared_master_(false)
 		, shared_obj_ptr_(NULL)
 #endif //LOG_SHARED
 
 #if LOG_MULTITHREADED
+		, mt_queue_head(NULL)
+		, mt_queue_flushed(NULL)
+		, mt_queue_next_write(NULL)
+		, mt_queue_tail(NULL)
+		, mt_queue_size(0)
+#if LOG_PRIORITY_QUEUE
+		, mt_priority_head(NULL)
+		, mt_priority_flushed(NULL)
+		, mt_priority_next_write(NULL)
+		, mt_priority_tail(NULL)
+#endif //LOG_PRIORITY_QUEUE
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		, mt_crashing(0)
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
 		, mt_terminating(0)
+		, mt_requests(0)
+#if LOG_RESTART_AFTER_FORK
+		, mt_fork_restart(0)
+#endif //LOG_RESTART_AFTER_FORK
 #endif //LOG_MULTITHREADED
+
+#if LOG_LOAD_SHEDDING
+		, mt_shed_levels(0)
+		, mt_shed_tid(0)
+		, mt_write_rate(0)
+		, mt_rate_busy_ms(0)
+		, mt_rate_written(0)
+#endif //LOG_LOAD_SHEDDING
+
+#if LOG_COLLAPSE_REPEATS
+		, repeat_message_()
+		, repeat_count_(0)
+		, repeat_since_(0)
+#endif //LOG_COLLAPSE_REPEATS
+
+#if !LOG_FLUSH_FILE_EVERY_WRITE
+		, stream_config_version_(0)
+#endif //LOG_FLUSH_FILE_EVERY_WRITE
 	{
 #if LOG_SHARED
 		if (shared_obj::try_found_shared_object(0) == NULL)
@@ -4013,7 +9804,8 @@ public:
 #endif //LOG_SHARED
 
 #if LOG_INI_CONFIGURATION
-		log_ini_configurator::configure(configurator.get_ini_file_find_paths().c_str());
+		std::string ini_file_path;
+		log_ini_configurator::configure(configurator.get_ini_file_find_paths().c_str(), &ini_file_path);
 #endif //LOG_INI_CONFIGURATION
 
 #if LOG_CONFIGURE_FROM_REGISTRY
@@ -4033,6 +9825,14 @@ public:
 		if (configurator.get_verbose_level() == logger_verbose_mute)
 			return;
 
+#if LOG_FLIGHT_RECORDER
+		flight_recorder::update_utc_offset();
+#endif //LOG_FLIGHT_RECORDER
+
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+		crash_writer::set_modules(&modules_);
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+
 		scroll_files(configurator.get_log_scroll_file_every_run());
 
 #if LOG_MULTITHREADED
@@ -4048,18 +9848,75 @@ public:
 		pthread_create(&log_thread_handle, NULL, (void*(*)(void*))&log_thread_fn, this);
 #	endif //LOG_PLATFORM_WINDOWS
 
+#	if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		crash_writer::set_pending_writer(&write_queue_on_crash, this);
+#	endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
+#	if LOG_RESTART_AFTER_FORK
+		fork_instance() = this;
+		register_fork_handlers();
+#	endif //LOG_RESTART_AFTER_FORK
+
 #endif //LOG_MULTITHREADED
 		
-		put_to_stream("\n");
+		if (configurator.get_output_format() == log_output_text)
+			put_to_stream("\n");
 
 #if LOG_USE_SYSTEMINFO
 		if (configurator.get_need_sys_info())
-			put_to_stream(query_system_info());
+		{
+			std::string system_info = query_system_info();
+			int output_format = configurator.get_output_format();
+
+			// every line of structured log must be a record
+			if (output_format != log_output_text)
+			{
+				std::string record = output_format == log_output_json ? "{" : "";
+				structured_format::append_key(record, output_format, "system_info", 11);
+				structured_format::append_string(record, output_format, system_info.c_str(), system_info.size());
+				system_info = record + (output_format == log_output_json ? "}\n" : "\n");
+			}
+
+			put_to_stream(system_info);
+		}
 #endif //LOG_USE_SYSTEMINFO
+
+#if LOG_INI_HOT_RELOAD
+		if (ini_file_path.size())
+			ini_watcher_.start(ini_file_path, this);
+#endif //LOG_INI_HOT_RELOAD
+
+#if LOG_CONTROL_SOCKET
+#	if LOG_INI_CONFIGURATION
+		control_server_.start(this, ini_file_path);
+#	else //LOG_INI_CONFIGURATION
+		control_server_.start(this, std::string());
+#	endif //LOG_INI_CONFIGURATION
+#endif //LOG_CONTROL_SOCKET
 	}
 
 	virtual ~logger() 
 	{
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+		crash_writer::set_modules(NULL);
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS) && LOG_USE_MODULEDEFINITION && LOG_USE_MODULES_CACHE
+
+#if LOG_RESTART_AFTER_FORK
+		if (fork_instance() == this)
+			fork_instance() = NULL;
+
+		// threads are stopped below, so in child process they must exist
+		restart_after_fork();
+#endif //LOG_RESTART_AFTER_FORK
+
+#if LOG_CONTROL_SOCKET
+		control_server_.stop();
+#endif //LOG_CONTROL_SOCKET
+
+#if LOG_INI_HOT_RELOAD
+		ini_watcher_.stop();
+#endif //LOG_INI_HOT_RELOAD
+
 #if LOG_SHARED
 		if (shared_master_ && shared_obj::free_shared_object(0))
 		{
@@ -4072,6 +9929,10 @@ public:
 #endif //LOG_SHARED
 
 #if LOG_MULTITHREADED
+#	if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		crash_writer::set_pending_writer(NULL, NULL);
+#	endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+
 		mt_terminating = 1;
 
 #	ifdef LOG_PLATFORM_WINDOWS
@@ -4084,6 +9945,7 @@ public:
 		pthread_cond_destroy(&write_event);
 #	endif //LOG_PLATFORM_WINDOWS
 
+		queue_clear();
 		LOG_MT_MUTEX_DESTROY(&mt_buffer_lock);
 
 #endif //LOG_MULTITHREADED
@@ -4094,28 +9956,85 @@ public:
 #endif //LOG_FLUSH_FILE_EVERY_WRITE
 	}
 
+	void flush()
+	{
+#if LOG_MULTITHREADED
+		post_request(mt_request_flush);
+#elif !LOG_FLUSH_FILE_EVERY_WRITE
+		stream.flush();
+#endif //LOG_MULTITHREADED
+	}
+
+	void rotate()
+	{
+#if LOG_MULTITHREADED
+		post_request(mt_request_rotate);
+#else //LOG_MULTITHREADED
+		scroll_files(true);
+#endif //LOG_MULTITHREADED
+	}
+
+#if LOG_FLIGHT_RECORDER
+	void dump_flight_recorder()
+	{
+		std::string records = flight_recorder::dump();
+		if (records.size())
+			put_to_stream(records);
+	}
+
+	// Context of message is written to the same lane as message, so it stays before it
+	void dump_flight_recorder(int verb_level)
+	{
+		std::string records = flight_recorder::dump();
+		if (records.size())
+			put_to_lane(records, verb_level);
+	}
+#endif //LOG_FLIGHT_RECORDER
+
+	std::string query_stats()
+	{
+#if LOG_MULTITHREADED
+		LOG_MT_MUTEX_LOCK(&mt_buffer_lock);
+		unsigned long queued = mt_queue_size;
+#endif //LOG_MULTITHREADED
+
+		std::string stats = stringformat("messages_written=" LOG_FMT_U64 "\nbytes_written=" LOG_FMT_U64 "\nrotations=%lu\ncurrent_file_size=%d\n",
+			static_cast<unsigned long long>(stat_messages_), static_cast<unsigned long long>(stat_bytes_), stat_rotations_, cur_file_size_);
+
+#if LOG_MULTITHREADED
+#	if LOG_LOAD_SHEDDING
+		stats += stringformat("write_rate=%lu\nshed_levels=%d\n", mt_write_rate, mt_shed_levels);
+#	endif //LOG_LOAD_SHEDDING
+
+		LOG_MT_MUTEX_UNLOCK(&mt_buffer_lock);
+		stats += stringformat("queued=%lu\n", queued);
+#endif //LOG_MULTITHREADED
+
+		return stats;
+	}
+
 	void log_binary(int verbLevel, void* addr, const char* functionName, 
 		const char* sourceFile, int lineNumber, const char* data, int len)
 	{
+		prepare_thread();
+
 		if (!is_message_enabled(verbLevel)) return;
 
-		std::string moduleName = try_get_module_name_fast(addr);
+		module_name_ref moduleName = try_get_module_name_fast(addr);
 		
 		std::stringstream sstream;
-		std::string header = log_process_macros(configurator.get_hdr_format(),verbLevel,lineNumber,sourceFile,functionName,moduleName.c_str());
-		sstream << header;
-
-		if (header.size())
-			sstream << " " << std::endl;
-
 		log_binary(sstream,data,len);
-		put_to_stream(sstream.str());
+
+		std::string text = sstream.str();
+		put_to_stream(make_record(configurator.get_config().get(),verbLevel,lineNumber,sourceFile,functionName,moduleName.c_str(),text.data(),text.size()," \n",false));
 	}
 
     void LOG_CDECL log(int verbLevel, void* addr, const char* functionName,
 		const char* sourceFile, int lineNumber, const char* format, ...)
 	{
+#if !LOG_FLIGHT_RECORDER
 		if (!is_message_enabled(verbLevel)) return;
+#endif //LOG_FLIGHT_RECORDER
 
 		va_list arguments;
 		va_start(arguments, format);
@@ -4128,13 +10047,26 @@ public:
 	void log_args(int verb_level, void* addr, const char* function_name, 
 		const char* src_file, int line_num, const char* format, va_list arguments)
 	{
-		if (!is_message_enabled(verb_level)) return;
+		prepare_thread();
+
+#if LOG_FLIGHT_RECORDER
+		bool enabled = is_message_enabled(verb_level);
 
-		std::string module_name = try_get_module_name_fast(addr);
-		std::string str = log_process_macros(configurator.get_hdr_format(),verb_level,line_num,src_file,function_name,module_name.c_str());
-		if (str.size())
-			str += " ";
+		va_list recorder_arguments;
+		LOG_VA_COPY(recorder_arguments, arguments);
+		flight_recorder::record(verb_level, enabled, src_file, line_num, function_name, format, recorder_arguments);
+		va_end(recorder_arguments);
 
+		if (!enabled) return;
+
+		// context which preceded error is written before it
+		if (verb_level & configurator.get_config()->flight_recorder_dump_level)
+			dump_flight_recorder(verb_level);
+#else //LOG_FLIGHT_RECORDER
+		if (!is_message_enabled(verb_level)) return;
+#endif //LOG_FLIGHT_RECORDER
+
+		module_name_ref module_name = try_get_module_name_fast(addr);
 		std::string result;
 
 #if LOG_PROCESS_MACRO_IN_LOG_TEXT
@@ -4144,93 +10076,182 @@ public:
 		format_arguments_list(result, format, arguments);
 #endif //LOG_PROCESS_MACRO_IN_LOG_TEXT
 
-		put_to_stream(str + result + "\n");
+		put_message(verb_level,addr,module_name.c_str(),function_name,src_file,line_num,result.data(),result.size());
 	}
 
-#if !LOG_USE_MODULEDEFINITION
-	__inline std::string try_get_module_name_fast(void* ptr)
+	void log_text(int verb_level, void* addr, const char* function_name, 
+		const char* src_file, int line_num, const char* text)
 	{
-        (void)ptr;
-		return std::string();
-	}
-#endif //!LOG_USE_MODULEDEFINITION
+		prepare_thread();
 
+#if LOG_FLIGHT_RECORDER
+		bool enabled = is_message_enabled(verb_level);
+		flight_recorder::record(verb_level, enabled, src_file, line_num, function_name, text);
 
-#if LOG_USE_MODULEDEFINITION
+		if (!enabled) return;
 
-#if LOG_USE_MODULES_CACHE
+		if (verb_level & configurator.get_config()->flight_recorder_dump_level)
+			dump_flight_recorder(verb_level);
+#else //LOG_FLIGHT_RECORDER
+		if (!is_message_enabled(verb_level)) return;
+#endif //LOG_FLIGHT_RECORDER
+
+		put_message(verb_level,addr,try_get_module_name_fast(addr).c_str(),function_name,src_file,line_num,text,strlen(text));
+	}
 
-    typedef struct _cache_module_t
+	// Record of LOG_* message, with LOG_COLLAPSE_REPEATS writer thread compares it with previous one
+	void put_message(int verb_level, void* addr, const char* module_name, const char* function_name,
+		const char* src_file, int line_num, const char* message, size_t len)
 	{
-		intptr_t base_addr;
-		intptr_t end_addr;
-		std::string name;
-    } cache_module_t;
+#if LOG_COLLAPSE_REPEATS
+		mt_record* record = new mt_record;
+		record->text = make_record(configurator.get_config().get(),verb_level,line_num,src_file,function_name,module_name,message,len,
+			" ",true,NULL,NULL,&record->message_pos);
+		record->message.src_file = src_file;
+		record->message.function_name = function_name;
+		record->message.line_num = line_num;
+		record->message.verb_level = verb_level;
+		record->message.addr = addr;
+		record->message.tid = process_ids::tid();
+#	if LOG_PRIORITY_QUEUE
+		record->priority = is_priority_level(verb_level);
+#	endif //LOG_PRIORITY_QUEUE
+		put_to_stream(record);
+#else //LOG_COLLAPSE_REPEATS
+		(void)addr;
+		put_to_lane(make_record(configurator.get_config().get(),verb_level,line_num,src_file,function_name,module_name,message,len), verb_level);
+#endif //LOG_COLLAPSE_REPEATS
+	}
+
+	// Record of message of verb_level, ERROR and FATAL ones are queued to priority lane (LOG_PRIORITY_QUEUE)
+	void put_to_lane(const std::string& text, int verb_level)
+	{
+#if LOG_PRIORITY_QUEUE
+		mt_record* record = new mt_record;
+		record->text = text;
+		record->priority = is_priority_level(verb_level);
+		put_to_stream(record);
+#else //LOG_PRIORITY_QUEUE
+		(void)verb_level;
+		put_to_stream(text);
+#endif //LOG_PRIORITY_QUEUE
+	}
 
-	std::vector<cache_module_t> cached_modules;
+#if LOG_TEMPLATE_API
+	void log_packed(const call_site_t& site, void* addr, std::string& args)
+	{
+		prepare_thread();
+
+#if LOG_DEFERRED_FORMAT
+		// level is checked by caller
+		mt_record* record = new mt_record;
+		record->text.swap(args);
+		record->site = &site;
+		record->addr = addr;
+		record->tid = process_ids::tid();
+		utils::get_timestamp(record->seconds, record->millisec);
+
+		if (configurator.get_config()->hdr_fields & log_field_seq)
+			record->sequence = next_sequence();
+
+#if LOG_PRIORITY_QUEUE
+		record->priority = is_priority_level(site.verb_level);
+#endif //LOG_PRIORITY_QUEUE
+
+#if LOG_USE_CONTEXT
+		const log_context_t* context = log_context::current();
+		if (context && (configurator.get_config()->hdr_fields & log_field_ctx))
+			record->context = *context;
+#endif //LOG_USE_CONTEXT
+
+		put_to_stream(record);
+#else //LOG_DEFERRED_FORMAT
+
+#if LOG_FLIGHT_RECORDER
+		bool enabled = is_message_enabled(site.verb_level);
+
+		std::string text;
+		template_format::render_message(text, site, args);
+		flight_recorder::record(site.verb_level, enabled, site.src_file, site.line_num, site.function_name, text.c_str());
+
+		if (!enabled) return;
+
+		if (site.verb_level & configurator.get_config()->flight_recorder_dump_level)
+			dump_flight_recorder(site.verb_level);
+#else //LOG_FLIGHT_RECORDER
+		if (!is_message_enabled(site.verb_level)) return;
+#endif //LOG_FLIGHT_RECORDER
+
+		put_to_lane(make_packed_record(configurator.get_config().get(), site, addr, args, NULL), site.verb_level);
+#endif //LOG_DEFERRED_FORMAT
+	}
 
-	bool is_module_found_in_cache(const char* name, intptr_t base_addr, intptr_t end_addr)
+	std::string make_packed_record(const log_config_t* config, const call_site_t& site, void* addr,
+		const std::string& packed, const message_stamp_t* stamp)
 	{
-		for (std::vector<cache_module_t>::iterator i=cached_modules.begin(); i!=cached_modules.end(); i++)
+		if (site.fields)
 		{
-			if (i->base_addr == base_addr && i->end_addr == end_addr && i->name == name)
-				return true;
+			return make_record(config, site.verb_level, site.line_num, site.src_file, site.function_name,
+				try_get_module_name_fast(addr).c_str(), site.format, strlen(site.format), " ", true, &packed, stamp);
 		}
 
-		return false;
+		std::string message;
+		template_format::render_packed(message, site.format, packed);
+
+		return make_record(config, site.verb_level, site.line_num, site.src_file, site.function_name,
+			try_get_module_name_fast(addr).c_str(), message.data(), message.size(), " ", true, NULL, stamp);
 	}
-#endif //LOG_USE_MODULES_CACHE
+#endif //LOG_TEMPLATE_API
+
+#if !LOG_USE_MODULEDEFINITION
+	struct module_name_ref
+	{
+		const char* c_str() const { return ""; }
+	};
 
-	std::string try_get_module_name_fast(void* ptr)
+	__inline module_name_ref try_get_module_name_fast(void* ptr)
 	{
-#if LOG_USE_MODULES_CACHE
-		intptr_t addr = (intptr_t)ptr;
+        (void)ptr;
+		return module_name_ref();
+	}
+
+	__inline module_name_ref try_get_cached_module_name(void* ptr)
+	{
+        (void)ptr;
+		return module_name_ref();
+	}
+#endif //!LOG_USE_MODULEDEFINITION
+
 
-		if (!addr)
-			return std::string();
+#if LOG_USE_MODULEDEFINITION
 
-		for (size_t i=0; i<cached_modules.size(); i++)
-		{
-			if (cached_modules[i].base_addr <= addr && cached_modules[i].end_addr >= addr)
-				return cached_modules[i].name;
-		}
+	module_cache modules_;
 
-		std::list<module_entry_t> modules;
-		if (module_definition::query_module_list(modules))
-		{
-			for (std::list<module_entry_t>::iterator i=modules.begin(); i!=modules.end(); i++)
-			{
-				if (!is_module_found_in_cache(i->moduleName.c_str(), i->baseAddress, i->baseAddress + i->size))
-				{
-					cache_module_t mod;
+	typedef module_cache::name_ref module_name_ref;
 
-					mod.base_addr = i->baseAddress;
-					mod.end_addr = i->size + i->baseAddress;
-					mod.name = i->moduleName;
-					cached_modules.push_back(mod);
-				}
-			}
-		}
-#endif // LOG_USE_MODULES_CACHE
+	__inline module_name_ref try_get_module_name_fast(void* ptr)
+	{
+		return modules_.find(ptr);
+	}
 
-		return logging::module_definition::module_name_by_addr(ptr);
+	// Module cache lock is not taken, so it is used under mt_buffer_lock: fork_prepare takes module cache lock
+	// before it. Modules loaded after last update of cache are not found
+	__inline module_name_ref try_get_cached_module_name(void* ptr)
+	{
+		intptr_t base;
+		return modules_.find_no_update(ptr, base);
 	}
 
 	void log_modules(int verb_level, void* addr, const char* function_name, 
 		const char* sourceFile, int lineNumber)
 	{
+		prepare_thread();
+
 		if (!is_message_enabled(verb_level)) return;
 
-		std::string module_name = try_get_module_name_fast(addr);
+		module_name_ref module_name = try_get_module_name_fast(addr);
 
 		std::stringstream sstream;
-
-		std::string header = log_process_macros(configurator.get_hdr_format(),verb_level,lineNumber,sourceFile,function_name,module_name.c_str());
-		sstream << header;
-		
-		if (header.size())
-			sstream << std::endl;
-
 		std::list<module_entry_t> modules;
 		if (!module_definition::query_module_list(modules))
 			return;
@@ -4269,7 +10290,8 @@ public:
 			sstream << std::endl;
 		}
 
-		put_to_stream(sstream.str());
+		std::string text = sstream.str();
+		put_to_stream(make_record(configurator.get_config().get(),verb_level,lineNumber,sourceFile,function_name,module_name.c_str(),text.data(),text.size(),"\n",false));
 	}
 #endif //LOG_USE_MODULEDEFINITION
 
@@ -4317,8 +10339,8 @@ public:
 
     std::string get_current_stack_trace_string()
     {
-        void *bt[1024];
-        int bt_size = backtrace(bt, 1024);
+        void *bt[LOG_STACKTRACE_MAX_DEPTH + 1];
+        int bt_size = runtime_debugging::capture_stack_trace(bt, LOG_STACKTRACE_MAX_DEPTH + 1);
         return runtime_debugging::get_stack_trace_string(bt, bt_size, 1);
     }
 #endif //LOG_PLATFORM_WINDOWS
@@ -4326,28 +10348,72 @@ public:
 	void log_stack_trace(int verb_level, void* addr, const char* function_name, 
 		const char* src_file, int lineNumber)
 	{
+		prepare_thread();
+
 		if (!is_message_enabled(verb_level)) return;
 
+		log_configurator::config_ref current = configurator.get_config();
+		const log_config_t* config = current.get();
+		module_name_ref module_name = try_get_module_name_fast(addr);
+
+		std::stringstream sstream;
+
 #ifdef LOG_PLATFORM_WINDOWS
         char* stack_trace = NULL;
         get_current_stack_trace_string(&stack_trace);
-		std::string stack = stack_trace; 
+		sstream << "Stack trace:" << std::endl << stack_trace << std::endl;
         free(stack_trace);
+
+		std::string text = sstream.str();
+		put_to_stream(make_record(config,verb_level,lineNumber,src_file,function_name,module_name.c_str(),text.data(),text.size()," ",false));
 #else //LOG_PLATFORM_WINDOWS
-        std::string stack = get_current_stack_trace_string();
-#endif //LOG_PLATFORM_WINDOWS
+		// first frame is log_stack_trace itself, it is skipped by get_stack_trace_string together with
+		// LOG_STACKTRACE_SKIP frames before it
+		void* stack[LOG_STACKTRACE_SKIP + 1 + LOG_STACKTRACE_MAX_DEPTH];
+		int stack_count = runtime_debugging::capture_stack_trace(stack, LOG_STACKTRACE_SKIP + 1 + LOG_STACKTRACE_MAX_DEPTH);
 
-		std::string module_name = try_get_module_name_fast(addr);
+		void** frames = stack + LOG_STACKTRACE_SKIP;
+		int frames_count = stack_count > LOG_STACKTRACE_SKIP ? stack_count - LOG_STACKTRACE_SKIP : 0;
 
-		std::stringstream sstream;
-		std::string header = log_process_macros(configurator.get_hdr_format(),verb_level,lineNumber,src_file,function_name,module_name.c_str());
-		sstream << header;
-		if (header.size())
-			sstream << " ";
+#if LOG_STACKTRACE_DEDUP_SIZE
+		std::string trace_id;
+		unsigned long seen_count = stack_dedup::instance().register_trace(frames + 1, frames_count - 1, trace_id);
+
+		if (seen_count > 1)
+		{
+			sstream << "Stack trace #" << trace_id << " (seen " << seen_count << " times)" << std::endl;
+			std::string text = sstream.str();
+			put_to_stream(make_record(config,verb_level,lineNumber,src_file,function_name,module_name.c_str(),text.data(),text.size()," ",false));
+			return;
+		}
+
+		sstream << "Stack trace #" << trace_id << ":" << std::endl;
+#else //LOG_STACKTRACE_DEDUP_SIZE
+		sstream << "Stack trace:" << std::endl;
+#endif //LOG_STACKTRACE_DEDUP_SIZE
 
-		sstream << "Stack trace:" << std::endl << stack << std::endl;
+#if LOG_DEFERRED_STACKTRACE
+		// only frame addresses are taken here, writer thread resolves symbols and writes trace after header.
+		// JSON record can not be continued by writer, so trace is resolved here
+		if (config->output_format == log_output_text)
+		{
+			std::string text = sstream.str();
+
+			mt_record* record = new mt_record;
+			record->text = make_record(config,verb_level,lineNumber,src_file,function_name,module_name.c_str(),text.data(),text.size()," ",false);
+			record->frames.assign(frames, frames + frames_count);
+			record->generation = module_cache::query_generation();
+
+			put_to_stream(record);
+			return;
+		}
+#endif //LOG_DEFERRED_STACKTRACE
+
+		sstream << runtime_debugging::get_stack_trace_string(frames, frames_count) << std::endl;
 
-		put_to_stream(sstream.str());
+		std::string text = sstream.str();
+		put_to_stream(make_record(config,verb_level,lineNumber,src_file,function_name,module_name.c_str(),text.data(),text.size()," ",false));
+#endif //LOG_PLATFORM_WINDOWS
 	}
 #endif //LOG_AUTO_DEBUGGING
 
@@ -4355,26 +10421,25 @@ public:
 	void log_exception(int verbLevel, void* addr, const char* function_name, 
 		const char* src_file, int line_num, const char* userMessage)
 	{
+		prepare_thread();
+
 		if (!is_message_enabled(verbLevel)) return;
 
-		std::string module_name = try_get_module_name_fast(addr);
+		module_name_ref module_name = try_get_module_name_fast(addr);
 
 		std::stringstream sstream;
-		std::string header = log_process_macros(configurator.get_hdr_format(),verbLevel,line_num,src_file,function_name,module_name.c_str());
-		sstream << header;
-
-		if (header.size())
-			sstream << " ";
-
 		sstream << "*** Exception occured at " << src_file << " (line " << line_num << ")" << std::endl;
 		sstream << userMessage << std::endl;
 
-		put_to_stream(sstream.str());
+		std::string text = sstream.str();
+		put_to_stream(make_record(configurator.get_config().get(),verbLevel,line_num,src_file,function_name,module_name.c_str(),text.data(),text.size()," ",false));
 	}
 
 	void log_exception(int verbLevel, void* addr, const char* function_name, 
 		const char* src_file, int line_num, std::exception* e)
 	{
+		prepare_thread();
+
 		if (!is_message_enabled(verbLevel)) return;
 
 		std::string message;
@@ -4400,14 +10465,16 @@ private:
 		struct tm processed_cached_tm;
 		std::string processed_cached_src_file;
 		std::string processed_cached_function_name;
-		std::string processed_cached_module_name;
-		std::string processed_cached_hdr_format;
-		int processed_cached_global_verb_level;
+		std::string processed_cached_module_name; // module names are freed with tables of module cache, so text is compared
+		unsigned long processed_cached_config_version;
 		int processed_cached_verb_level;
 		int processed_cached_line_num;
 		int processed_cached_millitm;
 		unsigned long processed_cached_pid;
 		unsigned long processed_cached_tid;
+#if LOG_USE_CONTEXT
+		unsigned long processed_cached_ctx_version; // context is per thread, compared together with thread id
+#endif //LOG_USE_CONTEXT
 
 
 #if LOG_MULTITHREADED
@@ -4415,6 +10482,7 @@ private:
 #endif //LOG_MULTITHREADED
 
 		log_macro_cache_t()
+			:processed_cached_config_version(0)
 		{
 #if LOG_MULTITHREADED
 			LOG_MT_MUTEX_INIT(&mt_cache_lock,NULL);
@@ -4447,51 +10515,192 @@ private:
 #endif //LOG_USE_MACRO_HEADER_CACHE
 
 
-	std::string log_process_macroses_nocache(std::string format, 
-									int verbose, 
-									int line_num, 
-									const char* src_file,	
-									const char* function_name, 
-									const char* module_name)
+	// Record of log file: header by HeaderFormat, separator, message and line end, or JSON object / logfmt line.
+	// Structured record takes message without its last line end, fields are packed by template_format::pack_fields.
+	// Position of message (of "message" key in structured record) is returned in message_pos
+	std::string make_record(const log_config_t* config, int verb_level, int line_num, const char* src_file,
+		const char* function_name, const char* module_name, const char* message, size_t len,
+		const char* separator = " ", bool line_end = true, const std::string* fields = NULL, const message_stamp_t* stamp = NULL,
+		size_t* message_pos = NULL)
 	{
-#if LOG_USE_MACRO_HEADER_CACHE
-		std::string result = log_process_macros_setlen(format, module_name);
-		result = log_process_macros_often(result, verbose, line_num, src_file, function_name);
+		std::string result;
+
+		if (config->output_format != log_output_text)
+		{
+			bool json = config->output_format == log_output_json;
+
+			result.reserve(160 + len);
+			if (json)
+				result += '{';
+
+			log_process_macros_structured(result, config->output_format, config->hdr_fields, verb_level, line_num,
+				src_file, function_name, module_name, stamp);
+
+			if (len && message[len - 1] == '\n')
+				len--;
+
+			if (message_pos)
+				*message_pos = result.size();
+
+			structured_format::append_key(result, config->output_format, "message", 7);
+			structured_format::append_string(result, config->output_format, message, len);
+
+#if LOG_TEMPLATE_API
+			if (fields)
+				template_format::render_fields(result, *fields, config->output_format);
+#endif //LOG_TEMPLATE_API
+
+			result += json ? "}\n" : "\n";
+			return result;
+		}
+
+		if (stamp)
+			result = log_process_macroses_nocache(config->hdr_format, verb_level, line_num, src_file, function_name, module_name, stamp);
+		else
+			result = log_process_macros(config, verb_level, line_num, src_file, function_name, module_name);
+
+		if (result.size())
+			result += separator;
+
+		if (message_pos)
+			*message_pos = result.size();
+
+		result.append(message, len);
+
+#if LOG_TEMPLATE_API
+		if (fields)
+			template_format::render_fields(result, *fields, log_output_text);
+#endif //LOG_TEMPLATE_API
+
+		if (line_end)
+			result += "\n";
+
 		return result;
-#else //LOG_USE_MACRO_HEADER_CACHE
-		return log_process_macros(result, verbose, line_num, src_file, function_name, module_name);
-#endif //LOG_USE_MACRO_HEADER_CACHE
 	}
-	
 
-	static unsigned long get_thread_id()
+	// Members of JSON record or logfmt pairs for macros of HeaderFormat, each followed by separator
+	void log_process_macros_structured(std::string& out, int output_format, int hdr_fields, int verbose, int line_num,
+		const char* src_file, const char* function_name, const char* module_name, const message_stamp_t* stamp)
 	{
-		unsigned long tid = 0;
+		const char separator = output_format == log_output_json ? ',' : ' ';
 
-#ifdef LOG_PLATFORM_WINDOWS
-		tid = GetCurrentThreadId();
-#else //LOG_PLATFORM_WINDOWS
+		if (hdr_fields & log_field_level)
+		{
+			const char* level = get_verbose_string(verbose);
+			structured_format::append_key(out, output_format, "level", 5);
+			structured_format::append_string(out, output_format, level, strlen(level));
+			out += separator;
+		}
 
-#	ifdef gettid
-		tid = (unsigned long) gettid();
-#	else //gettid
-#		if defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
-			tid = (unsigned long)syscall(SYS_gettid);
-#		else //defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
+		if (hdr_fields & log_field_time)
+		{
+			int millisec = stamp ? stamp->millisec : 0;
+			struct tm newtime = stamp ? stamp->time : utils::get_time(millisec);
+
+			structured_format::append_key(out, output_format, "time", 4);
+			if (output_format == log_output_json)
+				out += '"';
+			structured_format::append_time(out, newtime, millisec);
+			if (output_format == log_output_json)
+				out += '"';
+			out += separator;
+		}
 
-#			ifdef LOG_MULTITHREADED		
-				tid = (unsigned long) pthread_self();
-#			endif //LOG_MULTITHREADED
-#		endif //defined(SYS_gettid) && defined(LOG_HAVE_SYS_SYSCALL_H)
+		if (hdr_fields & log_field_seq)
+		{
+			structured_format::append_key(out, output_format, "seq", 3);
+			structured_format::append_unsigned(out, stamp ? stamp->sequence : next_sequence());
+			out += separator;
+		}
 
-#	endif //gettid
+		if (hdr_fields & log_field_pid)
+		{
+			structured_format::append_key(out, output_format, "pid", 3);
+			out += process_ids::pid_str();
+			out += separator;
+		}
 
-#endif //LOG_PLATFORM_WINDOWS
-		return tid;
+		if (hdr_fields & log_field_tid)
+		{
+			structured_format::append_key(out, output_format, "tid", 3);
+			if (stamp)
+				structured_format::append_unsigned(out, stamp->tid);
+			else
+				out += process_ids::tid_str();
+			out += separator;
+		}
+
+		if ((hdr_fields & (log_field_module | log_field_module_path)) && *module_name)
+		{
+			const char* name = module_name;
+
+			if (!(hdr_fields & log_field_module_path))
+			{
+				for (const char* ptr = module_name; *ptr; ptr++)
+					if (*ptr == '/' || *ptr == '\\')
+						name = ptr + 1;
+			}
+
+			structured_format::append_key(out, output_format, "module", 6);
+			structured_format::append_string(out, output_format, name, strlen(name));
+			out += separator;
+		}
+
+		if ((hdr_fields & log_field_function) && *function_name)
+		{
+			structured_format::append_key(out, output_format, "function", 8);
+			structured_format::append_string(out, output_format, function_name, strlen(function_name));
+			out += separator;
+		}
+
+		if ((hdr_fields & log_field_srcfile) && *src_file)
+		{
+			structured_format::append_key(out, output_format, "file", 4);
+			structured_format::append_string(out, output_format, src_file, strlen(src_file));
+			out += separator;
+		}
+
+		if ((hdr_fields & log_field_line) && line_num >= 0)
+		{
+			structured_format::append_key(out, output_format, "line", 4);
+			structured_format::append_signed(out, line_num);
+			out += separator;
+		}
+
+#if LOG_USE_CONTEXT
+		const log_context_t* context = (hdr_fields & log_field_ctx) ? (stamp ? stamp->context : log_context::current()) : NULL;
+
+		for (size_t pos = 0; context && pos < context->pairs.size(); )
+		{
+			const char* key = context->pairs.c_str() + pos;
+			size_t key_len = strlen(key);
+			const char* value = key + key_len + 1;
+			size_t value_len = strlen(value);
+
+			structured_format::append_key(out, output_format, key, key_len);
+			structured_format::append_string(out, output_format, value, value_len);
+			out += separator;
+			pos += key_len + value_len + 2;
+		}
+#endif //LOG_USE_CONTEXT
+	}
+
+	std::string log_process_macroses_nocache(std::string format, 
+									int verbose, 
+									int line_num, 
+									const char* src_file,	
+									const char* function_name, 
+									const char* module_name,
+									const message_stamp_t* stamp = NULL)
+	{
+		std::string result = log_process_macros_setlen(format, module_name, stamp);
+		result = log_process_macros_often(result, verbose, line_num, src_file, function_name, stamp);
+		return result;
 	}
+	
 
 
-	std::string log_process_macros(std::string format, 
+	std::string log_process_macros(const log_config_t* config, 
 									int verbose, 
 									int line_num, 
 									const char* src_file,	
@@ -4505,25 +10714,17 @@ private:
 
 		cache.lock();
 
-		if (configurator.get_hdr_format() != cache.processed_cached_hdr_format
-			|| configurator.get_verbose_level() != cache.processed_cached_global_verb_level)
+		// snapshots are immutable, so version comparison is enough to detect configuration change
+		if (config->version != cache.processed_cached_config_version)
 		{
 			recreate = true;
-
-			cache.processed_cached_hdr_format = configurator.get_hdr_format();
-			cache.processed_cached_global_verb_level = configurator.get_verbose_level();
+			cache.processed_cached_config_version = config->version;
 		}
 
-		unsigned long pid=0, tid = get_thread_id();
-#ifdef LOG_PLATFORM_WINDOWS
-		pid = GetCurrentProcessId();
-#else //LOG_PLATFORM_WINDOWS
-
-#	ifdef LOG_HAVE_UNISTD_H
-		pid = (unsigned long)getpid();
-#	endif //LOG_HAVE_UNISTD_H
-
-#endif //LOG_PLATFORM_WINDOWS
+		unsigned long pid = process_ids::pid(), tid = process_ids::tid();
+#if LOG_USE_CONTEXT
+		unsigned long ctx_version = log_context::current_version();
+#endif //LOG_USE_CONTEXT
 
         int millisec;
         struct tm newtime = utils::get_time(millisec);
@@ -4536,9 +10737,14 @@ private:
 			&& newtime.tm_mday == cache.processed_cached_tm.tm_mday
 			&& newtime.tm_hour == cache.processed_cached_tm.tm_hour
 			&& newtime.tm_min == cache.processed_cached_tm.tm_min
-			&& !strcmp(module_name, cache.processed_cached_module_name.c_str()) )
+			&& cache.processed_cached_module_name == module_name)
 		{
+			// $(seq) is different in each header
 			if (tid == cache.processed_cached_tid
+				&& !(config->hdr_fields & log_field_seq)
+#if LOG_USE_CONTEXT
+				&& ctx_version == cache.processed_cached_ctx_version
+#endif //LOG_USE_CONTEXT
 				&& newtime.tm_sec == cache.processed_cached_tm.tm_sec
                 && millisec == cache.processed_cached_millitm
 				&& line_num == cache.processed_cached_line_num
@@ -4561,6 +10767,9 @@ private:
 			cache.processed_cached_verb_level = verbose;
 			cache.processed_cached_pid = pid;
 			cache.processed_cached_tid = tid;
+#if LOG_USE_CONTEXT
+			cache.processed_cached_ctx_version = ctx_version;
+#endif //LOG_USE_CONTEXT
 
 			cache.unlock();
 			return result;
@@ -4568,7 +10777,7 @@ private:
 
 #endif //LOG_USE_MACRO_HEADER_CACHE
 
-		result = log_process_macros_setlen(format, module_name);
+		result = log_process_macros_setlen(config->hdr_format, module_name);
 
 #if LOG_USE_MACRO_HEADER_CACHE
 		cache.processed_cached_hdr_partial = result;
@@ -4588,6 +10797,9 @@ private:
 		cache.processed_cached_verb_level = verbose;
 		cache.processed_cached_pid = pid;
 		cache.processed_cached_tid = tid;
+#if LOG_USE_CONTEXT
+		cache.processed_cached_ctx_version = ctx_version;
+#endif //LOG_USE_CONTEXT
 
 		cache.unlock();
 #endif //LOG_USE_MACRO_HEADER_CACHE
@@ -4596,7 +10808,8 @@ private:
 	}
 
 	std::string log_process_macros_setlen(std::string format, 
-									const char* module_name)
+									const char* module_name,
+									const message_stamp_t* stamp = NULL)
 	{
 		const char *format_str = format.c_str();
 
@@ -4619,7 +10832,7 @@ private:
 		if (macro_yyyy || macro_yy || macro_MM || macro_M || macro_dd || macro_d || macro_hh || macro_h || macro_mm || macro_m || macro_PID)
 		{
             int millisec;
-            struct tm newtime = utils::get_time(millisec);
+            struct tm newtime = stamp ? stamp->time : utils::get_time(millisec);
 		
 			if (macro_yyyy)	format = replace(format,"$(yyyy)",stringformat("%.4d",newtime.tm_year + 1900));
 			if (macro_yy)   format = replace(format,"$(yy)",stringformat("%.2d",newtime.tm_year - 100));
@@ -4632,21 +10845,7 @@ private:
 			if (macro_m)    format = replace(format,"$(m)",stringformat("%d",newtime.tm_min));
 			if (macro_mm)   format = replace(format,"$(mm)",stringformat("%.2d",newtime.tm_min));
 			
-			if (macro_PID)  
-			{
-				unsigned long pid = 0;
-
-#ifdef LOG_PLATFORM_WINDOWS
-				pid = GetCurrentProcessId();
-#else //LOG_PLATFORM_WINDOWS
-
-#	ifdef LOG_HAVE_UNISTD_H
-				pid = (unsigned long)getpid();
-#	endif //LOG_HAVE_UNISTD_H
-
-#endif //LOG_PLATFORM_WINDOWS
-				format = replace(format,"$(PID)", stringformat("%d", pid));
-			}
+			if (macro_PID)  format = replace(format,"$(PID)", process_ids::pid_str());
 		}
 
 
@@ -4674,7 +10873,8 @@ private:
 									int verbose, 
 									int line_num, 
 									const char* src_file,	
-									const char* function_name)
+									const char* function_name,
+									const message_stamp_t* stamp = NULL)
 	{
 		const char *format_str = format.c_str();
 
@@ -4691,12 +10891,18 @@ private:
 		bool macro_v = contains(format_str,"$(v)");
 
 		bool macro_tid = contains(format_str, "$(TID)");
+
+#if LOG_USE_CONTEXT
+		bool macro_ctx = contains(format_str, "$(ctx)");
+#endif //LOG_USE_CONTEXT
+
+		bool macro_seq = contains(format_str, "$(seq)");
 		
 
 		if (macro_ss || macro_s || macro_ttt || macro_t)
 		{
-            int millisec;
-            struct tm newtime = utils::get_time(millisec);
+            int millisec = stamp ? stamp->millisec : 0;
+            struct tm newtime = stamp ? stamp->time : utils::get_time(millisec);
 		
 			if (macro_s)    format = replace(format,"$(s)",stringformat("%d",newtime.tm_sec));
 			if (macro_ss)   format = replace(format,"$(ss)",stringformat("%.2d",newtime.tm_sec));
@@ -4716,18 +10922,32 @@ private:
 		if (macro_function && strlen(function_name))
 			format = replace(format,"$(function)",function_name);
 
-		if (macro_tid)
+		if (macro_tid) format = replace(format,"$(TID)", stamp ? stringformat("%lu", stamp->tid) : process_ids::tid_str());
+		if (macro_seq) format = replace(format,"$(seq)", stringformat("%lu", stamp ? stamp->sequence : next_sequence()));
+
+#if LOG_USE_CONTEXT
+		// replaced once: context values are not trusted and can contain the macro itself
+		if (macro_ctx)
 		{
-			unsigned long tid = get_thread_id();
-			format = replace(format,"$(TID)", stringformat("%d", tid));
+			const log_context_t* context = stamp ? stamp->context : log_context::current();
+			format.replace(format.find("$(ctx)"), 6, context ? context->text : std::string());
 		}
+#endif //LOG_USE_CONTEXT
 
 		return format;
 	}
 
+	// Per-thread preparations done on first message of thread
+	__inline void prepare_thread()
+	{
+#if LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+		crash_writer::ensure_alt_stack();
+#endif //LOG_UNHANDLED_EXCEPTIONS && !defined(LOG_PLATFORM_WINDOWS)
+	}
+
 	__inline bool is_message_enabled(int verb_level) const
 	{
-		return (configurator.get_verbose_level() & verb_level) ? true : false;
+		return configurator.is_level_enabled(verb_level);
 	}
 
 	void log_binary(std::ostream& stream, const char* data, int len)
@@ -4896,41 +11116,77 @@ public:
 };
 #else // defined(LOG_PLATFORM_WINDOWS)
 
-static void crash_handler(int sig, siginfo_t *info, void *secret)
+// Signals which terminate process with core dump. Other signals (SIGSYS, SIGTRAP, SIGXCPU...) are not handled
+static const int fatal_signals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+static const int fatal_signals_count = sizeof(fatal_signals) / sizeof(fatal_signals[0]);
+
+// Handlers installed before logger, they are called after crash report
+static struct sigaction* previous_crash_actions()
 {
-    void *trace[1024];
-    ucontext_t *uc = (ucontext_t *)secret;
+    static struct sigaction actions[fatal_signals_count];
+    return actions;
+}
 
-#ifdef LOG_PLATFORM_64BIT
-    void* pc = (void*)uc->uc_mcontext.gregs[REG_RIP];
-#endif //LOG_PLATFORM_64BIT
+static void crash_handler(int sig, siginfo_t *info, void *secret)
+{
+    static volatile long crashed_tid = 0;
+    long tid = static_cast<long>(process_ids::query_tid());
 
-#ifdef LOG_PLATFORM_32BIT
-    void* pc = (void*)uc->uc_mcontext.gregs[REG_EIP];
-#endif //LOG_PLATFORM_32BIT
+    // report is written by first crashed thread. Other crashed threads wait until it terminates process,
+    // crash inside report itself goes directly to default action
+    if (atomic_ops::cas(&crashed_tid, 0, tid))
+    {
+        crash_writer::report(sig, info, secret);
 
-    std::string message = stringformat("*** Got signal %d, faulty address %p, from %p",sig, info->si_addr, pc);
-    LOG_FATAL(message.c_str());
-    LOG_MODULES_FATAL;
+#if LOG_RELEASE_ON_APP_CRASH && !LOG_MULTITHREADED
+        // not async-signal-safe: done only after crash report is written.
+        // In multithreaded mode queue is already written by crash report and stream is flushed by writer thread
+        _logger.release();
+#endif //LOG_RELEASE_ON_APP_CRASH && !LOG_MULTITHREADED
+    }
+    else if (atomic_ops::load(&crashed_tid) != tid)
+    {
+        for (;;)
+            pause();
+    }
 
-    int trace_size = backtrace(trace, 1024);
-    trace[1] = pc;
+    for (int i=0; i<fatal_signals_count; i++)
+    {
+        if (fatal_signals[i] != sig)
+            continue;
 
-    std::string result = "\n" + runtime_debugging::get_stack_trace_string(trace, trace_size, 0);
+        const struct sigaction& previous = previous_crash_actions()[i];
 
-    LOG_FATAL("*** STACKTRACE ***");
-    LOG_FATAL(result.c_str());
-    LOG_FATAL("*** END STACKTRACE ***");
+        // handler installed before logger decides itself what to do, it is called again if fault is repeated
+        if (previous.sa_flags & SA_SIGINFO)
+        {
+            if (previous.sa_sigaction)
+            {
+                previous.sa_sigaction(sig, info, secret);
+                return;
+            }
+        }
+        else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN)
+        {
+            previous.sa_handler(sig);
+            return;
+        }
 
-#if LOG_RELEASE_ON_APP_CRASH
-    _logger.release();
-#endif //LOG_RELEASE_ON_APP_CRASH
+        // ignored signal sent by kill/raise stays ignored, fault can not be ignored
+        if (previous.sa_handler == SIG_IGN && info->si_code <= 0)
+            return;
+    }
 
-#if LOG_SHOW_MESSAGE_ON_FATAL_CRASH
-    printf("%s\n", message.c_str());
-#endif //LOG_SHOW_MESSAGE_ON_FATAL_CRASH
+    // Default action makes core dump. Fault is repeated by instruction restart after return,
+    // signals sent by kill/raise/abort are raised again
+    struct sigaction default_action;
+    memset(&default_action, 0, sizeof(default_action));
+    default_action.sa_handler = SIG_DFL;
+    sigemptyset(&default_action.sa_mask);
+    sigaction(sig, &default_action, NULL);
 
-    exit(-1);
+    if (info->si_code <= 0)
+        raise(sig);
 }
 
 #endif // defined(LOG_PLATFORM_WINDOWS)
@@ -4943,13 +11199,24 @@ static void init_unhandled_exceptions_handler()
     SetUnhandledExceptionFilter(unhandled_exceptions_processor::crash_handler_exception_filter);
 #else //LOG_PLATFORM_WINDOWS
 
+    crash_writer::init();
+    crash_writer::ensure_alt_stack();
+
     struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
 
     sa.sa_sigaction = crash_handler;
     sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
+    sa.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
 
-    sigaction(SIGSEGV, &sa, NULL);
+    for (int i=0; i<fatal_signals_count; i++)
+    {
+        struct sigaction previous;
+
+        // handler is not chained to itself if it was installed already
+        if (sigaction(fatal_signals[i], &sa, &previous) == 0 && previous.sa_sigaction != crash_handler)
+            previous_crash_actions()[i] = previous;
+    }
 #endif //LOG_PLATFORM_WINDOWS
 }
 
@@ -4962,6 +11229,13 @@ static void init_unhandled_exceptions_handler()
 
 #else //defined(__cplusplus) && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
 
+#include <stdlib.h>
+#ifdef LOG_PLATFORM_WINDOWS
+#	include <windows.h>
+#else //LOG_PLATFORM_WINDOWS
+#	include <time.h>
+#endif //LOG_PLATFORM_WINDOWS
+
 #if defined (__cplusplus)
 extern "C" {
 #endif //defined(__cplusplus)
@@ -4972,6 +11246,112 @@ extern "C" {
 #	define LOG_ERROR(...)   __c_logger_log(logger_verbose_error, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
 #	define LOG_FATAL(...)   __c_logger_log(logger_verbose_fatal, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,__VA_ARGS__)
 
+// Rate limiting of C code and of clients of logger DLL, works as logging::rate_limiter. LOG_*_SAMPLED uses rand()
+typedef struct __c_logger_rate_site_t
+{
+	volatile long count;
+	volatile long last_ms;
+	volatile long suppressed;
+} __c_logger_rate_site_t;
+
+#ifdef LOG_COMPILER_MSVC
+#	define LOG_C_FETCH_ADD(ptr, value)         InterlockedExchangeAdd((ptr), (value))
+#	define LOG_C_CAS(ptr, expected, desired)   (InterlockedCompareExchange((ptr), (desired), (expected)) == (expected))
+#else //LOG_COMPILER_MSVC
+#	define LOG_C_FETCH_ADD(ptr, value)         __sync_fetch_and_add((ptr), (value))
+#	define LOG_C_CAS(ptr, expected, desired)   __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#endif //LOG_COMPILER_MSVC
+
+static __inline int __c_logger_every_n(__c_logger_rate_site_t* site, long n)
+{
+	return n <= 1 || (unsigned long)LOG_C_FETCH_ADD(&site->count, 1) % n == 0;
+}
+
+static __inline int __c_logger_first_n(__c_logger_rate_site_t* site, long n)
+{
+	return site->count < n && LOG_C_FETCH_ADD(&site->count, 1) < n;
+}
+
+static __inline int __c_logger_every_ms(__c_logger_rate_site_t* site, long interval_ms)
+{
+	long now, last;
+
+#ifdef LOG_PLATFORM_WINDOWS
+	now = (long)GetTickCount();
+#else //LOG_PLATFORM_WINDOWS
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (long)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif //LOG_PLATFORM_WINDOWS
+
+	if (!now)
+		now = 1;
+
+	last = site->last_ms;
+	if ((!last || (unsigned long)(now - last) >= (unsigned long)interval_ms) && LOG_C_CAS(&site->last_ms, last, now))
+		return 1;
+
+	LOG_C_FETCH_ADD(&site->suppressed, 1);
+	return 0;
+}
+
+static __inline long __c_logger_take_suppressed(__c_logger_rate_site_t* site)
+{
+	long suppressed = site->suppressed;
+
+	if (suppressed)
+		LOG_C_FETCH_ADD(&site->suppressed, -suppressed);
+
+	return suppressed;
+}
+
+static __inline int __c_logger_sampled(__c_logger_rate_site_t* site, double probability)
+{
+	(void)site;
+	return rand() / ((double)RAND_MAX + 1.0) < probability;
+}
+
+#	define LOG_RATE_LIMITED_LOG(log_macro, check, ...) do { \
+		static __c_logger_rate_site_t log_rate_site; \
+		if (check) \
+			log_macro(__VA_ARGS__); \
+	} while (0)
+
+#	define LOG_RATE_LIMITED_LOG_SUPPRESSED(log_macro, check, ...) do { \
+		static __c_logger_rate_site_t log_rate_site; \
+		if (check) { \
+			long log_suppressed = __c_logger_take_suppressed(&log_rate_site); \
+			if (log_suppressed) \
+				log_macro("(%ld messages suppressed)", log_suppressed); \
+			log_macro(__VA_ARGS__); \
+		} \
+	} while (0)
+
+#	define LOG_INFO_EVERY_N(n, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, __c_logger_every_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_INFO_FIRST_N(n, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, __c_logger_first_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_INFO_EVERY_MS(ms, ...)     LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_INFO, __c_logger_every_ms(&log_rate_site, ms), __VA_ARGS__)
+#	define LOG_INFO_SAMPLED(p, ...)       LOG_RATE_LIMITED_LOG(LOG_INFO, __c_logger_sampled(&log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_DEBUG_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, __c_logger_every_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_DEBUG_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, __c_logger_first_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_DEBUG_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_DEBUG, __c_logger_every_ms(&log_rate_site, ms), __VA_ARGS__)
+#	define LOG_DEBUG_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_DEBUG, __c_logger_sampled(&log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_WARNING_EVERY_N(n, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, __c_logger_every_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_WARNING_FIRST_N(n, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, __c_logger_first_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_WARNING_EVERY_MS(ms, ...)  LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_WARNING, __c_logger_every_ms(&log_rate_site, ms), __VA_ARGS__)
+#	define LOG_WARNING_SAMPLED(p, ...)    LOG_RATE_LIMITED_LOG(LOG_WARNING, __c_logger_sampled(&log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_ERROR_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, __c_logger_every_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_ERROR_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, __c_logger_first_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_ERROR_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_ERROR, __c_logger_every_ms(&log_rate_site, ms), __VA_ARGS__)
+#	define LOG_ERROR_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_ERROR, __c_logger_sampled(&log_rate_site, p), __VA_ARGS__)
+
+#	define LOG_FATAL_EVERY_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, __c_logger_every_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_FATAL_FIRST_N(n, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, __c_logger_first_n(&log_rate_site, n), __VA_ARGS__)
+#	define LOG_FATAL_EVERY_MS(ms, ...)    LOG_RATE_LIMITED_LOG_SUPPRESSED(LOG_FATAL, __c_logger_every_ms(&log_rate_site, ms), __VA_ARGS__)
+#	define LOG_FATAL_SAMPLED(p, ...)      LOG_RATE_LIMITED_LOG(LOG_FATAL, __c_logger_sampled(&log_rate_site, p), __VA_ARGS__)
+
 #	define LOG_BINARY_INFO(p,stack_frame)    __c_logger_log_binary(logger_verbose_info, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
 #	define LOG_BINARY_DEBUG(p,stack_frame)   __c_logger_log_binary(logger_verbose_debug, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
 #	define LOG_BINARY_WARNING(p,stack_frame) __c_logger_log_binary(logger_verbose_warning, LOG_GET_CALLER_ADDR,__FUNCTION__,__FILE__,__LINE__,p,stack_frame)
@@ -5030,6 +11410,9 @@ void __c_logger_log_stack_trace(int verbose_level, void* caller_addr, const char
 
 #endif //LOG_AUTO_DEBUGGING
 
+// flight recorder can be dumped only from C++ code
+#	define LOG_FLIGHT_RECORDER_DUMP
+
 #if LOG_USE_DLL
 extern void (LOG_CDECL *__c_logger_log)(int verbose_level, void* caller_addr, const char* function, const char* file, int line, const char* format, ...);
 extern void (LOG_CDECL *__c_logger_log_args)(int verbose_level, void* caller_addr, const char* function, const char* file, int line, const char* format, va_list args);
@@ -5046,6 +11429,122 @@ void __c_logger_log_binary(int verbose_level, void* caller_addr, const char* fun
 
 #endif //defined(__cplusplus) && (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL))
 
+
+///////////////   "{}" format API  ///////////////////////
+
+#if LOG_TEMPLATE_API
+
+namespace logging {
+
+template <typename... args_t>
+void log_template(const call_site_t& site, void* addr, const char* format, const args_t&... args)
+{
+#if LOG_DEFERRED_FORMAT
+	// message is rendered by writer thread
+	if (!configurator.is_level_enabled(site.verb_level))
+		return;
+
+	std::string packed;
+	template_format::pack(packed, args...);
+	_logger->log_packed(site, addr, packed);
+	(void)format;
+	return;
+#endif //LOG_DEFERRED_FORMAT
+
+#if (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)) && !LOG_FLIGHT_RECORDER
+	if (!configurator.is_level_enabled(site.verb_level))
+		return;
+#endif //(!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)) && !LOG_FLIGHT_RECORDER
+
+	std::string text;
+	template_format::render(text, format, args...);
+
+#if !LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+	_logger->log_text(site.verb_level, addr, site.function_name, site.src_file, site.line_num, text.c_str());
+#else //!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+	__c_logger_log(site.verb_level, addr, site.function_name, site.src_file, site.line_num, "%s", text.c_str());
+#endif //!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+}
+
+template <typename... args_t>
+void log_fields(const call_site_t& site, void* addr, const char* message, const args_t&... args)
+{
+	static_assert(sizeof...(args_t) % 2 == 0, "LOGGER: fields must be given as key and value pairs");
+
+#if (!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)) && !LOG_FLIGHT_RECORDER
+	if (!configurator.is_level_enabled(site.verb_level))
+		return;
+#endif //(!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)) && !LOG_FLIGHT_RECORDER
+
+	std::string packed;
+	template_format::pack_fields(packed, args...);
+
+#if !LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+	(void)message;
+	_logger->log_packed(site, addr, packed);
+#else //!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+	std::string text = message;
+	template_format::render_fields(text, packed, log_output_text);
+	__c_logger_log(site.verb_level, addr, site.function_name, site.src_file, site.line_num, "%s", text.c_str());
+#endif //!LOG_USE_DLL || defined(LOG_THIS_IS_DLL)
+}
+
+}; // namespace logging
+
+#	define LOG_TEMPLATE_EXPAND(x) x
+#	define LOG_TEMPLATE_FIRST_(first, ...) first
+#	define LOG_TEMPLATE_FIRST(...) LOG_TEMPLATE_EXPAND(LOG_TEMPLATE_FIRST_(__VA_ARGS__, 0))
+
+#	define LOG_TEMPLATE_LOG(level, ...) do { \
+		static_assert(logging::template_format::count_placeholders(LOG_TEMPLATE_FIRST(__VA_ARGS__)) + 1 == \
+			decltype(logging::template_format::args_count(__VA_ARGS__))::value, \
+			"LOGGER: number of {} placeholders in format does not match number of arguments"); \
+		static const logging::call_site_t log_call_site = { level, __FILE__, __LINE__, __FUNCTION__, LOG_TEMPLATE_FIRST(__VA_ARGS__), false }; \
+		logging::log_template(log_call_site, LOG_GET_CALLER_ADDR, __VA_ARGS__); \
+	} while (0)
+
+#	define LOG_INFO_T(...)    LOG_TEMPLATE_LOG(LOGGER_VERBOSE_INFO, __VA_ARGS__)
+#	define LOG_DEBUG_T(...)   LOG_TEMPLATE_LOG(LOGGER_VERBOSE_DEBUG, __VA_ARGS__)
+#	define LOG_WARNING_T(...) LOG_TEMPLATE_LOG(LOGGER_VERBOSE_WARNING, __VA_ARGS__)
+#	define LOG_ERROR_T(...)   LOG_TEMPLATE_LOG(LOGGER_VERBOSE_ERROR, __VA_ARGS__)
+#	define LOG_FATAL_T(...)   LOG_TEMPLATE_LOG(LOGGER_VERBOSE_FATAL, __VA_ARGS__)
+
+#	define LOG_FIELDS_LOG(level, ...) do { \
+		static const logging::call_site_t log_call_site = { level, __FILE__, __LINE__, __FUNCTION__, LOG_TEMPLATE_FIRST(__VA_ARGS__), true }; \
+		logging::log_fields(log_call_site, LOG_GET_CALLER_ADDR, __VA_ARGS__); \
+	} while (0)
+
+#	define LOG_INFO_KV(...)    LOG_FIELDS_LOG(LOGGER_VERBOSE_INFO, __VA_ARGS__)
+#	define LOG_DEBUG_KV(...)   LOG_FIELDS_LOG(LOGGER_VERBOSE_DEBUG, __VA_ARGS__)
+#	define LOG_WARNING_KV(...) LOG_FIELDS_LOG(LOGGER_VERBOSE_WARNING, __VA_ARGS__)
+#	define LOG_ERROR_KV(...)   LOG_FIELDS_LOG(LOGGER_VERBOSE_ERROR, __VA_ARGS__)
+#	define LOG_FATAL_KV(...)   LOG_FIELDS_LOG(LOGGER_VERBOSE_FATAL, __VA_ARGS__)
+
+#endif //LOG_TEMPLATE_API
+
+#if LOG_USE_CONTEXT
+
+#	define LOG_CONTEXT_SCOPE_NAME_(id) log_context_scope_##id
+#	define LOG_CONTEXT_SCOPE_NAME(id) LOG_CONTEXT_SCOPE_NAME_(id)
+
+#	ifdef __COUNTER__
+#		define LOG_CONTEXT_SCOPE LOG_CONTEXT_SCOPE_NAME(__COUNTER__)
+#	else //__COUNTER__
+#		define LOG_CONTEXT_SCOPE LOG_CONTEXT_SCOPE_NAME(__LINE__)
+#	endif //__COUNTER__
+
+#	define LOG_CONTEXT(key, value)   logging::log_context LOG_CONTEXT_SCOPE(key, value)
+#	define LOG_CONTEXT_CAPTURE(name) logging::log_context_t name = logging::log_context::capture()
+#	define LOG_CONTEXT_RESTORE(name) logging::log_context LOG_CONTEXT_SCOPE(name)
+
+#else //LOG_USE_CONTEXT
+
+#	define LOG_CONTEXT(key, value)
+#	define LOG_CONTEXT_CAPTURE(name)
+#	define LOG_CONTEXT_RESTORE(name)
+
+#endif //LOG_USE_CONTEXT
+
 #endif // LOG_ENABLED
 
 #endif //__LOGGER_HEADER
@@ -0,0 +1,118 @@
+// logctl.c
+// Sends control command to logger built with LOG_CONTROL_SOCKET=1 and prints reply
+//
+// Usage: logctl <pid | @abstract-name | /path/to/socket> <command> [args...]
+// Samples:
+//   logctl 1234 verbose 255 300     - set verbose level 255 for five minutes
+//   logctl 1234 stats
+//   logctl @myapp.1234.log flush
+// PID form works only with default LOG_CONTROL_SOCKET_NAME ("@$(EXEFILENAME).$(PID).log")
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int make_name_by_pid(const char* pid, char* name, size_t size)
+{
+	char link[64];
+	char exe_path[1024];
+	const char* file_name;
+	char* ext;
+	ssize_t len;
+
+	snprintf(link, sizeof(link), "/proc/%s/exe", pid);
+	len = readlink(link, exe_path, sizeof(exe_path) - 1);
+	if (len <= 0)
+		return -1;
+
+	exe_path[len] = 0;
+
+	file_name = strrchr(exe_path, '/');
+	file_name = file_name ? file_name + 1 : exe_path;
+
+	// $(EXEFILENAME) is file name without extension
+	snprintf(name, size, "@%s", file_name);
+	ext = strrchr(name, '.');
+	if (ext)
+		*ext = 0;
+
+	snprintf(name + strlen(name), size - strlen(name), ".%s.log", pid);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	char name[256];
+	char command[256];
+	char reply[4096];
+	struct sockaddr_un addr;
+	socklen_t addr_len;
+	ssize_t len;
+	int fd, i;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <pid | @abstract-name | socket-path> <command> [args...]\n"
+			"commands: verbose [level [seconds]], flush, rotate, stats, config, reload, recorder\n", argv[0]);
+		return 2;
+	}
+
+	if (strspn(argv[1], "0123456789") == strlen(argv[1]))
+	{
+		if (make_name_by_pid(argv[1], name, sizeof(name)) != 0)
+		{
+			fprintf(stderr, "process %s not found\n", argv[1]);
+			return 1;
+		}
+	}
+	else
+	{
+		snprintf(name, sizeof(name), "%s", argv[1]);
+	}
+
+	command[0] = 0;
+	for (i = 2; i < argc; i++)
+	{
+		strncat(command, argv[i], sizeof(command) - strlen(command) - 2);
+		strncat(command, i + 1 < argc ? " " : "\n", sizeof(command) - strlen(command) - 1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (name[0] == '@')
+	{
+		// abstract namespace: leading zero byte, name is not zero terminated
+		strncpy(addr.sun_path + 1, name + 1, sizeof(addr.sun_path) - 1);
+		addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strlen(name));
+	}
+	else
+	{
+		strncpy(addr.sun_path, name, sizeof(addr.sun_path) - 1);
+		addr_len = (socklen_t)sizeof(addr);
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, addr_len) != 0)
+	{
+		fprintf(stderr, "cannot connect to %s\n", name);
+		return 1;
+	}
+
+	if (write(fd, command, strlen(command)) < 0)
+	{
+		fprintf(stderr, "cannot send command to %s\n", name);
+		close(fd);
+		return 1;
+	}
+
+	while ((len = read(fd, reply, sizeof(reply))) > 0)
+		fwrite(reply, 1, len, stdout);
+
+	close(fd);
+	return 0;
+}
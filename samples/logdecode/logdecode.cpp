@@ -0,0 +1,428 @@
+// logdecode.cpp
+// Expands log file written with LOG_BINARY_FORMAT=1 to text or to JSON, one object per line
+//
+// Usage: logdecode [-json] [-header "<HeaderFormat>"] <file>
+// Samples:
+//   logdecode myapp.log                     - text as logger would write it, with HeaderFormat stored in file
+//   logdecode -header "[$(V)] $(TID)" myapp.log
+//   logdecode -json myapp.log.1
+// Time is shown in local time zone of this machine. File must be written on machine with the same byte order
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+struct call_site
+{
+	unsigned long long verb_level;
+	unsigned long long line;
+	std::string file;
+	std::string function;
+	std::string module;
+	std::string format;
+};
+
+struct segment
+{
+	int pointer_size;
+	unsigned long long pid;
+	unsigned long long time;
+	std::string header;
+	std::map<unsigned long long, call_site> sites;
+};
+
+struct reader
+{
+	const char* ptr;
+	const char* end;
+	bool failed;
+
+	unsigned long long number()
+	{
+		unsigned long long value = 0;
+
+		for (int shift = 0; ptr < end && shift < 64; shift += 7)
+		{
+			unsigned char byte = static_cast<unsigned char>(*ptr++);
+			value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return value;
+		}
+
+		failed = true;
+		return 0;
+	}
+
+	std::string string()
+	{
+		unsigned long long len = number();
+		if (failed || len > static_cast<unsigned long long>(end - ptr))
+		{
+			failed = true;
+			return std::string();
+		}
+
+		std::string result(ptr, static_cast<size_t>(len));
+		ptr += len;
+		return result;
+	}
+};
+
+static std::string stringformat(const char* format, ...)
+{
+	char buffer[64];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	return buffer;
+}
+
+// same as logging::logger::get_verbose_string
+static const char* get_verbose_string(unsigned long long verb_level)
+{
+	switch (verb_level)
+	{
+		case 0:  return "MUTE";
+		case 1:  return "FATAL";
+		case 2:  return "ERROR";
+		case 8:  return "INFO";
+		case 4:  return "WARNING";
+		default: return "DEBUG";
+	}
+}
+
+static void replace(std::string& text, const char* macro, const std::string& value)
+{
+	size_t len = strlen(macro);
+
+	for (size_t pos = text.find(macro); pos != std::string::npos; pos = text.find(macro, pos + value.size()))
+		text.replace(pos, len, value);
+}
+
+// same macros as logging::logger::log_process_macros_setlen and log_process_macros_often
+static std::string make_header(std::string header, const call_site& site, const struct tm& time, int millisec,
+	unsigned long long pid, unsigned long long tid)
+{
+	replace(header, "$(yyyy)", stringformat("%.4d", time.tm_year + 1900));
+	replace(header, "$(yy)", stringformat("%.2d", time.tm_year - 100));
+	replace(header, "$(MM)", stringformat("%.2d", time.tm_mon + 1));
+	replace(header, "$(M)", stringformat("%d", time.tm_mon + 1));
+	replace(header, "$(dd)", stringformat("%.2d", time.tm_mday));
+	replace(header, "$(d)", stringformat("%d", time.tm_mday));
+	replace(header, "$(hh)", stringformat("%.2d", time.tm_hour));
+	replace(header, "$(h)", stringformat("%d", time.tm_hour));
+	replace(header, "$(mm)", stringformat("%.2d", time.tm_min));
+	replace(header, "$(m)", stringformat("%d", time.tm_min));
+	replace(header, "$(ss)", stringformat("%.2d", time.tm_sec));
+	replace(header, "$(s)", stringformat("%d", time.tm_sec));
+	replace(header, "$(ttt)", stringformat("%.3d", millisec));
+	replace(header, "$(t)", stringformat("%d", millisec));
+	replace(header, "$(PID)", stringformat("%llu", pid));
+	replace(header, "$(TID)", stringformat("%llu", tid));
+	replace(header, "$(V)", get_verbose_string(site.verb_level));
+	replace(header, "$(v)", stringformat("%llu", site.verb_level));
+	replace(header, "$(line)", stringformat("%llu", site.line));
+
+	if (site.file.size())
+		replace(header, "$(srcfile)", site.file);
+
+	if (site.function.size())
+		replace(header, "$(function)", site.function);
+
+	if (site.module.size())
+	{
+		size_t position = site.module.find_last_of("\\/");
+		replace(header, "$(MODULE)", site.module);
+		replace(header, "$(module)", site.module.substr(position == std::string::npos ? 0 : position + 1));
+	}
+
+	return header;
+}
+
+template <typename type_t>
+static bool read_value(const std::string& args, size_t& position, type_t& value)
+{
+	if (position + sizeof(value) > args.size())
+		return false;
+
+	memcpy(&value, args.data() + position, sizeof(value));
+	position += sizeof(value);
+	return true;
+}
+
+// argument types and text of values are the same as in logging::template_format
+static bool render_message(std::string& out, const std::string& format, const std::string& args, int pointer_size)
+{
+	size_t position = 0;
+
+	for (const char* ptr = format.c_str(); *ptr; )
+	{
+		if ((ptr[0] == '{' || ptr[0] == '}') && ptr[1] == ptr[0])
+		{
+			out += *ptr;
+			ptr += 2;
+			continue;
+		}
+
+		if (ptr[0] != '{' || ptr[1] != '}')
+		{
+			out += *ptr++;
+			continue;
+		}
+
+		ptr += 2;
+
+		if (position >= args.size())
+			return false;
+
+		switch (args[position++])
+		{
+		case 0:
+			{
+				bool value;
+				if (!read_value(args, position, value)) return false;
+				out += value ? "true" : "false";
+			}
+			break;
+		case 1:
+			{
+				char value;
+				if (!read_value(args, position, value)) return false;
+				out += value;
+			}
+			break;
+		case 2:
+			{
+				long long value;
+				if (!read_value(args, position, value)) return false;
+				out += stringformat("%lld", value);
+			}
+			break;
+		case 3:
+			{
+				unsigned long long value;
+				if (!read_value(args, position, value)) return false;
+				out += stringformat("%llu", value);
+			}
+			break;
+		case 4:
+			{
+				double value;
+				if (!read_value(args, position, value)) return false;
+				out += stringformat("%g", value);
+			}
+			break;
+		case 5:
+			{
+				size_t len;
+				if (!read_value(args, position, len) || position + len > args.size()) return false;
+				out.append(args, position, len);
+				position += len;
+			}
+			break;
+		case 6:
+			{
+				if (pointer_size != sizeof(void*)) return false;
+				const void* value;
+				if (!read_value(args, position, value)) return false;
+				out += stringformat("0x%llx", static_cast<unsigned long long>(reinterpret_cast<size_t>(value)));
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static std::string json_string(const std::string& text)
+{
+	std::string result = "\"";
+
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		unsigned char c = static_cast<unsigned char>(text[i]);
+
+		if (c == '"' || c == '\\') { result += '\\'; result += c; }
+		else if (c == '\n') result += "\\n";
+		else if (c == '\r') result += "\\r";
+		else if (c == '\t') result += "\\t";
+		else if (c < 0x20) result += stringformat("\\u%.4x", c);
+		else result += c;
+	}
+
+	return result + "\"";
+}
+
+static void write_message(bool json, const segment& seg, const call_site& site, unsigned long long time,
+	unsigned long long tid, const std::string& message)
+{
+	time_t seconds = static_cast<time_t>(time / 1000);
+	int millisec = static_cast<int>(time % 1000);
+	struct tm local_time = *localtime(&seconds);
+
+	if (json)
+	{
+		printf("{\"time\":\"%.4d-%.2d-%.2dT%.2d:%.2d:%.2d.%.3d\",\"level\":\"%s\",\"pid\":%llu,\"tid\":%llu,"
+			"\"module\":%s,\"function\":%s,\"file\":%s,\"line\":%llu,\"message\":%s}\n",
+			local_time.tm_year + 1900, local_time.tm_mon + 1, local_time.tm_mday,
+			local_time.tm_hour, local_time.tm_min, local_time.tm_sec, millisec,
+			get_verbose_string(site.verb_level), seg.pid, tid, json_string(site.module).c_str(),
+			json_string(site.function).c_str(), json_string(site.file).c_str(), site.line, json_string(message).c_str());
+		return;
+	}
+
+	std::string header = make_header(seg.header, site, local_time, millisec, seg.pid, tid);
+	if (header.size())
+		header += " ";
+
+	printf("%s%s\n", header.c_str(), message.c_str());
+}
+
+static void write_text(bool json, const std::string& text)
+{
+	if (!json)
+	{
+		fwrite(text.data(), 1, text.size(), stdout);
+		return;
+	}
+
+	std::string line;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] != '\n')
+			line += text[i];
+
+		if (text[i] == '\n' || i + 1 == text.size())
+		{
+			printf("{\"text\":%s}\n", json_string(line).c_str());
+			line.clear();
+		}
+	}
+}
+
+static int decode(const std::string& data, bool json, const char* header)
+{
+	reader in = { data.data(), data.data() + data.size(), false };
+	segment seg;
+	bool started = false;
+
+	while (in.ptr < in.end && !in.failed)
+	{
+		const char* record = in.ptr;
+		char type = *in.ptr++;
+
+		if (type == 'S' && in.end - in.ptr > 5 && !memcmp(in.ptr, "CLB1", 4))
+		{
+			in.ptr += 4;
+			seg.pointer_size = *in.ptr++;
+			seg.pid = in.number();
+			seg.time = in.number();
+			seg.header = in.string();
+			seg.sites.clear();
+			started = true;
+
+			if (header)
+				seg.header = header;
+		}
+		else if (type == 'D' && started)
+		{
+			unsigned long long id = in.number();
+			call_site& site = seg.sites[id];
+			site.verb_level = in.number();
+			site.line = in.number();
+			site.file = in.string();
+			site.function = in.string();
+			site.module = in.string();
+			site.format = in.string();
+		}
+		else if (type == 'M' && started)
+		{
+			unsigned long long id = in.number();
+			unsigned long long delta = in.number();
+			unsigned long long tid = in.number();
+			std::string args = in.string();
+
+			seg.time += (delta >> 1) ^ (0 - (delta & 1));
+
+			std::map<unsigned long long, call_site>::const_iterator site = seg.sites.find(id);
+			std::string message;
+
+			if (in.failed || site == seg.sites.end() || !render_message(message, site->second.format, args, seg.pointer_size))
+			{
+				fprintf(stderr, "broken message record at offset %ld\n", static_cast<long>(record - data.data()));
+				return 1;
+			}
+
+			write_message(json, seg, site->second, seg.time, tid, message);
+		}
+		else if (type == 'T' && started)
+		{
+			write_text(json, in.string());
+		}
+		else if (static_cast<unsigned char>(type) == 0xFF)
+		{
+			// text written by crash handler until end of file
+			write_text(json, std::string(in.ptr, in.end - in.ptr));
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown record at offset %ld\n", static_cast<long>(record - data.data()));
+			return 1;
+		}
+	}
+
+	if (in.failed)
+	{
+		fprintf(stderr, "file is truncated\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	bool json = false;
+	const char* header = NULL;
+	const char* file_name = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-json"))
+			json = true;
+		else if (!strcmp(argv[i], "-header") && i + 1 < argc)
+			header = argv[++i];
+		else
+			file_name = argv[i];
+	}
+
+	if (!file_name)
+	{
+		fprintf(stderr, "usage: %s [-json] [-header \"<HeaderFormat>\"] <file>\n", argv[0]);
+		return 2;
+	}
+
+	FILE* file = fopen(file_name, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "cannot open %s\n", file_name);
+		return 1;
+	}
+
+	std::string data;
+	char buffer[65536];
+	size_t len;
+
+	while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.append(buffer, len);
+
+	fclose(file);
+	return decode(data, json, header);
+}
@@ -4,7 +4,13 @@
 
 int logger_test_c()
 {
+	int i;
+
 	LOG_DEBUG("Hello world from C! %d %d %d %d", 1, 2, 3, 4);
+
+	for (i = 0; i < 4; i++)
+		LOG_INFO_EVERY_N(2, "Every second message from C: %d", i);
+
 	LOG_MODULES_INFO;
 
 	LOG_STACKTRACE_WARNING;
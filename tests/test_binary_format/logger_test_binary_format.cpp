@@ -0,0 +1,196 @@
+#include "tests/test_common/logger_tests_log.h"
+
+#	define LOG_ENABLED 1
+#	define LOG_ONLY_DEBUG 0
+#	define LOG_USE_SYSTEMINFO 1
+#	define LOG_USE_MODULEDEFINITION 1
+#	define LOG_AUTO_DEBUGGING 0
+#	define LOG_UNHANDLED_EXCEPTIONS 1
+#	define LOG_SHOW_MESSAGE_ON_FATAL_CRASH 0
+#	define LOG_CRASH_REPORT_FILE 0
+#	define LOG_CONFIGURE_FROM_REGISTRY 0
+#	define LOG_INI_CONFIGURATION 0
+#	define LOG_CREATE_DIRECTORY 0
+#	define LOG_RTTI_ENABLED 0
+#	define LOG_SHARED 0
+#	define LOG_COMPILER_WARNINGS 1
+#	define LOG_USE_DLL 0
+#	define LOG_MULTITHREADED 1
+#	define LOG_FLUSH_FILE_EVERY_WRITE 0
+#	define LOG_CHECKED 1
+#	define LOG_USE_MACRO_HEADER_CACHE 1
+#	define LOG_PROCESS_MACRO_IN_LOG_TEXT 1
+#	define LOG_TEST_DO_NOT_WRITE_FILE 0
+#	define LOG_RELEASE_ON_APP_CRASH 1
+#	define LOG_BINARY_FORMAT 1
+
+#include "logger/logger.h"
+
+DEFINE_LOGGER;
+
+// tests run decoder in child process with redirected stdout, so they are built for Posix only
+#ifndef LOG_PLATFORM_WINDOWS
+
+#define main logdecode_main
+#include "samples/logdecode/logdecode.cpp"
+#undef main
+
+#include <sys/wait.h>
+
+static void configure(const char* file_name)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name(file_name);
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+}
+
+static std::vector<std::string> read_lines(const std::string& path)
+{
+	std::vector<std::string> lines;
+	std::ifstream stream(path.c_str());
+	std::string line;
+
+	while (std::getline(stream, line))
+	{
+		if (line.size())
+			lines.push_back(line);
+	}
+
+	return lines;
+}
+
+static void write_file(const std::string& path, const std::string& data)
+{
+	std::ofstream stream(path.c_str(), std::ios::binary);
+	stream << data;
+}
+
+// Runs logdecode for file, returns its exit code and lines written to stdout
+static int decode_file(const std::string& path, std::vector<std::string>& lines)
+{
+	std::string output_path = path + ".decoded";
+
+	pid_t pid = fork();
+	if (!pid)
+	{
+		if (!freopen(output_path.c_str(), "w", stdout))
+			_exit(100);
+
+		char name[] = "logdecode";
+		char* argv[] = { name, const_cast<char*>(path.c_str()), NULL };
+		int result = logdecode_main(2, argv);
+
+		fflush(stdout);
+		_exit(result);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	lines = read_lines(output_path);
+	std::remove(output_path.c_str());
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST_F(logger_tests_log, binary_round_trip)
+{
+	configure("test_binary.log");
+	std::string path = logging::configurator.get_full_log_file_path();
+
+	LOG_INFO_T("Start {} of {}", 1, "test");
+	LOG_ERROR("Text message");
+	LOG_WARNING_T("Done {}", 2.5);
+	logging::_logger.release();
+
+	std::vector<std::string> lines;
+	ASSERT_EQ(0, decode_file(path, lines));
+	std::remove(path.c_str());
+
+	ASSERT_EQ(3u, lines.size());
+	ASSERT_EQ("[INFO] Start 1 of test", lines[0]);
+	ASSERT_EQ("[ERROR] Text message", lines[1]);
+	ASSERT_EQ("[WARNING] Done 2.5", lines[2]);
+}
+
+TEST_F(logger_tests_log, binary_crash_text_marker)
+{
+	std::string path = logging::configurator.get_log_path() + "/test_binary_marker.log";
+
+	// crash text starting with record type byte is not taken for record
+	logging::binary_log_encoder encoder;
+	encoder.reset("[$(V)]");
+
+	std::string data;
+	encoder.encode_text(data, "[INFO] Before crash\n");
+	data += logging::binary_text_marker;
+	data += "Saved state\nDone\n";
+	write_file(path, data);
+
+	std::vector<std::string> lines;
+	ASSERT_EQ(0, decode_file(path, lines));
+
+	ASSERT_EQ(3u, lines.size());
+	ASSERT_EQ("[INFO] Before crash", lines[0]);
+	ASSERT_EQ("Saved state", lines[1]);
+	ASSERT_EQ("Done", lines[2]);
+
+	// byte which is neither record nor marker is an error
+	write_file(path, data.substr(0, data.find(logging::binary_text_marker)) + "Saved state\n");
+	ASSERT_EQ(1, decode_file(path, lines));
+	std::remove(path.c_str());
+}
+
+static void crash_with_messages()
+{
+	// first message is encoded by writer thread, second one is likely written by crash handler
+	LOG_INFO_T("Written {}", 1);
+	usleep(200000);
+	LOG_INFO("Saved before crash");
+
+	*(volatile int*)NULL = 0;
+}
+
+TEST_F(logger_tests_log, binary_crash_decoded)
+{
+	configure("test_binary_crash.log");
+	std::string path = logging::configurator.get_full_log_file_path();
+
+	pid_t pid = fork();
+	if (!pid)
+	{
+		logging::configurator.set_hdr_format("");
+		crash_with_messages();
+		_exit(0);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	ASSERT_TRUE(WIFSIGNALED(status));
+
+	std::vector<std::string> lines;
+	ASSERT_EQ(0, decode_file(path, lines));
+	std::remove(path.c_str());
+
+	// messages are written by writer thread or by crash handler, crash report follows them
+	size_t written = 0, saved = 0, fatal = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i] == "Written 1") written++;
+		if (lines[i] == "Saved before crash") saved++;
+		if (lines[i].find("[FATAL] *** Got signal 11") == 0) fatal++;
+	}
+
+	ASSERT_EQ(1u, written);
+	ASSERT_EQ(1u, saved);
+	ASSERT_EQ(1u, fatal);
+}
+
+#endif //LOG_PLATFORM_WINDOWS
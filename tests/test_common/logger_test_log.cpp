@@ -270,3 +270,214 @@ TEST_F(logger_tests_log, check_strong_header)
 	ASSERT_NE(0,pid);
 	ASSERT_TRUE(strlen(function) > 0);
 }
+
+TEST_F(logger_tests_log, template_format)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	std::string str = "text";
+	LOG_INFO_T("int={} neg={} str={} {{braces}} bool={}", 42, -7, str, true);
+	LOG_DEBUG_T("ull={} char={} double={} cstr={}", 18446744073709551615ULL, 'c', 0.5, "abc");
+	LOG_WARNING_T("no arguments");
+
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] int=42 neg=-7 str=text {braces} bool=true", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[DEBUG] ull=18446744073709551615 char=c double=0.5 cstr=abc", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[WARNING] no arguments", line);
+}
+
+TEST_F(logger_tests_log, structured_fields)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	LOG_INFO_KV("request done", "user", "bob", "ms", 12.25, "ok", true);
+
+	logging::configurator.set_output_format(logging::log_output_json);
+	LOG_WARNING_KV("request \"done\"", "user", "b\to\nb", "code", -7);
+	LOG_ERROR("TEST-ERROR %d", 5);
+	logging::configurator.set_output_format(logging::log_output_logfmt);
+	LOG_INFO_KV("two words", "empty", "", "pair", "a=b", "long", "value_longer_than_eight_bytes", "c", 'x');
+	logging::configurator.set_output_format(logging::log_output_text);
+
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] request done user=bob ms=12.25 ok=true", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("{\"level\":\"WARNING\",\"message\":\"request \\\"done\\\"\",\"user\":\"b\\to\\nb\",\"code\":-7}", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("{\"level\":\"ERROR\",\"message\":\"TEST-ERROR 5\"}", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("level=INFO message=\"two words\" empty=\"\" pair=\"a=b\" long=value_longer_than_eight_bytes c=x", line);
+}
+
+TEST_F(logger_tests_log, thread_context)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("[$(V)] $(ctx):");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	logging::log_context_t captured;
+
+	LOG_INFO("TEST-NONE");
+	{
+		LOG_CONTEXT("request", 42);
+		LOG_CONTEXT("tenant", "two words");
+		LOG_INFO("TEST-PUSH");
+		captured = logging::log_context::capture();
+	}
+	LOG_INFO("TEST-POP");
+	{
+		LOG_CONTEXT_RESTORE(captured);
+		LOG_INFO("TEST-RESTORE");
+	}
+	{
+		LOG_CONTEXT("user name", (const char*)NULL);
+		LOG_INFO("TEST-ESCAPE");
+	}
+
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] : TEST-NONE", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] request=42 tenant=\"two words\": TEST-PUSH", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] : TEST-POP", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] request=42 tenant=\"two words\": TEST-RESTORE", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] \"user name\"=(null): TEST-ESCAPE", line);
+}
+
+TEST_F(logger_tests_log, rate_limited)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	int evaluated = 0;
+
+	for (int i = 0; i < 7; i++)
+	{
+		LOG_INFO_EVERY_N(3, "TEST-EVERY-N %d %d", i, ++evaluated);
+		LOG_WARNING_FIRST_N(2, "TEST-FIRST-N %d", i);
+		LOG_ERROR_SAMPLED(0, "TEST-SAMPLED %d", i);
+	}
+
+	logging::_logger.release();
+
+	ASSERT_EQ(3, evaluated);
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] TEST-EVERY-N 0 1", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[WARNING] TEST-FIRST-N 0", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[WARNING] TEST-FIRST-N 1", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] TEST-EVERY-N 3 2", line);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_EQ("[INFO] TEST-EVERY-N 6 3", line);
+	ASSERT_FALSE(get_line_skip_empty(infile,line));
+}
+
+TEST_F(logger_tests_log, sequence_number)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("$(seq) [$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	// the same header of the same millisecond is not taken from cache
+	for (int i = 0; i < 3; i++)
+		LOG_INFO("TEST-SEQ");
+
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	unsigned long first = 0;
+
+	for (unsigned long i = 0; i < 3; i++)
+	{
+		ASSERT_TRUE(get_line_skip_empty(infile,line));
+
+		unsigned long sequence = strtoul(line.c_str(), NULL, 10);
+		if (!i)
+			first = sequence;
+
+		ASSERT_EQ(first + i, sequence);
+		ASSERT_EQ(" [INFO] TEST-SEQ", line.substr(line.find(' ')));
+	}
+}
@@ -0,0 +1,129 @@
+
+#include "tests/test_common/logger_tests_log.h"
+
+#	define LOG_ENABLED 1
+#	define LOG_ONLY_DEBUG 0
+#	define LOG_USE_SYSTEMINFO 1
+#	define LOG_USE_MODULEDEFINITION 0
+#	define LOG_AUTO_DEBUGGING 0
+#	define LOG_UNHANDLED_EXCEPTIONS 0
+#	define LOG_CONFIGURE_FROM_REGISTRY 0
+#	define LOG_INI_CONFIGURATION 0
+#	define LOG_CREATE_DIRECTORY 0
+#	define LOG_RTTI_ENABLED 0
+#	define LOG_SHARED 0
+#	define LOG_COMPILER_WARNINGS 1
+#	define LOG_USE_DLL 0
+#	define LOG_MULTITHREADED 0
+#	define LOG_FLUSH_FILE_EVERY_WRITE 0
+#	define LOG_CHECKED 1
+#	define LOG_USE_MACRO_HEADER_CACHE 1
+#	define LOG_PROCESS_MACRO_IN_LOG_TEXT 1
+#	define LOG_TEST_DO_NOT_WRITE_FILE 0
+#	define LOG_RELEASE_ON_APP_CRASH 1
+#	define LOG_FLIGHT_RECORDER 1
+#	define LOG_FLIGHT_RECORDER_DUMP_LEVEL 0
+
+#include "logger/logger.h"
+
+DEFINE_LOGGER;
+
+bool get_line_skip_empty(std::ifstream& infile, std::string& line)
+{
+	line = "";
+
+	while (!infile.eof() && !line.size())
+		std::getline(infile,line);
+
+	if (!line.size())
+		return false;
+
+	return true;
+}
+
+TEST_F(logger_tests_log, flight_recorder_dump_on_error)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test.log");
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_fatal_error);
+	logging::configurator.set_need_sys_info(false);
+
+	// drop messages recorded by other tests
+	LOG_FLIGHT_RECORDER_DUMP;
+	logging::_logger.release();
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	logging::configurator.set_flight_recorder_dump_level(logging::logger_verbose_error);
+
+	LOG_DEBUG("TEST-DEBUG %d", 1);
+	LOG_INFO("TEST-INFO");
+	LOG_FATAL("TEST-FATAL");
+	LOG_ERROR("TEST-ERROR");
+	LOG_ERROR("TEST-ERROR-2");
+
+	logging::configurator.set_flight_recorder_dump_level(0);
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "[FATAL] TEST-FATAL");
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "*** FLIGHT RECORDER ***");
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line.find("[DEBUG] ") == 0);
+	ASSERT_TRUE(line.find(": TEST-DEBUG 1") != std::string::npos);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line.find("[INFO] ") == 0);
+	ASSERT_TRUE(line.find(": TEST-INFO") != std::string::npos);
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "*** END FLIGHT RECORDER ***");
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "[ERROR] TEST-ERROR");
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "[ERROR] TEST-ERROR-2");
+}
+
+TEST_F(logger_tests_log, flight_recorder_long_message)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name("test_long.log");
+	logging::configurator.set_verbose_level(logging::logger_verbose_fatal_error);
+
+	LOG_FLIGHT_RECORDER_DUMP;
+	logging::_logger.release();
+
+	std::remove(logging::configurator.get_full_log_file_path().c_str());
+
+	// text of record is truncated by record size only, not by header of dumped line
+	const size_t text_size = logging::flight_recorder::text_size;
+	std::string message(2 * text_size, 'x');
+	LOG_DEBUG("%s", message.c_str());
+
+	LOG_FLIGHT_RECORDER_DUMP;
+	logging::_logger.release();
+
+	std::ifstream infile(logging::configurator.get_full_log_file_path());
+	if (!infile.is_open())
+		FAIL();
+
+	std::string line;
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line == "*** FLIGHT RECORDER ***");
+	ASSERT_TRUE(get_line_skip_empty(infile,line));
+	ASSERT_TRUE(line.find("[DEBUG] ") == 0);
+
+	size_t text_pos = line.find("] ", line.find(" [")) + 2;
+	ASSERT_EQ(text_size - 1, line.size() - text_pos);
+	ASSERT_EQ('x', line[line.size() - 1]);
+}
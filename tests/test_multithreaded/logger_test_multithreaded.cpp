@@ -0,0 +1,574 @@
+
+#include "tests/test_common/logger_tests_log.h"
+
+#	define LOG_ENABLED 1
+#	define LOG_ONLY_DEBUG 0
+#	define LOG_USE_SYSTEMINFO 1
+#	define LOG_USE_MODULEDEFINITION 0
+#	define LOG_AUTO_DEBUGGING 0
+#	define LOG_UNHANDLED_EXCEPTIONS 0
+#	define LOG_CONFIGURE_FROM_REGISTRY 0
+#	define LOG_INI_CONFIGURATION 0
+#	define LOG_CREATE_DIRECTORY 0
+#	define LOG_RTTI_ENABLED 0
+#	define LOG_SHARED 0
+#	define LOG_COMPILER_WARNINGS 1
+#	define LOG_USE_DLL 0
+#	define LOG_MULTITHREADED 1
+#	define LOG_FLUSH_FILE_EVERY_WRITE 0
+#	define LOG_CHECKED 1
+#	define LOG_USE_MACRO_HEADER_CACHE 1
+#	define LOG_PROCESS_MACRO_IN_LOG_TEXT 1
+#	define LOG_TEST_DO_NOT_WRITE_FILE 0
+#	define LOG_RELEASE_ON_APP_CRASH 1
+#	define LOG_DEFERRED_FORMAT 1
+#	define LOG_COLLAPSE_REPEATS 1
+#	define LOG_COLLAPSE_REPEATS_TIMEOUT 60000
+#	define LOG_LOAD_SHEDDING 1
+#	define LOG_LOAD_SHEDDING_DEBUG_QUEUE 16
+#	define LOG_LOAD_SHEDDING_INFO_QUEUE 32
+#	define LOG_PRIORITY_QUEUE 1
+#	define LOG_CONTROL_SOCKET 1
+
+#include "logger/logger.h"
+
+#include <thread>
+#include <algorithm>
+
+DEFINE_LOGGER;
+
+// tests need named pipe, so they are built for Posix only
+#ifndef LOG_PLATFORM_WINDOWS
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+
+// Log file is named pipe: writer thread blocks while it opens the file until test starts reading,
+// so records logged before stay in queue and writer thread processes them later
+class pipe_log
+{
+public:
+	explicit pipe_log(const char* file_name)
+	{
+		logging::configurator.set_log_file_name(file_name);
+		path_ = logging::configurator.get_full_log_file_path();
+
+		std::remove(path_.c_str());
+		mkfifo(path_.c_str(), 0600);
+	}
+
+	~pipe_log()
+	{
+		if (reader_.joinable())
+			reader_.join();
+
+		std::remove(path_.c_str());
+	}
+
+	void start_reading()
+	{
+		reader_ = std::thread([this]()
+		{
+			std::ifstream stream(path_.c_str());
+			std::string line;
+
+			while (std::getline(stream, line))
+			{
+				if (line.size())
+					lines_.push_back(line);
+			}
+		});
+	}
+
+	// Lines written until logger was released
+	const std::vector<std::string>& lines()
+	{
+		reader_.join();
+		return lines_;
+	}
+
+private:
+	std::string path_;
+	std::thread reader_;
+	std::vector<std::string> lines_;
+};
+
+static size_t count_lines(const std::vector<std::string>& lines, const std::string& text)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].find(text) != std::string::npos)
+			count++;
+	}
+
+	return count;
+}
+
+static void configure(const char* hdr_format)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_hdr_format(hdr_format);
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+}
+
+TEST_F(logger_tests_log, deferred_format_temporary_buffers)
+{
+	configure("[$(V)]");
+	pipe_log pipe("test_deferred.log");
+
+	std::thread threads[2];
+	for (int t = 0; t < 2; t++)
+	{
+		threads[t] = std::thread([t]()
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				char buffer[16];
+				snprintf(buffer, sizeof(buffer), "buf-%d-%d", t, i);
+				const char* text = buffer;
+				std::string str(1, static_cast<char>('a' + i));
+
+				LOG_INFO_T("thread={} text={} str={}", t, text, str);
+
+				// arguments are copied by LOG_INFO_T, writer thread formats message after they are changed
+				memset(buffer, 'x', sizeof(buffer) - 1);
+				str = "changed";
+			}
+		});
+	}
+
+	for (int t = 0; t < 2; t++)
+		threads[t].join();
+
+	pipe.start_reading();
+	logging::_logger.release();
+
+	std::vector<std::string> lines = pipe.lines();
+	std::sort(lines.begin(), lines.end());
+
+	ASSERT_EQ(6u, lines.size());
+	ASSERT_EQ("[INFO] thread=0 text=buf-0-0 str=a", lines[0]);
+	ASSERT_EQ("[INFO] thread=0 text=buf-0-1 str=b", lines[1]);
+	ASSERT_EQ("[INFO] thread=0 text=buf-0-2 str=c", lines[2]);
+	ASSERT_EQ("[INFO] thread=1 text=buf-1-0 str=a", lines[3]);
+	ASSERT_EQ("[INFO] thread=1 text=buf-1-1 str=b", lines[4]);
+	ASSERT_EQ("[INFO] thread=1 text=buf-1-2 str=c", lines[5]);
+}
+
+TEST_F(logger_tests_log, collapse_repeats)
+{
+	configure("[$(V)] $(TID)");
+	pipe_log pipe("test_collapse.log");
+
+	for (int i = 0; i < 5; i++)
+		LOG_INFO("TEST-REPEAT");
+
+	LOG_WARNING("TEST-OTHER");
+
+	// count of these is written when logger is released
+	for (int i = 0; i < 3; i++)
+		LOG_INFO("TEST-REPEAT");
+
+	pipe.start_reading();
+	logging::_logger.release();
+
+	// count is written by writer thread with thread id of collapsed messages
+	std::string tid = logging::process_ids::tid_str();
+	const std::vector<std::string>& lines = pipe.lines();
+
+	ASSERT_EQ(5u, lines.size());
+	ASSERT_EQ("[INFO] " + tid + " TEST-REPEAT", lines[0]);
+	ASSERT_EQ("[INFO] " + tid + " Last message repeated 4 times", lines[1]);
+	ASSERT_EQ("[WARNING] " + tid + " TEST-OTHER", lines[2]);
+	ASSERT_EQ("[INFO] " + tid + " TEST-REPEAT", lines[3]);
+	ASSERT_EQ("[INFO] " + tid + " Last message repeated 2 times", lines[4]);
+}
+
+TEST_F(logger_tests_log, load_shedding_slow_writer)
+{
+	configure("[$(V)] $(TID)");
+	pipe_log pipe("test_shedding.log");
+
+	std::string tids[2];
+	std::thread threads[2];
+	for (int t = 0; t < 2; t++)
+	{
+		threads[t] = std::thread([t, &tids]()
+		{
+			tids[t] = logging::process_ids::tid_str();
+
+			for (int i = 0; i < 20; i++)
+			{
+				LOG_DEBUG("TEST-DEBUG");
+				LOG_INFO("TEST-INFO %d %d", t, i);
+				LOG_WARNING("TEST-WARNING %d %d", t, i);
+			}
+		});
+	}
+
+	for (int t = 0; t < 2; t++)
+		threads[t].join();
+
+	pipe.start_reading();
+	logging::_logger.release();
+
+	const std::vector<std::string>& lines = pipe.lines();
+	size_t debug_count = count_lines(lines, " TEST-DEBUG");
+	size_t info_count = count_lines(lines, " TEST-INFO ");
+
+	// writer thread does not write anything until test reads file, so queue grows over both limits
+	ASSERT_EQ(40u, count_lines(lines, " TEST-WARNING "));
+	ASSERT_GE(size_t(LOG_LOAD_SHEDDING_DEBUG_QUEUE), debug_count);
+	ASSERT_GE(size_t(LOG_LOAD_SHEDDING_INFO_QUEUE), debug_count + info_count);
+	ASSERT_EQ(1u, count_lines(lines, "Load shedding: DEBUG and INFO messages are dropped"));
+
+	std::string last = lines.back();
+	std::string dropped = logging::stringformat(", %lu messages dropped", (unsigned long)(80 - debug_count - info_count));
+	ASSERT_NE(std::string::npos, last.find("Load shedding: all messages are written"));
+	ASSERT_NE(std::string::npos, last.find(dropped));
+
+	// changes are written with thread id of producer thread, also when writer thread ends shedding
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].find("Load shedding: ") == std::string::npos)
+			continue;
+
+		std::string tid = lines[i].substr(lines[i].find(' ') + 1);
+		tid = tid.substr(0, tid.find(' '));
+		ASSERT_TRUE(tid == tids[0] || tid == tids[1]);
+	}
+}
+
+TEST_F(logger_tests_log, priority_queue_order)
+{
+	configure("[$(V)] $(seq)");
+	pipe_log pipe("test_priority.log");
+
+	for (int i = 0; i < 5; i++)
+		LOG_INFO("TEST-INFO %d", i);
+
+	std::thread thread([]()
+	{
+		LOG_ERROR("TEST-ERROR");
+		LOG_FATAL_T("TEST-FATAL {}", 1);
+	});
+	thread.join();
+
+	LOG_WARNING("TEST-WARNING");
+
+	pipe.start_reading();
+	logging::_logger.release();
+
+	const std::vector<std::string>& lines = pipe.lines();
+	ASSERT_EQ(8u, lines.size());
+
+	// ERROR and FATAL are written before records queued earlier
+	const char* expected[] = { "[ERROR]", "[FATAL]", "[INFO]", "[INFO]", "[INFO]", "[INFO]", "[INFO]", "[WARNING]" };
+	unsigned long seq[8];
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		ASSERT_EQ(0u, lines[i].find(expected[i]));
+		seq[i] = strtoul(lines[i].c_str() + strlen(expected[i]), NULL, 10);
+	}
+
+	// sequence numbers keep order of logging calls in both lanes
+	ASSERT_EQ(seq[0] + 1, seq[1]);
+	for (int i = 2; i < 6; i++)
+		ASSERT_EQ(seq[i] + 1, seq[i + 1]);
+
+	ASSERT_EQ(seq[6] + 1, seq[0]);
+	ASSERT_EQ(seq[1] + 1, seq[7]);
+}
+
+static void log_every_ms(int t)
+{
+	LOG_INFO_EVERY_MS(1000000, "TEST-EVERY-MS %d", t);
+}
+
+TEST_F(logger_tests_log, every_ms_threads)
+{
+	configure("[$(V)]");
+	pipe_log pipe("test_every_ms.log");
+	pipe.start_reading();
+
+	// threads start together: only one of them passes first interval of call site
+	volatile long started = 0;
+	std::thread threads[8];
+	for (int t = 0; t < 8; t++)
+	{
+		threads[t] = std::thread([t, &started]()
+		{
+			logging::atomic_ops::fetch_add(&started, 1);
+			while (logging::atomic_ops::load(&started) < 8)
+				;
+
+			for (int i = 0; i < 1000; i++)
+				log_every_ms(t);
+		});
+	}
+
+	for (int t = 0; t < 8; t++)
+		threads[t].join();
+
+	logging::_logger.release();
+
+	ASSERT_EQ(1u, count_lines(pipe.lines(), "TEST-EVERY-MS"));
+}
+
+TEST_F(logger_tests_log, config_changes_while_logging)
+{
+	configure("[$(V)] A");
+	pipe_log pipe("test_config_changes.log");
+	pipe.start_reading();
+
+	std::thread threads[4];
+	for (int t = 0; t < 4; t++)
+	{
+		threads[t] = std::thread([t]()
+		{
+			for (int i = 0; i < 500; i++)
+				LOG_WARNING("TEST-CONFIG %d %d", t, i);
+		});
+	}
+
+	// every change retires snapshot which logging threads and writer thread may still read
+	for (int i = 0; i < 1000; i++)
+		logging::configurator.set_hdr_format(i % 2 ? "[$(V)] A" : "[$(V)] B");
+
+	for (int t = 0; t < 4; t++)
+		threads[t].join();
+
+	logging::_logger.release();
+
+	const std::vector<std::string>& lines = pipe.lines();
+	ASSERT_EQ(2000u, count_lines(lines, " TEST-CONFIG "));
+
+	for (size_t i = 0; i < lines.size(); i++)
+		ASSERT_TRUE(lines[i].find("[WARNING] A ") == 0 || lines[i].find("[WARNING] B ") == 0) << lines[i];
+}
+
+static std::vector<std::string> read_lines(const std::string& path)
+{
+	std::vector<std::string> lines;
+	std::ifstream stream(path.c_str());
+	std::string line;
+
+	while (std::getline(stream, line))
+	{
+		if (line.size())
+			lines.push_back(line);
+	}
+
+	return lines;
+}
+
+// Waits for child process not longer than 10 seconds, so deadlock in child fails test instead of hanging it
+static int wait_child(pid_t pid)
+{
+	int status = 0;
+
+	for (int i = 0; i < 1000; i++)
+	{
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+		usleep(10000);
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	return -1;
+}
+
+TEST_F(logger_tests_log, fork_restart)
+{
+	configure("[$(V)]");
+	logging::configurator.set_log_file_name("test_fork.log");
+	logging::configurator.set_fork_log_file_name("test_fork_$(PID).log");
+
+	std::string parent_path = logging::configurator.get_full_log_file_path();
+	std::remove(parent_path.c_str());
+
+	LOG_WARNING("TEST-BEFORE-FORK");
+
+	// other threads log while process forks, so logger locks are taken at the moment of fork
+	volatile bool stop = false;
+	std::thread threads[2];
+	for (int t = 0; t < 2; t++)
+	{
+		threads[t] = std::thread([&stop]()
+		{
+			while (!stop)
+				LOG_DEBUG("TEST-BACKGROUND");
+		});
+	}
+
+	std::vector<pid_t> children;
+	for (int i = 0; i < 10; i++)
+	{
+		pid_t pid = fork();
+		if (!pid)
+		{
+			// writer thread is started again in child, its file name has PID of child
+			LOG_WARNING("TEST-CHILD %d", i);
+			logging::_logger.release();
+			_exit(0);
+		}
+
+		ASSERT_LT(0, pid);
+		children.push_back(pid);
+	}
+
+	stop = true;
+	for (int t = 0; t < 2; t++)
+		threads[t].join();
+
+	LOG_WARNING("TEST-AFTER-FORK");
+	logging::_logger.release();
+
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		ASSERT_EQ(0, wait_child(children[i]));
+
+		std::string child_path = logging::configurator.get_log_path() + "/" + logging::stringformat("test_fork_%d.log", (int)children[i]);
+		std::vector<std::string> lines = read_lines(child_path);
+		std::remove(child_path.c_str());
+
+		ASSERT_EQ(1u, count_lines(lines, logging::stringformat("[WARNING] TEST-CHILD %d", (int)i)));
+		ASSERT_EQ(0u, count_lines(lines, "TEST-BEFORE-FORK"));
+	}
+
+	std::vector<std::string> lines = read_lines(parent_path);
+	ASSERT_EQ(1u, count_lines(lines, "[WARNING] TEST-BEFORE-FORK"));
+	ASSERT_EQ(1u, count_lines(lines, "[WARNING] TEST-AFTER-FORK"));
+	ASSERT_EQ(0u, count_lines(lines, "TEST-CHILD"));
+
+	logging::configurator.set_fork_log_file_name("");
+}
+
+// Sends command to control socket of this process and returns reply
+static std::string control_command(const std::string& command)
+{
+	std::string name = logging::log_configurator::process_config_macro(LOG_CONTROL_SOCKET_NAME);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name.c_str() + 1, name.size() - 1);
+	socklen_t addr_len = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + name.size());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, addr_len) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+
+		return "error: not connected";
+	}
+
+	std::string request = command + "\n";
+	send(fd, request.c_str(), request.size(), MSG_NOSIGNAL);
+
+	std::string reply;
+	char buffer[256];
+	ssize_t len;
+
+	while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		reply.append(buffer, len);
+
+	close(fd);
+	return reply;
+}
+
+// Threads read process id string while it is refreshed again and again, each of them sees whole value
+static int check_pid_string()
+{
+	std::string expected = logging::stringformat("%d", (int)getpid());
+	volatile long stop = 0;
+	volatile long mismatches = 0;
+	std::thread readers[4];
+
+	for (int t = 0; t < 4; t++)
+	{
+		readers[t] = std::thread([&]()
+		{
+			while (!logging::atomic_ops::load(&stop))
+			{
+				if (expected != logging::process_ids::pid_str())
+					logging::atomic_ops::fetch_add(&mismatches, 1);
+			}
+		});
+	}
+
+	for (int i = 0; i < 10000; i++)
+	{
+		logging::process_ids::reset_after_fork();
+		logging::process_ids::pid();
+	}
+
+	logging::atomic_ops::store(&stop, 1);
+	for (int t = 0; t < 4; t++)
+		readers[t].join();
+
+	return logging::atomic_ops::load(&mismatches) ? 1 : 0;
+}
+
+TEST_F(logger_tests_log, pid_string_refresh)
+{
+	ASSERT_EQ(logging::stringformat("%d", (int)getpid()), logging::process_ids::pid_str());
+
+	// child gets its own process id
+	pid_t pid = fork();
+	if (!pid)
+		_exit(check_pid_string());
+
+	ASSERT_EQ(0, wait_child(pid));
+	ASSERT_EQ(0, check_pid_string());
+}
+
+TEST_F(logger_tests_log, control_socket_commands)
+{
+	configure("[$(V)]");
+	pipe_log pipe("test_control.log");
+	pipe.start_reading();
+
+	// logger starts control server
+	LOG_WARNING("TEST-START");
+
+	ASSERT_EQ(logging::stringformat("verbose=%d\n", logging::logger_verbose_all), control_command("verbose"));
+	ASSERT_EQ("ok\n", control_command("verbose error"));
+	ASSERT_EQ(logging::logger_verbose_fatal_error, logging::configurator.get_verbose_level());
+
+	LOG_INFO("TEST-FILTERED");
+	LOG_ERROR("TEST-ERROR");
+
+	std::string config = control_command("config");
+	ASSERT_NE(std::string::npos, config.find("header_format=[$(V)]\n"));
+	ASSERT_NE(std::string::npos, config.find(logging::stringformat("verbose=%d\n", logging::logger_verbose_fatal_error)));
+
+	ASSERT_EQ("ok\n", control_command("flush"));
+	ASSERT_EQ(0u, control_command("stats").find("messages_written="));
+	ASSERT_EQ("error: unknown verbose level loud\n", control_command("verbose loud"));
+	ASSERT_EQ("error: unknown command bogus\n", control_command("bogus"));
+
+	// change is logged with INFO level, so it is written only when new level includes INFO
+	ASSERT_EQ("ok\n", control_command("verbose all"));
+	logging::_logger.release();
+
+	const std::vector<std::string>& lines = pipe.lines();
+	ASSERT_EQ(1u, count_lines(lines, "[WARNING] TEST-START"));
+	ASSERT_EQ(1u, count_lines(lines, logging::stringformat("[INFO] Verbose level changed to %d by control socket", logging::logger_verbose_all)));
+	ASSERT_EQ(0u, count_lines(lines, "TEST-FILTERED"));
+	ASSERT_EQ(1u, count_lines(lines, "[ERROR] TEST-ERROR"));
+}
+
+#endif //LOG_PLATFORM_WINDOWS
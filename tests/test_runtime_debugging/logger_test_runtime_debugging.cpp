@@ -0,0 +1,600 @@
+#include "tests/test_common/logger_tests_log.h"
+
+#	define LOG_ENABLED 1
+#	define LOG_ONLY_DEBUG 0
+#	define LOG_USE_SYSTEMINFO 1
+#	define LOG_USE_MODULEDEFINITION 1
+#	define LOG_USE_MODULES_CACHE 1
+#	define LOG_AUTO_DEBUGGING 1
+#	define LOG_ELF_SYMBOLS 1
+#	define LOG_SYMBOL_CACHE_SIZE 4096
+#	define LOG_FRAME_POINTER_UNWIND 1
+#	define LOG_STACKTRACE_SKIP 1
+#	define LOG_STACKTRACE_DEDUP_SIZE 64
+#	define LOG_UNHANDLED_EXCEPTIONS 1
+#	define LOG_SHOW_MESSAGE_ON_FATAL_CRASH 0
+#	define LOG_CRASH_REPORT_FILE 1
+#	define LOG_CONFIGURE_FROM_REGISTRY 0
+#	define LOG_INI_CONFIGURATION 0
+#	define LOG_CREATE_DIRECTORY 0
+#	define LOG_RTTI_ENABLED 0
+#	define LOG_SHARED 0
+#	define LOG_COMPILER_WARNINGS 1
+#	define LOG_USE_DLL 0
+#	define LOG_MULTITHREADED 1
+#	define LOG_FLUSH_FILE_EVERY_WRITE 0
+#	define LOG_CHECKED 1
+#	define LOG_USE_MACRO_HEADER_CACHE 1
+#	define LOG_PROCESS_MACRO_IN_LOG_TEXT 1
+#	define LOG_TEST_DO_NOT_WRITE_FILE 0
+#	define LOG_RELEASE_ON_APP_CRASH 1
+
+#include "logger/logger.h"
+
+DEFINE_LOGGER;
+
+// tests use Linux loader and /proc, so they are built for Posix only
+#ifndef LOG_PLATFORM_WINDOWS
+
+#include <dlfcn.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <thread>
+
+static int module_test_function()
+{
+	return 1;
+}
+
+TEST_F(logger_tests_log, module_cache_ranges)
+{
+	logging::module_cache modules;
+	int on_stack = 0;
+
+	ASSERT_EQ(logging::utils::do_readlink(LOG_SELF_PROC_LINK), modules.find((void*)&module_test_function).c_str());
+	ASSERT_STREQ("", modules.find(NULL).c_str());
+	ASSERT_STREQ("", modules.find(&on_stack).c_str());
+
+	// library is loaded after table was built: new generation of modules is found
+	void* library = dlopen("libBrokenLocale.so.1", RTLD_NOW | RTLD_LOCAL);
+	ASSERT_TRUE(library != NULL);
+
+	void* function = dlsym(library, "__ctype_get_mb_cur_max");
+	ASSERT_TRUE(function != NULL);
+
+	logging::module_cache::name_ref name = modules.find(function);
+	ASSERT_NE(std::string::npos, std::string(name.c_str()).find("libBrokenLocale"));
+
+	logging::intptr_t base = 0;
+	ASSERT_STREQ(name.c_str(), modules.find_no_update(function, base).c_str());
+	ASSERT_TRUE(base != 0);
+
+	// range of unloaded library is not found in table of the next generation, while name taken before
+	// stays valid until reference is released
+	dlclose(library);
+	ASSERT_STREQ("", modules.find(function).c_str());
+	ASSERT_NE(std::string::npos, std::string(name.c_str()).find("libBrokenLocale"));
+}
+
+// Stack trace text of one address, as frame of function which called other one
+static std::string resolve_address(void* addr)
+{
+	void* frames[2] = { NULL, static_cast<char*>(addr) + 1 };
+	return logging::runtime_debugging::get_stack_trace_string(frames, 2);
+}
+
+// Copies library which exports symbol to path, returns path of library
+static std::string copy_library(const char* name, const char* symbol, const std::string& path)
+{
+	void* library = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+	Dl_info info;
+	std::string source = library && dladdr(dlsym(library, symbol), &info) ? info.dli_fname : "";
+
+	if (library)
+		dlclose(library);
+
+	// new file, not rewritten one: library mapped from old file can be still in use
+	std::remove(path.c_str());
+	std::ifstream in(source.c_str(), std::ios::binary);
+	std::ofstream out(path.c_str(), std::ios::binary);
+	out << in.rdbuf();
+	return source;
+}
+
+TEST_F(logger_tests_log, symbol_cache_module_replaced)
+{
+	std::string path = logging::utils::get_process_file_path() + "/test_replaced_module.so";
+
+	// library loaded by path is resolved, then other library is loaded by the same path
+	ASSERT_NE("", copy_library("libBrokenLocale.so.1", "__ctype_get_mb_cur_max", path));
+	void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	ASSERT_TRUE(library != NULL);
+
+	void* function = dlsym(library, "__ctype_get_mb_cur_max");
+	ASSERT_TRUE(function != NULL);
+	ASSERT_NE(std::string::npos, resolve_address(function).find("__ctype_get_mb_cur_max"));
+
+	dlclose(library);
+
+	ASSERT_NE("", copy_library("libresolv.so.2", "__b64_ntop", path));
+	library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	ASSERT_TRUE(library != NULL);
+
+	void* other_function = dlsym(library, "__b64_ntop");
+	ASSERT_TRUE(other_function != NULL);
+
+	std::string text = resolve_address(other_function);
+	ASSERT_NE(std::string::npos, text.find("__b64_ntop")) << text;
+
+	// frame resolved for unloaded library is not taken from cache
+	if (function != other_function)
+		ASSERT_EQ(std::string::npos, resolve_address(function).find("__ctype_get_mb_cur_max"));
+
+	dlclose(library);
+	std::remove(path.c_str());
+}
+
+static std::string __attribute__((noinline)) capture_trace()
+{
+	void* frames[16];
+	int count = logging::runtime_debugging::capture_stack_trace(frames, 16);
+	return logging::runtime_debugging::get_stack_trace_string(frames, count);
+}
+
+// static function is not exported without -rdynamic, its name is read from .symtab
+static std::string __attribute__((noinline)) static_trace_caller()
+{
+	std::string trace = capture_trace();
+	asm volatile("");
+	return trace;
+}
+
+TEST_F(logger_tests_log, elf_symbols_static_function)
+{
+	ASSERT_NE(std::string::npos, static_trace_caller().find("static_trace_caller")) << static_trace_caller();
+
+	// executable is checked again after modules are changed, its symbols stay the same
+	void* library = dlopen("libBrokenLocale.so.1", RTLD_NOW | RTLD_LOCAL);
+	ASSERT_TRUE(library != NULL);
+	ASSERT_NE(std::string::npos, static_trace_caller().find("static_trace_caller"));
+	dlclose(library);
+}
+
+static void configure(const char* file_name)
+{
+	logging::_logger.release();
+
+	logging::configurator.set_log_file_name(file_name);
+	logging::configurator.set_hdr_format("[$(V)]");
+	logging::configurator.set_log_scroll_file_size(0);
+	logging::configurator.set_log_path("$(EXEDIR)");
+	logging::configurator.set_log_scroll_file_count(0);
+	logging::configurator.set_verbose_level(logging::logger_verbose_all);
+	logging::configurator.set_need_sys_info(false);
+}
+
+static std::vector<std::string> read_lines(const std::string& path)
+{
+	std::vector<std::string> lines;
+	std::ifstream stream(path.c_str());
+	std::string line;
+
+	while (std::getline(stream, line))
+	{
+		if (line.size())
+			lines.push_back(line);
+	}
+
+	return lines;
+}
+
+// Test is built without optimization, so its functions keep frame pointer and frame pointer unwinder sees them
+static int __attribute__((noinline)) capture_nested(int depth, void** frames, int max_frames)
+{
+	int count = depth ? capture_nested(depth - 1, frames, max_frames)
+		: logging::runtime_debugging::capture_stack_trace(frames, max_frames);
+
+	asm volatile("");
+	return count;
+}
+
+static size_t count_text(const std::string& text, const std::string& part)
+{
+	size_t count = 0;
+
+	for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + part.size()))
+		count++;
+
+	return count;
+}
+
+// Names of all frames: first one is skipped by get_stack_trace_string, so it is preceded by empty one
+static std::string resolve_frames(void** frames, int count)
+{
+	std::vector<void*> shifted(1, static_cast<void*>(NULL));
+	shifted.insert(shifted.end(), frames, frames + count);
+	return logging::runtime_debugging::get_stack_trace_string(&shifted[0], count + 1);
+}
+
+TEST_F(logger_tests_log, frame_pointer_unwind)
+{
+	void* frames[64];
+
+	// first frame is in caller of capture_stack_trace, each recursive call has own frame
+	int count = capture_nested(5, frames, 64);
+	ASSERT_GT(count, 6);
+
+	std::string text = resolve_frames(frames, 6);
+	ASSERT_EQ(6u, count_text(text, "capture_nested")) << text;
+	ASSERT_EQ(std::string::npos, text.find("capture_stack_trace")) << text;
+
+	// depth is limited by buffer
+	ASSERT_EQ(3, capture_nested(5, frames, 3));
+	ASSERT_EQ(3u, count_text(resolve_frames(frames, 3), "capture_nested"));
+}
+
+// LOG_STACKTRACE_SKIP is 1 in this test: frame of wrapper is not written
+static void __attribute__((noinline)) log_trace_wrapper()
+{
+	LOG_STACKTRACE_INFO;
+	asm volatile("");
+}
+
+static void __attribute__((noinline)) log_trace_caller(int times)
+{
+	for (int i = 0; i < times; i++)
+		log_trace_wrapper();
+
+	asm volatile("");
+}
+
+TEST_F(logger_tests_log, stack_trace_skip)
+{
+	configure("test_stack_skip.log");
+	std::string path = logging::configurator.get_full_log_file_path();
+
+	log_trace_caller(1);
+	logging::_logger.release();
+
+	std::vector<std::string> lines = read_lines(path);
+	std::remove(path.c_str());
+
+	// first written frame is caller of wrapper
+	ASSERT_GT(lines.size(), 2u);
+	ASSERT_EQ(0u, lines[0].find("[INFO] Stack trace")) << lines[0];
+	ASSERT_NE(std::string::npos, lines[1].find("[1] <--")) << lines[1];
+	ASSERT_NE(std::string::npos, lines[1].find("log_trace_caller")) << lines[1];
+
+	for (size_t i = 0; i < lines.size(); i++)
+		ASSERT_EQ(std::string::npos, lines[i].find("log_trace_wrapper")) << lines[i];
+}
+
+TEST_F(logger_tests_log, stack_trace_dedup)
+{
+	configure("test_stack_dedup.log");
+	std::string path = logging::configurator.get_full_log_file_path();
+
+	log_trace_caller(3);
+	log_trace_wrapper();
+	logging::_logger.release();
+
+	std::vector<std::string> lines = read_lines(path);
+	std::remove(path.c_str());
+
+	// same trace is written in full once, then by its id only
+	std::vector<std::string> headers;
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].find("[INFO] Stack trace #") == 0)
+			headers.push_back(lines[i]);
+	}
+
+	ASSERT_EQ(4u, headers.size());
+	std::string id = headers[0].substr(0, headers[0].find(':'));
+	ASSERT_EQ(id + ":", headers[0]);
+	ASSERT_EQ(id + " (seen 2 times)", headers[1]);
+	ASSERT_EQ(id + " (seen 3 times)", headers[2]);
+
+	// trace from another call site has own id
+	ASSERT_NE(id + ":", headers[3]);
+	ASSERT_EQ(':', headers[3][headers[3].size() - 1]);
+
+	size_t written = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+		written += count_text(lines[i], "[1] <--");
+
+	ASSERT_EQ(2u, written);
+}
+
+// Crash report files of log file, they are named <log file>__<date>__<time>.crash
+static std::vector<std::string> find_crash_reports(const std::string& log_file_name)
+{
+	std::vector<std::string> reports;
+	std::string prefix = log_file_name + "__";
+	std::string log_path = logging::configurator.get_log_path();
+
+	DIR* dir = opendir(log_path.c_str());
+	if (!dir)
+		return reports;
+
+	while (struct dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name.find(prefix) == 0 && name.size() > 6 && name.substr(name.size() - 6) == ".crash")
+			reports.push_back(log_path + "/" + name);
+	}
+
+	closedir(dir);
+	return reports;
+}
+
+static void remove_crash_reports(const std::string& log_file_name)
+{
+	std::vector<std::string> reports = find_crash_reports(log_file_name);
+	for (size_t i = 0; i < reports.size(); i++)
+		std::remove(reports[i].c_str());
+}
+
+// Runs function in child process, returns signal which terminated it or -1 and exit code of child.
+// Child is killed after 10 seconds
+static int run_crashing_child(void (*function)(), int* exit_code = NULL)
+{
+	pid_t pid = fork();
+	if (!pid)
+	{
+		function();
+		_exit(0);
+	}
+
+	int status = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		if (waitpid(pid, &status, WNOHANG) == pid)
+		{
+			if (exit_code)
+				*exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+			return WIFSIGNALED(status) ? WTERMSIG(status) : -1;
+		}
+
+		usleep(10000);
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	return -1;
+}
+
+static void crash_with_threads()
+{
+	LOG_WARNING("TEST-BEFORE-CRASH");
+
+	for (int t = 0; t < 3; t++)
+	{
+		std::thread([]()
+		{
+			pthread_setname_np(pthread_self(), "dump-sleeper");
+			for (;;)
+				usleep(100000);
+		}).detach();
+	}
+
+	// thread with blocked signal does not answer: crashed thread stops waiting for it
+	std::thread([]()
+	{
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, LOG_CRASH_THREAD_SIGNAL);
+		pthread_sigmask(SIG_BLOCK, &set, NULL);
+		pthread_setname_np(pthread_self(), "dump-blocked");
+
+		for (;;)
+			usleep(100000);
+	}).detach();
+
+	usleep(100000);
+	*(volatile int*)NULL = 0;
+}
+
+TEST_F(logger_tests_log, crash_report_thread_dump)
+{
+	configure("test_crash.log");
+	remove_crash_reports("test_crash.log");
+
+	ASSERT_EQ(SIGSEGV, run_crashing_child(&crash_with_threads));
+
+	std::vector<std::string> reports = find_crash_reports("test_crash.log");
+	ASSERT_EQ(1u, reports.size());
+
+	std::vector<std::string> lines = read_lines(reports[0]);
+	std::remove(reports[0].c_str());
+
+	size_t crashed = 0, sleepers = 0, blocked = 0, others = 0;
+	for (size_t i = 0; i + 1 < lines.size(); i++)
+	{
+		if (lines[i].find("*** THREAD ") != 0)
+			continue;
+
+		// each thread which answered has own backtrace after its header
+		bool has_frames = lines[i + 1].find("[0] 0x") == 0;
+
+		if (lines[i].find("(crashed)") != std::string::npos)
+		{
+			ASSERT_TRUE(has_frames);
+			crashed++;
+		}
+		else if (lines[i].find("\"dump-sleeper\"") != std::string::npos)
+		{
+			ASSERT_TRUE(has_frames) << lines[i + 1];
+			sleepers++;
+		}
+		else if (lines[i].find("\"dump-blocked\"") != std::string::npos)
+		{
+			ASSERT_EQ("no response", lines[i + 1]);
+			blocked++;
+		}
+		else
+		{
+			ASSERT_TRUE(has_frames) << lines[i] << " " << lines[i + 1];
+			others++;
+		}
+	}
+
+	ASSERT_EQ(1u, crashed);
+	ASSERT_EQ(3u, sleepers);
+	ASSERT_EQ(1u, blocked);
+	ASSERT_EQ(1u, others); // writer thread
+}
+
+static int overflow_stack(int depth)
+{
+	volatile char frame[1024];
+	frame[0] = static_cast<char>(depth);
+	return overflow_stack(depth + 1) + frame[0];
+}
+
+static void crash_with_stack_overflow()
+{
+	// thread gets alternate signal stack on its first message
+	std::thread([]()
+	{
+		LOG_WARNING("TEST-BEFORE-OVERFLOW");
+		overflow_stack(0);
+	}).join();
+}
+
+TEST_F(logger_tests_log, crash_report_stack_overflow)
+{
+	configure("test_overflow.log");
+	remove_crash_reports("test_overflow.log");
+
+	ASSERT_EQ(SIGSEGV, run_crashing_child(&crash_with_stack_overflow));
+
+	std::vector<std::string> reports = find_crash_reports("test_overflow.log");
+	ASSERT_EQ(1u, reports.size());
+
+	std::vector<std::string> lines = read_lines(reports[0]);
+	std::remove(reports[0].c_str());
+
+	size_t crashed = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].find("*** THREAD ") == 0 && lines[i].find("(crashed)") != std::string::npos)
+			crashed++;
+	}
+
+	ASSERT_EQ(1u, crashed);
+}
+
+static volatile sig_atomic_t previous_handler_calls = 0;
+
+static void previous_handler(int)
+{
+	previous_handler_calls++;
+}
+
+static void crash_with_previous_handler()
+{
+	// handler installed before logger is called after report and its decision is kept: process continues
+	LOG_WARNING("TEST-BEFORE-CRASH");
+	signal(SIGFPE, &previous_handler);
+	logging::init_unhandled_exceptions_handler();
+
+	raise(SIGFPE);
+	_exit(previous_handler_calls == 1 ? 3 : 4);
+}
+
+TEST_F(logger_tests_log, crash_previous_handler_returns)
+{
+	configure("test_chained.log");
+	remove_crash_reports("test_chained.log");
+
+	int exit_code = 0;
+	ASSERT_EQ(-1, run_crashing_child(&crash_with_previous_handler, &exit_code));
+	ASSERT_EQ(3, exit_code);
+
+	std::vector<std::string> reports = find_crash_reports("test_chained.log");
+	ASSERT_EQ(1u, reports.size());
+	std::remove(reports[0].c_str());
+}
+
+static const int queued_messages = 1000;
+
+static void freeze_thread(int)
+{
+	for (;;)
+		pause();
+}
+
+// Stops all other threads of process in signal handler, they are idle and hold no locks
+static void freeze_other_threads()
+{
+	signal(SIGUSR1, &freeze_thread);
+
+	DIR* dir = opendir("/proc/self/task");
+	while (struct dirent* entry = readdir(dir))
+	{
+		pid_t tid = atoi(entry->d_name);
+		if (tid && tid != static_cast<pid_t>(syscall(SYS_gettid)))
+			syscall(SYS_tgkill, getpid(), tid, SIGUSR1);
+	}
+
+	closedir(dir);
+	usleep(100000);
+}
+
+static void crash_with_queued_messages()
+{
+	LOG_INFO("TEST-BEFORE-QUEUE");
+	usleep(100000);
+
+	// writer thread can not write any of these messages, only crash handler does it
+	freeze_other_threads();
+
+	for (int i = 0; i < queued_messages; i++)
+		LOG_INFO("TEST-QUEUED %d", i);
+
+	*(volatile int*)NULL = 0;
+}
+
+TEST_F(logger_tests_log, crash_queue_drained)
+{
+	configure("test_queue_drained.log");
+	remove_crash_reports("test_queue_drained.log");
+	std::string path = logging::configurator.get_full_log_file_path();
+
+	ASSERT_EQ(SIGSEGV, run_crashing_child(&crash_with_queued_messages));
+
+	std::vector<std::string> lines = read_lines(path);
+	std::remove(path.c_str());
+	remove_crash_reports("test_queue_drained.log");
+
+	std::vector<int> written(queued_messages, 0);
+	size_t fatal = 0, last_queued = 0, fatal_line = 0;
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		int index = -1;
+		if (sscanf(lines[i].c_str(), "[INFO] TEST-QUEUED %d", &index) == 1 && index >= 0 && index < queued_messages)
+		{
+			written[index]++;
+			last_queued = i;
+		}
+
+		if (lines[i].find("[FATAL] *** Got signal 11") == 0)
+		{
+			fatal++;
+			fatal_line = i;
+		}
+	}
+
+	for (int i = 0; i < queued_messages; i++)
+		ASSERT_EQ(1, written[i]) << "message " << i;
+
+	// queued messages are written before crash report
+	ASSERT_LT(last_queued, fatal_line);
+	ASSERT_EQ(1u, fatal);
+}
+
+#endif //LOG_PLATFORM_WINDOWS